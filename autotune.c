@@ -0,0 +1,373 @@
+// autotune.c
+// a candidate is run through multi_device_run on the one device, so it is built, launched and timed just as a run is. The
+// correctness samples are two frames of two integrations each: random data, and the constant -8-8i that gives the largest
+// products (so an overflowing time_accum shows up). Both are compared bit for bit with the CPU correlator. The sweep goes in
+// stages rather than over the full cross product to keep the number of builds down: BASE_ACCUM and the work-group only
+// change the offset accumulator, which doesn't depend on the correlator's choices. Where larger tiles stop paying off
+// (fewer loads per product against fewer, larger work-groups and more padding in edge tiles) depends on the device and N,
+// so the tile edge gets a stage of its own.
+#include "autotune.h"
+#include <stdio.h> // printf
+#include <stdlib.h> // malloc, etc.
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h> // getpid
+#include "multi_device.h"
+#include "device_profile.h"
+#include "cpu_xengine.h"
+#include "gpu_data_reorg.h"
+#include "input_generator.h"
+
+#define DEFAULT_BLOCK_DIM               32 //the tile edge runs use without a tuning, and entries saved before it was tuned
+#define MIN_TIME_ACCUM                  32
+#define MAX_CANDIDATES                  16
+#define MAX_FRAME_BYTES                 (1ull<<30) //as for the default sizes, a frame is kept under 1 GB
+#define PAGESIZE_MEM                    4096u
+#define DB_LINE_LENGTH                  1024
+#define SAMPLE_SEED                     42
+
+static const int max_time_accum[2] = {291, 1912}; //the most each kernel batch can accumulate without overflowing (see -t)
+static const int base_accum_candidates[] = {16, 32, 64, 128, 256};
+static const size_t accum_local_size_candidates[] = {64, 32, 16, 8};
+static const int block_dim_candidates[] = {16, 32, 64};
+
+//the input frame being timed with, kept while the frame length stays the same
+typedef struct {
+    unsigned char *data;
+    int num_timesteps;
+} tuning_frame;
+
+static void copy_integration(void *context, int64_t integration, int64_t frame, double latency, int *output, int len){
+    memcpy(context, output, len*sizeof(int));
+    return;
+}
+
+static void discard_integration(void *context, int64_t integration, int64_t frame, double latency, int *output, int len){
+    return;
+}
+
+void autotune_device_key(cl_device_id device, char *key, size_t key_size){
+    char device_name[256] = "";
+    char driver_version[256] = "";
+    clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(device_name)-1, device_name, NULL);
+    clGetDeviceInfo(device, CL_DRIVER_VERSION, sizeof(driver_version)-1, driver_version, NULL);
+    snprintf(key, key_size, "%s (driver %s)", device_name, driver_version);
+    //the key is the first field of a tab separated line
+    for (char *c = key; *c != '\0'; c++){
+        if (*c == '\t' || *c == '\n' || *c == '\r')
+            *c = ' ';
+    }
+    return;
+}
+
+static int frame_length(const autotune_config *config, int time_accum){
+    return (config->num_timesteps > 0) ? config->num_timesteps : 128*time_accum;
+}
+
+static int run_candidate(const autotune_config *config, const autotune_params *p, int num_timesteps, unsigned char *input, int64_t iterations,
+                         multi_device_consumer consumer, void *consumer_context, double *run_time){
+    multi_device_config run = {.device_type = config->device_type, .max_devices = 1, .first_device = config->device_index,
+                               .num_elements = config->num_elements, .num_frequencies = config->num_frequencies, .num_timesteps = num_timesteps,
+                               .time_accum = p->time_accum, .base_accum = p->base_accum, .accum_local_size = p->accum_local_size,
+                               .block_dim = p->block_dim,
+                               .num_stages = config->num_stages, .iterations = iterations, .num_sources = config->num_sources,
+                               .sources = config->sources[p->kernel_batch], .source_sizes = config->source_sizes[p->kernel_batch],
+                               .kernel_cache_dir = config->kernel_cache_dir, .stream = NULL, .fixed_input = input,
+                               .consumer = consumer, .consumer_context = consumer_context, .quiet = 1};
+    int64_t num_integrations;
+    if (multi_device_run(&run, &num_integrations, run_time))
+        return (-1);
+    return (num_integrations == iterations) ? 0 : -1;
+}
+
+//returns 0 if the candidate's results match the CPU's on both samples, 1 if they don't, -1 if it couldn't be run
+static int check_candidate(const autotune_config *config, const autotune_params *p){
+    int num_elem = config->num_elements;
+    int num_freq = config->num_frequencies;
+    int num_timesteps = 2*p->time_accum;
+    int num_blocks = gpu_num_blocks(p->block_dim, num_elem);
+    size_t len = (size_t)num_freq*num_blocks*p->block_dim*p->block_dim*2;
+    size_t triangle_size = (size_t)num_freq*((num_elem*(num_elem+1))/2)*2;
+    int result = 0;
+
+    unsigned char *input = NULL;
+    int *gpu_output = (int *)malloc(len*sizeof(int));
+    int *gpu_triangle = (int *)malloc(triangle_size*sizeof(int));
+    int *cpu_triangle = (int *)malloc(triangle_size*sizeof(int));
+    if (posix_memalign((void **)&input, PAGESIZE_MEM, (size_t)num_timesteps*num_freq*num_elem) != 0 || gpu_output == NULL || gpu_triangle == NULL || cpu_triangle == NULL){
+        printf("failed to allocate memory\n");
+        free(input);
+        free(gpu_output);
+        free(gpu_triangle);
+        free(cpu_triangle);
+        return (-1);
+    }
+
+    for (int sample = 0; sample < 2 && result == 0; sample++){
+        if (sample == 0)
+            generate_char_data_set_threaded(GENERATE_DATASET_COUNTER_BASED, SAMPLE_SEED, 0, 0, 0, 0, ALL_FREQUENCIES, num_timesteps, num_freq, num_elem, 1, config->cpu_threads, input);
+        else
+            generate_char_data_set_threaded(GENERATE_DATASET_CONSTANT, SAMPLE_SEED, 0, 0, -8, -8, ALL_FREQUENCIES, num_timesteps, num_freq, num_elem, 0, config->cpu_threads, input);
+
+        double run_time;
+        if (run_candidate(config, p, num_timesteps, input, 1, copy_integration, gpu_output, &run_time)){
+            result = -1;
+            break;
+        }
+        if (reorganize_GPU_to_upper_triangle_threaded(p->block_dim, num_blocks, num_freq, num_elem, NULL, gpu_output, gpu_triangle, config->cpu_threads)
+            || cpu_xengine_correlate_threaded(input, num_timesteps, num_freq, num_elem, config->upper_triangle_convention, 1, 0, CPU_XENGINE_AUTO, config->cpu_threads, 0, cpu_triangle)){
+            result = -1;
+            break;
+        }
+        if (memcmp(gpu_triangle, cpu_triangle, triangle_size*sizeof(int)) != 0)
+            result = 1;
+    }
+
+    free(input);
+    free(gpu_output);
+    free(gpu_triangle);
+    free(cpu_triangle);
+    return result;
+}
+
+//time samples x channels per second over AUTOTUNE_TIMED_FRAMES frames (the pipeline filling up included), or -1
+static double time_candidate(const autotune_config *config, const autotune_params *p, tuning_frame *frame){
+    int num_timesteps = frame_length(config, p->time_accum);
+    if (frame->num_timesteps != num_timesteps){
+        free(frame->data);
+        frame->data = NULL;
+        frame->num_timesteps = 0;
+        if (posix_memalign((void **)&frame->data, PAGESIZE_MEM, (size_t)num_timesteps*config->num_frequencies*config->num_elements) != 0){
+            printf("failed to allocate memory\n");
+            frame->data = NULL;
+            return (-1);
+        }
+        generate_char_data_set_threaded(GENERATE_DATASET_COUNTER_BASED, SAMPLE_SEED, 0, 0, 0, 0, ALL_FREQUENCIES, num_timesteps,
+                                        config->num_frequencies, config->num_elements, 1, config->cpu_threads, frame->data);
+        frame->num_timesteps = num_timesteps;
+    }
+
+    double run_time;
+    if (run_candidate(config, p, num_timesteps, frame->data, AUTOTUNE_TIMED_FRAMES, discard_integration, NULL, &run_time))
+        return (-1);
+    return (double)num_timesteps*config->num_frequencies*AUTOTUNE_TIMED_FRAMES/run_time;
+}
+
+//checks and times a candidate, and keeps it in *best if it is the fastest so far. Returns its rate, or -1 if it was dropped
+static double evaluate(const autotune_config *config, const autotune_params *p, tuning_frame *frame, autotune_params *best){
+    printf("  kernel batch %d, time_accum %4d, tile %2d, BASE_ACCUM %3d, work-group %2zu: ", p->kernel_batch, p->time_accum, p->block_dim, p->base_accum, p->accum_local_size);
+    fflush(stdout);
+    int check = check_candidate(config, p);
+    if (check != 0){
+        printf("%s, dropped\n", (check > 0) ? "wrong results" : "failed to run");
+        return (-1);
+    }
+    double rate = time_candidate(config, p, frame);
+    if (rate < 0){
+        printf("failed to run, dropped\n");
+        return (-1);
+    }
+    printf("%.1f kHz of band%s\n", rate/1e3, (rate > best->rate) ? " (best so far)" : "");
+    if (rate > best->rate){
+        *best = *p;
+        best->rate = rate;
+    }
+    return rate;
+}
+
+static int usable_time_accum(const autotune_config *config, int time_accum){
+    if (config->num_timesteps > 0 && config->num_timesteps % time_accum != 0)
+        return 0;
+    return (unsigned long long)frame_length(config, time_accum)*config->num_frequencies*config->num_elements <= MAX_FRAME_BYTES;
+}
+
+//what the kernel batch can accumulate: powers of two from MIN_TIME_ACCUM, and the largest multiple of 64 under its limit
+static int time_accum_candidates(const autotune_config *config, int kernel_batch, int *candidates){
+    int num_candidates = 0;
+    int largest = (max_time_accum[kernel_batch]/64)*64;
+    int time_accum;
+    for (time_accum = MIN_TIME_ACCUM; time_accum <= largest && num_candidates < MAX_CANDIDATES-1; time_accum *= 2){
+        if (usable_time_accum(config, time_accum))
+            candidates[num_candidates++] = time_accum;
+    }
+    if (time_accum/2 != largest && usable_time_accum(config, largest))
+        candidates[num_candidates++] = largest;
+    return num_candidates;
+}
+
+int autotune_run(const autotune_config *config, autotune_params *best){
+    cl_device_id devices[DEVICE_PROFILE_MAX_DEVICES];
+    int num_devices = device_profile_find_devices(config->device_type, devices, DEVICE_PROFILE_MAX_DEVICES);
+    if (num_devices < 0)
+        return (-1);
+    if (config->device_index >= num_devices){
+        printf("Error: device %d requested, but only %d found\n", config->device_index, num_devices);
+        return (-1);
+    }
+    device_profile profile;
+    if (device_profile_query(devices[config->device_index], &profile) != 0)
+        return (-1);
+    size_t max_work_group_size = 0;
+    clGetDeviceInfo(devices[config->device_index], CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &max_work_group_size, NULL);
+
+    tuning_frame frame = {NULL, 0};
+    memset(best, 0, sizeof(autotune_params));
+    printf("Tuning for %s: %d elements, %d frequencies, %s convention\n", profile.name, config->num_elements, config->num_frequencies,
+           config->upper_triangle_convention ? "upper triangle" : "original");
+
+    printf("Stage 1: kernel batch and time_accum\n");
+    for (int kernel_batch = 0; kernel_batch < 2; kernel_batch++){
+        int candidates[MAX_CANDIDATES];
+        int num_candidates = time_accum_candidates(config, kernel_batch, candidates);
+        for (int c = 0; c < num_candidates; c++){
+            autotune_params p = {.kernel_batch = kernel_batch, .time_accum = candidates[c], .base_accum = MIN_TIME_ACCUM,
+                                 .accum_local_size = profile.accum_local_size, .block_dim = DEFAULT_BLOCK_DIM};
+            evaluate(config, &p, &frame, best);
+        }
+    }
+    if (best->rate <= 0){
+        printf("No candidate ran correctly\n");
+        free(frame.data);
+        return (-1);
+    }
+
+    printf("Stage 2: tile edge\n");
+    autotune_params stage_best = *best;
+    double tile_rate[sizeof(block_dim_candidates)/sizeof(block_dim_candidates[0])];
+    for (int c = 0; c < sizeof(block_dim_candidates)/sizeof(block_dim_candidates[0]); c++){
+        autotune_params p = stage_best;
+        p.block_dim = block_dim_candidates[c];
+        tile_rate[c] = -1;
+        if (p.block_dim == stage_best.block_dim){
+            tile_rate[c] = stage_best.rate;
+            continue;
+        }
+        //a work item does 4 x 4 of the tile, so the work-group is (block_dim/4)^2
+        if (max_work_group_size > 0 && (size_t)(p.block_dim/4)*(p.block_dim/4) > max_work_group_size)
+            continue;
+        tile_rate[c] = evaluate(config, &p, &frame, best);
+    }
+    //where the tiles cross over depends on the device, N and F, so report it for this one
+    printf("  tile edge for %d elements, %d frequencies:", config->num_elements, config->num_frequencies);
+    for (int c = 0; c < sizeof(block_dim_candidates)/sizeof(block_dim_candidates[0]); c++){
+        if (tile_rate[c] < 0)
+            printf("  %d: -", block_dim_candidates[c]);
+        else
+            printf("  %d: %.1f kHz (%.2fx tile %d)", block_dim_candidates[c], tile_rate[c]/1e3, tile_rate[c]/stage_best.rate, stage_best.block_dim);
+    }
+    printf("; fastest %d\n", best->block_dim);
+
+    printf("Stage 3: BASE_ACCUM\n");
+    stage_best = *best;
+    for (int c = 0; c < sizeof(base_accum_candidates)/sizeof(base_accum_candidates[0]); c++){
+        autotune_params p = stage_best;
+        p.base_accum = base_accum_candidates[c];
+        //each offset accumulator group has to stay inside one integration, and inside the frame
+        if (p.base_accum == stage_best.base_accum || stage_best.time_accum % p.base_accum != 0 || frame_length(config, p.time_accum) % p.base_accum != 0)
+            continue;
+        evaluate(config, &p, &frame, best);
+    }
+
+    printf("Stage 4: offsetAccumulateElements work-group\n");
+    stage_best = *best;
+    for (int c = 0; c < sizeof(accum_local_size_candidates)/sizeof(accum_local_size_candidates[0]); c++){
+        autotune_params p = stage_best;
+        p.accum_local_size = accum_local_size_candidates[c];
+        if (p.accum_local_size == stage_best.accum_local_size || (max_work_group_size > 0 && p.accum_local_size > max_work_group_size))
+            continue;
+        evaluate(config, &p, &frame, best);
+    }
+
+    free(frame.data);
+    printf("Best: kernel batch %d, time_accum %d, tile %d, BASE_ACCUM %d, work-group %zu: %.1f kHz of band\n", best->kernel_batch, best->time_accum,
+           best->block_dim, best->base_accum, best->accum_local_size, best->rate/1e3);
+    return 0;
+}
+
+//splits an entry line into its key and parameters. Returns 0, or -1 if it isn't an entry. Entries saved before the tile
+//edge was tuned have no block_dim field, and were tuned with the default tile
+static int parse_entry(char *line, char **device_key, int *num_elements, int *num_frequencies, int *upper_triangle_convention, autotune_params *params){
+    if (line[0] == '#')
+        return (-1);
+    char *tab = strchr(line, '\t');
+    if (tab == NULL)
+        return (-1);
+    *tab = '\0';
+    *device_key = line;
+    params->block_dim = DEFAULT_BLOCK_DIM;
+    int num_fields = sscanf(tab+1, "%d\t%d\t%d\t%d\t%d\t%d\t%zu\t%lf\t%d", num_elements, num_frequencies, upper_triangle_convention, &params->kernel_batch,
+                            &params->time_accum, &params->base_accum, &params->accum_local_size, &params->rate, &params->block_dim);
+    if (num_fields != 8 && num_fields != 9){
+        *tab = '\t';
+        return (-1);
+    }
+    return 0;
+}
+
+int autotune_db_load(const char *db_file, const char *device_key, int num_elements, int num_frequencies, int upper_triangle_convention, autotune_params *params){
+    if (db_file == NULL)
+        return 1;
+    FILE *fp = fopen(db_file, "r");
+    if (fp == NULL)
+        return 1;
+
+    char line[DB_LINE_LENGTH];
+    int found = 0;
+    while (fgets(line, sizeof(line), fp) != NULL){
+        char *entry_key;
+        int entry_elements, entry_frequencies, entry_convention;
+        autotune_params entry;
+        if (parse_entry(line, &entry_key, &entry_elements, &entry_frequencies, &entry_convention, &entry))
+            continue;
+        if (strcmp(entry_key, device_key) == 0 && entry_elements == num_elements && entry_frequencies == num_frequencies && entry_convention == upper_triangle_convention){
+            *params = entry;
+            found = 1;
+        }
+    }
+    fclose(fp);
+    if (found && (params->kernel_batch < 0 || params->kernel_batch > 1 || params->time_accum <= 0 || params->base_accum <= 0 || params->accum_local_size == 0
+                  || (params->block_dim != 16 && params->block_dim != 32 && params->block_dim != 64))){
+        printf("Error: the entry for this configuration in %s is damaged\n", db_file);
+        return (-1);
+    }
+    return found ? 0 : 1;
+}
+
+int autotune_db_save(const char *db_file, const char *device_key, int num_elements, int num_frequencies, int upper_triangle_convention, const autotune_params *params){
+    char temp_name[4096+32];
+    snprintf(temp_name, sizeof(temp_name), "%s.%d.tmp", db_file, (int)getpid());
+    FILE *out = fopen(temp_name, "w");
+    if (out == NULL){
+        printf("Error: could not write the tuning database %s\n", temp_name);
+        return (-1);
+    }
+    fprintf(out, "# correlator tuning: device\tN\tF\tconvention\tkernel_batch\ttime_accum\tbase_accum\taccum_local_size\trate (time samples x channels / s)\tblock_dim\n");
+
+    //the other entries are kept as they were
+    FILE *in = fopen(db_file, "r");
+    if (in != NULL){
+        char line[DB_LINE_LENGTH];
+        char copy[DB_LINE_LENGTH];
+        while (fgets(line, sizeof(line), in) != NULL){
+            char *entry_key;
+            int entry_elements, entry_frequencies, entry_convention;
+            autotune_params entry;
+            strcpy(copy, line);
+            if (parse_entry(line, &entry_key, &entry_elements, &entry_frequencies, &entry_convention, &entry))
+                continue;
+            if (strcmp(entry_key, device_key) == 0 && entry_elements == num_elements && entry_frequencies == num_frequencies && entry_convention == upper_triangle_convention)
+                continue;
+            fputs(copy, out);
+        }
+        fclose(in);
+    }
+    fprintf(out, "%s\t%d\t%d\t%d\t%d\t%d\t%d\t%zu\t%.1f\t%d\n", device_key, num_elements, num_frequencies, upper_triangle_convention,
+            params->kernel_batch, params->time_accum, params->base_accum, params->accum_local_size, params->rate, params->block_dim);
+
+    if (fclose(out) != 0 || rename(temp_name, db_file) != 0){
+        printf("Error: could not write the tuning database %s\n", db_file);
+        remove(temp_name);
+        return (-1);
+    }
+    return 0;
+}
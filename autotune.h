@@ -0,0 +1,52 @@
+// autotune.h
+// finds the fastest correct kernel batch, time_accum, tile edge, BASE_ACCUM and offsetAccumulateElements work-group for one device
+// and problem size, and keeps the results in a tuning database (a text file, one line per device, N, F and convention) that
+// normal runs look up.
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <CL/cl.h>
+#include <stddef.h>
+
+#define AUTOTUNE_DEFAULT_DB             "correlator_tuning.txt"
+#define AUTOTUNE_TIMED_FRAMES           16 //frames each candidate is timed over
+
+typedef struct {
+    int kernel_batch;
+    int time_accum;
+    int base_accum;
+    size_t accum_local_size;
+    int block_dim; //correlator tile edge (16, 32 or 64)
+    double rate; //time samples x channels per second (the runs' kHz of band x 1000), as measured when tuning
+} autotune_params;
+
+typedef struct {
+    cl_device_type device_type; //the device is the device_index'th of this type, counted as -d does
+    int device_index;
+    int num_elements;
+    int num_frequencies;
+    int upper_triangle_convention;
+    int num_timesteps; //frame length; 0 makes it 128 x time_accum for each candidate, as -t does without -T
+    int num_stages;
+    cl_uint num_sources;
+    const char **sources[2]; //kernel sources for kernel batches 0 and 1
+    const size_t *source_sizes[2];
+    const char *kernel_cache_dir;
+    int cpu_threads;
+} autotune_config;
+
+//the device's name and driver version: what a tuning is valid for
+void autotune_device_key(cl_device_id device, char *key, size_t key_size);
+
+//sweeps the candidates in stages (kernel batch and time_accum, then the tile edge, BASE_ACCUM and the work-group), keeping the fastest of
+//each stage. Every candidate is first checked against the CPU correlator on short samples, and dropped if it is wrong.
+//Returns 0 with the best in *best, or -1 if no candidate ran correctly
+int autotune_run(const autotune_config *config, autotune_params *best);
+
+//returns 0 and fills *params if db_file has an entry for the key, 1 if it has none (or there is no db_file), -1 on error
+int autotune_db_load(const char *db_file, const char *device_key, int num_elements, int num_frequencies, int upper_triangle_convention, autotune_params *params);
+
+//adds the entry, replacing any earlier one for the same key. Returns 0, or -1 on error
+int autotune_db_save(const char *db_file, const char *device_key, int num_elements, int num_frequencies, int upper_triangle_convention, const autotune_params *params);
+
+#endif
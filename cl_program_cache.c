@@ -0,0 +1,222 @@
+// cl_program_cache.c
+// a cache file is a header, then the key (as text, so that a hash collision can't load the wrong binary), then the binary.
+// Files are written under a temporary name and renamed into place, so a run that dies half way, or two runs saving the
+// same key at once, never leave a partial file under the real name.
+#include "cl_program_cache.h"
+#include <stdio.h> // printf
+#include <stdlib.h> // malloc, etc.
+#include <string.h> // strerror
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h> // getpid
+#include <sys/stat.h> // mkdir
+
+#define CACHE_MAGIC                     "CHIMEx-clbin1" //change the version digit if the file layout changes
+#define CACHE_MAGIC_LENGTH              14
+#define KEY_LENGTH                      4096
+
+typedef struct {
+    char magic[CACHE_MAGIC_LENGTH];
+    uint32_t key_length;
+    uint64_t binary_size;
+} cache_header;
+
+static uint64_t fnv1a_64(uint64_t hash, const unsigned char *data, size_t length){
+    for (size_t i = 0; i < length; i++){
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+//the key: everything the binary depends on. Returns its length, or -1 if it doesn't fit
+static int make_key(cl_device_id device, cl_uint num_sources, const char **sources, const size_t *source_sizes, const char *options, char *key){
+    char device_name[256] = "";
+    char device_version[256] = "";
+    char driver_version[256] = "";
+    char platform_version[256] = "";
+    cl_platform_id platform;
+    uint64_t source_hash = 14695981039346656037ull;
+    size_t source_length = 0;
+
+    clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(device_name)-1, device_name, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_VERSION, sizeof(device_version)-1, device_version, NULL);
+    clGetDeviceInfo(device, CL_DRIVER_VERSION, sizeof(driver_version)-1, driver_version, NULL);
+    if (clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, NULL) == CL_SUCCESS)
+        clGetPlatformInfo(platform, CL_PLATFORM_VERSION, sizeof(platform_version)-1, platform_version, NULL);
+
+    for (cl_uint i = 0; i < num_sources; i++){
+        source_hash = fnv1a_64(source_hash, (const unsigned char *)sources[i], source_sizes[i]);
+        source_hash = fnv1a_64(source_hash, (const unsigned char *)"\0", 1); //so moving text between files changes the key
+        source_length += source_sizes[i];
+    }
+
+    int key_length = snprintf(key, KEY_LENGTH, "options: %s\ndevice: %s\ndevice version: %s\ndriver version: %s\nplatform version: %s\nsources: %u, %zu bytes, hash %016llx\n",
+                              options, device_name, device_version, driver_version, platform_version,
+                              num_sources, source_length, (unsigned long long int)source_hash);
+    if (key_length < 0 || key_length >= KEY_LENGTH)
+        return (-1);
+    return key_length;
+}
+
+static void print_build_log(cl_program program, cl_device_id device){
+    size_t log_size;
+    clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+    char *program_log;
+    program_log = (char*)malloc(log_size+1);
+    program_log[log_size] = '\0';
+    clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size+1, program_log, NULL);
+    printf("%s\n",program_log);
+    free(program_log);
+}
+
+//returns the built program, or NULL if there is no usable cache file (a bad one is deleted)
+static cl_program load_cached(cl_context context, cl_device_id device, const char *options, const char *file_name, const char *key, int key_length){
+    FILE *fp = fopen(file_name, "rb");
+    if (fp == NULL)
+        return NULL; //not cached yet
+
+    cache_header header;
+    char *cached_key = NULL;
+    unsigned char *binary = NULL;
+    cl_program program = NULL;
+    const char *problem = NULL;
+
+    if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, CACHE_MAGIC, CACHE_MAGIC_LENGTH) != 0)
+        problem = "not a cache file";
+    else if (header.key_length != key_length)
+        problem = "key mismatch";
+    else{
+        cached_key = (char *)malloc(key_length);
+        binary = (unsigned char *)malloc(header.binary_size > 0 ? header.binary_size : 1);
+        if (cached_key == NULL || binary == NULL)
+            problem = "out of memory";
+        else if (fread(cached_key, 1, key_length, fp) != key_length || memcmp(cached_key, key, key_length) != 0)
+            problem = "key mismatch";
+        else if (header.binary_size == 0 || fread(binary, 1, header.binary_size, fp) != header.binary_size || fgetc(fp) != EOF)
+            problem = "truncated";
+    }
+    fclose(fp);
+
+    if (problem == NULL){
+        size_t binary_size = header.binary_size;
+        const unsigned char *binaries[1] = {binary};
+        cl_int binary_status;
+        cl_int err;
+        program = clCreateProgramWithBinary(context, 1, &device, &binary_size, binaries, &binary_status, &err);
+        if (err || binary_status != CL_SUCCESS){
+            problem = "refused by the driver";
+            if (program != NULL)
+                clReleaseProgram(program);
+            program = NULL;
+        }
+        else if (clBuildProgram(program, 1, &device, options, NULL, NULL) != CL_SUCCESS){
+            problem = "failed to build";
+            clReleaseProgram(program);
+            program = NULL;
+        }
+    }
+
+    if (problem != NULL){
+        printf("Discarding cached kernel binary %s: %s\n", file_name, problem);
+        remove(file_name);
+    }
+    free(cached_key);
+    free(binary);
+    return program;
+}
+
+//failing to save only costs the next run a compile, so it just prints a warning
+static void save_cached(cl_program program, const char *cache_dir, const char *file_name, const char *key, int key_length){
+    size_t binary_size = 0;
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binary_size, NULL) != CL_SUCCESS || binary_size == 0){
+        printf("Warning: the OpenCL driver doesn't provide the program binary, so it can't be cached\n");
+        return;
+    }
+    unsigned char *binary = (unsigned char *)malloc(binary_size);
+    if (binary == NULL)
+        return;
+    unsigned char *binaries[1] = {binary};
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binaries), binaries, NULL) != CL_SUCCESS){
+        printf("Warning: the OpenCL driver doesn't provide the program binary, so it can't be cached\n");
+        free(binary);
+        return;
+    }
+
+    if (mkdir(cache_dir, 0755) != 0 && errno != EEXIST){
+        printf("Warning: can't create the kernel cache directory %s: %s\n", cache_dir, strerror(errno));
+        free(binary);
+        return;
+    }
+
+    char temp_name[4096+32];
+    snprintf(temp_name, sizeof(temp_name), "%s.%d.tmp", file_name, (int)getpid());
+    FILE *fp = fopen(temp_name, "wb");
+    if (fp == NULL){
+        printf("Warning: can't write the kernel cache file %s: %s\n", temp_name, strerror(errno));
+        free(binary);
+        return;
+    }
+    cache_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, CACHE_MAGIC_LENGTH);
+    header.key_length = key_length;
+    header.binary_size = binary_size;
+    int ok = (fwrite(&header, sizeof(header), 1, fp) == 1);
+    ok &= (fwrite(key, 1, key_length, fp) == key_length);
+    ok &= (fwrite(binary, 1, binary_size, fp) == binary_size);
+    ok &= (fclose(fp) == 0);
+    if (!ok || rename(temp_name, file_name) != 0){
+        printf("Warning: failed to save the kernel cache file %s\n", file_name);
+        remove(temp_name);
+    }
+    free(binary);
+    return;
+}
+
+cl_program cl_program_cache_build(cl_context context, cl_device_id device, cl_uint num_sources, const char **sources, const size_t *source_sizes,
+                                  const char *options, const char *cache_dir, int *from_cache){
+    char key[KEY_LENGTH];
+    char file_name[4096];
+    int key_length = -1;
+    cl_program program;
+    cl_int err;
+
+    if (from_cache != NULL)
+        *from_cache = 0;
+
+    if (cache_dir != NULL){
+        key_length = make_key(device, num_sources, sources, source_sizes, options, key);
+        if (key_length < 0)
+            printf("Warning: the kernel cache key is too long, so the kernels won't be cached\n");
+        else{
+            uint64_t key_hash = fnv1a_64(14695981039346656037ull, (const unsigned char *)key, key_length);
+            snprintf(file_name, sizeof(file_name), "%s/%016llx.bin", cache_dir, (unsigned long long int)key_hash);
+            program = load_cached(context, device, options, file_name, key, key_length);
+            if (program != NULL){
+                if (from_cache != NULL)
+                    *from_cache = 1;
+                return program;
+            }
+        }
+    }
+
+    program = clCreateProgramWithSource(context, num_sources, sources, source_sizes, &err);
+    if (err){
+        printf("Error in clCreateProgramWithSource: %i\n",err);
+        return NULL;
+    }
+
+    err = clBuildProgram(program, 1, &device, options, NULL, NULL);
+    if (err){
+        printf("Error in clBuildProgram: %i\n",err);
+        print_build_log(program, device);
+        clReleaseProgram(program);
+        return NULL;
+    }
+
+    if (key_length >= 0)
+        save_cached(program, cache_dir, file_name, key, key_length);
+
+    return program;
+}
@@ -0,0 +1,19 @@
+// cl_program_cache.h
+// on-disk cache of built OpenCL programs. A built program is kept as the device's binary in a file named after a hash of
+// everything that decides what gets built: the kernel sources, the build options, and the device, driver and platform
+// versions. Any change to one of them gives a new key, so stale binaries are never loaded, just left unused.
+#ifndef CL_PROGRAM_CACHE_H
+#define CL_PROGRAM_CACHE_H
+
+#include <CL/cl.h>
+
+#define CL_PROGRAM_CACHE_DEFAULT_DIR    "cl_program_cache"
+
+//builds the program from the sources for one device, loading its binary from cache_dir when there is a matching one, and
+//saving it there when there isn't. A cache file that is damaged, holds another key, or is refused by the driver is deleted
+//and the program is built from source instead. cache_dir NULL turns the cache off. *from_cache (if not NULL) is set to 1
+//when the binary came from the cache. Returns NULL (after printing why, with the build log) if the program can't be built
+cl_program cl_program_cache_build(cl_context context, cl_device_id device, cl_uint num_sources, const char **sources, const size_t *source_sizes,
+                                  const char *options, const char *cache_dir, int *from_cache);
+
+#endif
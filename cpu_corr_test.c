@@ -4,9 +4,12 @@
 #include <stdio.h> // printf
 #include <stdlib.h> // malloc, etc.
 #include <math.h>
+#include <string.h> // memset
+#include <pthread.h>
 #include "four_bit_macros.h"
 #include "input_generator.h"
 #include "gpu_cpu_helpers.h"
+#include "cpu_xengine.h"
 
 int cpu_data_generate_and_correlate_nonstandard_convention(int num_timesteps, int num_frequencies, int num_elements, int *correlated_data, int gen_type, int default_seed, int default_real, int default_imaginary, int initial_real, int initial_imaginary, int generate_frequency, int no_repeat_random, int verbose){
     //correlatedData will be returned as num_frequencies blocks, each num_elements x num_elements x 2
@@ -203,6 +206,36 @@ int cpu_data_generate_and_correlate_upper_triangle_only(int num_timesteps, int n
 }
 
 
+typedef struct {
+    int gen_type;
+    int default_seed;
+    int default_real;
+    int default_imaginary;
+    int initial_real;
+    int initial_imaginary;
+    int generate_frequency;
+    int no_repeat_random;
+    int verbose;
+} generator_chunk_context;
+
+static int generate_chunk(void *context, int first_timestep, int num_timesteps, int num_frequencies, int num_elements, unsigned char *chunk){
+    generator_chunk_context *gen = (generator_chunk_context *)context;
+    generate_char_data_set_chunk(gen->gen_type, gen->default_seed, gen->default_real, gen->default_imaginary, gen->initial_real, gen->initial_imaginary, gen->generate_frequency,
+                                 first_timestep, num_timesteps, num_frequencies, num_elements, gen->no_repeat_random, chunk);
+    if (gen->verbose && first_timestep == 0){
+        print_element_data(1, num_frequencies, num_elements, ALL_FREQUENCIES, chunk);
+    }
+    return (0);
+}
+
+int cpu_data_generate_and_correlate_tiled(int num_timesteps, int num_frequencies, int num_elements, int *correlated_data, int gen_type, int default_seed, int default_real, int default_imaginary, int initial_real, int initial_imaginary, int generate_frequency, int no_repeat_random, int upper_triangle_convention, int output_triangle, int engine, int num_threads, int chunk_timesteps, int verbose){
+    //same results as the four functions above (selected by upper_triangle_convention and output_triangle), but uses the blocked correlator in cpu_xengine.c, spread over num_threads threads.
+    //The data set is generated chunk_timesteps at a time (<= 0: all at once), so long runs don't need the whole data set in memory
+    generator_chunk_context gen = {gen_type, default_seed, default_real, default_imaginary, initial_real, initial_imaginary, generate_frequency, no_repeat_random, verbose};
+
+    return (cpu_xengine_correlate_stream(generate_chunk, &gen, num_timesteps, chunk_timesteps, num_frequencies, num_elements, upper_triangle_convention, output_triangle, engine, num_threads, verbose, correlated_data));
+}
+
 void compare_NSquared_correlator_results ( int *num_err, int64_t *err_2, int num_frequencies, int num_elements, int *data_set_GPU, int *data_set_CPU, double *ratio_GPU_div_CPU, double *phase_difference, int verbosity){
     //this will compare the values of the two arrays and give information about the comparison
     int address = 0;
@@ -328,3 +361,200 @@ void compare_NSquared_correlator_results_data_has_upper_triangle_only ( int *num
     printf("Maximum amplitude squared error: %d\n", max_error);
     return;
 }
+
+typedef struct {
+    int num_frequencies;
+    int num_elements;
+    int upper_triangle_only;
+    int *data_set_GPU;
+    int *data_set_CPU;
+    double *ratio_GPU_div_CPU;
+    double *phase_difference;
+    int verbosity;
+    int *next_row; //shared: rows (one frequency, one element_y) are handed out one at a time
+    compare_statistics stats;
+} compare_thread_args;
+
+static void compare_statistics_init(compare_statistics *stats){
+    memset(stats, 0, sizeof(compare_statistics));
+    stats->ratio_min = INFINITY;
+    stats->ratio_max = -INFINITY;
+    stats->phase_min = INFINITY;
+    stats->phase_max = -INFINITY;
+    return;
+}
+
+static void compare_statistics_merge(compare_statistics *total, compare_statistics *part){
+    total->num_compared += part->num_compared;
+    total->num_err += part->num_err;
+    total->err_2 += part->err_2;
+    if (part->max_error > total->max_error)
+        total->max_error = part->max_error;
+    total->num_zero_CPU += part->num_zero_CPU;
+    total->num_ratio += part->num_ratio;
+    total->ratio_sum += part->ratio_sum;
+    if (part->ratio_min < total->ratio_min)
+        total->ratio_min = part->ratio_min;
+    if (part->ratio_max > total->ratio_max)
+        total->ratio_max = part->ratio_max;
+    total->phase_sum += part->phase_sum;
+    if (part->phase_min < total->phase_min)
+        total->phase_min = part->phase_min;
+    if (part->phase_max > total->phase_max)
+        total->phase_max = part->phase_max;
+    for (int i = 0; i < COMPARE_HISTOGRAM_BINS; i++){
+        total->ratio_histogram[i] += part->ratio_histogram[i];
+        total->phase_histogram[i] += part->phase_histogram[i];
+    }
+    return;
+}
+
+static void *compare_thread(void *arg){
+    compare_thread_args *args = (compare_thread_args *)arg;
+    compare_statistics *stats = &args->stats;
+    int num_elements = args->num_elements;
+    int num_rows = args->num_frequencies*num_elements;
+    for (;;){
+        int row = __sync_fetch_and_add(args->next_row, 1);
+        if (row >= num_rows)
+            break;
+        int freq = row/num_elements;
+        int element_y = row%num_elements;
+        int element_x_first = args->upper_triangle_only ? element_y : 0;
+        //index (in complex values) of the first baseline of the row
+        size_t local_Address;
+        if (args->upper_triangle_only)
+            local_Address = (size_t)freq*((num_elements*(num_elements+1))/2) + element_y*num_elements - ((element_y-1)*element_y)/2;
+        else
+            local_Address = ((size_t)freq*num_elements + element_y)*num_elements;
+
+        for (int element_x = element_x_first; element_x < num_elements; element_x++, local_Address++){
+            int data_Real_GPU = args->data_set_GPU[local_Address*2];
+            int data_Real_CPU = args->data_set_CPU[local_Address*2];
+            int data_Imag_GPU = args->data_set_GPU[local_Address*2+1];
+            int data_Imag_CPU = args->data_set_CPU[local_Address*2+1];
+            int64_t difference_real = (int64_t)data_Real_GPU - data_Real_CPU;
+            int64_t difference_imag = (int64_t)data_Imag_GPU - data_Imag_CPU;
+
+            double amplitude_squared_CPU = (double)data_Real_CPU*data_Real_CPU + (double)data_Imag_CPU*data_Imag_CPU;
+            double amplitude_squared_GPU = (double)data_Real_GPU*data_Real_GPU + (double)data_Imag_GPU*data_Imag_GPU;
+            double phase_difference = atan2((double)data_Imag_GPU,(double)data_Real_GPU) - atan2((double)data_Imag_CPU,(double)data_Real_CPU);
+            double ratio = (amplitude_squared_CPU != 0) ? amplitude_squared_GPU/amplitude_squared_CPU : -1;
+
+            if (args->ratio_GPU_div_CPU != NULL)
+                args->ratio_GPU_div_CPU[local_Address] = ratio;
+            if (args->phase_difference != NULL)
+                args->phase_difference[local_Address] = phase_difference;
+
+            stats->num_compared++;
+            if (amplitude_squared_CPU != 0){
+                stats->num_ratio++;
+                stats->ratio_sum += ratio;
+                if (ratio < stats->ratio_min)
+                    stats->ratio_min = ratio;
+                if (ratio > stats->ratio_max)
+                    stats->ratio_max = ratio;
+                int bin = (int)(ratio*(COMPARE_HISTOGRAM_BINS/COMPARE_RATIO_HISTOGRAM_MAX));
+                stats->ratio_histogram[bin < COMPARE_HISTOGRAM_BINS ? bin : COMPARE_HISTOGRAM_BINS-1]++;
+            }
+            else
+                stats->num_zero_CPU++;
+
+            //the statistics use the phase difference wrapped into [-pi, pi]
+            if (phase_difference > M_PI)
+                phase_difference -= 2*M_PI;
+            else if (phase_difference < -M_PI)
+                phase_difference += 2*M_PI;
+            stats->phase_sum += phase_difference;
+            if (phase_difference < stats->phase_min)
+                stats->phase_min = phase_difference;
+            if (phase_difference > stats->phase_max)
+                stats->phase_max = phase_difference;
+            int bin = (int)((phase_difference + M_PI)*(COMPARE_HISTOGRAM_BINS/(2*M_PI)));
+            stats->phase_histogram[bin < COMPARE_HISTOGRAM_BINS ? (bin > 0 ? bin : 0) : COMPARE_HISTOGRAM_BINS-1]++;
+
+            if (difference_real != 0 || difference_imag != 0){
+                stats->num_err++;
+                if (args->verbosity){
+                    printf ("freq: %6d element_x: %6d element_y: %6d Real CPU/GPU %8d %8d Imaginary CPU/GPU %8d %8d ERR: %7lld\n",freq, element_x, element_y, data_Real_CPU, data_Real_GPU, data_Imag_CPU, data_Imag_GPU, (long long int)stats->num_err);
+                }
+                int64_t amplitude_squared_error = difference_imag*difference_imag + difference_real*difference_real;
+                stats->err_2 += amplitude_squared_error;
+                if (amplitude_squared_error > stats->max_error)
+                    stats->max_error = amplitude_squared_error;
+            }
+            else{
+                if (args->verbosity){
+                    printf ("freq: %6d element_x: %6d element_y: %6d Real CPU/GPU %8d %8d Imaginary CPU/GPU %8d %8d\n",freq, element_x, element_y, data_Real_CPU, data_Real_GPU, data_Imag_CPU, data_Imag_GPU);
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+int compare_correlator_results_streaming(compare_statistics *stats, int num_frequencies, int num_elements, int upper_triangle_only, int *data_set_GPU, int *data_set_CPU, double *ratio_GPU_div_CPU, double *phase_difference, int num_threads, int verbosity){
+    //one pass over the data, with per-thread statistics that are merged at the end. ratio_GPU_div_CPU and phase_difference
+    //(one value per baseline, same layout as the data) are only filled if they aren't NULL
+    if (num_threads <= 0)
+        num_threads = cpu_xengine_default_num_threads();
+    if (verbosity) //keep the per-baseline printout in order
+        num_threads = 1;
+
+    compare_thread_args *args = (compare_thread_args *)malloc(num_threads*sizeof(compare_thread_args));
+    pthread_t *threads = (pthread_t *)malloc(num_threads*sizeof(pthread_t));
+    int *started = (int *)calloc(num_threads, sizeof(int));
+    if (args == NULL || threads == NULL || started == NULL){
+        printf ("Error allocating memory: compare_correlator_results_streaming\n");
+        free(args);
+        free(threads);
+        free(started);
+        return (-1);
+    }
+
+    int next_row = 0;
+    for (int i = 0; i < num_threads; i++){
+        args[i].num_frequencies = num_frequencies;
+        args[i].num_elements = num_elements;
+        args[i].upper_triangle_only = upper_triangle_only;
+        args[i].data_set_GPU = data_set_GPU;
+        args[i].data_set_CPU = data_set_CPU;
+        args[i].ratio_GPU_div_CPU = ratio_GPU_div_CPU;
+        args[i].phase_difference = phase_difference;
+        args[i].verbosity = verbosity;
+        args[i].next_row = &next_row;
+        compare_statistics_init(&args[i].stats);
+    }
+    //thread 0 is the calling thread; the others just help if they can be started
+    for (int i = 1; i < num_threads; i++)
+        started[i] = (pthread_create(&threads[i], NULL, compare_thread, &args[i]) == 0);
+    compare_thread(&args[0]);
+
+    compare_statistics_init(stats);
+    for (int i = 0; i < num_threads; i++){
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        compare_statistics_merge(stats, &args[i].stats);
+    }
+
+    printf("\nTotal number of errors: %lld, Sum of Squared Differences: %lld \n",(long long int)stats->num_err, (long long int)stats->err_2);
+    printf("sqrt(sum of squared differences/numberElements): %f \n", sqrt(stats->err_2*1.0/stats->num_compared));
+    printf("Maximum amplitude squared error: %lld\n", (long long int)stats->max_error);
+    if (stats->num_ratio > 0)
+        printf("Amplitude squared ratio GPU/CPU: min %f max %f mean %f (%lld baselines with zero CPU amplitude)\n", stats->ratio_min, stats->ratio_max, stats->ratio_sum/stats->num_ratio, (long long int)stats->num_zero_CPU);
+    printf("Phase difference GPU-CPU (rad): min %f max %f mean %f\n", stats->phase_min, stats->phase_max, stats->phase_sum/stats->num_compared);
+    if (stats->num_err > 0){ //the histograms are one spike when everything matches
+        printf("Amplitude squared ratio histogram [0, %.1f]:", COMPARE_RATIO_HISTOGRAM_MAX);
+        for (int i = 0; i < COMPARE_HISTOGRAM_BINS; i++)
+            printf(" %lld", (long long int)stats->ratio_histogram[i]);
+        printf("\nPhase difference histogram [-pi, pi]:");
+        for (int i = 0; i < COMPARE_HISTOGRAM_BINS; i++)
+            printf(" %lld", (long long int)stats->phase_histogram[i]);
+        printf("\n");
+    }
+
+    free(args);
+    free(threads);
+    free(started);
+    return (0);
+}
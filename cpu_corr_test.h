@@ -3,6 +3,27 @@
 #ifndef CPU_CORR_TEST_H
 #define CPU_CORR_TEST_H
 #include <stdlib.h>
+#include <stdint.h>
+
+#define COMPARE_HISTOGRAM_BINS          16
+#define COMPARE_RATIO_HISTOGRAM_MAX     2.0 //ratio histogram covers [0, 2); larger ratios go in the last bin
+
+typedef struct {
+    int64_t num_compared;
+    int64_t num_err;
+    int64_t err_2;
+    int64_t max_error;
+    int64_t num_zero_CPU; //baselines where the CPU amplitude is 0, so there is no ratio
+    int64_t num_ratio;
+    double ratio_min;
+    double ratio_max;
+    double ratio_sum;
+    double phase_min;
+    double phase_max;
+    double phase_sum;
+    int64_t ratio_histogram[COMPARE_HISTOGRAM_BINS];
+    int64_t phase_histogram[COMPARE_HISTOGRAM_BINS];
+} compare_statistics;
 
 int cpu_data_generate_and_correlate(int num_timesteps, int num_frequencies, int num_elements, int *correlated_data, int gen_type, int default_seed, int default_real, int default_imaginary, int initial_real, int initial_imaginary, int generate_frequency, int no_repeat_random, int verbose);
 
@@ -12,8 +33,12 @@ int cpu_data_generate_and_correlate_nonstandard_convention(int num_timesteps, in
 
 int cpu_data_generate_and_correlate_upper_triangle_only_nonstandard_convention(int num_timesteps, int num_frequencies, int num_elements, int *correlated_data_triangle, int gen_type, int default_seed, int default_real, int default_imaginary, int initial_real, int initial_imaginary, int generate_frequency, int no_repeat_random, int verbose);
 
+int cpu_data_generate_and_correlate_tiled(int num_timesteps, int num_frequencies, int num_elements, int *correlated_data, int gen_type, int default_seed, int default_real, int default_imaginary, int initial_real, int initial_imaginary, int generate_frequency, int no_repeat_random, int upper_triangle_convention, int output_triangle, int engine, int num_threads, int chunk_timesteps, int verbose);
+
 void compare_NSquared_correlator_results ( int *num_err, int64_t *err_2, int num_frequencies, int num_elements, int *data_set_GPU, int *data_set_CPU, double *ratio_GPU_div_CPU, double *phase_difference, int verbosity);
 
 void compare_NSquared_correlator_results_data_has_upper_triangle_only ( int *num_err, int64_t *err_2, int actual_num_frequencies, int actual_num_elements, int *data_set_GPU, int *data_set_CPU, double *ratio_GPU_div_CPU, double *phase_difference, int verbosity);
 
+int compare_correlator_results_streaming(compare_statistics *stats, int num_frequencies, int num_elements, int upper_triangle_only, int *data_set_GPU, int *data_set_CPU, double *ratio_GPU_div_CPU, double *phase_difference, int num_threads, int verbosity);
+
 #endif
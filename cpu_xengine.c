@@ -0,0 +1,297 @@
+// cpu_xengine.c
+// blocked cpu correlator. The baselines are cut into CPU_XENGINE_TILE_DIM x CPU_XENGINE_TILE_DIM tiles covering the upper triangle,
+// and all timesteps are accumulated inside a tile before it is written out, so the accumulators stay in cache and each
+// element is only decoded once per tile per timestep (rather than once per baseline as in the reference functions)
+#include "cpu_xengine.h"
+#include <stdio.h> // printf
+#include <stdlib.h> // malloc, etc.
+#include <string.h> // memset
+#include "four_bit_macros.h"
+#include "gpu_cpu_helpers.h"
+
+#define CPU_XENGINE_BENCHMARK_TIMESTEPS 1024
+#define CPU_XENGINE_BENCHMARK_REPEATS   3
+
+static void reference_correlate_tile(unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int frequency, int tile_x_start, int tile_y_start, int *tile_accum){
+    //the arithmetic of the reference functions in cpu_corr_test.c (both elements decoded per baseline, timesteps outermost),
+    //restricted to one tile so the engines can be timed against it
+    memset(tile_accum, 0, CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM*2*sizeof(int));
+    for (int k = 0; k < num_timesteps; k++){
+        unsigned char *timestep_data = data + ((size_t)k*num_frequencies + frequency)*num_elements;
+        for (int y_local = 0; y_local < CPU_XENGINE_TILE_DIM; y_local++){
+            unsigned char temp_char = timestep_data[tile_y_start + y_local];
+            int element_y_re = (int)(HI_NIBBLE(temp_char)) - 8;
+            int element_y_im = (int)(LO_NIBBLE(temp_char)) - 8;
+            for (int x_local = 0; x_local < CPU_XENGINE_TILE_DIM; x_local++){
+                temp_char = timestep_data[tile_x_start + x_local];
+                int element_x_re = (int)(HI_NIBBLE(temp_char)) - 8;
+                int element_x_im = (int)(LO_NIBBLE(temp_char)) - 8;
+                tile_accum[(y_local*CPU_XENGINE_TILE_DIM + x_local)*2]   += element_x_re*element_y_re + element_x_im*element_y_im;
+                tile_accum[(y_local*CPU_XENGINE_TILE_DIM + x_local)*2+1] += element_x_re*element_y_im - element_x_im*element_y_re;
+            }
+        }
+    }
+}
+
+void cpu_xengine_correlate_tile(unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int frequency, int tile_x_start, int tile_y_start, int *tile_accum){
+    //runs of up to CPU_XENGINE_INT16_TIMESTEPS are summed in short lanes (twice as many per vector as int) and then spilled
+    //into the int accumulators
+    short short_accum[CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM*2];
+    int x_width = num_elements - tile_x_start;
+    int y_width = num_elements - tile_y_start;
+    if (x_width > CPU_XENGINE_TILE_DIM)
+        x_width = CPU_XENGINE_TILE_DIM;
+    if (y_width > CPU_XENGINE_TILE_DIM)
+        y_width = CPU_XENGINE_TILE_DIM;
+
+    short *short_re = short_accum;
+    short *short_im = short_accum + CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM;
+    short x_re[CPU_XENGINE_TILE_DIM];
+    short x_im[CPU_XENGINE_TILE_DIM];
+    memset(tile_accum, 0, CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM*2*sizeof(int));
+
+    for (int run_start = 0; run_start < num_timesteps; run_start += CPU_XENGINE_INT16_TIMESTEPS){
+        int run_end = run_start + CPU_XENGINE_INT16_TIMESTEPS;
+        if (run_end > num_timesteps)
+            run_end = num_timesteps;
+        memset(short_accum, 0, sizeof(short_accum));
+
+        for (int k = run_start; k < run_end; k++){
+            unsigned char *timestep_data = data + ((size_t)k*num_frequencies + frequency)*num_elements;
+            //decode the x elements for this tile once, then reuse them for every y
+            for (int x_local = 0; x_local < x_width; x_local++){
+                unsigned char temp_char = timestep_data[tile_x_start + x_local];
+                x_re[x_local] = (short)(HI_NIBBLE(temp_char)) - 8;
+                x_im[x_local] = (short)(LO_NIBBLE(temp_char)) - 8;
+            }
+            for (int y_local = 0; y_local < y_width; y_local++){
+                unsigned char temp_char = timestep_data[tile_y_start + y_local];
+                short element_y_re = (short)(HI_NIBBLE(temp_char)) - 8;
+                short element_y_im = (short)(LO_NIBBLE(temp_char)) - 8;
+                short *row_re = short_re + y_local*CPU_XENGINE_TILE_DIM;
+                short *row_im = short_im + y_local*CPU_XENGINE_TILE_DIM;
+                //in the diagonal tiles only x >= y is needed. Products and sums are all 16 bit, which lets the compiler
+                //vectorize this loop with 16 bit multiplies and adds
+                int x_first = (tile_x_start == tile_y_start) ? y_local : 0;
+                for (int x_local = x_first; x_local < x_width; x_local++){
+                    row_re[x_local] += (short)(x_re[x_local]*element_y_re + x_im[x_local]*element_y_im);
+                    row_im[x_local] += (short)(x_re[x_local]*element_y_im - x_im[x_local]*element_y_re);
+                }
+            }
+        }
+
+        for (int i = 0; i < CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM*2; i++)
+            tile_accum[i] += short_accum[i];
+    }
+    return;
+}
+
+void cpu_xengine_correlate_tile_total(cpu_xengine_tile_function correlate_tile, unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int frequency, int tile_x_start, int tile_y_start,
+                                      int *tile_accum, int64_t *tile_total){
+    memset(tile_total, 0, CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM*2*sizeof(int64_t));
+    for (int run_start = 0; run_start < num_timesteps; run_start += CPU_XENGINE_INT32_TIMESTEPS){
+        int run_length = num_timesteps - run_start;
+        if (run_length > CPU_XENGINE_INT32_TIMESTEPS)
+            run_length = CPU_XENGINE_INT32_TIMESTEPS;
+        correlate_tile(data + (size_t)run_start*num_frequencies*num_elements, run_length, num_frequencies, num_elements, frequency, tile_x_start, tile_y_start, tile_accum);
+        for (int i = 0; i < CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM*2; i++)
+            tile_total[i] += tile_accum[i];
+    }
+    return;
+}
+
+static inline void store_value(void *correlated_data, int output_int64, size_t index, int64_t value, int accumulate){
+    //sums are done in 64 bit; narrowing to int keeps the low 32 bits, which is what the gpu's wrapping adds leave
+    if (output_int64){
+        int64_t *output = (int64_t *)correlated_data;
+        output[index] = accumulate ? output[index] + value : value;
+    }
+    else{
+        int *output = (int *)correlated_data;
+        output[index] = (int)(uint32_t)(accumulate ? output[index] + value : value);
+    }
+    return;
+}
+
+void cpu_xengine_store_tile(int num_elements, int frequency, int tile_x_start, int tile_y_start, int upper_triangle_convention, int output_triangle, int accumulate, int output_int64, int64_t *tile_total, void *correlated_data){
+    //writes the tile into the same layouts the reference functions produce: either the packed upper triangle
+    //(num_elements*(num_elements+1)/2 complex values per frequency) or the full num_elements x num_elements matrix.
+    //When accumulate is set, the tile is added to what is already in the output (used when the time axis is split up)
+    int x_width = num_elements - tile_x_start;
+    int y_width = num_elements - tile_y_start;
+    if (x_width > CPU_XENGINE_TILE_DIM)
+        x_width = CPU_XENGINE_TILE_DIM;
+    if (y_width > CPU_XENGINE_TILE_DIM)
+        y_width = CPU_XENGINE_TILE_DIM;
+
+    int64_t *total_re = tile_total;
+    int64_t *total_im = tile_total + CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM;
+
+    for (int y_local = 0; y_local < y_width; y_local++){
+        int y_ID_global = tile_y_start + y_local;
+        int x_first = (tile_x_start == tile_y_start) ? y_local : 0;
+        for (int x_local = x_first; x_local < x_width; x_local++){
+            int x_ID_global = tile_x_start + x_local;
+            int64_t value_re = total_re[y_local*CPU_XENGINE_TILE_DIM + x_local];
+            int64_t value_im = total_im[y_local*CPU_XENGINE_TILE_DIM + x_local];
+            if (upper_triangle_convention == 0) //the non-standard convention is the complex conjugate
+                value_im = -value_im;
+
+            if (output_triangle){
+                size_t address = (size_t)frequency*((num_elements*(num_elements+1))/2) + y_ID_global*num_elements - ((y_ID_global-1)*y_ID_global)/2 + (x_ID_global - y_ID_global);
+                store_value(correlated_data, output_int64, address*2  , value_re, accumulate);
+                store_value(correlated_data, output_int64, address*2+1, value_im, accumulate);
+            }
+            else{
+                size_t address = ((size_t)frequency*num_elements + y_ID_global)*num_elements + x_ID_global;
+                size_t address_conjugate = ((size_t)frequency*num_elements + x_ID_global)*num_elements + y_ID_global;
+                store_value(correlated_data, output_int64, address*2  , value_re, accumulate);
+                store_value(correlated_data, output_int64, address*2+1, value_im, accumulate);
+                if (x_ID_global != y_ID_global){ //the lower triangle holds the conjugates
+                    store_value(correlated_data, output_int64, address_conjugate*2  , value_re, accumulate);
+                    store_value(correlated_data, output_int64, address_conjugate*2+1, -value_im, accumulate);
+                }
+            }
+        }
+    }
+    return;
+}
+
+int cpu_xengine_engine_supported(int engine){
+    __builtin_cpu_init();
+    switch (engine){
+        case CPU_XENGINE_SCALAR:
+        case CPU_XENGINE_LUT:
+            return 1;
+        case CPU_XENGINE_AVX2:
+            return __builtin_cpu_supports("avx2");
+        case CPU_XENGINE_AVX512_VNNI:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vnni");
+        default:
+            return 0;
+    }
+}
+
+int cpu_xengine_benchmark_engines(int verbose){
+    //which engine wins depends on more than the instruction set (the lookup table can beat narrow SIMD units, for example),
+    //so each one is timed on a full tile of random data
+    unsigned char *data = (unsigned char *)malloc(CPU_XENGINE_BENCHMARK_TIMESTEPS*CPU_XENGINE_TILE_DIM*2);
+    int *tile_accum = (int *)malloc(CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM*2*sizeof(int));
+    if (data == NULL || tile_accum == NULL){
+        free(data);
+        free(tile_accum);
+        return CPU_XENGINE_SCALAR;
+    }
+    unsigned int state = 12345u;
+    for (int i = 0; i < CPU_XENGINE_BENCHMARK_TIMESTEPS*CPU_XENGINE_TILE_DIM*2; i++){
+        state = state*1103515245u + 12345u;
+        data[i] = (unsigned char)(state >> 16);
+    }
+
+    int best_engine = CPU_XENGINE_SCALAR;
+    double best_time = 0;
+    if (verbose)
+        printf("CPU correlator engines (%d x %d tile, %d timesteps, best of %d):\n", CPU_XENGINE_TILE_DIM, CPU_XENGINE_TILE_DIM, CPU_XENGINE_BENCHMARK_TIMESTEPS, CPU_XENGINE_BENCHMARK_REPEATS);
+    //engine -1 is the reference arithmetic, timed (when verbose) only as the baseline the engines are measured against
+    for (int engine = verbose ? -1 : 0; engine < CPU_XENGINE_NUM_ENGINES; engine++){
+        cpu_xengine_tile_function correlate_tile = engine < 0 ? reference_correlate_tile : cpu_xengine_get_tile_function(engine);
+        if (correlate_tile == NULL){
+            if (verbose)
+                printf("  %-12s not supported on this host\n", cpu_xengine_name(engine));
+            continue;
+        }
+        double engine_time = 0;
+        for (int repeat = 0; repeat < CPU_XENGINE_BENCHMARK_REPEATS; repeat++){
+            double start_time = e_time();
+            //an off-diagonal tile of 2 x 64 elements
+            correlate_tile(data, CPU_XENGINE_BENCHMARK_TIMESTEPS, 1, CPU_XENGINE_TILE_DIM*2, 0, CPU_XENGINE_TILE_DIM, 0, tile_accum);
+            double run_time = e_time() - start_time;
+            if (repeat == 0 || run_time < engine_time)
+                engine_time = run_time;
+        }
+        if (verbose)
+            printf("  %-12s %8.3f Gcmac/s\n", engine < 0 ? "reference" : cpu_xengine_name(engine), (double)CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM*CPU_XENGINE_BENCHMARK_TIMESTEPS/engine_time/1e9);
+        if (engine < 0)
+            continue;
+        if (engine == 0 || engine_time < best_time){
+            best_time = engine_time;
+            best_engine = engine;
+        }
+    }
+
+    free(data);
+    free(tile_accum);
+    return best_engine;
+}
+
+int cpu_xengine_best_available(void){
+    static int best_engine = CPU_XENGINE_AUTO; //call this before starting threads, like cpu_xengine_correlate_threaded does
+    if (best_engine == CPU_XENGINE_AUTO)
+        best_engine = cpu_xengine_benchmark_engines(0);
+    return best_engine;
+}
+
+const char *cpu_xengine_name(int engine){
+    switch (engine){
+        case CPU_XENGINE_AUTO:
+            return "auto";
+        case CPU_XENGINE_SCALAR:
+            return "scalar";
+        case CPU_XENGINE_AVX2:
+            return "avx2";
+        case CPU_XENGINE_AVX512_VNNI:
+            return "avx512_vnni";
+        case CPU_XENGINE_LUT:
+            return "lookup_table";
+        default:
+            return "unknown";
+    }
+}
+
+cpu_xengine_tile_function cpu_xengine_get_tile_function(int engine){
+    if (!cpu_xengine_engine_supported(engine))
+        return NULL;
+    switch (engine){
+        case CPU_XENGINE_AVX2:
+            return cpu_xengine_correlate_tile_avx2;
+        case CPU_XENGINE_AVX512_VNNI:
+            return cpu_xengine_correlate_tile_avx512_vnni;
+        case CPU_XENGINE_LUT:
+            return cpu_xengine_correlate_tile_lut;
+        default:
+            return cpu_xengine_correlate_tile;
+    }
+}
+
+int cpu_xengine_correlate(unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int upper_triangle_convention, int output_triangle, int engine, int *correlated_data){
+    //data is num_timesteps x num_frequencies x num_elements, packed 4+4 bit offset-encoded, as made by generate_char_data_set
+    if (engine == CPU_XENGINE_AUTO)
+        engine = cpu_xengine_best_available();
+    cpu_xengine_tile_function correlate_tile = cpu_xengine_get_tile_function(engine);
+    if (correlate_tile == NULL){
+        printf ("Error: cpu engine %d (%s) is not supported on this host\n", engine, cpu_xengine_name(engine));
+        return (-1);
+    }
+
+    int *tile_accum = (int *)malloc(CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM*2*sizeof(int));
+    int64_t *tile_total = (int64_t *)malloc(CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM*2*sizeof(int64_t));
+    if (tile_accum == NULL || tile_total == NULL){
+        printf ("Error allocating memory: cpu_xengine_correlate\n");
+        free(tile_accum);
+        free(tile_total);
+        return (-1);
+    }
+
+    for (int j = 0; j < num_frequencies; j++){
+        for (int tile_y_start = 0; tile_y_start < num_elements; tile_y_start += CPU_XENGINE_TILE_DIM){
+            for (int tile_x_start = tile_y_start; tile_x_start < num_elements; tile_x_start += CPU_XENGINE_TILE_DIM){
+                cpu_xengine_correlate_tile_total(correlate_tile, data, num_timesteps, num_frequencies, num_elements, j, tile_x_start, tile_y_start, tile_accum, tile_total);
+                cpu_xengine_store_tile(num_elements, j, tile_x_start, tile_y_start, upper_triangle_convention, output_triangle, 0, 0, tile_total, correlated_data);
+            }
+        }
+    }
+
+    free(tile_accum);
+    free(tile_total);
+    return (0);
+}
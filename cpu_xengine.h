@@ -0,0 +1,79 @@
+//cpu_xengine.h
+//blocked (cache-tiled) cpu correlator: gives the same answers as the reference functions in cpu_corr_test.c, just much faster
+#ifndef CPU_XENGINE_H
+#define CPU_XENGINE_H
+
+#include <stdint.h>
+
+#define CPU_XENGINE_TILE_DIM            64 //elements per side of a baseline tile. 64 x 64 x 2 ints = 32 kB of accumulators, which stays in cache
+
+//tile engines. CPU_XENGINE_AUTO times every engine the host supports (once) and picks the fastest
+#define CPU_XENGINE_AUTO                -1
+#define CPU_XENGINE_SCALAR              0
+#define CPU_XENGINE_AVX2                1 //vpmaddubsw + vpmaddwd
+#define CPU_XENGINE_AVX512_VNNI         2 //vpdpbusd
+#define CPU_XENGINE_LUT                 3 //256 x 256 product lookup table
+#define CPU_XENGINE_NUM_ENGINES         4
+
+//accumulation is tiered like the gpu's overflow protection: the engines sum short runs of timesteps in 16 bit lanes and spill
+//them into 32 bit tile accumulators, and cpu_xengine_correlate_tile_total splits the time axis into runs the 32 bit
+//accumulators can hold and sums those in 64 bit
+#define CPU_XENGINE_INT16_TIMESTEPS     255 //products are at most 128 in magnitude, so 255 of them fit a 16 bit lane
+#define CPU_XENGINE_INT32_TIMESTEPS     (1<<23) //with the simd engines' offsets a timestep adds up to 240: 2^23 x 240 < 2^31
+
+typedef void (*cpu_xengine_tile_function)(unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int frequency, int tile_x_start, int tile_y_start, int *tile_accum);
+
+//tile_accum holds CPU_XENGINE_TILE_DIM x CPU_XENGINE_TILE_DIM real values followed by the same number of imaginary values (standard convention)
+void cpu_xengine_correlate_tile(unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int frequency, int tile_x_start, int tile_y_start, int *tile_accum);
+
+//vectorized versions (cpu_xengine_simd.c). Only call these if cpu_xengine_engine_supported says the host can run them
+void cpu_xengine_correlate_tile_avx2(unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int frequency, int tile_x_start, int tile_y_start, int *tile_accum);
+void cpu_xengine_correlate_tile_avx512_vnni(unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int frequency, int tile_x_start, int tile_y_start, int *tile_accum);
+
+//lookup table version (cpu_xengine_lut.c); runs anywhere
+void cpu_xengine_correlate_tile_lut(unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int frequency, int tile_x_start, int tile_y_start, int *tile_accum);
+
+int cpu_xengine_engine_supported(int engine);
+int cpu_xengine_best_available(void); //fastest engine on this host, measured on the first call
+int cpu_xengine_benchmark_engines(int verbose); //times every supported engine on a test tile and returns the fastest
+const char *cpu_xengine_name(int engine);
+cpu_xengine_tile_function cpu_xengine_get_tile_function(int engine); //returns NULL for an unknown or unsupported engine
+
+//runs correlate_tile over the time axis in runs of at most CPU_XENGINE_INT32_TIMESTEPS (tile_accum is its scratch space)
+//and sums them into tile_total, which has the same layout as tile_accum but in 64 bit
+void cpu_xengine_correlate_tile_total(cpu_xengine_tile_function correlate_tile, unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int frequency, int tile_x_start, int tile_y_start,
+                                      int *tile_accum, int64_t *tile_total);
+
+//correlated_data is int64_t when output_int64 is set, int otherwise. int output wraps modulo 2^32, like the gpu's output buffer
+void cpu_xengine_store_tile(int num_elements, int frequency, int tile_x_start, int tile_y_start, int upper_triangle_convention, int output_triangle, int accumulate, int output_int64, int64_t *tile_total, void *correlated_data);
+
+int cpu_xengine_correlate(unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int upper_triangle_convention, int output_triangle, int engine, int *correlated_data);
+
+//cpu_xengine_threads.c: the same, spread over num_threads threads (<= 0 uses every online cpu).
+//With accumulate set the results are added to correlated_data rather than overwriting it
+int cpu_xengine_default_num_threads(void);
+
+int cpu_xengine_correlate_threaded(unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int upper_triangle_convention, int output_triangle, int accumulate, int engine, int num_threads, int verbose, int *correlated_data);
+int cpu_xengine_correlate_threaded_int64(unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int upper_triangle_convention, int output_triangle, int accumulate, int engine, int num_threads, int verbose, int64_t *correlated_data);
+
+//runs the threaded correlator at 1, 2, 4, ... max_threads threads and prints the speedup and parallel efficiency of each.
+//correlated_data gets the upper triangle (standard convention) result
+int cpu_xengine_scaling_report(unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int engine, int max_threads, int *correlated_data);
+
+//cpu_xengine_stream.c: walks the time axis in chunks of chunk_timesteps, asking get_chunk for each one, so only one chunk of
+//input is held at a time. get_chunk fills chunk with num_timesteps x num_frequencies x num_elements bytes starting at
+//timestep first_timestep, and returns 0 on success (anything else aborts the correlation and is returned)
+typedef int (*cpu_xengine_chunk_function)(void *context, int first_timestep, int num_timesteps, int num_frequencies, int num_elements, unsigned char *chunk);
+
+int cpu_xengine_correlate_stream(cpu_xengine_chunk_function get_chunk, void *context, int num_timesteps, int chunk_timesteps, int num_frequencies, int num_elements,
+                                 int upper_triangle_convention, int output_triangle, int engine, int num_threads, int verbose, int *correlated_data);
+
+//cpu_xengine_packed.c: bit-exact emulation of the offsetAccumulateElements, preseed and corr kernels of kernel_batch 0 or 1,
+//packed lanes, offset corrections, overflow protection and all. gpu_output gets what the gpu leaves in its output buffer:
+//num_frequencies x num_blocks blocks of block_dim x block_dim complex values. block_dim and base_accum are the BLOCK_DIM
+//(16, 32 or 64) and BASE_ACCUM the kernels are built with
+#define CPU_XENGINE_PACKED_MAX_BLOCK_DIM    64
+
+int cpu_xengine_emulate_kernels(unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int block_dim, int time_accum, int base_accum, int kernel_batch, int upper_triangle_convention, int num_threads, int *gpu_output);
+
+#endif
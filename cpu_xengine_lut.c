@@ -0,0 +1,76 @@
+// cpu_xengine_lut.c
+// lookup table version of cpu_xengine_correlate_tile. A 4+4 bit complex sample is one byte, so every possible product of an
+// x byte and a y byte fits in a 256 x 256 table. Each entry packs the product as two biased 16 bit values,
+//      (re + CPU_XENGINE_LUT_BIAS) | (im + CPU_XENGINE_LUT_BIAS) << 16
+// so a single 32 bit add accumulates both halves at once. An entry half is at most 2*CPU_XENGINE_LUT_BIAS, so up to
+// CPU_XENGINE_LUT_CHUNK timesteps can be summed before the low half could carry into the high one; the packed sums are then
+// unpacked, the bias removed, and added to the int accumulators.
+// The table holds standard convention products; like the other engines, the convention is applied when the tile is stored.
+#include "cpu_xengine.h"
+#include <stdint.h>
+#include <string.h> // memset
+#include <pthread.h>
+#include "four_bit_macros.h"
+
+#define CPU_XENGINE_LUT_BIAS            128 //products are in [-120, 128], so biased values are in [8, 256]
+#define CPU_XENGINE_LUT_CHUNK           255 //255*256 < 65536: no carry between the 16 bit halves
+
+static uint32_t product_table[256*256]; //[y byte][x byte]
+static pthread_once_t product_table_once = PTHREAD_ONCE_INIT;
+
+static void make_product_table(void){
+    for (int y_byte = 0; y_byte < 256; y_byte++){
+        int element_y_re = (int)(HI_NIBBLE(y_byte)) - 8;
+        int element_y_im = (int)(LO_NIBBLE(y_byte)) - 8;
+        for (int x_byte = 0; x_byte < 256; x_byte++){
+            int element_x_re = (int)(HI_NIBBLE(x_byte)) - 8;
+            int element_x_im = (int)(LO_NIBBLE(x_byte)) - 8;
+            int product_re = element_x_re*element_y_re + element_x_im*element_y_im;
+            int product_im = element_x_re*element_y_im - element_x_im*element_y_re;
+            product_table[y_byte*256 + x_byte] = (uint32_t)(product_re + CPU_XENGINE_LUT_BIAS) | ((uint32_t)(product_im + CPU_XENGINE_LUT_BIAS) << 16);
+        }
+    }
+    return;
+}
+
+void cpu_xengine_correlate_tile_lut(unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int frequency, int tile_x_start, int tile_y_start, int *tile_accum){
+    uint32_t packed_accum[CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM];
+    int x_width = num_elements - tile_x_start;
+    int y_width = num_elements - tile_y_start;
+    if (x_width > CPU_XENGINE_TILE_DIM)
+        x_width = CPU_XENGINE_TILE_DIM;
+    if (y_width > CPU_XENGINE_TILE_DIM)
+        y_width = CPU_XENGINE_TILE_DIM;
+
+    pthread_once(&product_table_once, make_product_table);
+    int *accum_re = tile_accum;
+    int *accum_im = tile_accum + CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM;
+    memset(tile_accum, 0, CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM*2*sizeof(int));
+
+    for (int chunk_start = 0; chunk_start < num_timesteps; chunk_start += CPU_XENGINE_LUT_CHUNK){
+        int chunk_end = chunk_start + CPU_XENGINE_LUT_CHUNK;
+        if (chunk_end > num_timesteps)
+            chunk_end = num_timesteps;
+        memset(packed_accum, 0, sizeof(packed_accum));
+
+        for (int k = chunk_start; k < chunk_end; k++){
+            unsigned char *timestep_data = data + ((size_t)k*num_frequencies + frequency)*num_elements;
+            unsigned char *x_bytes = timestep_data + tile_x_start;
+            for (int y_local = 0; y_local < y_width; y_local++){
+                uint32_t *table_row = product_table + timestep_data[tile_y_start + y_local]*256;
+                uint32_t *row = packed_accum + y_local*CPU_XENGINE_TILE_DIM;
+                int x_first = (tile_x_start == tile_y_start) ? y_local : 0;
+                for (int x_local = x_first; x_local < x_width; x_local++)
+                    row[x_local] += table_row[x_bytes[x_local]];
+            }
+        }
+
+        //remove the bias from the packed sums
+        uint32_t bias = (uint32_t)(chunk_end - chunk_start)*CPU_XENGINE_LUT_BIAS;
+        for (int i = 0; i < CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM; i++){
+            accum_re[i] += (int)(packed_accum[i] & 0xFFFF) - (int)bias;
+            accum_im[i] += (int)(packed_accum[i] >> 16) - (int)bias;
+        }
+    }
+    return;
+}
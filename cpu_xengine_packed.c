@@ -0,0 +1,411 @@
+// cpu_xengine_packed.c
+// bit-exact cpu emulation of the packed gpu kernels: offsetAccumulateElements (offset_accumulator.cl), then preseed and corr
+// from kernel batch 0 (pairwise_correlator*.cl, preseed_multifreq*.cl) or batch 1 (packed_correlator_overflow_protected_to_2272_iter*.cl,
+// preseed_multifreq_highly_packed_correlator_method*.cl). The output is the gpu block layout, holding exactly what the gpu
+// leaves there (lane overflows and all), so it can go through the same reorganize and compare path as the real gpu output.
+// When num_elements isn't a multiple of block_dim, the last block column and row are edge tiles: elements
+// past the end read as 0x88 (0 + 0i) and have sums of 0, as in the kernels' masked loads. The kernels don't write the groups
+// of 4 entirely past the end, so those (unused) values are the only ones that can differ from the gpu's.
+//
+// The kernels keep two 16 bit lanes in each 32 bit accumulator. Here two of those 32 bit accumulators (one x against two
+// neighbouring y elements) share a 64 bit word, and every multiply is a 4 bit value times a packed word, so a product never
+// crosses a 32 bit lane. The words are unpacked to 32 bits, which is where the gpu's mod 2^32 wrap is applied, before a lane
+// could carry into the next one:
+//   batch 0: every CPU_XENGINE_PACKED_BATCH0_FLUSH timesteps (a lane gains at most 15*(15*65536+15) per timestep)
+//   batch 1: every CPU_XENGINE_PACKED_OVERFLOW_CHECK timesteps (112 with 64 x 64 blocks, whose LOCAL_SIZE is 16), where the
+//            kernel checks its overflow bits and masks its accumulators anyway (a masked lane plus 120 timesteps stays below 2^32)
+#include "cpu_xengine.h"
+#include <stdio.h> // printf
+#include <stdlib.h> // malloc, etc.
+#include <string.h> // memset
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h> // sysconf
+#include "four_bit_macros.h"
+
+#define CPU_XENGINE_PACKED_MAX_PAIRS        (CPU_XENGINE_PACKED_MAX_BLOCK_DIM/2)
+#define CPU_XENGINE_PACKED_BATCH0_FLUSH     256u //256*15*(15*65536+15) < 2^32
+#define CPU_XENGINE_PACKED_OVERFLOW_CHECK   120u //extra_counter limit in packed_correlator_overflow_protected_to_2272_iter*.cl, before
+                                                 //rounding down to whole LOCAL_SIZE groups
+
+typedef struct {
+    int kernel_batch;
+    int upper_triangle_convention;
+    int num_timesteps;
+    int num_frequencies;
+    int num_elements;
+    int block_dim; //BLOCK_DIM in the kernels; LOCAL_SIZE, the timesteps stepped through at a time, is a quarter of it
+    int time_accum;
+    int num_blocks;
+    int first_item; //items are (frequency, block) pairs, numbered frequency*num_blocks + block_ID, as in the gpu output
+    int last_item;
+    unsigned char *data;
+    uint32_t *offset_sums;
+    int *block_x_map;
+    int *block_y_map;
+    int *gpu_output;
+} cpu_xengine_packed_args;
+
+static void accumulate_offsets(unsigned char *data, int num_timesteps, int base_accum, int num_frequencies, int num_elements, uint32_t *offset_sums){
+    //offsetAccumulateElements: sums of the offset-encoded real and imaginary parts of every element. The kernel sums
+    //num_timesteps/base_accum chunks, so any timesteps after the last full chunk are left out
+    size_t row_length = (size_t)num_frequencies*num_elements;
+    int num_summed = (num_timesteps/base_accum)*base_accum;
+    memset(offset_sums, 0, row_length*2*sizeof(uint32_t));
+    for (int t = 0; t < num_summed; t++){
+        unsigned char *row = data + (size_t)t*row_length;
+        for (size_t e = 0; e < row_length; e++){
+            offset_sums[e*2  ] += HI_NIBBLE(row[e]);
+            offset_sums[e*2+1] += LO_NIBBLE(row[e]);
+        }
+    }
+    return;
+}
+
+static void load_block_elements(unsigned char *row, int num_elements, int block_dim, int block, unsigned char *elements){
+    //one block's worth of a timestep row, masked like the kernels' loads in edge tiles
+    int first = block*block_dim;
+    for (int i = 0; i < block_dim; i++)
+        elements[i] = (first + i < num_elements) ? row[first + i] : 0x88;
+    return;
+}
+
+static void preseed_block(cpu_xengine_packed_args *args, int frequency, int block_x, int block_y, uint32_t *block_out){
+    //preseed_multifreq*.cl (batch 0) or preseed_multifreq_highly_packed_correlator_method*.cl (batch 1). The kernels mix int and
+    //uint; everything here is done mod 2^32, which gives the same bits
+    uint32_t time_offset = (uint32_t)args->num_timesteps*128u; //NUM_TIMESAMPLES_x_128
+    int block_dim = args->block_dim;
+    uint32_t *x_sums = args->offset_sums + ((size_t)frequency*args->num_elements + block_x*block_dim)*2;
+    uint32_t *y_sums = args->offset_sums + ((size_t)frequency*args->num_elements + block_y*block_dim)*2;
+    int x_in_range = args->num_elements - block_x*block_dim; //elements of the block that exist (edge tiles have fewer)
+    int y_in_range = args->num_elements - block_y*block_dim;
+    int ut = args->upper_triangle_convention;
+
+    for (int y = 0; y < block_dim; y++){
+        uint32_t y_re = (y < y_in_range) ? y_sums[y*2] : 0u;
+        uint32_t y_im = (y < y_in_range) ? y_sums[y*2+1] : 0u;
+        for (int x = 0; x < block_dim; x++){
+            uint32_t x_re = (x < x_in_range) ? x_sums[x*2] : 0u;
+            uint32_t x_im = (x < x_in_range) ? x_sums[x*2+1] : 0u;
+            uint32_t value_re, value_im;
+            if (args->kernel_batch == 0){
+                uint32_t x_pair_1 = ut ? x_im - x_re : x_re - x_im;
+                uint32_t y_pair_1 = ut ? y_re - y_im : y_im - y_re;
+                value_re = time_offset - 8u*((x_re + x_im) + (y_re + y_im));
+                value_im = 8u*(x_pair_1 + y_pair_1);
+            }
+            else{
+                uint32_t x_offset_1 = ut ? 8u*x_im + 7u*x_re : 0u - 8u*x_im - 7u*x_re;
+                uint32_t y_offset_1 = ut ? 8u*(y_re - y_im) : 0u - 8u*(y_re - y_im);
+                value_re = time_offset + (7u*x_im - 8u*x_re) + (0u - 8u*(y_re + y_im));
+                value_im = x_offset_1 + y_offset_1;
+            }
+            block_out[(y*block_dim + x)*2  ] = value_re;
+            block_out[(y*block_dim + x)*2+1] = value_im;
+        }
+    }
+    return;
+}
+
+static void correlate_block_batch0(cpu_xengine_packed_args *args, int frequency, int block_x, int block_y, uint32_t *block_out){
+    //pairwise_correlator*.cl: corr_?0 += x_re * (y_re<<16 | y_im) and corr_?1 += x_im * (y_re<<16 | y_im).
+    //packed_?[x][p] holds those for y elements 2p (low 32 bits) and 2p+1 (high 32 bits)
+    uint64_t packed_0[CPU_XENGINE_PACKED_MAX_BLOCK_DIM][CPU_XENGINE_PACKED_MAX_PAIRS];
+    uint64_t packed_1[CPU_XENGINE_PACKED_MAX_BLOCK_DIM][CPU_XENGINE_PACKED_MAX_PAIRS];
+    uint32_t corr_0[CPU_XENGINE_PACKED_MAX_BLOCK_DIM][CPU_XENGINE_PACKED_MAX_BLOCK_DIM]; //[y][x], the kernel's 32 bit accumulators
+    uint32_t corr_1[CPU_XENGINE_PACKED_MAX_BLOCK_DIM][CPU_XENGINE_PACKED_MAX_BLOCK_DIM];
+    uint64_t y_packed[CPU_XENGINE_PACKED_MAX_PAIRS];
+    unsigned char x_bytes[CPU_XENGINE_PACKED_MAX_BLOCK_DIM];
+    unsigned char y_bytes[CPU_XENGINE_PACKED_MAX_BLOCK_DIM];
+    size_t row_length = (size_t)args->num_frequencies*args->num_elements;
+    int block_dim = args->block_dim;
+    int pairs = block_dim/2;
+    int local_size = block_dim/4;
+    int steps_per_chunk = ((args->time_accum + local_size - 1)/local_size)*local_size;
+    int num_chunks = args->num_timesteps/args->time_accum;
+
+    for (int chunk = 0; chunk < num_chunks; chunk++){
+        memset(packed_0, 0, sizeof(packed_0));
+        memset(packed_1, 0, sizeof(packed_1));
+        memset(corr_0, 0, sizeof(corr_0));
+        memset(corr_1, 0, sizeof(corr_1));
+        for (int step = 0; step < steps_per_chunk; step++){
+            unsigned char *row = args->data + ((size_t)chunk*args->time_accum + step)*row_length + (size_t)frequency*args->num_elements;
+            load_block_elements(row, args->num_elements, block_dim, block_x, x_bytes);
+            load_block_elements(row, args->num_elements, block_dim, block_y, y_bytes);
+            for (int p = 0; p < pairs; p++){
+                uint64_t y0 = ((uint64_t)HI_NIBBLE(y_bytes[2*p  ]) << 16) | LO_NIBBLE(y_bytes[2*p  ]);
+                uint64_t y1 = ((uint64_t)HI_NIBBLE(y_bytes[2*p+1]) << 16) | LO_NIBBLE(y_bytes[2*p+1]);
+                y_packed[p] = y0 | (y1 << 32);
+            }
+            for (int x = 0; x < block_dim; x++){
+                uint64_t x_re = HI_NIBBLE(x_bytes[x]);
+                uint64_t x_im = LO_NIBBLE(x_bytes[x]);
+                for (int p = 0; p < pairs; p++){
+                    packed_0[x][p] += x_re*y_packed[p];
+                    packed_1[x][p] += x_im*y_packed[p];
+                }
+            }
+            if ((step + 1) % CPU_XENGINE_PACKED_BATCH0_FLUSH == 0 || step + 1 == steps_per_chunk){
+                for (int x = 0; x < block_dim; x++){
+                    for (int p = 0; p < pairs; p++){
+                        corr_0[2*p  ][x] += (uint32_t)packed_0[x][p];
+                        corr_0[2*p+1][x] += (uint32_t)(packed_0[x][p] >> 32);
+                        corr_1[2*p  ][x] += (uint32_t)packed_1[x][p];
+                        corr_1[2*p+1][x] += (uint32_t)(packed_1[x][p] >> 32);
+                        packed_0[x][p] = 0;
+                        packed_1[x][p] = 0;
+                    }
+                }
+            }
+        }
+        //the kernel's corr_buf update, once per time_accum chunk
+        for (int y = 0; y < block_dim; y++){
+            for (int x = 0; x < block_dim; x++){
+                uint32_t c0 = corr_0[y][x];
+                uint32_t c1 = corr_1[y][x];
+                block_out[(y*block_dim + x)*2  ] += (c0 >> 16) + (c1 & 0xffff);
+                if (args->upper_triangle_convention)
+                    block_out[(y*block_dim + x)*2+1] += (c0 & 0xffff) - (c1 >> 16);
+                else
+                    block_out[(y*block_dim + x)*2+1] += (c1 >> 16) - (c0 & 0xffff);
+            }
+        }
+    }
+    return;
+}
+
+static void correlate_block_batch1(cpu_xengine_packed_args *args, int block_x, int block_y, uint32_t *block_out){
+    //packed_correlator_overflow_protected_to_2272_iter*.cl. For x elements x0 = 2q, x1 = 2q+1 against y (with its imaginary part
+    //flipped to 15 - y_im):
+    //  corr_?0 += (x0_re<<16 | x0_im) * (y_re<<16 | y_im), corr_?1 the same for x1  (mod 2^32, so x_re*y_re drops out)
+    //  corr_?2 += (x0_re<<16 | x1_re) * y_re
+    //The first two are split as x_re*(y_im<<16) + x_im*(y_re<<16 | y_im) so that each multiply is by a 4 bit value.
+    //packed_?[q][p] holds them for y elements 2p (low 32 bits) and 2p+1 (high 32 bits); overflow[y][q] is the kernel's overflow_?
+    uint64_t packed_0[CPU_XENGINE_PACKED_MAX_PAIRS][CPU_XENGINE_PACKED_MAX_PAIRS];
+    uint64_t packed_1[CPU_XENGINE_PACKED_MAX_PAIRS][CPU_XENGINE_PACKED_MAX_PAIRS];
+    uint64_t packed_2[CPU_XENGINE_PACKED_MAX_PAIRS][CPU_XENGINE_PACKED_MAX_PAIRS];
+    uint32_t overflow[CPU_XENGINE_PACKED_MAX_BLOCK_DIM][CPU_XENGINE_PACKED_MAX_PAIRS];
+    uint64_t y_im_shifted[CPU_XENGINE_PACKED_MAX_PAIRS];
+    uint64_t y_packed[CPU_XENGINE_PACKED_MAX_PAIRS];
+    uint64_t y_re[CPU_XENGINE_PACKED_MAX_PAIRS];
+    unsigned char x_bytes[CPU_XENGINE_PACKED_MAX_BLOCK_DIM];
+    unsigned char y_bytes[CPU_XENGINE_PACKED_MAX_BLOCK_DIM];
+    //like the kernel, this ignores the frequency: timestep rows are num_elements apart
+    size_t row_length = (size_t)args->num_elements;
+    int block_dim = args->block_dim;
+    int pairs = block_dim/2;
+    int local_size = block_dim/4;
+    int steps_per_chunk = ((args->time_accum + local_size - 1)/local_size)*local_size;
+    int overflow_check = (CPU_XENGINE_PACKED_OVERFLOW_CHECK/local_size)*local_size; //OVERFLOW_CHECK_ITERATIONS
+    int num_chunks = args->num_timesteps/args->time_accum;
+
+    for (int chunk = 0; chunk < num_chunks; chunk++){
+        memset(packed_0, 0, sizeof(packed_0));
+        memset(packed_1, 0, sizeof(packed_1));
+        memset(packed_2, 0, sizeof(packed_2));
+        memset(overflow, 0, sizeof(overflow));
+        for (int step = 0; step < steps_per_chunk; step++){
+            unsigned char *row = args->data + ((size_t)chunk*args->time_accum + step)*row_length;
+            load_block_elements(row, args->num_elements, block_dim, block_x, x_bytes);
+            load_block_elements(row, args->num_elements, block_dim, block_y, y_bytes);
+            for (int p = 0; p < pairs; p++){
+                uint64_t y0_re = HI_NIBBLE(y_bytes[2*p  ]);
+                uint64_t y1_re = HI_NIBBLE(y_bytes[2*p+1]);
+                uint64_t y0_im = 15u - LO_NIBBLE(y_bytes[2*p  ]);
+                uint64_t y1_im = 15u - LO_NIBBLE(y_bytes[2*p+1]);
+                y_im_shifted[p] = (y0_im << 16) | (y1_im << 48);
+                y_packed[p] = ((y0_re << 16) | y0_im) | (((y1_re << 16) | y1_im) << 32);
+                y_re[p] = y0_re | (y1_re << 32);
+            }
+            for (int q = 0; q < pairs; q++){
+                uint64_t x0_re = HI_NIBBLE(x_bytes[2*q  ]);
+                uint64_t x0_im = LO_NIBBLE(x_bytes[2*q  ]);
+                uint64_t x1_re = HI_NIBBLE(x_bytes[2*q+1]);
+                uint64_t x1_im = LO_NIBBLE(x_bytes[2*q+1]);
+                uint64_t both_re = (x0_re << 16) | x1_re;
+                for (int p = 0; p < pairs; p++){
+                    packed_0[q][p] += x0_re*y_im_shifted[p] + x0_im*y_packed[p];
+                    packed_1[q][p] += x1_re*y_im_shifted[p] + x1_im*y_packed[p];
+                    packed_2[q][p] += both_re*y_re[p];
+                }
+            }
+            if ((step + 1) % overflow_check == 0){
+                //the kernel's overflow protection: count the top bits of each lane, then clear them
+                for (int q = 0; q < pairs; q++){
+                    for (int p = 0; p < pairs; p++){
+                        uint64_t masked_0 = 0, masked_1 = 0, masked_2 = 0;
+                        for (int lane = 0; lane < 2; lane++){
+                            uint32_t c0 = (uint32_t)(packed_0[q][p] >> (32*lane));
+                            uint32_t c1 = (uint32_t)(packed_1[q][p] >> (32*lane));
+                            uint32_t c2 = (uint32_t)(packed_2[q][p] >> (32*lane));
+                            overflow[2*p + lane][q] += (((c0 & 0xE0000000) >> 5)  | ((c0 & 0x00008000) << 5)
+                                                      | ((c1 & 0xE0000000) >> 21) | ((c1 & 0x00008000) >> 11)
+                                                      | ((c2 & 0x80008000) >> 15));
+                            masked_0 |= (uint64_t)(c0 & 0x1FFF7FFF) << (32*lane);
+                            masked_1 |= (uint64_t)(c1 & 0x1FFF7FFF) << (32*lane);
+                            masked_2 |= (uint64_t)(c2 & 0x7FFF7FFF) << (32*lane);
+                        }
+                        packed_0[q][p] = masked_0;
+                        packed_1[q][p] = masked_1;
+                        packed_2[q][p] = masked_2;
+                    }
+                }
+            }
+        }
+        //the kernel's corr_buf update, once per time_accum chunk
+        for (int q = 0; q < pairs; q++){
+            for (int p = 0; p < pairs; p++){
+                for (int lane = 0; lane < 2; lane++){
+                    int y = 2*p + lane;
+                    uint32_t c0 = (uint32_t)(packed_0[q][p] >> (32*lane));
+                    uint32_t c1 = (uint32_t)(packed_1[q][p] >> (32*lane));
+                    uint32_t c2 = (uint32_t)(packed_2[q][p] >> (32*lane));
+                    uint32_t ovf = overflow[y][q];
+                    uint32_t *out_0 = block_out + (y*block_dim + 2*q)*2;
+                    uint32_t *out_1 = out_0 + 2;
+                    uint32_t im_0 = ((c0 >> 16) & 0xffff) + ((ovf & 0xFF000000) >> 11);
+                    uint32_t im_1 = ((c1 >> 16) & 0xffff) + ((ovf & 0x0000FF00) <<  5);
+                    out_0[0] += (((c2 >> 16) & 0xffff) + ((ovf & 0x000F0000) >> 1))  - ((c0 & 0xFFFF) + ((ovf & 0x00F00000) >> 5));
+                    out_1[0] += ((c2 & 0xffff)         + ((ovf & 0x0000000F) << 15)) - ((c1 & 0xFFFF) + ((ovf & 0x000000F0) << 11));
+                    if (args->upper_triangle_convention){
+                        out_0[1] -= im_0;
+                        out_1[1] -= im_1;
+                    }
+                    else{
+                        out_0[1] += im_0;
+                        out_1[1] += im_1;
+                    }
+                }
+            }
+        }
+    }
+    return;
+}
+
+static void *emulate_kernels_thread(void *arg){
+    cpu_xengine_packed_args *args = (cpu_xengine_packed_args *)arg;
+    uint32_t correction[CPU_XENGINE_PACKED_MAX_BLOCK_DIM*CPU_XENGINE_PACKED_MAX_BLOCK_DIM*2];
+    size_t block_size = (size_t)args->block_dim*args->block_dim*2;
+    for (int item = args->first_item; item < args->last_item; item++){
+        int frequency = item/args->num_blocks;
+        int block_ID = item%args->num_blocks;
+        int block_x = args->block_x_map[block_ID];
+        int block_y = args->block_y_map[block_ID];
+        //unsigned, so the wrap-around matches the gpu's; the bits are the same as the int the gpu stores
+        uint32_t *block_out = (uint32_t *)(args->gpu_output + (size_t)item*block_size);
+
+        preseed_block(args, frequency, block_x, block_y, block_out);
+        if (args->kernel_batch == 0)
+            correlate_block_batch0(args, frequency, block_x, block_y, block_out);
+        else if (frequency == 0){
+            //batch 1 doesn't index the frequency: every frequency band's work group correlates the same rows and adds
+            //the result to the frequency 0 blocks
+            memset(correction, 0, block_size*sizeof(uint32_t));
+            correlate_block_batch1(args, block_x, block_y, correction);
+            for (size_t i = 0; i < block_size; i++)
+                block_out[i] += (uint32_t)args->num_frequencies*correction[i];
+        }
+    }
+    return NULL;
+}
+
+int cpu_xengine_emulate_kernels(unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int block_dim, int time_accum, int base_accum, int kernel_batch, int upper_triangle_convention, int num_threads, int *gpu_output){
+    if (kernel_batch < 0 || kernel_batch > 1){
+        printf ("Error: cpu_xengine_emulate_kernels: no kernel batch %d\n", kernel_batch);
+        return (-1);
+    }
+    if (num_elements <= 0 || time_accum <= 0 || base_accum <= 0){
+        printf ("Error: cpu_xengine_emulate_kernels: num_elements, time_accum and base_accum must be positive\n");
+        return (-1);
+    }
+    if (block_dim != 16 && block_dim != 32 && block_dim != 64){
+        printf ("Error: cpu_xengine_emulate_kernels: no kernels with a block_dim of %d (16, 32 or 64)\n", block_dim);
+        return (-1);
+    }
+    //the kernels round each chunk up to a whole LOCAL_SIZE group of timesteps, reading into the next chunk. In the last chunk
+    //that would read past the input, which has no defined result to emulate
+    int local_size = block_dim/4;
+    int steps_per_chunk = ((time_accum + local_size - 1)/local_size)*local_size;
+    long rows_available = (kernel_batch == 0) ? num_timesteps : (long)num_timesteps*num_frequencies;
+    if ((long)(num_timesteps/time_accum - 1)*time_accum + steps_per_chunk > rows_available){
+        printf ("Error: cpu_xengine_emulate_kernels: with time_accum %d the kernels read past the end of the input\n", time_accum);
+        return (-1);
+    }
+
+    int num_blocks_side = (num_elements + block_dim - 1)/block_dim; //the last may be an edge tile
+    int num_blocks = (num_blocks_side*(num_blocks_side+1))/2;
+    int num_items = num_frequencies*num_blocks;
+    if (num_threads <= 0)
+        num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_threads > num_items)
+        num_threads = num_items;
+    if (num_threads < 1)
+        num_threads = 1;
+
+    uint32_t *offset_sums = (uint32_t *)malloc((size_t)num_frequencies*num_elements*2*sizeof(uint32_t));
+    int *block_x_map = (int *)malloc(num_blocks*sizeof(int));
+    int *block_y_map = (int *)malloc(num_blocks*sizeof(int));
+    cpu_xengine_packed_args *args = (cpu_xengine_packed_args *)malloc(num_threads*sizeof(cpu_xengine_packed_args));
+    pthread_t *threads = (pthread_t *)malloc(num_threads*sizeof(pthread_t));
+    int *started = (int *)calloc(num_threads, sizeof(int));
+    if (offset_sums == NULL || block_x_map == NULL || block_y_map == NULL || args == NULL || threads == NULL || started == NULL){
+        printf ("Error allocating memory: cpu_xengine_emulate_kernels\n");
+        free(offset_sums);
+        free(block_x_map);
+        free(block_y_map);
+        free(args);
+        free(threads);
+        free(started);
+        return (-1);
+    }
+
+    //same block numbering as the id_x_map/id_y_map the kernels are given
+    int block_ID = 0;
+    for (int j = 0; j < num_blocks_side; j++){
+        for (int i = j; i < num_blocks_side; i++){
+            block_x_map[block_ID] = i;
+            block_y_map[block_ID] = j;
+            block_ID++;
+        }
+    }
+
+    accumulate_offsets(data, num_timesteps, base_accum, num_frequencies, num_elements, offset_sums);
+
+    for (int i = 0; i < num_threads; i++){
+        args[i].kernel_batch = kernel_batch;
+        args[i].upper_triangle_convention = upper_triangle_convention;
+        args[i].num_timesteps = num_timesteps;
+        args[i].num_frequencies = num_frequencies;
+        args[i].num_elements = num_elements;
+        args[i].block_dim = block_dim;
+        args[i].time_accum = time_accum;
+        args[i].num_blocks = num_blocks;
+        args[i].first_item = (int)(((long)num_items*i)/num_threads);
+        args[i].last_item = (int)(((long)num_items*(i+1))/num_threads);
+        args[i].data = data;
+        args[i].offset_sums = offset_sums;
+        args[i].block_x_map = block_x_map;
+        args[i].block_y_map = block_y_map;
+        args[i].gpu_output = gpu_output;
+    }
+    //thread 0 is the calling thread; a thread that can't be started has its share done here instead
+    for (int i = 1; i < num_threads; i++){
+        started[i] = (pthread_create(&threads[i], NULL, emulate_kernels_thread, &args[i]) == 0);
+        if (!started[i])
+            emulate_kernels_thread(&args[i]);
+    }
+    emulate_kernels_thread(&args[0]);
+    for (int i = 1; i < num_threads; i++){
+        if (started[i])
+            pthread_join(threads[i], NULL);
+    }
+
+    free(offset_sums);
+    free(block_x_map);
+    free(block_y_map);
+    free(args);
+    free(threads);
+    free(started);
+    return (0);
+}
@@ -0,0 +1,323 @@
+// cpu_xengine_simd.c
+// vectorized versions of cpu_xengine_correlate_tile, using integer dot-product instructions.
+//
+// Two consecutive timesteps of one element are expanded into a 4 B word: for the x element the offset-encoded (unsigned, 0-15)
+// values [Re_t, Im_t, Re_t+1, Im_t+1], and for the y element the signed values [Re_t, Im_t, Re_t+1, Im_t+1] (for the real part
+// of the product) and [Im_t, -Re_t, Im_t+1, -Re_t+1] (for the imaginary part). A u8 x s8 dot product over the 4 B word
+// (vpdpbusd, or vpmaddubsw + vpmaddwd on AVX2) then gives the sum over both timesteps of
+//      (x_re+8)*y_re + (x_im+8)*y_im  and  (x_re+8)*y_im - (x_im+8)*y_re
+// which is the wanted product plus 8*(y_re+y_im) (resp. 8*(y_im-y_re)). That offset only depends on y, so it is summed
+// separately and removed at the end--the same offset-binary trick the gpu kernels use with the preseed kernel.
+// The AVX2 engine keeps 16 bit sums within a chunk of timesteps and widens them to 32 bit at the end of the chunk. All sums
+// are exact (up to CPU_XENGINE_INT32_TIMESTEPS timesteps per call), so results match the scalar engine bit for bit.
+#include "cpu_xengine.h"
+#include <string.h> // memset, memcpy
+#include <immintrin.h>
+#include "four_bit_macros.h"
+
+#define SIMD_TIME_CHUNK                 128 //timesteps expanded at a time (64 timestep pairs)
+#define SIMD_PAIRS_PER_CHUNK            (SIMD_TIME_CHUNK/2)
+
+//expands one timestep pair of a tile's worth of elements. x_buf gets the unsigned x words, y_re_buf and y_im_buf the signed y words.
+//row_1 == NULL means the second timestep is past the end of the data: its x values are zeroed so it adds nothing.
+__attribute__((target("avx2")))
+static void expand_timestep_pair(unsigned char *row_0, unsigned char *row_1, int width, unsigned char *x_buf, unsigned char *y_re_buf, unsigned char *y_im_buf){
+    unsigned char padded_0[CPU_XENGINE_TILE_DIM] __attribute__((aligned(16)));
+    unsigned char padded_1[CPU_XENGINE_TILE_DIM] __attribute__((aligned(16)));
+    const __m128i low_mask = _mm_set1_epi8(0x0F);
+    const __m128i signed_lut = _mm_setr_epi8(-8,-7,-6,-5,-4,-3,-2,-1,0,1,2,3,4,5,6,7);  //offset encoded nibble -> signed value
+    const __m128i negated_lut = _mm_setr_epi8(8,7,6,5,4,3,2,1,0,-1,-2,-3,-4,-5,-6,-7); //offset encoded nibble -> negated signed value
+
+    //edge tiles and the last timestep are copied so that the vector loads never leave the data set
+    if (width < CPU_XENGINE_TILE_DIM){
+        memset(padded_0, 0, CPU_XENGINE_TILE_DIM);
+        memcpy(padded_0, row_0, width);
+        row_0 = padded_0;
+    }
+    if (row_1 == NULL || width < CPU_XENGINE_TILE_DIM){
+        memset(padded_1, 0, CPU_XENGINE_TILE_DIM);
+        if (row_1 != NULL)
+            memcpy(padded_1, row_1, width);
+        row_1 = padded_1;
+    }
+
+    for (int i = 0; i < CPU_XENGINE_TILE_DIM; i += 16){
+        __m128i raw_0 = _mm_loadu_si128((__m128i *)(row_0 + i));
+        __m128i raw_1 = _mm_loadu_si128((__m128i *)(row_1 + i));
+        __m128i re_0 = _mm_and_si128(_mm_srli_epi16(raw_0, 4), low_mask);
+        __m128i im_0 = _mm_and_si128(raw_0, low_mask);
+        __m128i re_1 = _mm_and_si128(_mm_srli_epi16(raw_1, 4), low_mask);
+        __m128i im_1 = _mm_and_si128(raw_1, low_mask);
+
+        //x: offset encoded values as they are
+        __m128i pair_0_lo = _mm_unpacklo_epi8(re_0, im_0);
+        __m128i pair_0_hi = _mm_unpackhi_epi8(re_0, im_0);
+        __m128i pair_1_lo = _mm_unpacklo_epi8(re_1, im_1);
+        __m128i pair_1_hi = _mm_unpackhi_epi8(re_1, im_1);
+        _mm_storeu_si128((__m128i *)(x_buf + i*4     ), _mm_unpacklo_epi16(pair_0_lo, pair_1_lo));
+        _mm_storeu_si128((__m128i *)(x_buf + i*4 + 16), _mm_unpackhi_epi16(pair_0_lo, pair_1_lo));
+        _mm_storeu_si128((__m128i *)(x_buf + i*4 + 32), _mm_unpacklo_epi16(pair_0_hi, pair_1_hi));
+        _mm_storeu_si128((__m128i *)(x_buf + i*4 + 48), _mm_unpackhi_epi16(pair_0_hi, pair_1_hi));
+
+        //y: signed values through the lookup tables
+        __m128i s_re_0 = _mm_shuffle_epi8(signed_lut, re_0);
+        __m128i s_im_0 = _mm_shuffle_epi8(signed_lut, im_0);
+        __m128i s_re_1 = _mm_shuffle_epi8(signed_lut, re_1);
+        __m128i s_im_1 = _mm_shuffle_epi8(signed_lut, im_1);
+        __m128i n_re_0 = _mm_shuffle_epi8(negated_lut, re_0);
+        __m128i n_re_1 = _mm_shuffle_epi8(negated_lut, re_1);
+
+        pair_0_lo = _mm_unpacklo_epi8(s_re_0, s_im_0);
+        pair_0_hi = _mm_unpackhi_epi8(s_re_0, s_im_0);
+        pair_1_lo = _mm_unpacklo_epi8(s_re_1, s_im_1);
+        pair_1_hi = _mm_unpackhi_epi8(s_re_1, s_im_1);
+        _mm_storeu_si128((__m128i *)(y_re_buf + i*4     ), _mm_unpacklo_epi16(pair_0_lo, pair_1_lo));
+        _mm_storeu_si128((__m128i *)(y_re_buf + i*4 + 16), _mm_unpackhi_epi16(pair_0_lo, pair_1_lo));
+        _mm_storeu_si128((__m128i *)(y_re_buf + i*4 + 32), _mm_unpacklo_epi16(pair_0_hi, pair_1_hi));
+        _mm_storeu_si128((__m128i *)(y_re_buf + i*4 + 48), _mm_unpackhi_epi16(pair_0_hi, pair_1_hi));
+
+        pair_0_lo = _mm_unpacklo_epi8(s_im_0, n_re_0);
+        pair_0_hi = _mm_unpackhi_epi8(s_im_0, n_re_0);
+        pair_1_lo = _mm_unpacklo_epi8(s_im_1, n_re_1);
+        pair_1_hi = _mm_unpackhi_epi8(s_im_1, n_re_1);
+        _mm_storeu_si128((__m128i *)(y_im_buf + i*4     ), _mm_unpacklo_epi16(pair_0_lo, pair_1_lo));
+        _mm_storeu_si128((__m128i *)(y_im_buf + i*4 + 16), _mm_unpackhi_epi16(pair_0_lo, pair_1_lo));
+        _mm_storeu_si128((__m128i *)(y_im_buf + i*4 + 32), _mm_unpacklo_epi16(pair_0_hi, pair_1_hi));
+        _mm_storeu_si128((__m128i *)(y_im_buf + i*4 + 48), _mm_unpackhi_epi16(pair_0_hi, pair_1_hi));
+    }
+    return;
+}
+
+//expands a chunk of timesteps for the x and y elements of a tile and adds the y offset corrections for those timesteps into
+//offset_re/offset_im. The buffers are laid out [timestep pair][element] with 4 B per entry.
+__attribute__((target("avx2")))
+static void expand_chunk(unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int frequency, int chunk_start, int tile_x_start, int tile_y_start,
+                         unsigned char *x_buf, unsigned char *y_re_buf, unsigned char *y_im_buf, int *offset_re, int *offset_im){
+    unsigned char unused_x[CPU_XENGINE_TILE_DIM*4] __attribute__((aligned(16)));
+    unsigned char unused_y[CPU_XENGINE_TILE_DIM*4] __attribute__((aligned(16)));
+    int x_width = num_elements - tile_x_start;
+    int y_width = num_elements - tile_y_start;
+    if (x_width > CPU_XENGINE_TILE_DIM)
+        x_width = CPU_XENGINE_TILE_DIM;
+    if (y_width > CPU_XENGINE_TILE_DIM)
+        y_width = CPU_XENGINE_TILE_DIM;
+
+    for (int pair = 0; pair < SIMD_PAIRS_PER_CHUNK; pair++){
+        int k = chunk_start + 2*pair;
+        unsigned char *x_pair = x_buf + pair*CPU_XENGINE_TILE_DIM*4;
+        unsigned char *y_re_pair = y_re_buf + pair*CPU_XENGINE_TILE_DIM*4;
+        unsigned char *y_im_pair = y_im_buf + pair*CPU_XENGINE_TILE_DIM*4;
+        if (k >= num_timesteps){ //past the end of the data: nothing to add
+            memset(x_pair, 0, CPU_XENGINE_TILE_DIM*4);
+            continue;
+        }
+        unsigned char *timestep_0 = data + ((size_t)k*num_frequencies + frequency)*num_elements;
+        unsigned char *timestep_1 = (k+1 < num_timesteps) ? timestep_0 + (size_t)num_frequencies*num_elements : NULL;
+
+        expand_timestep_pair(timestep_0 + tile_x_start, timestep_1 == NULL ? NULL : timestep_1 + tile_x_start, x_width, x_pair, unused_y, unused_y);
+        expand_timestep_pair(timestep_0 + tile_y_start, timestep_1 == NULL ? NULL : timestep_1 + tile_y_start, y_width, unused_x, y_re_pair, y_im_pair);
+
+        for (int y_local = 0; y_local < y_width; y_local++){
+            unsigned char temp_char = timestep_0[tile_y_start + y_local];
+            int element_y_re = (int)(HI_NIBBLE(temp_char)) - 8;
+            int element_y_im = (int)(LO_NIBBLE(temp_char)) - 8;
+            offset_re[y_local] += 8*(element_y_re + element_y_im);
+            offset_im[y_local] += 8*(element_y_im - element_y_re);
+            if (timestep_1 != NULL){
+                temp_char = timestep_1[tile_y_start + y_local];
+                element_y_re = (int)(HI_NIBBLE(temp_char)) - 8;
+                element_y_im = (int)(LO_NIBBLE(temp_char)) - 8;
+                offset_re[y_local] += 8*(element_y_re + element_y_im);
+                offset_im[y_local] += 8*(element_y_im - element_y_re);
+            }
+        }
+    }
+    return;
+}
+
+static void remove_offsets(int *tile_accum, int *offset_re, int *offset_im){
+    int *accum_re = tile_accum;
+    int *accum_im = tile_accum + CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM;
+    for (int y_local = 0; y_local < CPU_XENGINE_TILE_DIM; y_local++){
+        for (int x_local = 0; x_local < CPU_XENGINE_TILE_DIM; x_local++){
+            accum_re[y_local*CPU_XENGINE_TILE_DIM + x_local] -= offset_re[y_local];
+            accum_im[y_local*CPU_XENGINE_TILE_DIM + x_local] -= offset_im[y_local];
+        }
+    }
+    return;
+}
+
+//adds the two 16 bit lanes of each element together and onto 8 int accumulators
+__attribute__((target("avx2")))
+static inline void spill_int16_lanes(int *accum, __m256i lanes, __m256i ones){
+    __m256i sums = _mm256_madd_epi16(lanes, ones);
+    _mm256_storeu_si256((__m256i *)accum, _mm256_add_epi32(_mm256_loadu_si256((__m256i *)accum), sums));
+    return;
+}
+
+__attribute__((target("avx2")))
+void cpu_xengine_correlate_tile_avx2(unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int frequency, int tile_x_start, int tile_y_start, int *tile_accum){
+    unsigned char x_buf   [SIMD_PAIRS_PER_CHUNK*CPU_XENGINE_TILE_DIM*4] __attribute__((aligned(32)));
+    unsigned char y_re_buf[SIMD_PAIRS_PER_CHUNK*CPU_XENGINE_TILE_DIM*4] __attribute__((aligned(32)));
+    unsigned char y_im_buf[SIMD_PAIRS_PER_CHUNK*CPU_XENGINE_TILE_DIM*4] __attribute__((aligned(32)));
+    int offset_re[CPU_XENGINE_TILE_DIM];
+    int offset_im[CPU_XENGINE_TILE_DIM];
+    int *accum_re = tile_accum;
+    int *accum_im = tile_accum + CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM;
+    const __m256i ones = _mm256_set1_epi16(1);
+
+    memset(tile_accum, 0, CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM*2*sizeof(int));
+    memset(offset_re, 0, sizeof(offset_re));
+    memset(offset_im, 0, sizeof(offset_im));
+    memset(y_re_buf, 0, sizeof(y_re_buf));
+    memset(y_im_buf, 0, sizeof(y_im_buf));
+
+    for (int chunk_start = 0; chunk_start < num_timesteps; chunk_start += SIMD_TIME_CHUNK){
+        int num_pairs = (num_timesteps - chunk_start + 1)/2;
+        if (num_pairs > SIMD_PAIRS_PER_CHUNK)
+            num_pairs = SIMD_PAIRS_PER_CHUNK;
+        expand_chunk(data, num_timesteps, num_frequencies, num_elements, frequency, chunk_start, tile_x_start, tile_y_start, x_buf, y_re_buf, y_im_buf, offset_re, offset_im);
+
+        //2 y rows x 16 x elements at a time: 8 accumulators, 2 x vectors and 4 broadcast y words fit the 16 ymm registers.
+        //Within a chunk the vpmaddubsw results are summed as they are, in 16 bit lanes (one per element and timestep of
+        //the pair): a lane gets at most 240 per pair, and 64 x 240 < 32768. The lane pairs are only added together and
+        //widened to 32 bit (vpmaddwd) once per chunk
+        for (int y_local = 0; y_local < CPU_XENGINE_TILE_DIM; y_local += 2){
+            for (int x_local = 0; x_local < CPU_XENGINE_TILE_DIM; x_local += 16){
+                __m256i acc_re_00 = _mm256_setzero_si256();
+                __m256i acc_re_01 = _mm256_setzero_si256();
+                __m256i acc_re_10 = _mm256_setzero_si256();
+                __m256i acc_re_11 = _mm256_setzero_si256();
+                __m256i acc_im_00 = _mm256_setzero_si256();
+                __m256i acc_im_01 = _mm256_setzero_si256();
+                __m256i acc_im_10 = _mm256_setzero_si256();
+                __m256i acc_im_11 = _mm256_setzero_si256();
+                for (int pair = 0; pair < num_pairs; pair++){
+                    unsigned char *x_pair = x_buf + (pair*CPU_XENGINE_TILE_DIM + x_local)*4;
+                    int *y_re_pair = (int *)(y_re_buf + (pair*CPU_XENGINE_TILE_DIM + y_local)*4);
+                    int *y_im_pair = (int *)(y_im_buf + (pair*CPU_XENGINE_TILE_DIM + y_local)*4);
+                    __m256i x_0 = _mm256_load_si256((__m256i *)(x_pair));
+                    __m256i x_1 = _mm256_load_si256((__m256i *)(x_pair + 32));
+                    __m256i y_re_0 = _mm256_set1_epi32(y_re_pair[0]);
+                    __m256i y_re_1 = _mm256_set1_epi32(y_re_pair[1]);
+                    __m256i y_im_0 = _mm256_set1_epi32(y_im_pair[0]);
+                    __m256i y_im_1 = _mm256_set1_epi32(y_im_pair[1]);
+                    //products of one timestep pair are at most 2*15*8 = 240 in magnitude, so vpmaddubsw never saturates
+                    acc_re_00 = _mm256_add_epi16(acc_re_00, _mm256_maddubs_epi16(x_0, y_re_0));
+                    acc_re_01 = _mm256_add_epi16(acc_re_01, _mm256_maddubs_epi16(x_1, y_re_0));
+                    acc_re_10 = _mm256_add_epi16(acc_re_10, _mm256_maddubs_epi16(x_0, y_re_1));
+                    acc_re_11 = _mm256_add_epi16(acc_re_11, _mm256_maddubs_epi16(x_1, y_re_1));
+                    acc_im_00 = _mm256_add_epi16(acc_im_00, _mm256_maddubs_epi16(x_0, y_im_0));
+                    acc_im_01 = _mm256_add_epi16(acc_im_01, _mm256_maddubs_epi16(x_1, y_im_0));
+                    acc_im_10 = _mm256_add_epi16(acc_im_10, _mm256_maddubs_epi16(x_0, y_im_1));
+                    acc_im_11 = _mm256_add_epi16(acc_im_11, _mm256_maddubs_epi16(x_1, y_im_1));
+                }
+                int *re_0 = accum_re + y_local*CPU_XENGINE_TILE_DIM + x_local;
+                int *im_0 = accum_im + y_local*CPU_XENGINE_TILE_DIM + x_local;
+                spill_int16_lanes(re_0, acc_re_00, ones);
+                spill_int16_lanes(re_0 + 8, acc_re_01, ones);
+                spill_int16_lanes(re_0 + CPU_XENGINE_TILE_DIM, acc_re_10, ones);
+                spill_int16_lanes(re_0 + CPU_XENGINE_TILE_DIM + 8, acc_re_11, ones);
+                spill_int16_lanes(im_0, acc_im_00, ones);
+                spill_int16_lanes(im_0 + 8, acc_im_01, ones);
+                spill_int16_lanes(im_0 + CPU_XENGINE_TILE_DIM, acc_im_10, ones);
+                spill_int16_lanes(im_0 + CPU_XENGINE_TILE_DIM + 8, acc_im_11, ones);
+            }
+        }
+    }
+    remove_offsets(tile_accum, offset_re, offset_im);
+    return;
+}
+
+__attribute__((target("avx2,avx512f,avx512bw,avx512vnni")))
+void cpu_xengine_correlate_tile_avx512_vnni(unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int frequency, int tile_x_start, int tile_y_start, int *tile_accum){
+    unsigned char x_buf   [SIMD_PAIRS_PER_CHUNK*CPU_XENGINE_TILE_DIM*4] __attribute__((aligned(64)));
+    unsigned char y_re_buf[SIMD_PAIRS_PER_CHUNK*CPU_XENGINE_TILE_DIM*4] __attribute__((aligned(64)));
+    unsigned char y_im_buf[SIMD_PAIRS_PER_CHUNK*CPU_XENGINE_TILE_DIM*4] __attribute__((aligned(64)));
+    int offset_re[CPU_XENGINE_TILE_DIM];
+    int offset_im[CPU_XENGINE_TILE_DIM];
+    int *accum_re = tile_accum;
+    int *accum_im = tile_accum + CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM;
+
+    memset(tile_accum, 0, CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM*2*sizeof(int));
+    memset(offset_re, 0, sizeof(offset_re));
+    memset(offset_im, 0, sizeof(offset_im));
+    memset(y_re_buf, 0, sizeof(y_re_buf));
+    memset(y_im_buf, 0, sizeof(y_im_buf));
+
+    for (int chunk_start = 0; chunk_start < num_timesteps; chunk_start += SIMD_TIME_CHUNK){
+        int num_pairs = (num_timesteps - chunk_start + 1)/2;
+        if (num_pairs > SIMD_PAIRS_PER_CHUNK)
+            num_pairs = SIMD_PAIRS_PER_CHUNK;
+        expand_chunk(data, num_timesteps, num_frequencies, num_elements, frequency, chunk_start, tile_x_start, tile_y_start, x_buf, y_re_buf, y_im_buf, offset_re, offset_im);
+
+        //2 y rows x the full 64 x elements at a time: 16 accumulators, 4 x vectors and 4 broadcast y words
+        for (int y_local = 0; y_local < CPU_XENGINE_TILE_DIM; y_local += 2){
+            int *re_0 = accum_re + y_local*CPU_XENGINE_TILE_DIM;
+            int *im_0 = accum_im + y_local*CPU_XENGINE_TILE_DIM;
+            __m512i acc_re_00 = _mm512_loadu_si512(re_0);
+            __m512i acc_re_01 = _mm512_loadu_si512(re_0 + 16);
+            __m512i acc_re_02 = _mm512_loadu_si512(re_0 + 32);
+            __m512i acc_re_03 = _mm512_loadu_si512(re_0 + 48);
+            __m512i acc_re_10 = _mm512_loadu_si512(re_0 + CPU_XENGINE_TILE_DIM);
+            __m512i acc_re_11 = _mm512_loadu_si512(re_0 + CPU_XENGINE_TILE_DIM + 16);
+            __m512i acc_re_12 = _mm512_loadu_si512(re_0 + CPU_XENGINE_TILE_DIM + 32);
+            __m512i acc_re_13 = _mm512_loadu_si512(re_0 + CPU_XENGINE_TILE_DIM + 48);
+            __m512i acc_im_00 = _mm512_loadu_si512(im_0);
+            __m512i acc_im_01 = _mm512_loadu_si512(im_0 + 16);
+            __m512i acc_im_02 = _mm512_loadu_si512(im_0 + 32);
+            __m512i acc_im_03 = _mm512_loadu_si512(im_0 + 48);
+            __m512i acc_im_10 = _mm512_loadu_si512(im_0 + CPU_XENGINE_TILE_DIM);
+            __m512i acc_im_11 = _mm512_loadu_si512(im_0 + CPU_XENGINE_TILE_DIM + 16);
+            __m512i acc_im_12 = _mm512_loadu_si512(im_0 + CPU_XENGINE_TILE_DIM + 32);
+            __m512i acc_im_13 = _mm512_loadu_si512(im_0 + CPU_XENGINE_TILE_DIM + 48);
+            for (int pair = 0; pair < num_pairs; pair++){
+                unsigned char *x_pair = x_buf + pair*CPU_XENGINE_TILE_DIM*4;
+                int *y_re_pair = (int *)(y_re_buf + (pair*CPU_XENGINE_TILE_DIM + y_local)*4);
+                int *y_im_pair = (int *)(y_im_buf + (pair*CPU_XENGINE_TILE_DIM + y_local)*4);
+                __m512i x_0 = _mm512_load_si512(x_pair);
+                __m512i x_1 = _mm512_load_si512(x_pair + 64);
+                __m512i x_2 = _mm512_load_si512(x_pair + 128);
+                __m512i x_3 = _mm512_load_si512(x_pair + 192);
+                __m512i y_re_0 = _mm512_set1_epi32(y_re_pair[0]);
+                __m512i y_re_1 = _mm512_set1_epi32(y_re_pair[1]);
+                __m512i y_im_0 = _mm512_set1_epi32(y_im_pair[0]);
+                __m512i y_im_1 = _mm512_set1_epi32(y_im_pair[1]);
+                acc_re_00 = _mm512_dpbusd_epi32(acc_re_00, x_0, y_re_0);
+                acc_re_01 = _mm512_dpbusd_epi32(acc_re_01, x_1, y_re_0);
+                acc_re_02 = _mm512_dpbusd_epi32(acc_re_02, x_2, y_re_0);
+                acc_re_03 = _mm512_dpbusd_epi32(acc_re_03, x_3, y_re_0);
+                acc_re_10 = _mm512_dpbusd_epi32(acc_re_10, x_0, y_re_1);
+                acc_re_11 = _mm512_dpbusd_epi32(acc_re_11, x_1, y_re_1);
+                acc_re_12 = _mm512_dpbusd_epi32(acc_re_12, x_2, y_re_1);
+                acc_re_13 = _mm512_dpbusd_epi32(acc_re_13, x_3, y_re_1);
+                acc_im_00 = _mm512_dpbusd_epi32(acc_im_00, x_0, y_im_0);
+                acc_im_01 = _mm512_dpbusd_epi32(acc_im_01, x_1, y_im_0);
+                acc_im_02 = _mm512_dpbusd_epi32(acc_im_02, x_2, y_im_0);
+                acc_im_03 = _mm512_dpbusd_epi32(acc_im_03, x_3, y_im_0);
+                acc_im_10 = _mm512_dpbusd_epi32(acc_im_10, x_0, y_im_1);
+                acc_im_11 = _mm512_dpbusd_epi32(acc_im_11, x_1, y_im_1);
+                acc_im_12 = _mm512_dpbusd_epi32(acc_im_12, x_2, y_im_1);
+                acc_im_13 = _mm512_dpbusd_epi32(acc_im_13, x_3, y_im_1);
+            }
+            _mm512_storeu_si512(re_0, acc_re_00);
+            _mm512_storeu_si512(re_0 + 16, acc_re_01);
+            _mm512_storeu_si512(re_0 + 32, acc_re_02);
+            _mm512_storeu_si512(re_0 + 48, acc_re_03);
+            _mm512_storeu_si512(re_0 + CPU_XENGINE_TILE_DIM, acc_re_10);
+            _mm512_storeu_si512(re_0 + CPU_XENGINE_TILE_DIM + 16, acc_re_11);
+            _mm512_storeu_si512(re_0 + CPU_XENGINE_TILE_DIM + 32, acc_re_12);
+            _mm512_storeu_si512(re_0 + CPU_XENGINE_TILE_DIM + 48, acc_re_13);
+            _mm512_storeu_si512(im_0, acc_im_00);
+            _mm512_storeu_si512(im_0 + 16, acc_im_01);
+            _mm512_storeu_si512(im_0 + 32, acc_im_02);
+            _mm512_storeu_si512(im_0 + 48, acc_im_03);
+            _mm512_storeu_si512(im_0 + CPU_XENGINE_TILE_DIM, acc_im_10);
+            _mm512_storeu_si512(im_0 + CPU_XENGINE_TILE_DIM + 16, acc_im_11);
+            _mm512_storeu_si512(im_0 + CPU_XENGINE_TILE_DIM + 32, acc_im_12);
+            _mm512_storeu_si512(im_0 + CPU_XENGINE_TILE_DIM + 48, acc_im_13);
+        }
+    }
+    remove_offsets(tile_accum, offset_re, offset_im);
+    return;
+}
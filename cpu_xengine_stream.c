@@ -0,0 +1,38 @@
+// cpu_xengine_stream.c
+// chunked driver for the blocked cpu correlator. The input is never held as a whole: the time axis is handed over one chunk at
+// a time and every chunk is added onto the output, so memory use is one chunk plus the output, however long the run
+#include "cpu_xengine.h"
+#include <stdio.h> // printf
+#include <stdlib.h> // malloc, etc.
+
+int cpu_xengine_correlate_stream(cpu_xengine_chunk_function get_chunk, void *context, int num_timesteps, int chunk_timesteps, int num_frequencies, int num_elements,
+                                 int upper_triangle_convention, int output_triangle, int engine, int num_threads, int verbose, int *correlated_data){
+    if (chunk_timesteps <= 0 || chunk_timesteps > num_timesteps)
+        chunk_timesteps = num_timesteps;
+
+    unsigned char *chunk = (unsigned char *)malloc((size_t)chunk_timesteps*num_frequencies*num_elements*sizeof(unsigned char));
+    if (chunk == NULL){
+        printf ("Error allocating memory: cpu_xengine_correlate_stream\n");
+        return (-1);
+    }
+
+    int err = 0;
+    for (int first_timestep = 0; first_timestep < num_timesteps; first_timestep += chunk_timesteps){
+        int this_chunk = num_timesteps - first_timestep;
+        if (this_chunk > chunk_timesteps)
+            this_chunk = chunk_timesteps;
+
+        err = get_chunk(context, first_timestep, this_chunk, num_frequencies, num_elements, chunk);
+        if (err){
+            printf ("Error: could not get input timesteps %d to %d for the cpu correlator\n", first_timestep, first_timestep + this_chunk - 1);
+            break;
+        }
+        //the first chunk sets the output, the rest add onto it
+        err = cpu_xengine_correlate_threaded(chunk, this_chunk, num_frequencies, num_elements, upper_triangle_convention, output_triangle, first_timestep > 0, engine, num_threads, verbose && first_timestep == 0, correlated_data);
+        if (err)
+            break;
+    }
+
+    free(chunk);
+    return (err);
+}
@@ -0,0 +1,256 @@
+// cpu_xengine_threads.c
+// multi-threaded driver for the blocked cpu correlator. The work is cut into (frequency, baseline tile) tasks.
+// Since the tiles cover the upper triangle, the tile rows are uneven (the first row has N/64 tiles, the last has one),
+// so rather than splitting rows between threads up front, each thread starts with an even share of tasks in its own
+// queue and steals from the back of the other queues once its own runs dry.
+// Every output tile is written by exactly one thread, and each thread has its own tile accumulator, so the only shared
+// state is the queues.
+#include "cpu_xengine.h"
+#include <stdio.h> // printf
+#include <stdlib.h> // malloc, etc.
+#include <string.h> // memcmp, memcpy
+#include <pthread.h>
+#include <unistd.h> // sysconf
+#include "gpu_cpu_helpers.h"
+
+typedef struct {
+    int frequency;
+    int tile_x_start;
+    int tile_y_start;
+} cpu_xengine_task;
+
+typedef struct {
+    pthread_mutex_t lock;
+    int head; //next task for the owning thread
+    int tail; //one past the last task; thieves take from here
+} cpu_xengine_queue;
+
+typedef struct {
+    int thread_id;
+    int num_threads;
+    cpu_xengine_task *tasks;
+    cpu_xengine_queue *queues;
+    cpu_xengine_tile_function correlate_tile;
+    unsigned char *data;
+    int num_timesteps;
+    int num_frequencies;
+    int num_elements;
+    int upper_triangle_convention;
+    int output_triangle;
+    int accumulate;
+    int output_int64;
+    void *correlated_data;
+    int tiles_done;
+    int tiles_stolen;
+    int err;
+} cpu_xengine_thread_args;
+
+int cpu_xengine_default_num_threads(void){
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_cpus < 1)
+        return 1;
+    return (int)num_cpus;
+}
+
+static int pop_own_task(cpu_xengine_queue *queue){
+    int task = -1;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail)
+        task = queue->head++;
+    pthread_mutex_unlock(&queue->lock);
+    return task;
+}
+
+static int steal_task(cpu_xengine_queue *queue){
+    int task = -1;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail)
+        task = --queue->tail;
+    pthread_mutex_unlock(&queue->lock);
+    return task;
+}
+
+static void *cpu_xengine_worker(void *arg){
+    cpu_xengine_thread_args *args = (cpu_xengine_thread_args *)arg;
+    int *tile_accum = (int *)malloc(CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM*2*sizeof(int));
+    int64_t *tile_total = (int64_t *)malloc(CPU_XENGINE_TILE_DIM*CPU_XENGINE_TILE_DIM*2*sizeof(int64_t));
+    if (tile_accum == NULL || tile_total == NULL){
+        printf ("Error allocating memory: cpu_xengine_worker\n");
+        free(tile_accum);
+        free(tile_total);
+        args->err = -1;
+        return NULL;
+    }
+
+    for (;;){
+        int task = pop_own_task(&args->queues[args->thread_id]);
+        //own queue is empty: go around the other threads, starting with the next one up so thieves spread out
+        for (int i = 1; task < 0 && i < args->num_threads; i++){
+            task = steal_task(&args->queues[(args->thread_id + i) % args->num_threads]);
+            if (task >= 0)
+                args->tiles_stolen++;
+        }
+        if (task < 0)
+            break; //every queue is empty
+
+        cpu_xengine_task *t = &args->tasks[task];
+        cpu_xengine_correlate_tile_total(args->correlate_tile, args->data, args->num_timesteps, args->num_frequencies, args->num_elements, t->frequency, t->tile_x_start, t->tile_y_start, tile_accum, tile_total);
+        cpu_xengine_store_tile(args->num_elements, t->frequency, t->tile_x_start, t->tile_y_start, args->upper_triangle_convention, args->output_triangle, args->accumulate, args->output_int64, tile_total, args->correlated_data);
+        args->tiles_done++;
+    }
+
+    free(tile_accum);
+    free(tile_total);
+    return NULL;
+}
+
+static int correlate_threaded(unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int upper_triangle_convention, int output_triangle, int accumulate, int output_int64,
+                              int engine, int num_threads, int verbose, void *correlated_data){
+    if (num_threads <= 0)
+        num_threads = cpu_xengine_default_num_threads();
+    if (engine == CPU_XENGINE_AUTO)
+        engine = cpu_xengine_best_available();
+    cpu_xengine_tile_function correlate_tile = cpu_xengine_get_tile_function(engine);
+    if (correlate_tile == NULL){
+        printf ("Error: cpu engine %d (%s) is not supported on this host\n", engine, cpu_xengine_name(engine));
+        return (-1);
+    }
+
+    int num_tiles_side = (num_elements + CPU_XENGINE_TILE_DIM - 1)/CPU_XENGINE_TILE_DIM;
+    int num_tasks = num_frequencies*(num_tiles_side*(num_tiles_side+1))/2;
+    if (num_threads > num_tasks)
+        num_threads = num_tasks;
+
+    cpu_xengine_task *tasks = (cpu_xengine_task *)malloc(num_tasks*sizeof(cpu_xengine_task));
+    cpu_xengine_queue *queues = (cpu_xengine_queue *)malloc(num_threads*sizeof(cpu_xengine_queue));
+    cpu_xengine_thread_args *args = (cpu_xengine_thread_args *)calloc(num_threads, sizeof(cpu_xengine_thread_args));
+    pthread_t *threads = (pthread_t *)malloc(num_threads*sizeof(pthread_t));
+    if (tasks == NULL || queues == NULL || args == NULL || threads == NULL){
+        printf ("Error allocating memory: cpu_xengine_correlate_threaded\n");
+        free(tasks);
+        free(queues);
+        free(args);
+        free(threads);
+        return (-1);
+    }
+
+    int task = 0;
+    for (int j = 0; j < num_frequencies; j++){
+        for (int tile_y_start = 0; tile_y_start < num_elements; tile_y_start += CPU_XENGINE_TILE_DIM){
+            for (int tile_x_start = tile_y_start; tile_x_start < num_elements; tile_x_start += CPU_XENGINE_TILE_DIM){
+                tasks[task].frequency = j;
+                tasks[task].tile_x_start = tile_x_start;
+                tasks[task].tile_y_start = tile_y_start;
+                task++;
+            }
+        }
+    }
+
+    //contiguous, even split to start with: neighbouring tiles share their y elements, which keeps those in cache
+    for (int i = 0; i < num_threads; i++){
+        pthread_mutex_init(&queues[i].lock, NULL);
+        queues[i].head = (int)(((long)num_tasks*i)/num_threads);
+        queues[i].tail = (int)(((long)num_tasks*(i+1))/num_threads);
+    }
+
+    int err = 0;
+    int num_started = 0;
+    for (int i = 0; i < num_threads; i++){
+        args[i].thread_id = i;
+        args[i].num_threads = num_threads;
+        args[i].tasks = tasks;
+        args[i].queues = queues;
+        args[i].correlate_tile = correlate_tile;
+        args[i].data = data;
+        args[i].num_timesteps = num_timesteps;
+        args[i].num_frequencies = num_frequencies;
+        args[i].num_elements = num_elements;
+        args[i].upper_triangle_convention = upper_triangle_convention;
+        args[i].output_triangle = output_triangle;
+        args[i].accumulate = accumulate;
+        args[i].output_int64 = output_int64;
+        args[i].correlated_data = correlated_data;
+        //thread 0 is the calling thread
+        if (i > 0){
+            if (pthread_create(&threads[i], NULL, cpu_xengine_worker, &args[i]) != 0){
+                //not fatal: the threads that did start steal the unstarted thread's tasks
+                printf ("Warning: could not start cpu correlator thread %d\n", i);
+                break;
+            }
+            num_started++;
+        }
+    }
+    cpu_xengine_worker(&args[0]);
+    for (int i = 1; i <= num_started; i++)
+        pthread_join(threads[i], NULL);
+
+    for (int i = 0; i < num_threads; i++){
+        if (args[i].err)
+            err = -1;
+        if (verbose)
+            printf("cpu correlator thread %3d: %6d tiles (%d stolen)\n", i, args[i].tiles_done, args[i].tiles_stolen);
+        pthread_mutex_destroy(&queues[i].lock);
+    }
+
+    free(tasks);
+    free(queues);
+    free(args);
+    free(threads);
+    return (err);
+}
+
+int cpu_xengine_correlate_threaded(unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int upper_triangle_convention, int output_triangle, int accumulate, int engine, int num_threads, int verbose, int *correlated_data){
+    return correlate_threaded(data, num_timesteps, num_frequencies, num_elements, upper_triangle_convention, output_triangle, accumulate, 0, engine, num_threads, verbose, correlated_data);
+}
+
+int cpu_xengine_correlate_threaded_int64(unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int upper_triangle_convention, int output_triangle, int accumulate, int engine, int num_threads, int verbose, int64_t *correlated_data){
+    return correlate_threaded(data, num_timesteps, num_frequencies, num_elements, upper_triangle_convention, output_triangle, accumulate, 1, engine, num_threads, verbose, correlated_data);
+}
+
+int cpu_xengine_scaling_report(unsigned char *data, int num_timesteps, int num_frequencies, int num_elements, int engine, int max_threads, int *correlated_data){
+    //times the correlator at 1, 2, 4, ... max_threads threads (and max_threads itself) and checks every run gives the
+    //same output as the single threaded one. Output is the upper triangle, standard convention.
+    if (max_threads <= 0)
+        max_threads = cpu_xengine_default_num_threads();
+    size_t output_size = (size_t)num_frequencies*((num_elements*(num_elements+1))/2)*2;
+    int *single_thread_data = (int *)malloc(output_size*sizeof(int));
+    if (single_thread_data == NULL){
+        printf ("Error allocating memory: cpu_xengine_scaling_report\n");
+        return (-1);
+    }
+
+    if (engine == CPU_XENGINE_AUTO)
+        engine = cpu_xengine_benchmark_engines(1);
+    printf("CPU correlator scaling (%s engine, %d elements, %d frequencies, %d timesteps):\n", cpu_xengine_name(engine == CPU_XENGINE_AUTO ? cpu_xengine_best_available() : engine), num_elements, num_frequencies, num_timesteps);
+    printf("  threads      time (s)   speedup   efficiency\n");
+    double single_thread_time = 0;
+    int err = 0;
+    int num_threads = 1;
+    for (;;){
+        double start_time = e_time();
+        err = cpu_xengine_correlate_threaded(data, num_timesteps, num_frequencies, num_elements, 1, 1, 0, engine, num_threads, 0, correlated_data);
+        double run_time = e_time() - start_time;
+        if (err)
+            break;
+        if (num_threads == 1){
+            single_thread_time = run_time;
+            memcpy(single_thread_data, correlated_data, output_size*sizeof(int));
+        }
+        double speedup = single_thread_time/run_time;
+        printf("  %7d  %12.4f  %8.2f  %10.1f%%", num_threads, run_time, speedup, 100.*speedup/num_threads);
+        if (memcmp(correlated_data, single_thread_data, output_size*sizeof(int)) != 0){
+            printf("  (output differs from 1 thread!)\n");
+            err = -1;
+            break;
+        }
+        printf("\n");
+        if (num_threads == max_threads)
+            break;
+        num_threads *= 2;
+        if (num_threads > max_threads)
+            num_threads = max_threads;
+    }
+
+    free(single_thread_data);
+    return (err);
+}
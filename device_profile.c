@@ -0,0 +1,133 @@
+// device_profile.c
+// the peak is clock x compute units x lanes per compute unit x ops per lane. A GCN compute unit has 4 SIMDs of 16 lanes
+// with a single cycle integer multiply-add, which is the estimate the harness always used. A CPU core (a compute unit to
+// OpenCL) is taken to issue two native integer vectors per cycle, with the multiply and the add as separate instructions.
+// The correlator and preseed work-groups are fixed by the tile, (BLOCK_DIM/4) x (BLOCK_DIM/4), so only the offset
+// accumulator's work-group is tuned here: a full 64 wide group on GPUs, where its loads coalesce, and narrower ones on
+// CPUs, where a work-group runs on one core and smaller groups spread the work over more of them.
+#include "device_profile.h"
+#include <stdint.h>
+#include <stdio.h> // printf
+#include <string.h>
+
+#define MAX_PLATFORMS                   8
+//offsetAccumulateElements work-groups in flight per compute unit, to hide memory latency. A starting guess that hasn't
+//been measured yet, so it only applies with -Q 0 (the default is a single partial)
+#define ACCUM_GROUPS_PER_COMPUTE_UNIT   8
+
+typedef struct {
+    const char *kind;
+    cl_device_type type;
+    const char *vendor; //substring of CL_DEVICE_VENDOR, or NULL for any
+    size_t accum_local_size;
+    int lanes_per_compute_unit; //0: native_vector_width x vector_issue
+    int vector_issue;
+    int ops_per_lane;
+} profile_entry;
+
+//first match wins
+static const profile_entry profile_table[] = {
+    {"AMD GCN GPU",     CL_DEVICE_TYPE_GPU,         "Advanced Micro Devices", 64, 64, 0, 2},
+    {"AMD GCN GPU",     CL_DEVICE_TYPE_GPU,         "AMD",                    64, 64, 0, 2},
+    {"GPU",             CL_DEVICE_TYPE_GPU,         NULL,                     64, 64, 0, 2},
+    {"CPU",             CL_DEVICE_TYPE_CPU,         NULL,                     16,  0, 2, 1},
+    {"accelerator",     CL_DEVICE_TYPE_ACCELERATOR, NULL,                     64,  0, 1, 2},
+    {"other",           CL_DEVICE_TYPE_ALL,         NULL,                     64,  0, 1, 1},
+};
+
+int device_profile_parse_type(const char *type_name, cl_device_type *type){
+    if (strcmp(type_name, "gpu") == 0)
+        *type = CL_DEVICE_TYPE_GPU;
+    else if (strcmp(type_name, "cpu") == 0)
+        *type = CL_DEVICE_TYPE_CPU;
+    else if (strcmp(type_name, "accelerator") == 0)
+        *type = CL_DEVICE_TYPE_ACCELERATOR;
+    else if (strcmp(type_name, "all") == 0)
+        *type = CL_DEVICE_TYPE_ALL;
+    else
+        return (-1);
+    return 0;
+}
+
+int device_profile_find_devices(cl_device_type type, cl_device_id *devices, int max_devices){
+    cl_platform_id platforms[MAX_PLATFORMS];
+    cl_uint num_platforms = 0;
+    int num_devices = 0;
+
+    if (clGetPlatformIDs(MAX_PLATFORMS, platforms, &num_platforms) != CL_SUCCESS || num_platforms == 0){
+        printf("Error: no OpenCL platforms found\n");
+        return (-1);
+    }
+    if (num_platforms > MAX_PLATFORMS)
+        num_platforms = MAX_PLATFORMS;
+    for (cl_uint p = 0; p < num_platforms && num_devices < max_devices; p++){
+        cl_uint num_platform_devices = 0;
+        if (clGetDeviceIDs(platforms[p], type, max_devices - num_devices, &devices[num_devices], &num_platform_devices) != CL_SUCCESS)
+            continue; //CL_DEVICE_NOT_FOUND
+        num_devices += (num_platform_devices < max_devices - num_devices) ? num_platform_devices : max_devices - num_devices;
+    }
+    if (num_devices == 0){
+        printf("Error: no OpenCL devices of the requested type found\n");
+        return (-1);
+    }
+    return num_devices;
+}
+
+int device_profile_query(cl_device_id device, device_profile *profile){
+    memset(profile, 0, sizeof(device_profile));
+    cl_int err;
+    err  = clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(cl_device_type), &profile->type, NULL);
+    err |= clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(profile->name)-1, profile->name, NULL);
+    err |= clGetDeviceInfo(device, CL_DEVICE_VENDOR, sizeof(profile->vendor)-1, profile->vendor, NULL);
+    err |= clGetDeviceInfo(device, CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(cl_uint), &profile->clock_mhz, NULL);
+    err |= clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &profile->compute_units, NULL);
+    if (err){
+        printf("Error getting device info\n");
+        return (-1);
+    }
+    if (clGetDeviceInfo(device, CL_DEVICE_NATIVE_VECTOR_WIDTH_INT, sizeof(cl_uint), &profile->native_vector_width, NULL) != CL_SUCCESS
+        || profile->native_vector_width == 0)
+        profile->native_vector_width = 1;
+
+    const profile_entry *entry = &profile_table[sizeof(profile_table)/sizeof(profile_table[0]) - 1];
+    for (int i = 0; i < sizeof(profile_table)/sizeof(profile_table[0]); i++){
+        if ((profile_table[i].type & profile->type) && (profile_table[i].vendor == NULL || strstr(profile->vendor, profile_table[i].vendor) != NULL)){
+            entry = &profile_table[i];
+            break;
+        }
+    }
+
+    //a work-group can't be larger than the device allows
+    size_t max_work_group_size = 0;
+    profile->accum_local_size = entry->accum_local_size;
+    if (clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &max_work_group_size, NULL) == CL_SUCCESS){
+        while (profile->accum_local_size > 1 && profile->accum_local_size > max_work_group_size)
+            profile->accum_local_size /= 2;
+    }
+
+    profile->kind = entry->kind;
+    profile->lanes_per_compute_unit = (entry->lanes_per_compute_unit > 0) ? entry->lanes_per_compute_unit : profile->native_vector_width * entry->vector_issue;
+    profile->ops_per_lane = entry->ops_per_lane;
+    profile->peak_ops = profile->clock_mhz * 1e6 * profile->compute_units * profile->lanes_per_compute_unit * profile->ops_per_lane;
+    return 0;
+}
+
+void device_profile_print(const device_profile *profile){
+    printf("Device: %s (%s), %s profile: %u compute units at %u MHz, %d lanes each, native int vector width %u, offsetAccumulate work-group %zu; peak estimate %.2f Tops/s\n",
+           profile->name, profile->vendor, profile->kind, profile->compute_units, profile->clock_mhz, profile->lanes_per_compute_unit,
+           profile->native_vector_width, profile->accum_local_size, profile->peak_ops / 1e12);
+    return;
+}
+
+int device_profile_accum_partials(const device_profile *profile, size_t accum_local_size, int requested, int num_elements, int num_frequencies, int num_timesteps, int base_accum){
+    int num_chunks = num_timesteps/base_accum;
+    if (requested > 0)
+        return (requested < num_chunks) ? requested : ((num_chunks > 1) ? num_chunks : 1);
+    //a partial has a 64 wide row of work items (4 elements each) for every 256 elements x frequencies
+    int64_t groups_per_partial = (((int64_t)num_elements*num_frequencies + 255)/256) * (64/accum_local_size);
+    int64_t wanted_groups = (int64_t)profile->compute_units * ACCUM_GROUPS_PER_COMPUTE_UNIT;
+    int64_t num_partials = (wanted_groups + groups_per_partial - 1)/groups_per_partial;
+    if (num_partials > num_chunks)
+        num_partials = num_chunks;
+    return (num_partials > 1) ? (int)num_partials : 1;
+}
@@ -0,0 +1,40 @@
+// device_profile.h
+// what the harness assumes about an OpenCL device: the work-group sizes it launches with and how its peak throughput is
+// estimated. The assumptions come from a profile per kind of device (AMD GCN GPUs, which the kernels were written for,
+// other GPUs, CPUs and accelerators), filled in with what the device reports about itself.
+#ifndef DEVICE_PROFILE_H
+#define DEVICE_PROFILE_H
+
+#include <CL/cl.h>
+
+#define DEVICE_PROFILE_MAX_DEVICES      32
+
+typedef struct {
+    const char *kind; //the profile used
+    char name[256];
+    char vendor[256];
+    cl_device_type type;
+    cl_uint clock_mhz;
+    cl_uint compute_units;
+    cl_uint native_vector_width; //32 bit integer lanes in a native vector
+    size_t accum_local_size; //work-group size of offsetAccumulateElements (a divisor of 64)
+    int lanes_per_compute_unit; //integer lanes a compute unit can issue on every cycle
+    int ops_per_lane; //ops per lane per cycle: 2 where a multiply-add is a single instruction
+    double peak_ops; //ops/s
+} device_profile;
+
+//parses gpu, cpu, accelerator or all; returns 0, or -1 for anything else
+int device_profile_parse_type(const char *type_name, cl_device_type *type);
+
+//devices of the given type on every platform, in platform order; returns how many (up to max_devices), or -1 if none
+int device_profile_find_devices(cl_device_type type, cl_device_id *devices, int max_devices);
+
+int device_profile_query(cl_device_id device, device_profile *profile);
+
+//number of partial sums offsetAccumulateElements splits the timesteps into (its global size along dimension 2): requested,
+//or with 0 enough work-groups to keep every compute unit busy; never more than there are chunks of base_accum timesteps
+int device_profile_accum_partials(const device_profile *profile, size_t accum_local_size, int requested, int num_elements, int num_frequencies, int num_timesteps, int base_accum);
+
+void device_profile_print(const device_profile *profile);
+
+#endif
@@ -0,0 +1,423 @@
+// event_profiler.c
+// each tracked event gets a record, filled in by an event callback once the command completes. The summary is worked out
+// after the run: the latencies of each step an event goes through (queued -> submit -> start -> end), the time each stage
+// kept the device busy (the union of its start-end intervals, so overlapping commands aren't counted twice), and the
+// overlap of the transfers (writes and read backs) with the kernels.
+#include "event_profiler.h"
+#include <stdio.h> // printf
+#include <stdlib.h> // malloc, etc.
+#include <string.h>
+
+static const char *stage_names[EVENT_PROFILE_NUM_STAGES] = {"write_input", "write_accum", "offset_accumulate", "combine_offsets", "preseed", "corr", "integrate", "pack", "read_back"};
+
+#define NUM_LATENCIES                   3
+static const char *latency_names[NUM_LATENCIES] = {"queued", "submitted", "running"}; //time spent in each state
+
+typedef struct {
+    int64_t count;
+    cl_ulong min[NUM_LATENCIES];
+    cl_ulong max[NUM_LATENCIES];
+    double sum[NUM_LATENCIES];
+    int64_t histogram[NUM_LATENCIES][EVENT_PROFILE_NUM_BINS];
+    cl_ulong busy;
+} stage_summary;
+
+typedef struct {
+    stage_summary stages[EVENT_PROFILE_NUM_STAGES];
+    cl_ulong first; //earliest queued time: the others are reported relative to it
+    cl_ulong span; //first queued to last end
+    cl_ulong transfer_busy;
+    cl_ulong compute_busy;
+    cl_ulong overlap; //time with both a transfer and a kernel running
+} profile_summary;
+
+typedef struct {
+    cl_ulong start;
+    cl_ulong end;
+} interval;
+
+static void CL_CALLBACK record_event(cl_event event, cl_int status, void *user_data){
+    event_profile_record *record = (event_profile_record *)user_data;
+    event_profiler *profiler = record->profiler;
+    cl_int err = CL_SUCCESS;
+    if (status == CL_COMPLETE){
+        err  = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &record->queued, NULL);
+        err |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &record->submit, NULL);
+        err |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &record->start, NULL);
+        err |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &record->end, NULL);
+    }
+    record->complete = (status == CL_COMPLETE && err == CL_SUCCESS);
+
+    pthread_mutex_lock(&profiler->lock);
+    profiler->num_completed++;
+    if (!record->complete)
+        profiler->num_failed++;
+    pthread_cond_broadcast(&profiler->completed);
+    pthread_mutex_unlock(&profiler->lock);
+    return;
+}
+
+int event_profiler_init(event_profiler *profiler, int64_t max_records){
+    memset(profiler, 0, sizeof(event_profiler));
+    profiler->records = (event_profile_record *)calloc(max_records, sizeof(event_profile_record));
+    if (profiler->records == NULL){
+        printf ("Error allocating the event profiler's records\n");
+        return (-1);
+    }
+    profiler->max_records = max_records;
+    pthread_mutex_init(&profiler->lock, NULL);
+    pthread_cond_init(&profiler->completed, NULL);
+    return 0;
+}
+
+void event_profiler_set_stage(event_profiler *profiler, int stage, double bytes, double ops){
+    profiler->stage_bytes[stage] = bytes;
+    profiler->stage_ops[stage] = ops;
+    return;
+}
+
+int event_profiler_track(event_profiler *profiler, cl_event event, int stage, int64_t frame){
+    pthread_mutex_lock(&profiler->lock);
+    if (profiler->num_records == profiler->max_records){
+        profiler->num_untracked++;
+        pthread_mutex_unlock(&profiler->lock);
+        return 0;
+    }
+    event_profile_record *record = &profiler->records[profiler->num_records++];
+    pthread_mutex_unlock(&profiler->lock);
+
+    record->profiler = profiler;
+    record->stage = stage;
+    record->frame = frame;
+    cl_int err = clSetEventCallback(event, CL_COMPLETE, record_event, record);
+    if (err){
+        printf ("Error setting the profiling callback: %d\n", err);
+        pthread_mutex_lock(&profiler->lock);
+        profiler->num_completed++;
+        profiler->num_failed++;
+        pthread_mutex_unlock(&profiler->lock);
+        return (-1);
+    }
+    return 0;
+}
+
+void event_profiler_wait(event_profiler *profiler){
+    pthread_mutex_lock(&profiler->lock);
+    while (profiler->num_completed < profiler->num_records)
+        pthread_cond_wait(&profiler->completed, &profiler->lock);
+    pthread_mutex_unlock(&profiler->lock);
+    return;
+}
+
+static int histogram_bin(cl_ulong ns){
+    int bin = 0;
+    while (ns > 1 && bin < EVENT_PROFILE_NUM_BINS-1){
+        ns >>= 1;
+        bin++;
+    }
+    return bin;
+}
+
+static int compare_intervals(const void *a, const void *b){
+    cl_ulong start_a = ((const interval *)a)->start;
+    cl_ulong start_b = ((const interval *)b)->start;
+    return (start_a > start_b) - (start_a < start_b);
+}
+
+//merges the intervals (in place) into a sorted list of disjoint ones, and returns how many there are
+static int64_t merge_intervals(interval *intervals, int64_t count){
+    if (count == 0)
+        return 0;
+    qsort(intervals, count, sizeof(interval), compare_intervals);
+    int64_t merged = 0;
+    for (int64_t i = 1; i < count; i++){
+        if (intervals[i].start <= intervals[merged].end){
+            if (intervals[i].end > intervals[merged].end)
+                intervals[merged].end = intervals[i].end;
+        }
+        else
+            intervals[++merged] = intervals[i];
+    }
+    return merged + 1;
+}
+
+static cl_ulong total_length(const interval *intervals, int64_t count){
+    cl_ulong total = 0;
+    for (int64_t i = 0; i < count; i++)
+        total += intervals[i].end - intervals[i].start;
+    return total;
+}
+
+//both lists sorted and disjoint
+static cl_ulong intersection_length(const interval *a, int64_t count_a, const interval *b, int64_t count_b){
+    cl_ulong total = 0;
+    int64_t i = 0, j = 0;
+    while (i < count_a && j < count_b){
+        cl_ulong start = (a[i].start > b[j].start) ? a[i].start : b[j].start;
+        cl_ulong end = (a[i].end < b[j].end) ? a[i].end : b[j].end;
+        if (end > start)
+            total += end - start;
+        if (a[i].end < b[j].end)
+            i++;
+        else
+            j++;
+    }
+    return total;
+}
+
+static int is_transfer(int stage){
+    return (stage == EVENT_PROFILE_WRITE_INPUT || stage == EVENT_PROFILE_WRITE_ACCUM || stage == EVENT_PROFILE_READ_BACK);
+}
+
+static int summarise(event_profiler *profiler, profile_summary *summary){
+    memset(summary, 0, sizeof(profile_summary));
+    interval *intervals = (interval *)malloc((profiler->num_records+1) * sizeof(interval));
+    interval *transfers = (interval *)malloc((profiler->num_records+1) * sizeof(interval));
+    interval *kernels = (interval *)malloc((profiler->num_records+1) * sizeof(interval));
+    if (intervals == NULL || transfers == NULL || kernels == NULL){
+        printf ("Error allocating memory for the profile summary\n");
+        free(intervals);
+        free(transfers);
+        free(kernels);
+        return (-1);
+    }
+
+    int64_t num_transfers = 0;
+    int64_t num_kernels = 0;
+    cl_ulong last = 0;
+    summary->first = ~(cl_ulong)0;
+    for (int64_t i = 0; i < profiler->num_records; i++){
+        event_profile_record *record = &profiler->records[i];
+        if (!record->complete)
+            continue;
+        if (record->queued < summary->first)
+            summary->first = record->queued;
+        if (record->end > last)
+            last = record->end;
+        if (is_transfer(record->stage))
+            transfers[num_transfers++] = (interval){record->start, record->end};
+        else
+            kernels[num_kernels++] = (interval){record->start, record->end};
+    }
+    if (last < summary->first) //nothing completed
+        summary->first = last = 0;
+    summary->span = last - summary->first;
+
+    for (int s = 0; s < EVENT_PROFILE_NUM_STAGES; s++){
+        stage_summary *stage = &summary->stages[s];
+        int64_t num_intervals = 0;
+        for (int l = 0; l < NUM_LATENCIES; l++)
+            stage->min[l] = ~(cl_ulong)0;
+        for (int64_t i = 0; i < profiler->num_records; i++){
+            event_profile_record *record = &profiler->records[i];
+            if (!record->complete || record->stage != s)
+                continue;
+            //the counters should be in order, but don't trust a driver to keep differences positive
+            cl_ulong latencies[NUM_LATENCIES] = {(record->submit > record->queued) ? record->submit - record->queued : 0,
+                                                 (record->start > record->submit) ? record->start - record->submit : 0,
+                                                 (record->end > record->start) ? record->end - record->start : 0};
+            for (int l = 0; l < NUM_LATENCIES; l++){
+                if (latencies[l] < stage->min[l])
+                    stage->min[l] = latencies[l];
+                if (latencies[l] > stage->max[l])
+                    stage->max[l] = latencies[l];
+                stage->sum[l] += latencies[l];
+                stage->histogram[l][histogram_bin(latencies[l])]++;
+            }
+            intervals[num_intervals++] = (interval){record->start, record->end};
+            stage->count++;
+        }
+        if (stage->count == 0){
+            for (int l = 0; l < NUM_LATENCIES; l++)
+                stage->min[l] = 0;
+        }
+        num_intervals = merge_intervals(intervals, num_intervals);
+        stage->busy = total_length(intervals, num_intervals);
+    }
+
+    num_transfers = merge_intervals(transfers, num_transfers);
+    num_kernels = merge_intervals(kernels, num_kernels);
+    summary->transfer_busy = total_length(transfers, num_transfers);
+    summary->compute_busy = total_length(kernels, num_kernels);
+    summary->overlap = intersection_length(transfers, num_transfers, kernels, num_kernels);
+
+    free(intervals);
+    free(transfers);
+    free(kernels);
+    return 0;
+}
+
+static double fraction(cl_ulong part, cl_ulong whole){
+    return (whole > 0) ? (double)part / whole : 0.;
+}
+
+//rates while the stage's commands were running
+static double stage_rate(double per_event, const stage_summary *stage){
+    return (stage->sum[NUM_LATENCIES-1] > 0) ? per_event * stage->count / (stage->sum[NUM_LATENCIES-1] * 1e-9) : 0.;
+}
+
+void event_profiler_report(event_profiler *profiler){
+    profile_summary summary;
+    if (summarise(profiler, &summary))
+        return;
+
+    printf("Event profile: %lld events over %.4fs", (long long int)(profiler->num_completed - profiler->num_failed), summary.span * 1e-9);
+    if (profiler->num_failed > 0 || profiler->num_untracked > 0)
+        printf(" (%lld failed or without profiling info, %lld not tracked)", (long long int)profiler->num_failed, (long long int)profiler->num_untracked);
+    printf("\n");
+    printf("  %-18s %8s %12s %12s %12s %8s %12s %12s\n", "stage", "count", "queued (us)", "submit (us)", "run (us)", "busy", "GB/s", "Gop/s");
+    for (int s = 0; s < EVENT_PROFILE_NUM_STAGES; s++){
+        stage_summary *stage = &summary.stages[s];
+        if (stage->count == 0)
+            continue;
+        printf("  %-18s %8lld %12.1f %12.1f %12.1f %7.1f%% %12.2f %12.2f\n", stage_names[s], (long long int)stage->count,
+               stage->sum[0] / stage->count * 1e-3, stage->sum[1] / stage->count * 1e-3, stage->sum[2] / stage->count * 1e-3,
+               100. * fraction(stage->busy, summary.span), stage_rate(profiler->stage_bytes[s], stage) * 1e-9, stage_rate(profiler->stage_ops[s], stage) * 1e-9);
+    }
+    printf("  transfers busy %.1f%%, kernels busy %.1f%%; %.1f%% of the transfer time overlaps kernels\n",
+           100. * fraction(summary.transfer_busy, summary.span), 100. * fraction(summary.compute_busy, summary.span),
+           100. * fraction(summary.overlap, summary.transfer_busy));
+    return;
+}
+
+static void write_json(FILE *fp, event_profiler *profiler, profile_summary *summary){
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"span_s\": %.9f,\n", summary->span * 1e-9);
+    fprintf(fp, "  \"events\": %lld,\n", (long long int)(profiler->num_completed - profiler->num_failed));
+    fprintf(fp, "  \"failed_events\": %lld,\n", (long long int)profiler->num_failed);
+    fprintf(fp, "  \"untracked_events\": %lld,\n", (long long int)profiler->num_untracked);
+    fprintf(fp, "  \"overlap\": {\"transfer_busy_s\": %.9f, \"compute_busy_s\": %.9f, \"overlap_s\": %.9f, "
+                "\"transfer_overlapped_fraction\": %.6f, \"compute_overlapped_fraction\": %.6f},\n",
+            summary->transfer_busy * 1e-9, summary->compute_busy * 1e-9, summary->overlap * 1e-9,
+            fraction(summary->overlap, summary->transfer_busy), fraction(summary->overlap, summary->compute_busy));
+    fprintf(fp, "  \"stages\": [\n");
+    for (int s = 0; s < EVENT_PROFILE_NUM_STAGES; s++){
+        stage_summary *stage = &summary->stages[s];
+        fprintf(fp, "    {\"name\": \"%s\", \"count\": %lld, \"busy_s\": %.9f, \"busy_fraction\": %.6f, "
+                    "\"bytes_per_event\": %.0f, \"ops_per_event\": %.0f, \"bytes_per_s\": %.6e, \"ops_per_s\": %.6e, "
+                    "\"sustained_bytes_per_s\": %.6e, \"sustained_ops_per_s\": %.6e,\n",
+                stage_names[s], (long long int)stage->count, stage->busy * 1e-9, fraction(stage->busy, summary->span),
+                profiler->stage_bytes[s], profiler->stage_ops[s],
+                stage_rate(profiler->stage_bytes[s], stage), stage_rate(profiler->stage_ops[s], stage),
+                (summary->span > 0) ? profiler->stage_bytes[s] * stage->count / (summary->span * 1e-9) : 0.,
+                (summary->span > 0) ? profiler->stage_ops[s] * stage->count / (summary->span * 1e-9) : 0.);
+        fprintf(fp, "     \"latency_ns\": {");
+        for (int l = 0; l < NUM_LATENCIES; l++){
+            fprintf(fp, "%s\n       \"%s\": {\"min\": %llu, \"mean\": %.1f, \"max\": %llu, \"histogram\": [", (l > 0) ? "," : "", latency_names[l],
+                    (unsigned long long int)stage->min[l], (stage->count > 0) ? stage->sum[l] / stage->count : 0., (unsigned long long int)stage->max[l]);
+            int first_bin = 1;
+            for (int b = 0; b < EVENT_PROFILE_NUM_BINS; b++){
+                if (stage->histogram[l][b] == 0)
+                    continue;
+                fprintf(fp, "%s{\"low\": %llu, \"high\": %llu, \"count\": %lld}", first_bin ? "" : ", ",
+                        (b == 0) ? 0ull : 1ull << b, 1ull << (b+1), (long long int)stage->histogram[l][b]);
+                first_bin = 0;
+            }
+            fprintf(fp, "]}");
+        }
+        fprintf(fp, "\n     }}%s\n", (s < EVENT_PROFILE_NUM_STAGES-1) ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    return;
+}
+
+//one value per line: stage,metric,bin_low_ns,bin_high_ns,value (the bins are empty except for histograms)
+static void write_csv(FILE *fp, event_profiler *profiler, profile_summary *summary){
+    fprintf(fp, "stage,metric,bin_low_ns,bin_high_ns,value\n");
+    fprintf(fp, "all,span_s,,,%.9f\n", summary->span * 1e-9);
+    fprintf(fp, "all,events,,,%lld\n", (long long int)(profiler->num_completed - profiler->num_failed));
+    fprintf(fp, "all,failed_events,,,%lld\n", (long long int)profiler->num_failed);
+    fprintf(fp, "all,untracked_events,,,%lld\n", (long long int)profiler->num_untracked);
+    fprintf(fp, "all,transfer_busy_s,,,%.9f\n", summary->transfer_busy * 1e-9);
+    fprintf(fp, "all,compute_busy_s,,,%.9f\n", summary->compute_busy * 1e-9);
+    fprintf(fp, "all,overlap_s,,,%.9f\n", summary->overlap * 1e-9);
+    fprintf(fp, "all,transfer_overlapped_fraction,,,%.6f\n", fraction(summary->overlap, summary->transfer_busy));
+    fprintf(fp, "all,compute_overlapped_fraction,,,%.6f\n", fraction(summary->overlap, summary->compute_busy));
+    for (int s = 0; s < EVENT_PROFILE_NUM_STAGES; s++){
+        stage_summary *stage = &summary->stages[s];
+        fprintf(fp, "%s,count,,,%lld\n", stage_names[s], (long long int)stage->count);
+        fprintf(fp, "%s,busy_s,,,%.9f\n", stage_names[s], stage->busy * 1e-9);
+        fprintf(fp, "%s,busy_fraction,,,%.6f\n", stage_names[s], fraction(stage->busy, summary->span));
+        fprintf(fp, "%s,bytes_per_s,,,%.6e\n", stage_names[s], stage_rate(profiler->stage_bytes[s], stage));
+        fprintf(fp, "%s,ops_per_s,,,%.6e\n", stage_names[s], stage_rate(profiler->stage_ops[s], stage));
+        for (int l = 0; l < NUM_LATENCIES; l++){
+            fprintf(fp, "%s,%s_min_ns,,,%llu\n", stage_names[s], latency_names[l], (unsigned long long int)stage->min[l]);
+            fprintf(fp, "%s,%s_mean_ns,,,%.1f\n", stage_names[s], latency_names[l], (stage->count > 0) ? stage->sum[l] / stage->count : 0.);
+            fprintf(fp, "%s,%s_max_ns,,,%llu\n", stage_names[s], latency_names[l], (unsigned long long int)stage->max[l]);
+            for (int b = 0; b < EVENT_PROFILE_NUM_BINS; b++){
+                if (stage->histogram[l][b] > 0)
+                    fprintf(fp, "%s,%s_histogram,%llu,%llu,%lld\n", stage_names[s], latency_names[l],
+                            (b == 0) ? 0ull : 1ull << b, 1ull << (b+1), (long long int)stage->histogram[l][b]);
+            }
+        }
+    }
+    return;
+}
+
+static void write_events_csv(FILE *fp, event_profiler *profiler, profile_summary *summary){
+    fprintf(fp, "frame,stage,queued_ns,submit_ns,start_ns,end_ns\n");
+    for (int64_t i = 0; i < profiler->num_records; i++){
+        event_profile_record *record = &profiler->records[i];
+        if (!record->complete)
+            continue;
+        fprintf(fp, "%lld,%s,%llu,%llu,%llu,%llu\n", (long long int)record->frame, stage_names[record->stage],
+                (unsigned long long int)(record->queued - summary->first), (unsigned long long int)(record->submit - summary->first),
+                (unsigned long long int)(record->start - summary->first), (unsigned long long int)(record->end - summary->first));
+    }
+    return;
+}
+
+int event_profiler_write(event_profiler *profiler, const char *file_name){
+    profile_summary summary;
+    if (summarise(profiler, &summary))
+        return (-1);
+
+    size_t name_length = strlen(file_name);
+    int json = (name_length >= 5 && strcmp(file_name + name_length - 5, ".json") == 0);
+    FILE *fp = fopen(file_name, "w");
+    if (fp == NULL){
+        printf ("Error opening the profile file %s\n", file_name);
+        return (-1);
+    }
+    if (json)
+        write_json(fp, profiler, &summary);
+    else
+        write_csv(fp, profiler, &summary);
+    if (fclose(fp) != 0){
+        printf ("Error writing the profile file %s\n", file_name);
+        return (-1);
+    }
+    if (json)
+        return 0;
+
+    //the events go next to the summary: name_events.csv
+    char *events_name = (char *)malloc(name_length + 16);
+    if (events_name == NULL)
+        return (-1);
+    const char *extension = strrchr(file_name, '.');
+    if (extension == NULL || strchr(extension, '/') != NULL)
+        extension = file_name + name_length;
+    sprintf(events_name, "%.*s_events%s", (int)(extension - file_name), file_name, extension);
+    fp = fopen(events_name, "w");
+    if (fp == NULL){
+        printf ("Error opening the profile file %s\n", events_name);
+        free(events_name);
+        return (-1);
+    }
+    write_events_csv(fp, profiler, &summary);
+    int err = 0;
+    if (fclose(fp) != 0){
+        printf ("Error writing the profile file %s\n", events_name);
+        err = -1;
+    }
+    free(events_name);
+    return err;
+}
+
+void event_profiler_free(event_profiler *profiler){
+    free(profiler->records);
+    profiler->records = NULL;
+    pthread_mutex_destroy(&profiler->lock);
+    pthread_cond_destroy(&profiler->completed);
+    return;
+}
@@ -0,0 +1,72 @@
+// event_profiler.h
+// samples the OpenCL profiling counters (queued, submit, start and end times) of the events in the correlator loop and
+// summarises them per stage: latency histograms, busy time, bytes/s and ops/s, and how much of the transfer time is hidden
+// behind compute. Needs queues created with CL_QUEUE_PROFILING_ENABLE.
+#ifndef EVENT_PROFILER_H
+#define EVENT_PROFILER_H
+
+#include <CL/cl.h>
+#include <stdint.h>
+#include <pthread.h>
+
+//stages of the loop, in pipeline order
+#define EVENT_PROFILE_WRITE_INPUT       0
+#define EVENT_PROFILE_WRITE_ACCUM       1 //zeroing the fused correlator's output (-u)
+#define EVENT_PROFILE_OFFSET_ACCUMULATE 2
+#define EVENT_PROFILE_COMBINE_OFFSETS   3 //adding up the offset accumulator's partial sums, when there is more than one
+#define EVENT_PROFILE_PRESEED           4
+#define EVENT_PROFILE_CORR              5
+#define EVENT_PROFILE_INTEGRATE         6 //folding a frame into the long-term integration (-N)
+#define EVENT_PROFILE_PACK              7 //packing the upper triangle for the read back (-O)
+#define EVENT_PROFILE_READ_BACK         8
+#define EVENT_PROFILE_NUM_STAGES        9
+
+#define EVENT_PROFILE_NUM_BINS          40 //latency histograms have power of 2 bins: bin b counts [2^b, 2^(b+1)) ns (bin 0 from 0)
+
+typedef struct event_profiler event_profiler;
+
+typedef struct {
+    event_profiler *profiler;
+    int stage;
+    int complete;
+    int64_t frame;
+    cl_ulong queued;
+    cl_ulong submit;
+    cl_ulong start;
+    cl_ulong end;
+} event_profile_record;
+
+struct event_profiler {
+    event_profile_record *records;
+    int64_t max_records;
+    int64_t num_records; //handed out (a record per tracked event)
+    int64_t num_untracked; //events that found the records all used
+    int64_t num_completed; //callbacks that have run
+    int64_t num_failed; //of those, events that failed or had no profiling info
+    double stage_bytes[EVENT_PROFILE_NUM_STAGES]; //per event
+    double stage_ops[EVENT_PROFILE_NUM_STAGES];
+    pthread_mutex_t lock;
+    pthread_cond_t completed;
+};
+
+int event_profiler_init(event_profiler *profiler, int64_t max_records);
+
+//bytes moved and operations done by each event of a stage, for the rates
+void event_profiler_set_stage(event_profiler *profiler, int stage, double bytes, double ops);
+
+//samples the event when it completes (through an event callback, so the caller can release the event right away)
+int event_profiler_track(event_profiler *profiler, cl_event event, int stage, int64_t frame);
+
+//waits for the callbacks of all tracked events: call after the queues are finished
+void event_profiler_wait(event_profiler *profiler);
+
+//prints the summary
+void event_profiler_report(event_profiler *profiler);
+
+//writes the summary (JSON if file_name ends in .json, CSV otherwise), and with CSV a second file, file_name with
+//"_events" before the extension, holding every sampled event
+int event_profiler_write(event_profiler *profiler, const char *file_name);
+
+void event_profiler_free(event_profiler *profiler);
+
+#endif
@@ -0,0 +1,405 @@
+//fused version of packed_correlator_overflow_protected_to_2272_iter_UT.cl (-u). Besides correlating, each work item sums the offset-encoded values
+//of its 4 x and 4 y elements over the work-group's time chunk as they stream through, and adds that chunk's share of
+//the preseed_multifreq_highly_packed_correlator_method_UT.cl correction when it writes out. Summed over the chunks that is exactly
+//what preseed writes, so offsetAccumulateElements and preseed (with their global atomics and second read of the input)
+//aren't needed; the output only has to start at zero.
+//Like the kernel it fuses, it only handles a single frequency channel
+//Keith Vaderlinde's reduced-calculation-count version, coded by Peter Klages
+#define NUM_ELEMENTS_div_4                          (NUM_ELEMENTS/4u)  // N/4
+#define BLOCK_SIZE                                  (BLOCK_DIM*BLOCK_DIM*2u) //ints in an output block (BLOCK_DIM x BLOCK_DIM complex values)
+#define NUM_BLOCKS_x_BLOCK_SIZE                     (NUM_BLOCKS*BLOCK_SIZE)
+#define OUTPUT_ROW                                  (BLOCK_DIM*2u) //ints in a row of an output block
+
+#define LOCAL_SIZE                                  (BLOCK_DIM/4u) //BLOCK_DIM (the tile edge: 16, 32 or 64) defined at compile time; a work item does 4 x 4 of the tile
+#define BLOCK_DIM_div_4                             (BLOCK_DIM/4u)
+#define OVERFLOW_CHECK_ITERATIONS                   ((120u/(TIME_UNROLL*LOCAL_SIZE))*(TIME_UNROLL*LOCAL_SIZE)) //120 timesteps in whole passes: 112 with 64 x 64 tiles, where 128 could wrap a masked high lane
+#define N_TIME_CHUNKS_LOCAL                         NUM_TIME_ACCUM
+#define N_TIME_CHUNKS_LOCAL_x_128                   (N_TIME_CHUNKS_LOCAL*128u) //this chunk's share of preseed's NUM_TIMESAMPLES*128
+
+//-D DIAGONAL_BLOCKS builds corr for the diagonal blocks alone, in a launch of their own over NUM_BLOCKS_1D blocks per
+//time chunk; the build for the rest of the blocks (-D OFF_DIAGONAL_BLOCKS) skips them
+#define NUM_BLOCKS_1D                               ((NUM_ELEMENTS + BLOCK_DIM - 1u)/BLOCK_DIM)
+#ifdef DIAGONAL_BLOCKS
+#define TIME_STEP_DIV_N_TIMESTEPS                   (get_global_id(2)/NUM_BLOCKS_1D)
+#define DIAGONAL_INDEX                              (get_global_id(2)%NUM_BLOCKS_1D)
+#define BLOCK_ID_LOCAL                              (DIAGONAL_INDEX*(2u*NUM_BLOCKS_1D + 1u - DIAGONAL_INDEX)/2u) //blocks are numbered along the rows of the upper triangle
+#else
+#define TIME_STEP_DIV_N_TIMESTEPS                   (get_global_id(2)/NUM_BLOCKS)
+#define BLOCK_ID_LOCAL                              (get_global_id(2)%NUM_BLOCKS)
+#endif
+#define LOCAL_X                                     (get_local_id(0))
+#define LOCAL_Y                                     (get_local_id(1))
+
+//on a diagonal block (block_x == block_y) the 4 x 4 patches below the diagonal are never read, as the output is the upper
+//triangle. There the LOCAL_SIZE*(LOCAL_SIZE+1)/2 patches on or above the diagonal are handed to the lowest linear ids, and the
+//rest of the work items only help load the block, so whole wavefronts of them sit out the multiply-adds. Patch rows p and
+//LOCAL_SIZE-1-p together hold LOCAL_SIZE+1 patches, so the hand-out folds those pairs of rows into rows of LOCAL_SIZE+1
+#define NUM_UPPER_PATCHES                           (LOCAL_SIZE*(LOCAL_SIZE+1u)/2u)
+//with only those patches to correlate, the DIAGONAL_BLOCKS build (which has its own registers) loads TIME_UNROLL x
+//LOCAL_SIZE timesteps per pass instead of LOCAL_SIZE, so it runs twice as many multiply-adds between barriers
+#if defined(DIAGONAL_BLOCKS) && (N_TIME_CHUNKS_LOCAL%(2u*LOCAL_SIZE)) == 0u
+#define TIME_UNROLL                                 2u
+#else
+#define TIME_UNROLL                                 1u
+#endif
+
+
+//NUM_ELEMENTS needn't be a multiple of BLOCK_DIM: addresses into packed are in bytes (i.e. elements), and the blocks of the last
+//block column and row are edge tiles. There, elements past NUM_ELEMENTS load as 0x88 (0 + 0i, without touching memory)
+//and groups of 4 entirely past it aren't written out. With a multiple of BLOCK_DIM none of this is compiled in
+#if (NUM_ELEMENTS%BLOCK_DIM) == 0u
+#define LOAD_4_ELEMENTS(addr, element)              packed[(addr)>>2u]
+#define GROUP_IN_RANGE(element_x, element_y)        1
+#else
+#define LOAD_4_ELEMENTS(addr, element)              load_4_elements(packed, (addr), (element))
+#define GROUP_IN_RANGE(element_x, element_y)        ((element_x) < NUM_ELEMENTS && (element_y) < NUM_ELEMENTS)
+
+uint load_4_elements(__global const uint *packed, uint addr, uint element){
+    if (element + 4u <= NUM_ELEMENTS)
+#if (NUM_ELEMENTS%4u) == 0u
+        return packed[addr>>2u];
+#else
+        return as_uint(vload4(0u, (__global const uchar *)packed + addr)); //rows don't start on 4 B boundaries
+#endif
+    uint word = 0x88888888u;
+    for (uint k = 0u; element + k < NUM_ELEMENTS; k++)
+        word = (word & ~(0xffu << (8u*k))) | ((uint)((__global const uchar *)packed)[addr + k] << (8u*k));
+    return word;
+}
+#endif
+
+__kernel __attribute__((reqd_work_group_size(LOCAL_SIZE, LOCAL_SIZE, 1)))
+void corr ( __global const uint *packed, //packed data loaded in groups of 4x(4+4bit) data to use the bus most efficiently
+            __global  int *corr_buf, //buffer to save correlated results into
+            __constant uint *id_x_map,
+            __constant uint *id_y_map,
+            __global int *block_lock)
+{
+    __local uint stillPackedX[TIME_UNROLL*LOCAL_SIZE*BLOCK_DIM]; //1kB with 32 x 32 tiles
+    __local uint stillPackedY[TIME_UNROLL*LOCAL_SIZE*BLOCK_DIM]; //1kB with 32 x 32 tiles
+    __local uint temp_y_real[TIME_UNROLL*LOCAL_SIZE*BLOCK_DIM]; //1kB with 32 x 32 tiles
+
+    const uint block_x = id_x_map[BLOCK_ID_LOCAL]; //column of output block
+    const uint block_y = id_y_map[BLOCK_ID_LOCAL]; //row of output block  //if NUM_BLOCKS = 1, then BLOCK_ID = 0 then block_x = block_y = 0
+#ifdef OFF_DIAGONAL_BLOCKS
+    if (block_x == block_y) //done by the DIAGONAL_BLOCKS build
+        return;
+#endif
+    //the 4 x 4 patch of the block this work item correlates: its own, except on diagonal blocks (see NUM_UPPER_PATCHES)
+    uint patch_x = LOCAL_X;
+    uint patch_y = LOCAL_Y;
+    uint patch_active = 1u;
+    if (block_x == block_y){
+        const uint linear_id = LOCAL_Y*LOCAL_SIZE + LOCAL_X;
+        const uint fold_row = linear_id/(LOCAL_SIZE+1u);
+        const uint fold_col = linear_id%(LOCAL_SIZE+1u);
+        patch_y = (fold_col < LOCAL_SIZE - fold_row) ? fold_row : LOCAL_SIZE-1u - fold_row;
+        patch_x = (fold_col < LOCAL_SIZE - fold_row) ? fold_row + fold_col : fold_col - 1u;
+        patch_active = (linear_id < NUM_UPPER_PATCHES);
+    }
+    //nor is anything of a patch that starts past the last element (in an edge tile), so it isn't computed either
+    if (!GROUP_IN_RANGE(4u*(BLOCK_DIM_div_4*block_x + patch_x), 4u*(BLOCK_DIM_div_4*block_y + patch_y)))
+        patch_active = 0u;
+
+    /// The address for the x elements for the data
+    //the common part that can be used for x and y is calculated first
+    uint addr_x = (   LOCAL_Y*NUM_ELEMENTS //LOCAL_Y used for grabbing a time offset here
+                    + TIME_STEP_DIV_N_TIMESTEPS * N_TIME_CHUNKS_LOCAL *NUM_ELEMENTS); //frequency offset
+
+    /// The address for the y elements for the data
+    const uint element_y = 4u*(BLOCK_DIM_div_4*block_y + LOCAL_X); //first of the 4 y (and x) elements this work item loads
+    const uint element_x = 4u*(BLOCK_DIM_div_4*block_x + LOCAL_X);
+    uint addr_y = element_y + addr_x; //offset into 1D input for the y lookup, using LOCAL X as the 0-7 offset for the group
+
+    addr_x += element_x; //the x address
+
+    uint corr_a0=0u;
+    uint corr_b0=0u;
+    uint corr_c0=0u;
+    uint corr_d0=0u;
+    uint corr_e0=0u;
+    uint corr_f0=0u;
+    uint corr_g0=0u;
+    uint corr_h0=0u;
+    uint corr_a1=0u;
+    uint corr_b1=0u;
+    uint corr_c1=0u;
+    uint corr_d1=0u;
+    uint corr_e1=0u;
+    uint corr_f1=0u;
+    uint corr_g1=0u;
+    uint corr_h1=0u;
+    uint corr_a2=0u;
+    uint corr_b2=0u;
+    uint corr_c2=0u;
+    uint corr_d2=0u;
+    uint corr_e2=0u;
+    uint corr_f2=0u;
+    uint corr_g2=0u;
+    uint corr_h2=0u;
+    uint overflow_a=0u;
+    uint overflow_b=0u;
+    uint overflow_c=0u;
+    uint overflow_d=0u;
+    uint overflow_e=0u;
+    uint overflow_f=0u;
+    uint overflow_g=0u;
+    uint overflow_h=0u;
+    //vectors (i.e., uint4) make clearer code, but empirically had a very slight performance cost
+
+    uint4 temp_stillPackedX;
+    uint4 temp_stillPackedY;
+    uint4 sumX = (uint4)(0u,0u,0u,0u); //offset-encoded sums of this work item's x (and y) elements over the chunk,
+    uint4 sumY = (uint4)(0u,0u,0u,0u); //packed as real << 16 | imaginary like stillPacked: at most 15 x 1912 per half
+    uint4 temp_Y; //new for this method--means only a reduction of 4 vgprs...
+    uint temp_pa;
+    uint pa;
+    uint la;
+    uint addr_o;
+
+    uint extra_counter = 0; //should be a scalar, so no extra cost
+
+//        uint address_offset= TIME_STEP_DIV_N_TIMESTEPS*2*N_TIME_CHUNKS_LOCAL*NUM_ELEMENTS_div_4 +repeat_count*N_TIME_CHUNKS_LOCAL*NUM_ELEMENTS_div_4;
+        for (uint i = 0; i < N_TIME_CHUNKS_LOCAL; i += TIME_UNROLL*LOCAL_SIZE){ //256 is a number of timesteps to do a local accum before saving to global memory
+            for (uint u = 0; u < TIME_UNROLL; u++){ //rows u*LOCAL_SIZE + LOCAL_Y of the pass
+                pa=LOAD_4_ELEMENTS((i + u*LOCAL_SIZE) * NUM_ELEMENTS + addr_y, element_y);// + address_offset]; //add an additional time offset
+                la=((u*LOCAL_SIZE + LOCAL_Y)*BLOCK_DIM + (LOCAL_X<<2)); //BLOCK_DIM is a power of 2, so this is still a shift and an or
+
+                if (u == 0u) //the previous pass has been read in full before any of it is overwritten
+                    barrier(CLK_LOCAL_MEM_FENCE);
+                //unpack y values slightly (from 2 values per byte to 2 values per 4 bytes and fill local memory
+                //first 'invert' the imaginary values (i.e. 15 - offset-encoded imaginary values)
+                pa = pa ^0x0f0f0f0f; //exclusive or--flip the bits for the imaginary parts to 'invert'
+                stillPackedY[la]    = ((pa & 0x000000f0) << 12u) | ((pa & 0x0000000f) >>  0u);
+                stillPackedY[la+1u] = ((pa & 0x0000f000) <<  4u) | ((pa & 0x00000f00) >>  8u);
+                stillPackedY[la+2u] = ((pa & 0x00f00000) >>  4u) | ((pa & 0x000f0000) >> 16u);
+                stillPackedY[la+3u] = ((pa & 0xf0000000) >> 12u) | ((pa & 0x0f000000) >> 24u);
+
+                //prepare the y array for quick lookup from local (and minimal number of calculations in the inner loop)
+                temp_y_real[la]     = (pa & 0x000000f0)  >>  4u;
+                temp_y_real[la+1u]  = (pa & 0x0000f000)  >> 12u;
+                temp_y_real[la+2u]  = (pa & 0x00f00000)  >> 20u;
+                temp_y_real[la+3u]  = (pa & 0xf0000000)  >> 28u;
+
+                //barrier(CLK_LOCAL_MEM_FENCE);//does not appear to be needed on the current AMD architectures--things go in lockstep
+
+                //unpack x values slightly (from 2 values per byte to 2 values per 4 bytes)
+                temp_pa=LOAD_4_ELEMENTS((i + u*LOCAL_SIZE) * NUM_ELEMENTS + addr_x, element_x);
+
+                stillPackedX[la]    = ((temp_pa & 0x000000f0) << 12u) | ((temp_pa & 0x0000000f) >>  0u);
+                stillPackedX[la+1u] = ((temp_pa & 0x0000f000) <<  4u) | ((temp_pa & 0x00000f00) >>  8u);
+                stillPackedX[la+2u] = ((temp_pa & 0x00f00000) >>  4u) | ((temp_pa & 0x000f0000) >> 16u);
+                stillPackedX[la+3u] = ((temp_pa & 0xf0000000) >> 12u) | ((temp_pa & 0x0f000000) >> 24u);
+            }
+            barrier(CLK_LOCAL_MEM_FENCE);
+            if (!patch_active) //nothing of this patch is kept: the work item only helps load the block
+                continue;
+
+            for (uint j=0; j< TIME_UNROLL*LOCAL_SIZE; j++){
+                temp_stillPackedX = vload4(mad24(j, LOCAL_SIZE, patch_x), stillPackedX);
+                temp_stillPackedY = vload4(mad24(j, LOCAL_SIZE, patch_y), stillPackedY);
+                sumX += temp_stillPackedX;
+                sumY += temp_stillPackedY;
+
+                temp_Y = vload4(mad24(j, LOCAL_SIZE, patch_y), temp_y_real);
+
+                pa = temp_stillPackedX.s0;
+                temp_pa = pa & 0x000f0000;
+                corr_a0 = mad24(pa, temp_stillPackedY.s0, corr_a0);
+                corr_b0 = mad24(pa, temp_stillPackedY.s1, corr_b0);
+                corr_c0 = mad24(pa, temp_stillPackedY.s2, corr_c0);
+                corr_d0 = mad24(pa, temp_stillPackedY.s3, corr_d0);
+
+                pa = temp_stillPackedX.s1;
+                temp_pa = temp_pa | ((pa >> 16u) & 0xf); //both reals repacked //do this outside the loop?
+                corr_a1 = mad24(pa, temp_stillPackedY.s0, corr_a1);
+                corr_b1 = mad24(pa, temp_stillPackedY.s1, corr_b1);
+                corr_c1 = mad24(pa, temp_stillPackedY.s2, corr_c1);
+                corr_d1 = mad24(pa, temp_stillPackedY.s3, corr_d1);
+
+                //the extra term needed to get the overall real part in the correlation
+                //real component 1 for two elements against the temp_Y
+                corr_a2 = mad24(temp_pa, temp_Y.s0, corr_a2);
+                corr_b2 = mad24(temp_pa, temp_Y.s1, corr_b2);
+                corr_c2 = mad24(temp_pa, temp_Y.s2, corr_c2);
+                corr_d2 = mad24(temp_pa, temp_Y.s3, corr_d2);
+
+                //next two
+                pa = temp_stillPackedX.s2;
+                temp_pa = pa & 0x000f0000;
+                corr_e0 = mad24(pa, temp_stillPackedY.s0, corr_e0);
+                corr_f0 = mad24(pa, temp_stillPackedY.s1, corr_f0);
+                corr_g0 = mad24(pa, temp_stillPackedY.s2, corr_g0);
+                corr_h0 = mad24(pa, temp_stillPackedY.s3, corr_h0);
+
+                pa = temp_stillPackedX.s3;
+                temp_pa = temp_pa | ((pa >> 16u) & 0xf); //both reals packed
+                corr_e1 = mad24(pa, temp_stillPackedY.s0, corr_e1);
+                corr_f1 = mad24(pa, temp_stillPackedY.s1, corr_f1);
+                corr_g1 = mad24(pa, temp_stillPackedY.s2, corr_g1);
+                corr_h1 = mad24(pa, temp_stillPackedY.s3, corr_h1);
+
+                corr_e2 = mad24(temp_pa, temp_Y.s0, corr_e2);
+                corr_f2 = mad24(temp_pa, temp_Y.s1, corr_f2);
+                corr_g2 = mad24(temp_pa, temp_Y.s2, corr_g2);
+                corr_h2 = mad24(temp_pa, temp_Y.s3, corr_h2);
+
+                extra_counter++;
+            }
+            // add code to keep track of possible overflows
+            // it is known that overflows will only possibly occur after 145 iterations.
+
+            if (extra_counter >= OVERFLOW_CHECK_ITERATIONS){ // 120 because taking only top 3 bits for the Im part
+                //overflow data is packed 8 4 4 (Im Re-Pt1 Re-Pt2) x 2 and accumulated.  These
+                //overflow bits limit the number of iterations in a single kernel.
+                //15 overflows max in the 1 b nibbles: 15 * 120 = 1800 iterations max,
+                //but it can't overflow 15 times in 15 iterations.
+                //Max iter = 2272 for complete correctness
+                //(note that having larger overflow section would mean more registers would be used and
+                //the kernel would slow down--we are VGPR limited at the moment)
+                overflow_a  += (((corr_a0 & 0xE0000000)>>5)  | ((corr_a0 & 0x00008000)<<5)
+                              | ((corr_a1 & 0xE0000000)>>21) | ((corr_a1 & 0x00008000)>>11)
+                              | ((corr_a2 & 0x80008000)>>15) );
+
+                overflow_b  += (((corr_b0 & 0xE0000000)>>5)  | ((corr_b0 & 0x00008000)<<5)
+                              | ((corr_b1 & 0xE0000000)>>21) | ((corr_b1 & 0x00008000)>>11)
+                              | ((corr_b2 & 0x80008000)>>15) );
+
+                overflow_c  += (((corr_c0 & 0xE0000000)>>5)  | ((corr_c0 & 0x00008000)<<5)
+                              | ((corr_c1 & 0xE0000000)>>21) | ((corr_c1 & 0x00008000)>>11)
+                              | ((corr_c2 & 0x80008000)>>15) );
+
+                overflow_d  += (((corr_d0 & 0xE0000000)>>5)  | ((corr_d0 & 0x00008000)<<5)
+                              | ((corr_d1 & 0xE0000000)>>21) | ((corr_d1 & 0x00008000)>>11)
+                              | ((corr_d2 & 0x80008000)>>15) );
+
+                overflow_e  += (((corr_e0 & 0xE0000000)>>5)  | ((corr_e0 & 0x00008000)<<5)
+                              | ((corr_e1 & 0xE0000000)>>21) | ((corr_e1 & 0x00008000)>>11)
+                              | ((corr_e2 & 0x80008000)>>15) );
+
+                overflow_f  += (((corr_f0 & 0xE0000000)>>5)  | ((corr_f0 & 0x00008000)<<5)
+                              | ((corr_f1 & 0xE0000000)>>21) | ((corr_f1 & 0x00008000)>>11)
+                              | ((corr_f2 & 0x80008000)>>15) );
+
+                overflow_g  += (((corr_g0 & 0xE0000000)>>5)  | ((corr_g0 & 0x00008000)<<5)
+                              | ((corr_g1 & 0xE0000000)>>21) | ((corr_g1 & 0x00008000)>>11)
+                              | ((corr_g2 & 0x80008000)>>15) );
+
+                overflow_h  += (((corr_h0 & 0xE0000000)>>5)  | ((corr_h0 & 0x00008000)<<5)
+                              | ((corr_h1 & 0xE0000000)>>21) | ((corr_h1 & 0x00008000)>>11)
+                              | ((corr_h2 & 0x80008000)>>15) );
+
+                corr_a0 = corr_a0 &0x1FFF7FFF;
+                corr_a1 = corr_a1 &0x1FFF7FFF;
+                corr_a2 = corr_a2 &0x7FFF7FFF;
+                corr_b0 = corr_b0 &0x1FFF7FFF;
+                corr_b1 = corr_b1 &0x1FFF7FFF;
+                corr_b2 = corr_b2 &0x7FFF7FFF;
+                corr_c0 = corr_c0 &0x1FFF7FFF;
+                corr_c1 = corr_c1 &0x1FFF7FFF;
+                corr_c2 = corr_c2 &0x7FFF7FFF;
+                corr_d0 = corr_d0 &0x1FFF7FFF;
+                corr_d1 = corr_d1 &0x1FFF7FFF;
+                corr_d2 = corr_d2 &0x7FFF7FFF;
+                corr_e0 = corr_e0 &0x1FFF7FFF;
+                corr_e1 = corr_e1 &0x1FFF7FFF;
+                corr_e2 = corr_e2 &0x7FFF7FFF;
+                corr_f0 = corr_f0 &0x1FFF7FFF;
+                corr_f1 = corr_f1 &0x1FFF7FFF;
+                corr_f2 = corr_f2 &0x7FFF7FFF;
+                corr_g0 = corr_g0 &0x1FFF7FFF;
+                corr_g1 = corr_g1 &0x1FFF7FFF;
+                corr_g2 = corr_g2 &0x7FFF7FFF;
+                corr_h0 = corr_h0 &0x1FFF7FFF;
+                corr_h1 = corr_h1 &0x1FFF7FFF;
+                corr_h2 = corr_h2 &0x7FFF7FFF;
+
+                extra_counter = 0;
+            }
+
+        }
+
+
+        //this chunk's preseed correction, as preseed computes it from the whole frame's sums. The y imaginary parts were
+        //inverted (15 - value) before they were summed, so they are turned back here
+        uint8 xVals = (uint8)(sumX.s0 >> 16u, sumX.s0 & 0xffff, sumX.s1 >> 16u, sumX.s1 & 0xffff,
+                              sumX.s2 >> 16u, sumX.s2 & 0xffff, sumX.s3 >> 16u, sumX.s3 & 0xffff);
+        uint8 yVals = (uint8)(sumY.s0 >> 16u, 15u*N_TIME_CHUNKS_LOCAL - (sumY.s0 & 0xffff), sumY.s1 >> 16u, 15u*N_TIME_CHUNKS_LOCAL - (sumY.s1 & 0xffff),
+                              sumY.s2 >> 16u, 15u*N_TIME_CHUNKS_LOCAL - (sumY.s2 & 0xffff), sumY.s3 >> 16u, 15u*N_TIME_CHUNKS_LOCAL - (sumY.s3 & 0xffff));
+        int  xValOffsets[8u];
+        int  yValOffsets[8u];
+        xValOffsets[0u] = -8*((int)xVals.s0) + 7*((int)xVals.s1);
+        xValOffsets[1u] =  8*((int)xVals.s1) + 7*((int)xVals.s0);
+        xValOffsets[2u] = -8*((int)xVals.s2) + 7*((int)xVals.s3);
+        xValOffsets[3u] =  8*((int)xVals.s3) + 7*((int)xVals.s2);
+        xValOffsets[4u] = -8*((int)xVals.s4) + 7*((int)xVals.s5);
+        xValOffsets[5u] =  8*((int)xVals.s5) + 7*((int)xVals.s4);
+        xValOffsets[6u] = -8*((int)xVals.s6) + 7*((int)xVals.s7);
+        xValOffsets[7u] =  8*((int)xVals.s7) + 7*((int)xVals.s6);
+        yValOffsets[0u] = -8*(((int)yVals.s0) + ((int)yVals.s1));
+        yValOffsets[1u] =  8*(((int)yVals.s0) - ((int)yVals.s1));
+        yValOffsets[2u] = -8*(((int)yVals.s2) + ((int)yVals.s3));
+        yValOffsets[3u] =  8*(((int)yVals.s2) - ((int)yVals.s3));
+        yValOffsets[4u] = -8*(((int)yVals.s4) + ((int)yVals.s5));
+        yValOffsets[5u] =  8*(((int)yVals.s4) - ((int)yVals.s5));
+        yValOffsets[6u] = -8*(((int)yVals.s6) + ((int)yVals.s7));
+        yValOffsets[7u] =  8*(((int)yVals.s6) - ((int)yVals.s7));
+
+        //output: 32 numbers--> 16 pairs of real/imag numbers
+        //32 * 8 (local_size(0)) * 8 (local_size(1)) = 2048 ints / block
+        addr_o = ((BLOCK_ID_LOCAL * BLOCK_SIZE) + (patch_y * 4u*OUTPUT_ROW) + (patch_x * 8u));// +((TIME_STEP_DIV_N_TIMESTEPS*SIZE_PER_SET)&0xf)) ; //extra part cycles through outputs
+
+
+    //     custom block spin-lock section
+        if (LOCAL_X == 0 && LOCAL_Y == 0){
+            while(atomic_cmpxchg(&block_lock[BLOCK_ID_LOCAL],0,1)); //wait until unlocked
+        }
+
+            barrier(CLK_GLOBAL_MEM_FENCE); //sync point for the group
+            if (patch_active){
+                //note that to be careful, each output needs to include their overflow protection values
+
+                corr_buf[addr_o+0u]   += (((corr_a2 >> 16u)& 0xffff) + ((overflow_a  & 0x000F0000)>>  1))  - ((corr_a0 & 0xFFFF) + ((overflow_a &0x00F00000)>> 5)) + N_TIME_CHUNKS_LOCAL_x_128 + xValOffsets[0] + yValOffsets[0]; //real value
+                corr_buf[addr_o+1u]   += xValOffsets[1] + yValOffsets[1] - (((corr_a0 >> 16u)& 0xffff) + ((overflow_a  & 0xFF000000)>> 11)); //imag value
+                corr_buf[addr_o+2u]   += (((corr_a2 >>  0u)& 0xffff) + ((overflow_a  & 0x0000000F)<< 15))  - ((corr_a1 & 0xFFFF) + ((overflow_a &0x000000F0)<<11)) + N_TIME_CHUNKS_LOCAL_x_128 + xValOffsets[2] + yValOffsets[0];
+                corr_buf[addr_o+3u]   += xValOffsets[3] + yValOffsets[1] - (((corr_a1 >> 16u)& 0xffff) + ((overflow_a  & 0x0000FF00)<<  5));
+                corr_buf[addr_o+4u]   += (((corr_e2 >> 16u)& 0xffff) + ((overflow_e  & 0x000F0000)>>  1))  - ((corr_e0 & 0xFFFF) + ((overflow_e &0x00F00000)>> 5)) + N_TIME_CHUNKS_LOCAL_x_128 + xValOffsets[4] + yValOffsets[0];
+                corr_buf[addr_o+5u]   += xValOffsets[5] + yValOffsets[1] - (((corr_e0 >> 16u)& 0xffff) + ((overflow_e  & 0xFF000000)>> 11));
+                corr_buf[addr_o+6u]   += (((corr_e2 >>  0u)& 0xffff) + ((overflow_e  & 0x0000000F)<< 15))  - ((corr_e1 & 0xFFFF) + ((overflow_e &0x000000F0)<<11)) + N_TIME_CHUNKS_LOCAL_x_128 + xValOffsets[6] + yValOffsets[0];
+                corr_buf[addr_o+7u]   += xValOffsets[7] + yValOffsets[1] - (((corr_e1 >> 16u)& 0xffff) + ((overflow_e  & 0x0000FF00)<<  5));
+
+                //next 4 complex numbers from the next row
+                corr_buf[addr_o+OUTPUT_ROW+0u]  += (((corr_b2 >> 16u)& 0xffff) + ((overflow_b  & 0x000F0000)>>  1))  - ((corr_b0 & 0xFFFF) + ((overflow_b &0x00F00000)>> 5)) + N_TIME_CHUNKS_LOCAL_x_128 + xValOffsets[0] + yValOffsets[2]; //real value
+                corr_buf[addr_o+OUTPUT_ROW+1u]  += xValOffsets[1] + yValOffsets[3] - (((corr_b0 >> 16u)& 0xffff) + ((overflow_b  & 0xFF000000)>> 11)); //imag value
+                corr_buf[addr_o+OUTPUT_ROW+2u]  += (((corr_b2 >>  0u)& 0xffff) + ((overflow_b  & 0x0000000F)<< 15))  - ((corr_b1 & 0xFFFF) + ((overflow_b &0x000000F0)<<11)) + N_TIME_CHUNKS_LOCAL_x_128 + xValOffsets[2] + yValOffsets[2];
+                corr_buf[addr_o+OUTPUT_ROW+3u]  += xValOffsets[3] + yValOffsets[3] - (((corr_b1 >> 16u)& 0xffff) + ((overflow_b  & 0x0000FF00)<<  5));
+                corr_buf[addr_o+OUTPUT_ROW+4u]  += (((corr_f2 >> 16u)& 0xffff) + ((overflow_f  & 0x000F0000)>>  1))  - ((corr_f0 & 0xFFFF) + ((overflow_f &0x00F00000)>> 5)) + N_TIME_CHUNKS_LOCAL_x_128 + xValOffsets[4] + yValOffsets[2];
+                corr_buf[addr_o+OUTPUT_ROW+5u]  += xValOffsets[5] + yValOffsets[3] - (((corr_f0 >> 16u)& 0xffff) + ((overflow_f  & 0xFF000000)>> 11));
+                corr_buf[addr_o+OUTPUT_ROW+6u]  += (((corr_f2 >>  0u)& 0xffff) + ((overflow_f  & 0x0000000F)<< 15))  - ((corr_f1 & 0xFFFF) + ((overflow_f &0x000000F0)<<11)) + N_TIME_CHUNKS_LOCAL_x_128 + xValOffsets[6] + yValOffsets[2];
+                corr_buf[addr_o+OUTPUT_ROW+7u]  += xValOffsets[7] + yValOffsets[3] - (((corr_f1 >> 16u)& 0xffff) + ((overflow_f  & 0x0000FF00)<<  5));
+
+                corr_buf[addr_o+2u*OUTPUT_ROW+0u] += (((corr_c2 >> 16u)& 0xffff) + ((overflow_c  & 0x000F0000)>>  1))  - ((corr_c0 & 0xFFFF) + ((overflow_c &0x00F00000)>> 5)) + N_TIME_CHUNKS_LOCAL_x_128 + xValOffsets[0] + yValOffsets[4]; //real value
+                corr_buf[addr_o+2u*OUTPUT_ROW+1u] += xValOffsets[1] + yValOffsets[5] - (((corr_c0 >> 16u)& 0xffff) + ((overflow_c  & 0xFF000000)>> 11)); //imag value
+                corr_buf[addr_o+2u*OUTPUT_ROW+2u] += (((corr_c2 >>  0u)& 0xffff) + ((overflow_c  & 0x0000000F)<< 15))  - ((corr_c1 & 0xFFFF) + ((overflow_c &0x000000F0)<<11)) + N_TIME_CHUNKS_LOCAL_x_128 + xValOffsets[2] + yValOffsets[4];
+                corr_buf[addr_o+2u*OUTPUT_ROW+3u] += xValOffsets[3] + yValOffsets[5] - (((corr_c1 >> 16u)& 0xffff) + ((overflow_c  & 0x0000FF00)<<  5));
+                corr_buf[addr_o+2u*OUTPUT_ROW+4u] += (((corr_g2 >> 16u)& 0xffff) + ((overflow_g  & 0x000F0000)>>  1))  - ((corr_g0 & 0xFFFF) + ((overflow_g &0x00F00000)>> 5)) + N_TIME_CHUNKS_LOCAL_x_128 + xValOffsets[4] + yValOffsets[4];
+                corr_buf[addr_o+2u*OUTPUT_ROW+5u] += xValOffsets[5] + yValOffsets[5] - (((corr_g0 >> 16u)& 0xffff) + ((overflow_g  & 0xFF000000)>> 11));
+                corr_buf[addr_o+2u*OUTPUT_ROW+6u] += (((corr_g2 >>  0u)& 0xffff) + ((overflow_g  & 0x0000000F)<< 15))  - ((corr_g1 & 0xFFFF) + ((overflow_g &0x000000F0)<<11)) + N_TIME_CHUNKS_LOCAL_x_128 + xValOffsets[6] + yValOffsets[4];
+                corr_buf[addr_o+2u*OUTPUT_ROW+7u] += xValOffsets[7] + yValOffsets[5] - (((corr_g1 >> 16u)& 0xffff) + ((overflow_g  & 0x0000FF00)<<  5));
+
+                corr_buf[addr_o+3u*OUTPUT_ROW+0u] += (((corr_d2 >> 16u)& 0xffff) + ((overflow_d  & 0x000F0000)>>  1))  - ((corr_d0 & 0xFFFF) + ((overflow_d &0x00F00000)>> 5)) + N_TIME_CHUNKS_LOCAL_x_128 + xValOffsets[0] + yValOffsets[6]; //real value
+                corr_buf[addr_o+3u*OUTPUT_ROW+1u] += xValOffsets[1] + yValOffsets[7] - (((corr_d0 >> 16u)& 0xffff) + ((overflow_d  & 0xFF000000)>> 11)); //imag value
+                corr_buf[addr_o+3u*OUTPUT_ROW+2u] += (((corr_d2 >>  0u)& 0xffff) + ((overflow_d  & 0x0000000F)<< 15))  - ((corr_d1 & 0xFFFF) + ((overflow_d &0x000000F0)<<11)) + N_TIME_CHUNKS_LOCAL_x_128 + xValOffsets[2] + yValOffsets[6];
+                corr_buf[addr_o+3u*OUTPUT_ROW+3u] += xValOffsets[3] + yValOffsets[7] - (((corr_d1 >> 16u)& 0xffff) + ((overflow_d  & 0x0000FF00)<<  5));
+                corr_buf[addr_o+3u*OUTPUT_ROW+4u] += (((corr_h2 >> 16u)& 0xffff) + ((overflow_h  & 0x000F0000)>>  1))  - ((corr_h0 & 0xFFFF) + ((overflow_h &0x00F00000)>> 5)) + N_TIME_CHUNKS_LOCAL_x_128 + xValOffsets[4] + yValOffsets[6];
+                corr_buf[addr_o+3u*OUTPUT_ROW+5u] += xValOffsets[5] + yValOffsets[7] - (((corr_h0 >> 16u)& 0xffff) + ((overflow_h  & 0xFF000000)>> 11));
+                corr_buf[addr_o+3u*OUTPUT_ROW+6u] += (((corr_h2 >>  0u)& 0xffff) + ((overflow_h  & 0x0000000F)<< 15))  - ((corr_h1 & 0xFFFF) + ((overflow_h &0x000000F0)<<11)) + N_TIME_CHUNKS_LOCAL_x_128 + xValOffsets[6] + yValOffsets[6];
+                corr_buf[addr_o+3u*OUTPUT_ROW+7u] += xValOffsets[7] + yValOffsets[7] - (((corr_h1 >> 16u)& 0xffff) + ((overflow_h  & 0x0000FF00)<<  5));
+
+            }
+            barrier(CLK_GLOBAL_MEM_FENCE); //make sure everyone is done
+
+        if (LOCAL_X == 0 && LOCAL_Y == 0)
+            block_lock[BLOCK_ID_LOCAL]=0;
+
+}
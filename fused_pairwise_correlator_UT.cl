@@ -0,0 +1,317 @@
+//fused version of pairwise_correlator_UT.cl (-u). Besides correlating, each work item sums the offset-encoded values
+//of its 4 x and 4 y elements over the work-group's time chunk as they stream through, and adds that chunk's share of
+//the preseed_multifreq_UT.cl correction when it writes out. Summed over the chunks that is exactly
+//what preseed writes, so offsetAccumulateElements and preseed (with their global atomics and second read of the input)
+//aren't needed; the output only has to start at zero.
+//NUM_ELEMENTS, NUM_FREQUENCIES, NUM_BLOCKS defined at compile time
+//#define NUM_ELEMENTS                                32u // 2560u eventually //minimum 32
+//#define NUM_FREQUENCIES                             128u
+//#define NUM_BLOCKS                                  1u  // N(N+1)/2 where N=(NUM_ELEMENTS/32)
+#define N_TIME_CHUNKS_LOCAL                         NUM_TIME_ACCUM //256u
+#define N_TIME_CHUNKS_LOCAL_x_128                   (N_TIME_CHUNKS_LOCAL*128u) //this chunk's share of preseed's NUM_TIMESAMPLES*128
+#define _INTLENGTH_x_NUM_ELEMENTS_x_NUM_FREQUENCIES (N_TIME_CHUNKS_LOCAL*NUM_ELEMENTS*NUM_FREQUENCIES)
+#define NUM_ELEMENTS_x_NUM_FREQUENCIES              (NUM_ELEMENTS*NUM_FREQUENCIES)
+#define BLOCK_SIZE                                  (BLOCK_DIM*BLOCK_DIM*2u) //ints in an output block (BLOCK_DIM x BLOCK_DIM complex values)
+#define NUM_BLOCKS_x_BLOCK_SIZE                     (NUM_BLOCKS*BLOCK_SIZE)
+#define OUTPUT_ROW                                  (BLOCK_DIM*2u) //ints in a row of an output block
+
+#define LOCAL_SIZE                                  (BLOCK_DIM/4u) //BLOCK_DIM (the tile edge: 16, 32 or 64) defined at compile time; a work item does 4 x 4 of the tile
+#define BLOCK_DIM_div_4                             (BLOCK_DIM/4u)
+
+
+#define FREQUENCY_BAND                              (get_group_id(1))
+//-D DIAGONAL_BLOCKS builds corr for the diagonal blocks alone, in a launch of their own over NUM_BLOCKS_1D blocks per
+//time chunk; the build for the rest of the blocks (-D OFF_DIAGONAL_BLOCKS) skips them
+#define NUM_BLOCKS_1D                               ((NUM_ELEMENTS + BLOCK_DIM - 1u)/BLOCK_DIM)
+#ifdef DIAGONAL_BLOCKS
+#define TIME_STEP_DIV_INTLENGTH                     (get_global_id(2)/NUM_BLOCKS_1D)
+#define DIAGONAL_INDEX                              (get_global_id(2)%NUM_BLOCKS_1D)
+#define BLOCK_ID_CORR                               (DIAGONAL_INDEX*(2u*NUM_BLOCKS_1D + 1u - DIAGONAL_INDEX)/2u) //blocks are numbered along the rows of the upper triangle
+#else
+#define TIME_STEP_DIV_INTLENGTH                     (get_global_id(2)/NUM_BLOCKS)
+#define BLOCK_ID_CORR                               (get_global_id(2)%NUM_BLOCKS)
+#endif
+#define LOCAL_X                                     (get_local_id(0))
+#define LOCAL_Y                                     (get_local_id(1))
+
+//on a diagonal block (block_x == block_y) the 4 x 4 patches below the diagonal are never read, as the output is the upper
+//triangle. There the LOCAL_SIZE*(LOCAL_SIZE+1)/2 patches on or above the diagonal are handed to the lowest linear ids, and the
+//rest of the work items only help load the block, so whole wavefronts of them sit out the multiply-adds. Patch rows p and
+//LOCAL_SIZE-1-p together hold LOCAL_SIZE+1 patches, so the hand-out folds those pairs of rows into rows of LOCAL_SIZE+1
+#define NUM_UPPER_PATCHES                           (LOCAL_SIZE*(LOCAL_SIZE+1u)/2u)
+//with only those patches to correlate, the DIAGONAL_BLOCKS build (which has its own registers) loads TIME_UNROLL x
+//LOCAL_SIZE timesteps per pass instead of LOCAL_SIZE, so it runs twice as many multiply-adds between barriers
+#if defined(DIAGONAL_BLOCKS) && (N_TIME_CHUNKS_LOCAL%(2u*LOCAL_SIZE)) == 0u
+#define TIME_UNROLL                                 2u
+#else
+#define TIME_UNROLL                                 1u
+#endif
+
+
+//NUM_ELEMENTS needn't be a multiple of BLOCK_DIM: addresses into packed are in bytes (i.e. elements), and the blocks of the last
+//block column and row are edge tiles. There, elements past NUM_ELEMENTS load as 0x88 (0 + 0i, without touching memory)
+//and groups of 4 entirely past it aren't written out. With a multiple of BLOCK_DIM none of this is compiled in
+#if (NUM_ELEMENTS%BLOCK_DIM) == 0u
+#define LOAD_4_ELEMENTS(addr, element)              packed[(addr)>>2u]
+#define GROUP_IN_RANGE(element_x, element_y)        1
+#else
+#define LOAD_4_ELEMENTS(addr, element)              load_4_elements(packed, (addr), (element))
+#define GROUP_IN_RANGE(element_x, element_y)        ((element_x) < NUM_ELEMENTS && (element_y) < NUM_ELEMENTS)
+
+uint load_4_elements(__global const uint *packed, uint addr, uint element){
+    if (element + 4u <= NUM_ELEMENTS)
+#if (NUM_ELEMENTS%4u) == 0u
+        return packed[addr>>2u];
+#else
+        return as_uint(vload4(0u, (__global const uchar *)packed + addr)); //rows don't start on 4 B boundaries
+#endif
+    uint word = 0x88888888u;
+    for (uint k = 0u; element + k < NUM_ELEMENTS; k++)
+        word = (word & ~(0xffu << (8u*k))) | ((uint)((__global const uchar *)packed)[addr + k] << (8u*k));
+    return word;
+}
+#endif
+
+__kernel __attribute__((reqd_work_group_size(LOCAL_SIZE, LOCAL_SIZE, 1)))
+void corr ( __global const uint *packed,
+            __global  int *corr_buf,
+            __constant uint *id_x_map,
+            __constant uint *id_y_map,
+            __global int *block_lock)
+{
+    __local uint stillPackedY[TIME_UNROLL*LOCAL_SIZE*BLOCK_DIM];
+    __local uint stillPackedX[TIME_UNROLL*LOCAL_SIZE*BLOCK_DIM];
+    const uint block_x = id_x_map[BLOCK_ID_CORR]; //column of output block
+    const uint block_y = id_y_map[BLOCK_ID_CORR]; //row of output block  //if NUM_BLOCKS = 1, then BLOCK_ID = 0 then block_x = block_y = 0
+#ifdef OFF_DIAGONAL_BLOCKS
+    if (block_x == block_y) //done by the DIAGONAL_BLOCKS build
+        return;
+#endif
+    //the 4 x 4 patch of the block this work item correlates: its own, except on diagonal blocks (see NUM_UPPER_PATCHES)
+    uint patch_x = LOCAL_X;
+    uint patch_y = LOCAL_Y;
+    uint patch_active = 1u;
+    if (block_x == block_y){
+        const uint linear_id = LOCAL_Y*LOCAL_SIZE + LOCAL_X;
+        const uint fold_row = linear_id/(LOCAL_SIZE+1u);
+        const uint fold_col = linear_id%(LOCAL_SIZE+1u);
+        patch_y = (fold_col < LOCAL_SIZE - fold_row) ? fold_row : LOCAL_SIZE-1u - fold_row;
+        patch_x = (fold_col < LOCAL_SIZE - fold_row) ? fold_row + fold_col : fold_col - 1u;
+        patch_active = (linear_id < NUM_UPPER_PATCHES);
+    }
+    //nor is anything of a patch that starts past the last element (in an edge tile), so it isn't computed either
+    if (!GROUP_IN_RANGE(4u*(BLOCK_DIM_div_4*block_x + patch_x), 4u*(BLOCK_DIM_div_4*block_y + patch_y)))
+        patch_active = 0u;
+
+    /// The address for the x elements for the data
+    uint addr_x = (   LOCAL_Y*NUM_ELEMENTS_x_NUM_FREQUENCIES
+                    + TIME_STEP_DIV_INTLENGTH * _INTLENGTH_x_NUM_ELEMENTS_x_NUM_FREQUENCIES
+                    + FREQUENCY_BAND*NUM_ELEMENTS); //temporarily precompute an offset
+
+    /// The address for the y elements for the data
+    const uint element_y = 4u*(BLOCK_DIM_div_4*block_y + LOCAL_X); //first of the 4 y (and x) elements this work item loads
+    const uint element_x = 4u*(BLOCK_DIM_div_4*block_x + LOCAL_X);
+    uint addr_y = element_y + addr_x;
+
+    addr_x += element_x; //the x address
+
+    uint corr_a0=0u;
+    uint corr_b0=0u;
+    uint corr_c0=0u;
+    uint corr_d0=0u;
+    uint corr_e0=0u;
+    uint corr_f0=0u;
+    uint corr_g0=0u;
+    uint corr_h0=0u;
+    uint corr_a1=0u;
+    uint corr_b1=0u;
+    uint corr_c1=0u;
+    uint corr_d1=0u;
+    uint corr_e1=0u;
+    uint corr_f1=0u;
+    uint corr_g1=0u;
+    uint corr_h1=0u;
+    uint corr_a2=0u;
+    uint corr_b2=0u;
+    uint corr_c2=0u;
+    uint corr_d2=0u;
+    uint corr_e2=0u;
+    uint corr_f2=0u;
+    uint corr_g2=0u;
+    uint corr_h2=0u;
+    uint corr_a3=0u;
+    uint corr_b3=0u;
+    uint corr_c3=0u;
+    uint corr_d3=0u;
+    uint corr_e3=0u;
+    uint corr_f3=0u;
+    uint corr_g3=0u;
+    uint corr_h3=0u;
+    //vectors (i.e., uint4) make clearer code, but empirically had a very slight performance cost
+
+    uint4 temp_stillPackedY;
+    uint4 sumX = (uint4)(0u,0u,0u,0u); //offset-encoded sums of this work item's x (and y) elements over the chunk,
+    uint4 sumY = (uint4)(0u,0u,0u,0u); //packed as real << 16 | imaginary like stillPacked: at most 15 x 1912 per half
+    uint4 temp_stillPackedX;
+    uint temp_pa;
+    uint pa;
+
+    for (uint i = 0; i < N_TIME_CHUNKS_LOCAL; i += TIME_UNROLL*LOCAL_SIZE){
+        for (uint u = 0; u < TIME_UNROLL; u++){ //rows u*LOCAL_SIZE + LOCAL_Y of the pass
+            pa=LOAD_4_ELEMENTS((i + u*LOCAL_SIZE) * NUM_ELEMENTS_x_NUM_FREQUENCIES + addr_y, element_y);
+            uint la=((u*LOCAL_SIZE + LOCAL_Y)*BLOCK_DIM + (LOCAL_X<<2)); //BLOCK_DIM is a power of 2, so this is still a shift and an or
+
+            if (u == 0u) //the previous pass has been read in full before any of it is overwritten
+                barrier(CLK_LOCAL_MEM_FENCE);
+            stillPackedY[la]    = ((pa & 0x000000f0) << 12u) | ((pa & 0x0000000f) >>  0u);
+            stillPackedY[la+1u] = ((pa & 0x0000f000) <<  4u) | ((pa & 0x00000f00) >>  8u);
+            stillPackedY[la+2u] = ((pa & 0x00f00000) >>  4u) | ((pa & 0x000f0000) >> 16u);
+            stillPackedY[la+3u] = ((pa & 0xf0000000) >> 12u) | ((pa & 0x0f000000) >> 24u);
+            //barrier(CLK_LOCAL_MEM_FENCE);//is removing this a bad idea???  things should be in lock-step...
+
+            temp_pa=LOAD_4_ELEMENTS((i + u*LOCAL_SIZE) * NUM_ELEMENTS_x_NUM_FREQUENCIES + addr_x, element_x);
+
+            stillPackedX[la]    = ((temp_pa & 0x000000f0) << 12u) | ((temp_pa & 0x0000000f) >>  0u);
+            stillPackedX[la+1u] = ((temp_pa & 0x0000f000) <<  4u) | ((temp_pa & 0x00000f00) >>  8u);
+            stillPackedX[la+2u] = ((temp_pa & 0x00f00000) >>  4u) | ((temp_pa & 0x000f0000) >> 16u);
+            stillPackedX[la+3u] = ((temp_pa & 0xf0000000) >> 12u) | ((temp_pa & 0x0f000000) >> 24u);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (!patch_active) //nothing of this patch is kept: the work item only helps load the block
+            continue;
+
+        for (uint j=0; j< TIME_UNROLL*LOCAL_SIZE; j++){
+            temp_stillPackedY = vload4(mad24(j, LOCAL_SIZE, patch_y), stillPackedY);
+            temp_stillPackedX = vload4(mad24(j, LOCAL_SIZE, patch_x), stillPackedX);
+            sumX += temp_stillPackedX;
+            sumY += temp_stillPackedY;
+
+            pa = temp_stillPackedX.s0;
+
+            temp_pa = (pa >> 16u)  & 0xf; //real
+            corr_a0 = mad24(temp_pa, temp_stillPackedY.s0, corr_a0);
+            corr_b0 = mad24(temp_pa, temp_stillPackedY.s1, corr_b0);
+            corr_c0 = mad24(temp_pa, temp_stillPackedY.s2, corr_c0);
+            corr_d0 = mad24(temp_pa, temp_stillPackedY.s3, corr_d0);
+
+            temp_pa = pa          & 0xf; //imag
+            corr_a1 = mad24(temp_pa, temp_stillPackedY.s0, corr_a1);
+            corr_b1 = mad24(temp_pa, temp_stillPackedY.s1, corr_b1);
+            corr_c1 = mad24(temp_pa, temp_stillPackedY.s2, corr_c1);
+            corr_d1 = mad24(temp_pa, temp_stillPackedY.s3, corr_d1);
+
+            pa = temp_stillPackedX.s1;
+            temp_pa = (pa >> 16u) & 0xf; //real
+            corr_a2 = mad24(temp_pa, temp_stillPackedY.s0, corr_a2);
+            corr_b2 = mad24(temp_pa, temp_stillPackedY.s1, corr_b2);
+            corr_c2 = mad24(temp_pa, temp_stillPackedY.s2, corr_c2);
+            corr_d2 = mad24(temp_pa, temp_stillPackedY.s3, corr_d2);
+
+            temp_pa = pa          & 0xf; //imag
+            corr_a3 = mad24(temp_pa, temp_stillPackedY.s0, corr_a3);
+            corr_b3 = mad24(temp_pa, temp_stillPackedY.s1, corr_b3);
+            corr_c3 = mad24(temp_pa, temp_stillPackedY.s2, corr_c3);
+            corr_d3 = mad24(temp_pa, temp_stillPackedY.s3, corr_d3);
+
+            pa = temp_stillPackedX.s2;
+            temp_pa = (pa >> 16u) & 0xf;
+            corr_e0 = mad24(temp_pa, temp_stillPackedY.s0, corr_e0);
+            corr_f0 = mad24(temp_pa, temp_stillPackedY.s1, corr_f0);
+            corr_g0 = mad24(temp_pa, temp_stillPackedY.s2, corr_g0);
+            corr_h0 = mad24(temp_pa, temp_stillPackedY.s3, corr_h0);
+
+            temp_pa = pa          & 0xf; //imag
+            corr_e1 = mad24(temp_pa, temp_stillPackedY.s0, corr_e1);
+            corr_f1 = mad24(temp_pa, temp_stillPackedY.s1, corr_f1);
+            corr_g1 = mad24(temp_pa, temp_stillPackedY.s2, corr_g1);
+            corr_h1 = mad24(temp_pa, temp_stillPackedY.s3, corr_h1);
+
+            pa = temp_stillPackedX.s3;
+            temp_pa = (pa >> 16u) & 0xf;
+            corr_e2 = mad24(temp_pa, temp_stillPackedY.s0, corr_e2);
+            corr_f2 = mad24(temp_pa, temp_stillPackedY.s1, corr_f2);
+            corr_g2 = mad24(temp_pa, temp_stillPackedY.s2, corr_g2);
+            corr_h2 = mad24(temp_pa, temp_stillPackedY.s3, corr_h2);
+
+            temp_pa = pa          & 0xf; //imag
+            corr_e3 = mad24(temp_pa, temp_stillPackedY.s0, corr_e3);
+            corr_f3 = mad24(temp_pa, temp_stillPackedY.s1, corr_f3);
+            corr_g3 = mad24(temp_pa, temp_stillPackedY.s2, corr_g3);
+            corr_h3 = mad24(temp_pa, temp_stillPackedY.s3, corr_h3);
+        }
+    }
+    //this chunk's preseed correction, as preseed computes it from the whole frame's sums
+    uint8 xVals = (uint8)(sumX.s0 >> 16u, sumX.s0 & 0xffff, sumX.s1 >> 16u, sumX.s1 & 0xffff,
+                          sumX.s2 >> 16u, sumX.s2 & 0xffff, sumX.s3 >> 16u, sumX.s3 & 0xffff);
+    uint8 yVals = (uint8)(sumY.s0 >> 16u, sumY.s0 & 0xffff, sumY.s1 >> 16u, sumY.s1 & 0xffff,
+                          sumY.s2 >> 16u, sumY.s2 & 0xffff, sumY.s3 >> 16u, sumY.s3 & 0xffff);
+    int  xValPairs[8u];
+    int  yValPairs[8u];
+    xValPairs[0u] = xVals.s0 + xVals.s1;
+    xValPairs[1u] = xVals.s1 - xVals.s0;
+    xValPairs[2u] = xVals.s2 + xVals.s3;
+    xValPairs[3u] = xVals.s3 - xVals.s2;
+    xValPairs[4u] = xVals.s4 + xVals.s5;
+    xValPairs[5u] = xVals.s5 - xVals.s4;
+    xValPairs[6u] = xVals.s6 + xVals.s7;
+    xValPairs[7u] = xVals.s7 - xVals.s6;
+    yValPairs[0u] = yVals.s0 + yVals.s1;
+    yValPairs[1u] = yVals.s0 - yVals.s1;
+    yValPairs[2u] = yVals.s2 + yVals.s3;
+    yValPairs[3u] = yVals.s2 - yVals.s3;
+    yValPairs[4u] = yVals.s4 + yVals.s5;
+    yValPairs[5u] = yVals.s4 - yVals.s5;
+    yValPairs[6u] = yVals.s6 + yVals.s7;
+    yValPairs[7u] = yVals.s6 - yVals.s7;
+
+    //output: 32 numbers--> 16 pairs of real/imag numbers
+    //32 * 8 (local_size(0)) * 8 (local_size(1)) = 2048 ints/block
+    uint addr_o = ((BLOCK_ID_CORR * BLOCK_SIZE) + (patch_y * 4u*OUTPUT_ROW) + (patch_x * 8u)) + (FREQUENCY_BAND * NUM_BLOCKS_x_BLOCK_SIZE);
+
+    if (LOCAL_X == 0 && LOCAL_Y == 0){
+        while(atomic_cmpxchg(&block_lock[FREQUENCY_BAND*NUM_BLOCKS + BLOCK_ID_CORR],0,1)); //wait until unlocked
+    }
+        barrier(CLK_GLOBAL_MEM_FENCE); //sync point for the group
+        if (patch_active){
+            corr_buf[addr_o+0u]   += (corr_a0 >> 16u)   + (corr_a1 & 0xffff) + N_TIME_CHUNKS_LOCAL_x_128 - 8u*(xValPairs[0u]+yValPairs[0u]); //real value
+            corr_buf[addr_o+1u]   += (corr_a0 & 0xffff) - (corr_a1 >> 16u) + 8u*(xValPairs[1u]+yValPairs[1u]);
+            corr_buf[addr_o+2u]   += (corr_a2 >> 16u)   + (corr_a3 & 0xffff) + N_TIME_CHUNKS_LOCAL_x_128 - 8u*(xValPairs[2u]+yValPairs[0u]);
+            corr_buf[addr_o+3u]   += (corr_a2 & 0xffff) - (corr_a3 >> 16u) + 8u*(xValPairs[3u]+yValPairs[1u]);
+            corr_buf[addr_o+4u]   += (corr_e0 >> 16u)   + (corr_e1 & 0xffff) + N_TIME_CHUNKS_LOCAL_x_128 - 8u*(xValPairs[4u]+yValPairs[0u]);
+            corr_buf[addr_o+5u]   += (corr_e0 & 0xffff) - (corr_e1 >> 16u) + 8u*(xValPairs[5u]+yValPairs[1u]);
+            corr_buf[addr_o+6u]   += (corr_e2 >> 16u)   + (corr_e3 & 0xffff) + N_TIME_CHUNKS_LOCAL_x_128 - 8u*(xValPairs[6u]+yValPairs[0u]);
+            corr_buf[addr_o+7u]   += (corr_e2 & 0xffff) - (corr_e3 >> 16u) + 8u*(xValPairs[7u]+yValPairs[1u]);
+
+            corr_buf[addr_o+OUTPUT_ROW+0u]  += (corr_b0 >> 16u)   + (corr_b1 & 0xffff) + N_TIME_CHUNKS_LOCAL_x_128 - 8u*(xValPairs[0u]+yValPairs[2u]);
+            corr_buf[addr_o+OUTPUT_ROW+1u]  += (corr_b0 & 0xffff) - (corr_b1 >> 16u) + 8u*(xValPairs[1u]+yValPairs[3u]);
+            corr_buf[addr_o+OUTPUT_ROW+2u]  += (corr_b2 >> 16u)   + (corr_b3 & 0xffff) + N_TIME_CHUNKS_LOCAL_x_128 - 8u*(xValPairs[2u]+yValPairs[2u]);
+            corr_buf[addr_o+OUTPUT_ROW+3u]  += (corr_b2 & 0xffff) - (corr_b3 >> 16u) + 8u*(xValPairs[3u]+yValPairs[3u]);
+            corr_buf[addr_o+OUTPUT_ROW+4u]  += (corr_f0 >> 16u)   + (corr_f1 & 0xffff) + N_TIME_CHUNKS_LOCAL_x_128 - 8u*(xValPairs[4u]+yValPairs[2u]);
+            corr_buf[addr_o+OUTPUT_ROW+5u]  += (corr_f0 & 0xffff) - (corr_f1 >> 16u) + 8u*(xValPairs[5u]+yValPairs[3u]);
+            corr_buf[addr_o+OUTPUT_ROW+6u]  += (corr_f2 >> 16u)   + (corr_f3 & 0xffff) + N_TIME_CHUNKS_LOCAL_x_128 - 8u*(xValPairs[6u]+yValPairs[2u]);
+            corr_buf[addr_o+OUTPUT_ROW+7u]  += (corr_f2 & 0xffff) - (corr_f3 >> 16u) + 8u*(xValPairs[7u]+yValPairs[3u]);
+
+            corr_buf[addr_o+2u*OUTPUT_ROW+0u] += (corr_c0 >> 16u)   + (corr_c1 & 0xffff) + N_TIME_CHUNKS_LOCAL_x_128 - 8u*(xValPairs[0u]+yValPairs[4u]);
+            corr_buf[addr_o+2u*OUTPUT_ROW+1u] += (corr_c0 & 0xffff) - (corr_c1 >> 16u) + 8u*(xValPairs[1u]+yValPairs[5u]);
+            corr_buf[addr_o+2u*OUTPUT_ROW+2u] += (corr_c2 >> 16u)   + (corr_c3 & 0xffff) + N_TIME_CHUNKS_LOCAL_x_128 - 8u*(xValPairs[2u]+yValPairs[4u]);
+            corr_buf[addr_o+2u*OUTPUT_ROW+3u] += (corr_c2 & 0xffff) - (corr_c3 >> 16u) + 8u*(xValPairs[3u]+yValPairs[5u]);
+            corr_buf[addr_o+2u*OUTPUT_ROW+4u] += (corr_g0 >> 16u)   + (corr_g1 & 0xffff) + N_TIME_CHUNKS_LOCAL_x_128 - 8u*(xValPairs[4u]+yValPairs[4u]);
+            corr_buf[addr_o+2u*OUTPUT_ROW+5u] += (corr_g0 & 0xffff) - (corr_g1 >> 16u) + 8u*(xValPairs[5u]+yValPairs[5u]);
+            corr_buf[addr_o+2u*OUTPUT_ROW+6u] += (corr_g2 >> 16u)   + (corr_g3 & 0xffff) + N_TIME_CHUNKS_LOCAL_x_128 - 8u*(xValPairs[6u]+yValPairs[4u]);
+            corr_buf[addr_o+2u*OUTPUT_ROW+7u] += (corr_g2 & 0xffff) - (corr_g3 >> 16u) + 8u*(xValPairs[7u]+yValPairs[5u]);
+
+            corr_buf[addr_o+3u*OUTPUT_ROW+0u] += (corr_d0 >> 16u)   + (corr_d1 & 0xffff) + N_TIME_CHUNKS_LOCAL_x_128 - 8u*(xValPairs[0u]+yValPairs[6u]);
+            corr_buf[addr_o+3u*OUTPUT_ROW+1u] += (corr_d0 & 0xffff) - (corr_d1 >> 16u) + 8u*(xValPairs[1u]+yValPairs[7u]);
+            corr_buf[addr_o+3u*OUTPUT_ROW+2u] += (corr_d2 >> 16u)   + (corr_d3 & 0xffff) + N_TIME_CHUNKS_LOCAL_x_128 - 8u*(xValPairs[2u]+yValPairs[6u]);
+            corr_buf[addr_o+3u*OUTPUT_ROW+3u] += (corr_d2 & 0xffff) - (corr_d3 >> 16u) + 8u*(xValPairs[3u]+yValPairs[7u]);
+            corr_buf[addr_o+3u*OUTPUT_ROW+4u] += (corr_h0 >> 16u)   + (corr_h1 & 0xffff) + N_TIME_CHUNKS_LOCAL_x_128 - 8u*(xValPairs[4u]+yValPairs[6u]);
+            corr_buf[addr_o+3u*OUTPUT_ROW+5u] += (corr_h0 & 0xffff) - (corr_h1 >> 16u) + 8u*(xValPairs[5u]+yValPairs[7u]);
+            corr_buf[addr_o+3u*OUTPUT_ROW+6u] += (corr_h2 >> 16u)   + (corr_h3 & 0xffff) + N_TIME_CHUNKS_LOCAL_x_128 - 8u*(xValPairs[6u]+yValPairs[6u]);
+            corr_buf[addr_o+3u*OUTPUT_ROW+7u] += (corr_h2 & 0xffff) - (corr_h3 >> 16u) + 8u*(xValPairs[7u]+yValPairs[7u]);
+
+        }
+        barrier(CLK_GLOBAL_MEM_FENCE); //make sure everyone is done
+
+    if (LOCAL_X == 0 && LOCAL_Y == 0)
+        block_lock[FREQUENCY_BAND*NUM_BLOCKS + BLOCK_ID_CORR]=0;
+}
@@ -6,6 +6,7 @@
 #define GENERATE_DATASET_RAMP_UP        2u
 #define GENERATE_DATASET_RAMP_DOWN      3u
 #define GENERATE_DATASET_RANDOM_SEEDED  4u
+#define GENERATE_DATASET_COUNTER_BASED  5u
 #define ALL_FREQUENCIES                -1
 #define SDK_SUCCESS                     0u
 
@@ -1,7 +1,19 @@
 // gpu_data_reorg.c
 // The correlation data output from the gpu algorithms is organized in tiles that cover the upper triangle
 // These functions reorganize the data to other forms that are more useful on the cpu side
+#include "gpu_data_reorg.h"
+#include <stdio.h> // printf
+#include <stdlib.h> // malloc, etc.
+#include <string.h> // memcpy
+#include <pthread.h>
+#include <unistd.h> // sysconf
 
+int gpu_num_blocks(int block_side_length, int actual_num_elements){
+    //blocks covering the upper triangle, numbered along each block row in turn (as in id_x_map/id_y_map). When
+    //actual_num_elements isn't a multiple of block_side_length, the last block column and row are partly filled edge tiles
+    int num_blocks_x = (actual_num_elements + block_side_length - 1)/block_side_length;
+    return (num_blocks_x*(num_blocks_x+1))/2;
+}
 
 void reorganize_32_to_16_feed_GPU_Correlated_Data(int actual_num_frequencies, int actual_num_elements, int *correlated_data){
     //data is processed as 32 elements x 32 elements to fit the kernel even though only 16 elements exist.
@@ -39,7 +51,7 @@ void reorganize_GPU_to_full_Matrix_for_comparison(int block_side_length, int num
     for (int frequency_bin = 0; frequency_bin < actual_num_frequencies; frequency_bin++ ){
         int block_x_ID = 0;
         int block_y_ID = 0;
-        int num_blocks_x = actual_num_elements/block_side_length;
+        int num_blocks_x = (actual_num_elements + block_side_length - 1)/block_side_length;
         int block_check = num_blocks_x;
 
         for (int block_ID = 0; block_ID < num_blocks; block_ID++){
@@ -54,7 +66,7 @@ void reorganize_GPU_to_full_Matrix_for_comparison(int block_side_length, int num
                 for (int x_ID_local = 0; x_ID_local < block_side_length; x_ID_local++){
                     int GPU_address = frequency_bin*(num_blocks*block_side_length*block_side_length*2) + block_ID *(block_side_length*block_side_length*2) + y_ID_local*block_side_length*2+x_ID_local*2; ///TO DO :simplify this statement after getting everything working
                     int x_ID_global = block_x_ID * block_side_length + x_ID_local;
-                    if (x_ID_global >= y_ID_global){
+                    if (x_ID_global >= y_ID_global && x_ID_global < actual_num_elements){ //edge tiles hold nothing past the last element
                         if (x_ID_global > y_ID_global){ //store the conjugate: x and y addresses get swapped and the imaginary value is the negative of the original value
                             final_matrix[(frequency_bin*actual_num_elements*actual_num_elements+x_ID_global*actual_num_elements+y_ID_global)*2]   =  gpu_data[GPU_address];
                             final_matrix[(frequency_bin*actual_num_elements*actual_num_elements+x_ID_global*actual_num_elements+y_ID_global)*2+1] = -gpu_data[GPU_address+1];
@@ -78,7 +90,7 @@ void reorganize_GPU_to_upper_triangle(int block_side_length, int num_blocks, int
     for (int frequency_bin = 0; frequency_bin < actual_num_frequencies; frequency_bin++ ){
         int block_x_ID = 0;
         int block_y_ID = 0;
-        int num_blocks_x = actual_num_elements/block_side_length;
+        int num_blocks_x = (actual_num_elements + block_side_length - 1)/block_side_length;
         int block_check = num_blocks_x;
         int frequency_offset = frequency_bin * (actual_num_elements* (actual_num_elements+1))/2;// frequency_bin * number of items in an upper triangle
 
@@ -100,7 +112,10 @@ void reorganize_GPU_to_upper_triangle(int block_side_length, int num_blocks, int
                     /// address_1d_output = frequency_offset, plus the number of entries in the rectangle area (y_ID_global*actual_num_elements), minus the number of elements in lower triangle to that row (((y_ID_global-1)*y_ID_global)/2), plus the contributions to the address from the current row (x_ID_global - y_ID_global)
                     int address_1d_output = frequency_offset + y_ID_global*actual_num_elements - ((y_ID_global-1)*y_ID_global)/2 + (x_ID_global - y_ID_global);
 
-                    if (block_x_ID != block_y_ID){ //when we are not in the diagonal blocks
+                    if (x_ID_global >= actual_num_elements || y_ID_global >= actual_num_elements){ //past the last element of an edge tile
+                        GPU_address += 2;
+                    }
+                    else if (block_x_ID != block_y_ID){ //when we are not in the diagonal blocks
                         final_matrix[address_1d_output*2  ] = gpu_data[GPU_address++];
                         final_matrix[address_1d_output*2+1] = gpu_data[GPU_address++];
                     }
@@ -147,3 +162,135 @@ void reorganize_data_16_element_with_triangle_conversion (int num_frequencies_fi
     }
     return;
 }
+
+int *make_upper_triangle_block_offset_table(int block_side_length, int num_blocks, int actual_num_elements){
+    //for every row of every gpu block: [output offset (in complex values, within one frequency) of the first value kept, first x_local kept
+    //(0 except in the diagonal blocks, where only x >= y is kept), number of values kept (short of block_side_length - first x_local
+    //only in edge tiles, and 0 for their rows past the last element)]. This takes the address arithmetic and the walk along the
+    //block IDs out of the copy loops, so any block can be converted on its own
+    int *block_offset_table = (int *)malloc((size_t)num_blocks*block_side_length*3*sizeof(int));
+    if (block_offset_table == NULL){
+        printf ("Error allocating memory: make_upper_triangle_block_offset_table\n");
+        return NULL;
+    }
+    int block_x_ID = 0;
+    int block_y_ID = 0;
+    int num_blocks_x = (actual_num_elements + block_side_length - 1)/block_side_length;
+    int block_check = num_blocks_x;
+    for (int block_ID = 0; block_ID < num_blocks; block_ID++){
+        if (block_ID == block_check){
+            num_blocks_x--;
+            block_check += num_blocks_x;
+            block_y_ID++;
+            block_x_ID = block_y_ID;
+        }
+        for (int y_ID_local = 0; y_ID_local < block_side_length; y_ID_local++){
+            int y_ID_global = block_y_ID * block_side_length + y_ID_local;
+            int x_ID_local_first = (block_x_ID == block_y_ID) ? y_ID_local : 0;
+            int x_ID_global = block_x_ID * block_side_length + x_ID_local_first;
+            int x_ID_global_end = block_x_ID * block_side_length + block_side_length;
+            if (x_ID_global_end > actual_num_elements)
+                x_ID_global_end = actual_num_elements;
+            block_offset_table[(block_ID*block_side_length + y_ID_local)*3  ] = y_ID_global*actual_num_elements - ((y_ID_global-1)*y_ID_global)/2 + (x_ID_global - y_ID_global);
+            block_offset_table[(block_ID*block_side_length + y_ID_local)*3+1] = x_ID_local_first;
+            block_offset_table[(block_ID*block_side_length + y_ID_local)*3+2] = (y_ID_global < actual_num_elements && x_ID_global_end > x_ID_global) ? x_ID_global_end - x_ID_global : 0;
+        }
+        block_x_ID++;
+    }
+    return block_offset_table;
+}
+
+typedef struct {
+    int block_side_length;
+    int num_blocks;
+    int actual_num_elements;
+    int first_item; //items are (frequency, block) pairs, numbered frequency*num_blocks + block_ID
+    int last_item;
+    int *block_offset_table;
+    int *gpu_data;
+    int *final_matrix;
+} reorganize_thread_args;
+
+static void *reorganize_upper_triangle_thread(void *arg){
+    reorganize_thread_args *args = (reorganize_thread_args *)arg;
+    int block_side_length = args->block_side_length;
+    size_t block_size = (size_t)block_side_length*block_side_length*2;
+    size_t triangle_size = ((size_t)args->actual_num_elements*(args->actual_num_elements+1))/2;
+    for (int item = args->first_item; item < args->last_item; item++){
+        int frequency_bin = item/args->num_blocks;
+        int block_ID = item%args->num_blocks;
+        int *block_data = args->gpu_data + (size_t)item*block_size;
+        int *frequency_output = args->final_matrix + frequency_bin*triangle_size*2;
+        int *table = args->block_offset_table + (size_t)block_ID*block_side_length*3;
+        //each block row is one contiguous run in the output: copy it whole
+        for (int y_ID_local = 0; y_ID_local < block_side_length; y_ID_local++){
+            int x_ID_local_first = table[y_ID_local*3+1];
+            memcpy(frequency_output + (size_t)table[y_ID_local*3]*2,
+                   block_data + (y_ID_local*block_side_length + x_ID_local_first)*2,
+                   (size_t)table[y_ID_local*3+2]*2*sizeof(int));
+        }
+    }
+    return NULL;
+}
+
+int reorganize_GPU_to_upper_triangle_threaded(int block_side_length, int num_blocks, int actual_num_frequencies, int actual_num_elements, int *block_offset_table, int *gpu_data, int *final_matrix, int num_threads){
+    //same output as reorganize_GPU_to_upper_triangle, written straight into final_matrix (actual_num_frequencies packed upper triangles).
+    //block_offset_table comes from make_upper_triangle_block_offset_table; pass NULL to have one made (and freed) here.
+    //Work is split over num_threads threads (<= 0: one per online cpu)
+    int *table = block_offset_table;
+    if (table == NULL){
+        table = make_upper_triangle_block_offset_table(block_side_length, num_blocks, actual_num_elements);
+        if (table == NULL)
+            return (-1);
+    }
+    int num_items = actual_num_frequencies*num_blocks;
+    if (num_threads <= 0)
+        num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_threads > num_items)
+        num_threads = num_items;
+    if (num_threads < 1)
+        num_threads = 1;
+
+    reorganize_thread_args *args = (reorganize_thread_args *)malloc(num_threads*sizeof(reorganize_thread_args));
+    pthread_t *threads = (pthread_t *)malloc(num_threads*sizeof(pthread_t));
+    int *started = (int *)calloc(num_threads, sizeof(int));
+    if (args == NULL || threads == NULL || started == NULL){
+        printf ("Error allocating memory: reorganize_GPU_to_upper_triangle_threaded\n");
+        free(args);
+        free(threads);
+        free(started);
+        if (block_offset_table == NULL)
+            free(table);
+        return (-1);
+    }
+
+    //every item is the same amount of copying, so an even split balances
+    for (int i = 0; i < num_threads; i++){
+        args[i].block_side_length = block_side_length;
+        args[i].num_blocks = num_blocks;
+        args[i].actual_num_elements = actual_num_elements;
+        args[i].first_item = (int)(((long)num_items*i)/num_threads);
+        args[i].last_item = (int)(((long)num_items*(i+1))/num_threads);
+        args[i].block_offset_table = table;
+        args[i].gpu_data = gpu_data;
+        args[i].final_matrix = final_matrix;
+    }
+    //thread 0 is the calling thread; a thread that can't be started has its share done here instead
+    for (int i = 1; i < num_threads; i++){
+        started[i] = (pthread_create(&threads[i], NULL, reorganize_upper_triangle_thread, &args[i]) == 0);
+        if (!started[i])
+            reorganize_upper_triangle_thread(&args[i]);
+    }
+    reorganize_upper_triangle_thread(&args[0]);
+    for (int i = 1; i < num_threads; i++){
+        if (started[i])
+            pthread_join(threads[i], NULL);
+    }
+
+    free(args);
+    free(threads);
+    free(started);
+    if (block_offset_table == NULL)
+        free(table);
+    return (0);
+}
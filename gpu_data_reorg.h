@@ -3,6 +3,9 @@
 #ifndef GPU_DATA_REORG_H
 #define GPU_DATA_REORG_H
 
+//number of gpu output blocks for actual_num_elements (the last block column and row are edge tiles if it isn't a multiple of block_side_length)
+int gpu_num_blocks(int block_side_length, int actual_num_elements);
+
 void reorganize_32_to_16_feed_GPU_Correlated_Data(int actual_num_frequencies, int actual_num_elements, int *correlated_data);
 
 void reorganize_GPU_to_full_Matrix_for_comparison(int block_side_length, int num_blocks, int actual_num_frequencies, int actual_num_elements, int *gpu_data, int *final_matrix);
@@ -11,4 +14,8 @@ void reorganize_GPU_to_upper_triangle(int block_side_length, int num_blocks, int
 
 void reorganize_data_16_element_with_triangle_conversion (int num_frequencies_final, int actual_num_frequencies, int *input_data, int *output_data);
 
+int *make_upper_triangle_block_offset_table(int block_side_length, int num_blocks, int actual_num_elements);
+
+int reorganize_GPU_to_upper_triangle_threaded(int block_side_length, int num_blocks, int actual_num_frequencies, int actual_num_elements, int *block_offset_table, int *gpu_data, int *final_matrix, int num_threads);
+
 #endif
@@ -3,6 +3,22 @@
 #include "input_generator.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <immintrin.h>
+
+//Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", SC11). Each call turns a 128 bit counter
+//into 128 random bits, i.e. 16 packed 4+4 bit samples. The counter is (element/16, frequency, timestep, 0) and the key
+//is the seed, so any sample can be made without generating the ones before it.
+#define PHILOX_M0                       0xD2511F53u
+#define PHILOX_M1                       0xCD9E8D57u
+#define PHILOX_W0                       0x9E3779B9u
+#define PHILOX_W1                       0xBB67AE85u
+#define PHILOX_ROUNDS                   10
+#define PHILOX_SAMPLES_PER_CALL         16
+#define PHILOX_KEY_1                    0x43484D45u //second key word: fixed
 
 
 int offset_and_clip_value(int input_value, int offset_value, int min_val, int max_val){
@@ -14,6 +30,112 @@ int offset_and_clip_value(int input_value, int offset_value, int min_val, int ma
     return(offset_and_clipped);
 }
 
+static void philox4x32_10(uint32_t counter[4], uint32_t key_0, uint32_t key_1, uint32_t output[4]){
+    uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    for (int round = 0; round < PHILOX_ROUNDS; round++){
+        uint64_t product_0 = (uint64_t)PHILOX_M0*c0;
+        uint64_t product_1 = (uint64_t)PHILOX_M1*c2;
+        c0 = (uint32_t)(product_1>>32) ^ c1 ^ key_0;
+        c1 = (uint32_t)product_1;
+        c2 = (uint32_t)(product_0>>32) ^ c3 ^ key_1;
+        c3 = (uint32_t)product_0;
+        key_0 += PHILOX_W0;
+        key_1 += PHILOX_W1;
+    }
+    output[0] = c0;
+    output[1] = c1;
+    output[2] = c2;
+    output[3] = c3;
+    return;
+}
+
+unsigned char counter_based_sample(int random_seed, int timestep, int frequency, int element){
+    uint32_t counter[4] = {(uint32_t)element/PHILOX_SAMPLES_PER_CALL, (uint32_t)frequency, (uint32_t)timestep, 0};
+    uint32_t output[4];
+    philox4x32_10(counter, (uint32_t)random_seed, PHILOX_KEY_1, output);
+    int byte = element % PHILOX_SAMPLES_PER_CALL;
+    return (unsigned char)(output[byte/4] >> (8*(byte%4)));
+}
+
+//8 counters at once. Only the low 32 bits of _mm256_mul_epu32 lanes are multiplied, so odd lanes are shifted down for a second multiply
+__attribute__((target("avx2")))
+static inline void mulhilo_avx2(__m256i a, __m256i m, __m256i *hi, __m256i *lo){
+    __m256i product_even = _mm256_mul_epu32(a, m);
+    __m256i product_odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+    *lo = _mm256_mullo_epi32(a, m);
+    *hi = _mm256_blend_epi32(_mm256_srli_epi64(product_even, 32), product_odd, 0xAA);
+    return;
+}
+
+__attribute__((target("avx2")))
+static void counter_based_row_avx2(int random_seed, int timestep, int frequency, int num_elements, unsigned char *row){
+    unsigned char tail[8*PHILOX_SAMPLES_PER_CALL];
+    const __m256i m0 = _mm256_set1_epi32((int)PHILOX_M0);
+    const __m256i m1 = _mm256_set1_epi32((int)PHILOX_M1);
+    for (int element = 0; element < num_elements; element += 8*PHILOX_SAMPLES_PER_CALL){
+        uint32_t block = (uint32_t)element/PHILOX_SAMPLES_PER_CALL;
+        __m256i c0 = _mm256_add_epi32(_mm256_set1_epi32((int)block), _mm256_setr_epi32(0,1,2,3,4,5,6,7));
+        __m256i c1 = _mm256_set1_epi32(frequency);
+        __m256i c2 = _mm256_set1_epi32(timestep);
+        __m256i c3 = _mm256_setzero_si256();
+        uint32_t key_0 = (uint32_t)random_seed;
+        uint32_t key_1 = PHILOX_KEY_1;
+        for (int round = 0; round < PHILOX_ROUNDS; round++){
+            __m256i hi_0, lo_0, hi_1, lo_1;
+            mulhilo_avx2(c0, m0, &hi_0, &lo_0);
+            mulhilo_avx2(c2, m1, &hi_1, &lo_1);
+            c0 = _mm256_xor_si256(_mm256_xor_si256(hi_1, c1), _mm256_set1_epi32((int)key_0));
+            c1 = lo_1;
+            c2 = _mm256_xor_si256(_mm256_xor_si256(hi_0, c3), _mm256_set1_epi32((int)key_1));
+            c3 = lo_0;
+            key_0 += PHILOX_W0;
+            key_1 += PHILOX_W1;
+        }
+        //transpose so each counter's 4 output words are next to each other
+        __m256i t0 = _mm256_unpacklo_epi32(c0, c1);
+        __m256i t1 = _mm256_unpackhi_epi32(c0, c1);
+        __m256i t2 = _mm256_unpacklo_epi32(c2, c3);
+        __m256i t3 = _mm256_unpackhi_epi32(c2, c3);
+        __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+        __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+        __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+        __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+        unsigned char *out = (element + 8*PHILOX_SAMPLES_PER_CALL <= num_elements) ? row + element : tail;
+        _mm256_storeu_si256((__m256i *)(out     ), _mm256_permute2x128_si256(u0, u1, 0x20));
+        _mm256_storeu_si256((__m256i *)(out + 32), _mm256_permute2x128_si256(u2, u3, 0x20));
+        _mm256_storeu_si256((__m256i *)(out + 64), _mm256_permute2x128_si256(u0, u1, 0x31));
+        _mm256_storeu_si256((__m256i *)(out + 96), _mm256_permute2x128_si256(u2, u3, 0x31));
+        if (out == tail)
+            memcpy(row + element, tail, num_elements - element);
+    }
+    return;
+}
+
+//whether the AVX2 rows can be used: found out once, however many generator threads ask at the same time
+static int use_avx2 = 0;
+static pthread_once_t use_avx2_once = PTHREAD_ONCE_INIT;
+
+static void find_avx2(void){
+    __builtin_cpu_init();
+    use_avx2 = __builtin_cpu_supports("avx2");
+}
+
+static void counter_based_row(int random_seed, int timestep, int frequency, int num_elements, unsigned char *row){
+    pthread_once(&use_avx2_once, find_avx2);
+    if (use_avx2){
+        counter_based_row_avx2(random_seed, timestep, frequency, num_elements, row);
+        return;
+    }
+    for (int element = 0; element < num_elements; element += PHILOX_SAMPLES_PER_CALL){
+        uint32_t counter[4] = {(uint32_t)element/PHILOX_SAMPLES_PER_CALL, (uint32_t)frequency, (uint32_t)timestep, 0};
+        uint32_t output[4];
+        philox4x32_10(counter, (uint32_t)random_seed, PHILOX_KEY_1, output);
+        for (int byte = 0; byte < PHILOX_SAMPLES_PER_CALL && element + byte < num_elements; byte++)
+            row[element + byte] = (unsigned char)(output[byte/4] >> (8*(byte%4)));
+    }
+    return;
+}
+
 void generate_char_data_set(int generation_Type,
                             int random_seed,
                             int default_real,
@@ -26,6 +148,27 @@ void generate_char_data_set(int generation_Type,
                             int num_elements,
                             int no_repeat_random,
                             unsigned char *packed_data_set){
+    generate_char_data_set_chunk(generation_Type, random_seed, default_real, default_imaginary, initial_real, initial_imaginary, single_frequency,
+                                 0, num_timesteps, num_frequencies, num_elements, no_repeat_random, packed_data_set);
+    return;
+}
+
+void generate_char_data_set_chunk(int generation_Type,
+                                  int random_seed,
+                                  int default_real,
+                                  int default_imaginary,
+                                  int initial_real,
+                                  int initial_imaginary,
+                                  int single_frequency,
+                                  int first_timestep,
+                                  int num_timesteps,
+                                  int num_frequencies,
+                                  int num_elements,
+                                  int no_repeat_random,
+                                  unsigned char *packed_data_set){
+    //generates timesteps first_timestep to first_timestep+num_timesteps-1 of the data set into packed_data_set.
+    //With no_repeat_random the random sequence runs on from the previous chunk, so the chunks have to be made in order
+    //(and nothing else may call rand() in between) to get the same data as one call for the whole set
 
     if (single_frequency > num_frequencies || single_frequency < 0)
         single_frequency = ALL_FREQUENCIES;
@@ -43,7 +186,7 @@ void generate_char_data_set(int generation_Type,
 
     //printf("clipped_offset_initial_real: %d, clipped_offset_initial_imaginary: %d, clipped_offset_default_real: %d, clipped_offset_default_imaginary: %d\n", clipped_offset_initial_real, clipped_offset_initial_imaginary, clipped_offset_default_real, clipped_offset_default_imaginary);
 
-    if (generation_Type == GENERATE_DATASET_RANDOM_SEEDED){
+    if (generation_Type == GENERATE_DATASET_RANDOM_SEEDED && first_timestep == 0){
         srand(random_seed);
     }
 
@@ -54,8 +197,13 @@ void generate_char_data_set(int generation_Type,
         }
         for (int j = 0; j < num_frequencies; j++){
             //printf("j: %d\n",j);
+            if (generation_Type == GENERATE_DATASET_COUNTER_BASED && (single_frequency == ALL_FREQUENCIES || j == single_frequency)){
+                //a whole row at a time. Without no_repeat_random every timestep uses the counter of timestep 0, so the data repeats like the seeded mode
+                counter_based_row(random_seed, no_repeat_random ? first_timestep + k : 0, j, num_elements, packed_data_set + ((size_t)k*num_frequencies + j)*num_elements);
+                continue;
+            }
             for (int i = 0; i < num_elements; i++){
-                int currentAddress = k*num_frequencies*num_elements + j*num_elements + i;
+                size_t currentAddress = (size_t)k*num_frequencies*num_elements + j*num_elements + i;
                 unsigned char new_real;
                 unsigned char new_imaginary;
                 switch (generation_Type){
@@ -75,6 +223,10 @@ void generate_char_data_set(int generation_Type,
                         new_real = (unsigned char)(rand()%16); //to put the pseudorandom value in the range 0-15
                         new_imaginary = (unsigned char)(rand()%16);
                         break;
+                    case GENERATE_DATASET_COUNTER_BASED: //only reached for the frequencies that aren't generated (handled above)
+                        new_real = clipped_offset_default_real;
+                        new_imaginary = clipped_offset_default_imaginary;
+                        break;
                     default: //shouldn't happen, but in case it does, just assign the default values everywhere
                         new_real = clipped_offset_default_real;
                         new_imaginary = clipped_offset_default_imaginary;
@@ -101,3 +253,116 @@ void generate_char_data_set(int generation_Type,
 
     return;
 }
+
+typedef struct {
+    int generation_Type;
+    int random_seed;
+    int default_real;
+    int default_imaginary;
+    int initial_real;
+    int initial_imaginary;
+    int single_frequency;
+    int first_timestep;
+    int num_timesteps;
+    int num_frequencies;
+    int num_elements;
+    int no_repeat_random;
+    unsigned char *packed_data_set;
+    int started;
+} generator_thread_args;
+
+static void *generator_thread(void *arg){
+    generator_thread_args *args = (generator_thread_args *)arg;
+    generate_char_data_set_chunk(args->generation_Type, args->random_seed, args->default_real, args->default_imaginary, args->initial_real, args->initial_imaginary, args->single_frequency,
+                                 args->first_timestep, args->num_timesteps, args->num_frequencies, args->num_elements, args->no_repeat_random,
+                                 args->packed_data_set);
+    return NULL;
+}
+
+void generate_char_data_set_threaded(int generation_Type,
+                                     int random_seed,
+                                     int default_real,
+                                     int default_imaginary,
+                                     int initial_real,
+                                     int initial_imaginary,
+                                     int single_frequency,
+                                     int num_timesteps,
+                                     int num_frequencies,
+                                     int num_elements,
+                                     int no_repeat_random,
+                                     int num_threads,
+                                     unsigned char *packed_data_set){
+    //same output as generate_char_data_set, with the timesteps split over num_threads threads (<= 0: one per online cpu)
+    generate_char_data_set_chunk_threaded(generation_Type, random_seed, default_real, default_imaginary, initial_real, initial_imaginary, single_frequency,
+                                          0, num_timesteps, num_frequencies, num_elements, no_repeat_random, num_threads, packed_data_set);
+    return;
+}
+
+void generate_char_data_set_chunk_threaded(int generation_Type,
+                                           int random_seed,
+                                           int default_real,
+                                           int default_imaginary,
+                                           int initial_real,
+                                           int initial_imaginary,
+                                           int single_frequency,
+                                           int first_timestep,
+                                           int num_timesteps,
+                                           int num_frequencies,
+                                           int num_elements,
+                                           int no_repeat_random,
+                                           int num_threads,
+                                           unsigned char *packed_data_set){
+    //same output as generate_char_data_set_chunk, with the timesteps split over num_threads threads (<= 0: one per online cpu).
+    //The rand() based mode has to replay its sequence in order, so it stays on one thread
+    if (num_threads <= 0)
+        num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_threads > num_timesteps)
+        num_threads = num_timesteps;
+    if (generation_Type == GENERATE_DATASET_RANDOM_SEEDED || num_threads <= 1){
+        generate_char_data_set_chunk(generation_Type, random_seed, default_real, default_imaginary, initial_real, initial_imaginary, single_frequency,
+                                     first_timestep, num_timesteps, num_frequencies, num_elements, no_repeat_random, packed_data_set);
+        return;
+    }
+
+    generator_thread_args *args = (generator_thread_args *)malloc(num_threads*sizeof(generator_thread_args));
+    pthread_t *threads = (pthread_t *)malloc(num_threads*sizeof(pthread_t));
+    if (args == NULL || threads == NULL){
+        free(args);
+        free(threads);
+        generate_char_data_set_chunk(generation_Type, random_seed, default_real, default_imaginary, initial_real, initial_imaginary, single_frequency,
+                                     first_timestep, num_timesteps, num_frequencies, num_elements, no_repeat_random, packed_data_set);
+        return;
+    }
+
+    for (int i = 0; i < num_threads; i++){
+        args[i].generation_Type = generation_Type;
+        args[i].random_seed = random_seed;
+        args[i].default_real = default_real;
+        args[i].default_imaginary = default_imaginary;
+        args[i].initial_real = initial_real;
+        args[i].initial_imaginary = initial_imaginary;
+        args[i].single_frequency = single_frequency;
+        int thread_first = (int)(((long)num_timesteps*i)/num_threads);
+        args[i].first_timestep = first_timestep + thread_first;
+        args[i].num_timesteps = (int)(((long)num_timesteps*(i+1))/num_threads) - thread_first;
+        args[i].num_frequencies = num_frequencies;
+        args[i].num_elements = num_elements;
+        args[i].no_repeat_random = no_repeat_random;
+        args[i].packed_data_set = packed_data_set + (size_t)thread_first*num_frequencies*num_elements;
+    }
+    //thread 0 is the calling thread; a thread that can't be started just runs its share here instead
+    for (int i = 1; i < num_threads; i++){
+        args[i].started = (pthread_create(&threads[i], NULL, generator_thread, &args[i]) == 0);
+        if (!args[i].started)
+            generator_thread(&args[i]);
+    }
+    generator_thread(&args[0]);
+    for (int i = 1; i < num_threads; i++){
+        if (args[i].started)
+            pthread_join(threads[i], NULL);
+    }
+
+    free(args);
+    free(threads);
+    return;
+}
@@ -6,6 +6,7 @@
 #define GENERATE_DATASET_RAMP_UP        2u
 #define GENERATE_DATASET_RAMP_DOWN      3u
 #define GENERATE_DATASET_RANDOM_SEEDED  4u
+#define GENERATE_DATASET_COUNTER_BASED  5u //counter-based (Philox) random: any sample can be made on its own, so it runs in parallel
 #define ALL_FREQUENCIES                -1
 
 int offset_and_clip_value(int input_value, int offset_value, int min_val, int max_val);
@@ -23,4 +24,50 @@ void generate_char_data_set(int generation_Type,
                             int no_repeat_random,
                             unsigned char *packed_data_set);
 
+void generate_char_data_set_chunk(int generation_Type,
+                                  int random_seed,
+                                  int default_real,
+                                  int default_imaginary,
+                                  int initial_real,
+                                  int initial_imaginary,
+                                  int single_frequency,
+                                  int first_timestep,
+                                  int num_timesteps,
+                                  int num_frequencies,
+                                  int num_elements,
+                                  int no_repeat_random,
+                                  unsigned char *packed_data_set);
+
+void generate_char_data_set_threaded(int generation_Type,
+                                     int random_seed,
+                                     int default_real,
+                                     int default_imaginary,
+                                     int initial_real,
+                                     int initial_imaginary,
+                                     int single_frequency,
+                                     int num_timesteps,
+                                     int num_frequencies,
+                                     int num_elements,
+                                     int no_repeat_random,
+                                     int num_threads,
+                                     unsigned char *packed_data_set);
+
+void generate_char_data_set_chunk_threaded(int generation_Type,
+                                           int random_seed,
+                                           int default_real,
+                                           int default_imaginary,
+                                           int initial_real,
+                                           int initial_imaginary,
+                                           int single_frequency,
+                                           int first_timestep,
+                                           int num_timesteps,
+                                           int num_frequencies,
+                                           int num_elements,
+                                           int no_repeat_random,
+                                           int num_threads,
+                                           unsigned char *packed_data_set);
+
+//the GENERATE_DATASET_COUNTER_BASED sample for (seed, timestep, frequency, element) (timestep 0 when no_repeat_random is off)
+unsigned char counter_based_sample(int random_seed, int timestep, int frequency, int element);
+
 #endif
@@ -0,0 +1,295 @@
+// input_stream.c
+// streaming input: a producer thread fills a ring of page-aligned, mlocked frame buffers while the consumer takes them in
+// frame order and hands each one back once it is done with it (for the GPU, when its upload has finished).
+// Without real-time pacing the producer runs flat out and waits whenever the ring is full (backpressure), so the slower of
+// the two sets the pace and the run measures the sustained rate of the whole chain. With real-time pacing frame f is due
+// f frame periods after the start, like a telescope that can't be paused: a frame that finds the ring full is dropped,
+// and a frame that takes the source longer than a frame period to make is an overrun.
+#include "input_stream.h"
+#include <stdio.h> // printf
+#include <stdlib.h> // malloc, etc.
+#include <string.h> // strerror
+#include <errno.h>
+#include <limits.h> // INT_MAX
+#include <time.h> // nanosleep
+#include <fcntl.h> // open
+#include <unistd.h> // pread, sysconf
+#include <sys/mman.h> // mlock
+#include <sys/stat.h> // fstat
+#include "input_generator.h"
+#include "gpu_cpu_helpers.h"
+
+int input_stream_init(input_stream *stream, int num_buffers, int num_timesteps, int num_frequencies, int num_elements, int64_t num_frames, int realtime){
+    memset(stream, 0, sizeof(input_stream));
+    if (num_buffers < 1){
+        printf ("Error: an input stream needs at least one buffer\n");
+        return (-1);
+    }
+    stream->num_timesteps = num_timesteps;
+    stream->num_frequencies = num_frequencies;
+    stream->num_elements = num_elements;
+    stream->frame_size = (size_t)num_timesteps*num_frequencies*num_elements;
+    stream->num_frames = num_frames;
+    stream->realtime = realtime;
+    stream->frame_period = num_timesteps/INPUT_STREAM_CHANNEL_RATE; //the frequency channels arrive side by side
+    stream->file_descriptor = -1;
+    stream->num_buffers = num_buffers;
+    pthread_mutex_init(&stream->lock, NULL);
+    pthread_cond_init(&stream->changed, NULL);
+
+    stream->buffers = (unsigned char **)calloc(num_buffers, sizeof(unsigned char *));
+    stream->buffer_frame = (int64_t *)calloc(num_buffers, sizeof(int64_t));
+    stream->buffer_state = (int *)calloc(num_buffers, sizeof(int));
+    stream->buffer_refs = (input_stream_buffer_ref *)calloc(num_buffers, sizeof(input_stream_buffer_ref));
+    if (stream->buffers == NULL || stream->buffer_frame == NULL || stream->buffer_state == NULL || stream->buffer_refs == NULL){
+        printf ("Error allocating memory: input_stream_init\n");
+        input_stream_free(stream);
+        return (-1);
+    }
+
+    //page aligned and locked, like the other buffers that are handed to OpenCL, so uploads can go straight from them
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    for (int i = 0; i < num_buffers; i++){
+        int err = posix_memalign((void **)&stream->buffers[i], page_size, stream->frame_size);
+        if (err){
+            printf ("Error allocating input stream buffer %d, err: %d\n", i, err);
+            stream->buffers[i] = NULL;
+            input_stream_free(stream);
+            return (-1);
+        }
+        if (mlock(stream->buffers[i], stream->frame_size)){
+            printf ("Error locking input stream buffer %d: %s\n", i, strerror(errno));
+            input_stream_free(stream);
+            return (-1);
+        }
+        stream->buffer_refs[i].stream = stream;
+        stream->buffer_refs[i].index = i;
+    }
+    return (0);
+}
+
+void input_stream_use_generator(input_stream *stream, int generation_Type, int random_seed, int default_real, int default_imaginary, int initial_real, int initial_imaginary,
+                                int single_frequency, int no_repeat_random, int num_threads){
+    stream->source = INPUT_STREAM_SOURCE_GENERATOR;
+    stream->generation_Type = generation_Type;
+    stream->random_seed = random_seed;
+    stream->default_real = default_real;
+    stream->default_imaginary = default_imaginary;
+    stream->initial_real = initial_real;
+    stream->initial_imaginary = initial_imaginary;
+    stream->single_frequency = single_frequency;
+    stream->no_repeat_random = no_repeat_random;
+    stream->num_threads = num_threads;
+    return;
+}
+
+int input_stream_use_file(input_stream *stream, const char *file_name){
+    //the descriptor is only handed to the stream once the file is usable, so every error return here closes it
+    struct stat file_info;
+    int file_descriptor = open(file_name, O_RDONLY);
+    if (file_descriptor < 0){
+        printf ("Error opening input stream file %s: %s\n", file_name, strerror(errno));
+        return (-1);
+    }
+    if (fstat(file_descriptor, &file_info) != 0){
+        printf ("Error reading the size of input stream file %s: %s\n", file_name, strerror(errno));
+        close(file_descriptor);
+        return (-1);
+    }
+    if ((size_t)file_info.st_size < stream->frame_size){
+        printf ("Error: input stream file %s is smaller than one frame (%zu B)\n", file_name, stream->frame_size);
+        close(file_descriptor);
+        return (-1);
+    }
+    if (stream->file_descriptor >= 0)
+        close(stream->file_descriptor);
+    stream->file_descriptor = file_descriptor;
+    stream->source = INPUT_STREAM_SOURCE_FILE;
+    stream->frames_in_file = (int64_t)file_info.st_size/stream->frame_size;
+    return (0);
+}
+
+int input_stream_fill_frame(input_stream *stream, int64_t frame, unsigned char *buffer){
+    if (stream->source == INPUT_STREAM_SOURCE_FILE){
+        off_t offset = (off_t)((frame % stream->frames_in_file)*stream->frame_size);
+        size_t done = 0;
+        while (done < stream->frame_size){
+            ssize_t num_read = pread(stream->file_descriptor, buffer + done, stream->frame_size - done, offset + done);
+            if (num_read <= 0){
+                printf ("Error reading frame %lld from the input stream file: %s\n", (long long int)frame, num_read < 0 ? strerror(errno) : "end of file");
+                return (-1);
+            }
+            done += num_read;
+        }
+        return (0);
+    }
+
+    //frames carry on the generator's timesteps (which matters for the no_repeat_random modes); the int timestep counter
+    //starts over after INT_MAX timesteps
+    int64_t frames_per_cycle = INT_MAX/stream->num_timesteps;
+    int first_timestep = (int)((frame % frames_per_cycle)*stream->num_timesteps);
+    generate_char_data_set_chunk_threaded(stream->generation_Type, stream->random_seed, stream->default_real, stream->default_imaginary, stream->initial_real, stream->initial_imaginary,
+                                          stream->single_frequency, first_timestep, stream->num_timesteps, stream->num_frequencies, stream->num_elements, stream->no_repeat_random,
+                                          stream->num_threads, buffer);
+    return (0);
+}
+
+static void wait_until(double due_time){
+    double wait_time = due_time - e_time();
+    if (wait_time <= 0)
+        return;
+    struct timespec wait;
+    wait.tv_sec = (time_t)wait_time;
+    wait.tv_nsec = (long)((wait_time - wait.tv_sec)*1e9);
+    while (nanosleep(&wait, &wait) != 0 && errno == EINTR)
+        ;
+    return;
+}
+
+static void *producer_thread(void *arg){
+    input_stream *stream = (input_stream *)arg;
+    int64_t frame = 0;
+    for (;;){
+        double due_time = stream->start_time + frame*stream->frame_period;
+        if (stream->realtime)
+            wait_until(due_time);
+
+        pthread_mutex_lock(&stream->lock);
+        if (stream->stop || stream->frames_produced >= stream->num_frames){
+            pthread_mutex_unlock(&stream->lock);
+            break;
+        }
+        int index = stream->produce_index;
+        if (stream->buffer_state[index] != INPUT_STREAM_BUFFER_FREE){
+            if (stream->realtime){ //the data doesn't wait: this frame is lost
+                stream->frames_dropped++;
+                frame++;
+                pthread_mutex_unlock(&stream->lock);
+                continue;
+            }
+            stream->producer_waits++;
+            while (stream->buffer_state[index] != INPUT_STREAM_BUFFER_FREE && !stream->stop)
+                pthread_cond_wait(&stream->changed, &stream->lock);
+            if (stream->stop){
+                pthread_mutex_unlock(&stream->lock);
+                break;
+            }
+        }
+        stream->buffer_state[index] = INPUT_STREAM_BUFFER_FILLING;
+        pthread_mutex_unlock(&stream->lock);
+
+        int err = input_stream_fill_frame(stream, frame, stream->buffers[index]);
+
+        pthread_mutex_lock(&stream->lock);
+        if (err){
+            stream->err = err;
+            stream->buffer_state[index] = INPUT_STREAM_BUFFER_FREE;
+            pthread_mutex_unlock(&stream->lock);
+            break;
+        }
+        if (stream->realtime && e_time() > due_time + stream->frame_period)
+            stream->overruns++;
+        stream->buffer_frame[index] = frame;
+        stream->buffer_state[index] = INPUT_STREAM_BUFFER_READY;
+        stream->produce_index = (index + 1) % stream->num_buffers;
+        stream->frames_produced++;
+        frame++;
+        pthread_cond_broadcast(&stream->changed);
+        pthread_mutex_unlock(&stream->lock);
+    }
+
+    pthread_mutex_lock(&stream->lock);
+    stream->finished = 1;
+    pthread_cond_broadcast(&stream->changed);
+    pthread_mutex_unlock(&stream->lock);
+    return NULL;
+}
+
+int input_stream_start(input_stream *stream){
+    stream->start_time = e_time();
+    if (pthread_create(&stream->producer, NULL, producer_thread, stream) != 0){
+        printf ("Error: could not start the input stream producer thread\n");
+        return (-1);
+    }
+    stream->producer_started = 1;
+    return (0);
+}
+
+int input_stream_acquire(input_stream *stream, int64_t *frame){
+    pthread_mutex_lock(&stream->lock);
+    int index = stream->consume_index;
+    if (stream->buffer_state[index] != INPUT_STREAM_BUFFER_READY && !stream->finished)
+        stream->consumer_waits++;
+    while (stream->buffer_state[index] != INPUT_STREAM_BUFFER_READY && !stream->finished)
+        pthread_cond_wait(&stream->changed, &stream->lock);
+    if (stream->buffer_state[index] != INPUT_STREAM_BUFFER_READY){ //finished, and nothing left
+        pthread_mutex_unlock(&stream->lock);
+        return (-1);
+    }
+    stream->buffer_state[index] = INPUT_STREAM_BUFFER_IN_USE;
+    stream->consume_index = (index + 1) % stream->num_buffers;
+    stream->frames_consumed++;
+    *frame = stream->buffer_frame[index];
+    pthread_mutex_unlock(&stream->lock);
+    return index;
+}
+
+void input_stream_release(input_stream *stream, int index){
+    pthread_mutex_lock(&stream->lock);
+    stream->buffer_state[index] = INPUT_STREAM_BUFFER_FREE;
+    pthread_cond_broadcast(&stream->changed);
+    pthread_mutex_unlock(&stream->lock);
+    return;
+}
+
+void input_stream_stop(input_stream *stream){
+    if (!stream->producer_started)
+        return;
+    pthread_mutex_lock(&stream->lock);
+    stream->stop = 1;
+    pthread_cond_broadcast(&stream->changed);
+    pthread_mutex_unlock(&stream->lock);
+    pthread_join(stream->producer, NULL);
+    stream->producer_started = 0;
+    return;
+}
+
+void input_stream_report(input_stream *stream, double run_time){
+    double samples = (double)stream->frames_consumed*stream->frame_size;
+    double sample_rate = samples/run_time;
+    double realtime_rate = INPUT_STREAM_CHANNEL_RATE*stream->num_frequencies*stream->num_elements;
+    printf("Input stream (%d buffers of %zu B, %s%s):\n", stream->num_buffers, stream->frame_size,
+           stream->source == INPUT_STREAM_SOURCE_FILE ? "from file" : "from the generator", stream->realtime ? ", paced at the real-time rate" : "");
+    printf("    %lld frames consumed, %lld dropped (ring full), %lld overruns (source slower than real time)\n",
+           (long long int)stream->frames_consumed, (long long int)stream->frames_dropped, (long long int)stream->overruns);
+    printf("    producer waited on a full ring %lld times, consumer waited on an empty ring %lld times\n",
+           (long long int)stream->producer_waits, (long long int)stream->consumer_waits);
+    printf("    sustained: %.4g samples/s over %.4fs; real time needs %.4g samples/s (%.1f%%)\n", sample_rate, run_time, realtime_rate, 100.*sample_rate/realtime_rate);
+    return;
+}
+
+void input_stream_free(input_stream *stream){
+    input_stream_stop(stream);
+    if (stream->buffers != NULL){
+        for (int i = 0; i < stream->num_buffers; i++){
+            if (stream->buffers[i] != NULL){
+                munlock(stream->buffers[i], stream->frame_size);
+                free(stream->buffers[i]);
+            }
+        }
+    }
+    if (stream->file_descriptor >= 0)
+        close(stream->file_descriptor);
+    free(stream->buffers);
+    free(stream->buffer_frame);
+    free(stream->buffer_state);
+    free(stream->buffer_refs);
+    stream->buffers = NULL;
+    stream->buffer_frame = NULL;
+    stream->buffer_state = NULL;
+    stream->buffer_refs = NULL;
+    stream->file_descriptor = -1;
+    pthread_mutex_destroy(&stream->lock);
+    pthread_cond_destroy(&stream->changed);
+    return;
+}
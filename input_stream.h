@@ -0,0 +1,101 @@
+//input_stream.h
+//streaming input for the correlator: a ring of page-aligned, mlocked frame buffers that a producer thread fills (from the
+//generator or a raw file) while the consumer (the upload to the GPU) empties them. A frame is one GPU upload:
+//num_timesteps x num_frequencies x num_elements bytes
+#ifndef INPUT_STREAM_H
+#define INPUT_STREAM_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define INPUT_STREAM_SOURCE_GENERATOR   0
+#define INPUT_STREAM_SOURCE_FILE        1
+
+#define INPUT_STREAM_CHANNEL_RATE       390625.0 //timesteps per second in each frequency channel: the 400 MHz band in 1024 channels
+
+//buffer states
+#define INPUT_STREAM_BUFFER_FREE        0
+#define INPUT_STREAM_BUFFER_FILLING     1 //the producer is writing it
+#define INPUT_STREAM_BUFFER_READY       2 //waiting for the consumer
+#define INPUT_STREAM_BUFFER_IN_USE      3 //taken by the consumer, until input_stream_release
+
+typedef struct input_stream input_stream;
+
+typedef struct {
+    input_stream *stream;
+    int index;
+} input_stream_buffer_ref; //for release callbacks that only get a single pointer
+
+struct input_stream {
+    //frame layout and source
+    int num_timesteps;
+    int num_frequencies;
+    int num_elements;
+    size_t frame_size;
+    int64_t num_frames; //frames to deliver (dropped frames don't count)
+    int realtime; //frames are due every frame_period seconds; a frame that finds the ring full is dropped
+    double frame_period;
+    int source;
+    int generation_Type;
+    int random_seed;
+    int default_real;
+    int default_imaginary;
+    int initial_real;
+    int initial_imaginary;
+    int single_frequency;
+    int no_repeat_random;
+    int num_threads;
+    int file_descriptor;
+    int64_t frames_in_file; //the file is replayed from the start once it runs out
+
+    //ring
+    int num_buffers;
+    unsigned char **buffers;
+    int64_t *buffer_frame; //frame number held by each buffer
+    int *buffer_state;
+    input_stream_buffer_ref *buffer_refs;
+    int produce_index; //next buffer the producer fills
+    int consume_index; //next buffer the consumer takes
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pthread_t producer;
+    int producer_started;
+    int stop;
+    int finished; //the producer has delivered its last frame (or failed)
+    int err;
+    double start_time;
+
+    //counters
+    int64_t frames_produced;
+    int64_t frames_consumed;
+    int64_t frames_dropped; //realtime only: no free buffer when the frame was due
+    int64_t overruns; //realtime only: the source took longer than a frame period to make a frame
+    int64_t producer_waits; //times the producer found the ring full and had to wait (backpressure)
+    int64_t consumer_waits; //times the consumer found no frame ready and had to wait
+};
+
+int input_stream_init(input_stream *stream, int num_buffers, int num_timesteps, int num_frequencies, int num_elements, int64_t num_frames, int realtime);
+
+void input_stream_use_generator(input_stream *stream, int generation_Type, int random_seed, int default_real, int default_imaginary, int initial_real, int initial_imaginary,
+                                int single_frequency, int no_repeat_random, int num_threads);
+int input_stream_use_file(input_stream *stream, const char *file_name);
+
+//fills buffer with frame number frame, straight from the source. The producer uses it, and after the run it can remake any
+//frame for checking (except for the rand() generator with no_repeat_random, whose sequence only runs forwards)
+int input_stream_fill_frame(input_stream *stream, int64_t frame, unsigned char *buffer);
+
+int input_stream_start(input_stream *stream);
+
+//returns the index of the next full buffer (in frame order) and its frame number, waiting if need be, or -1 once the stream
+//has ended. The buffer belongs to the caller until it is handed back with input_stream_release
+int input_stream_acquire(input_stream *stream, int64_t *frame);
+void input_stream_release(input_stream *stream, int index);
+
+void input_stream_stop(input_stream *stream);
+
+//prints the counters, and the sustained rate in samples/s over run_time seconds against the real-time rate
+void input_stream_report(input_stream *stream, double run_time);
+
+void input_stream_free(input_stream *stream);
+
+#endif
@@ -0,0 +1,13 @@
+//long_term_integrator.cl
+//folds one frame's corr output (any layout: it works value by value) into 64 bit accumulators kept on the device, so
+//only every integrate_frames'th frame has to be read back. 32 bit sums would overflow after a few frames.
+//first starts a new integration by overwriting the accumulators, so they never need zeroing from the host
+
+__kernel void integrate_frames (__global const int *frame,
+                                __global long *integration,
+                                const int first){
+    size_t i = get_global_id(0);
+    long value = (long)frame[i];
+
+    integration[i] = first ? value : integration[i] + value;
+}
@@ -15,12 +15,20 @@
 #include <sys/mman.h>
 #include <assert.h>
 #include <getopt.h>
+#include <pthread.h>
 #include "amd_firepro_error_code_list_for_opencl.h"
 #include "input_generator.h"
 #include "four_bit_macros.h"
 #include "gpu_data_reorg.h"
 #include "gpu_cpu_helpers.h"
 #include "cpu_corr_test.h"
+#include "cpu_xengine.h"
+#include "input_stream.h"
+#include "cl_program_cache.h"
+#include "event_profiler.h"
+#include "multi_device.h"
+#include "device_profile.h"
+#include "autotune.h"
 
 
 #define NUM_CL_FILES                    3
@@ -40,30 +48,50 @@
 #define OPENCL_FILENAME_PACKED2_UT_2    "offset_accumulator.cl"
 #define OPENCL_FILENAME_PACKED2_UT_3    "preseed_multifreq_highly_packed_correlator_method_UT.cl"
 
-#define N_STAGES                        2 //write to CL_Mem, Kernel (Read is done after many runs since answers are accumulated)
-#define N_QUEUES                        2 //have 2 separate queues so transfer and process paths can be queued nicely
+//-u replaces the correlator (the first file of a batch) with a version that applies the preseed correction itself
+#define OPENCL_FILENAME_FUSED1          "fused_pairwise_correlator.cl"
+#define OPENCL_FILENAME_FUSED1_UT       "fused_pairwise_correlator_UT.cl"
+#define OPENCL_FILENAME_FUSED2          "fused_packed_correlator_overflow_protected_to_2272_iter.cl"
+#define OPENCL_FILENAME_FUSED2_UT       "fused_packed_correlator_overflow_protected_to_2272_iter_UT.cl"
+
+#define OPENCL_FILENAME_INTEGRATOR      "long_term_integrator.cl" //built on its own, and only with -N
+#define OPENCL_FILENAME_PACKER          "upper_triangle_packer.cl" //built on its own, and only with -O
+
+#define MAX_STAGES                      8 //each stage is a set of buffers for write to CL_Mem -> offsetAccumulate -> preseed -> corr -> read back
+#define DEFAULT_STAGES                  2
+#define N_QUEUES                        3 //separate queues for uploads, kernels and read backs, so the three can overlap
+#define TRANSFER_COPY                   0 //clEnqueueWriteBuffer from the host pointer into a device buffer
+#define TRANSFER_PINNED_STAGING         1 //clEnqueueCopyBuffer from the pinned (CL_MEM_USE_HOST_PTR) buffer into a device buffer
+#define TRANSFER_ZERO_COPY              2 //map/unmap the pinned buffer and let the kernels read host memory directly
+#define TRIANGLE_OUTPUT_BLOCKS          0 //read back corr's blocks, and reorganize them on the host
+#define TRIANGLE_OUTPUT_INT             1 //pack the upper triangle on the device, as int32
+#define TRIANGLE_OUTPUT_FLOAT           2 //pack the upper triangle on the device, as float32
 #define PAGESIZE_MEM                    4096u
 #define BASE_TIMESAMPLES_ACCUM          32u
 
 #define SDK_SUCCESS                     0u
 #define TRIANGLE                        1
+#define AMP2_RATIO_DUMP_FILE            "amp2_ratio_GPU_div_CPU.bin"
+#define PHASE_DIFF_DUMP_FILE            "phase_diff_GPU_m_CPU.bin"
 
 void print_help() {
     printf("Usage: sudo ./correlator_test [opts]\n\n");
     printf("Options:\n");
     printf("  --help (-h)                               Display the available run options.\n");
-    printf("  --device (-d) [device_number]             Default: 0. For multi-GPU computers, can choose larger values.\n");
+    printf("  --device (-d) [device_number]             Default: 0. For multi-GPU computers, can choose larger values (devices of the -G type, counted over every platform).\n");
+    printf("  --device_type (-G) [type]                 Default: gpu (all with -M). (gpu, cpu, accelerator, all). Type of OpenCL device to run on; work-group sizes and the peak throughput estimate come from a profile for the device found (e.g. cpu runs the kernels on PoCL).\n");
     printf("  --iterations (-i) [number]                Default: 100. Number of iterations to test the code.\n");
     printf("  --time_accum (-t) [number]                Default: 256. Range [1,291] for version from conference, [1,1912] for new alg.\n");
     printf("  --time_steps (-T) [number]                Default: Automatically generated. Number of time steps of element data.\n");
     printf("  --num_freq (-f) [number]                  Default: 1. Number of frequency channels to process simultaneously.\n");
-    printf("  --num_elements (-e) [number]              Default: 2048. Number of elements to correlate.\n");
+    printf("  --num_elements (-e) [number]              Default: 2048. Number of elements to correlate. Any count: if it isn't a multiple of the tile edge (-b), the last row and column of output blocks are masked edge tiles.\n");
+    printf("  --block_dim (-b) [number]                 Default: 32 (or the tuned value). (16, 32 or 64). Edge of the square output tile a work-group correlates; each work item still does 4 x 4 of it. Larger tiles reuse each loaded element more, smaller ones give more work-groups and waste less on edge tiles. Which is fastest depends on the device, N and F, and no crossover has been measured for the default: -A times all three and prints where they cross over for the device, N and F, then saves the fastest.\n");
     printf("  --timer_without_copies (-w) [number]      Default: off. When on, it separates the copy section from the iterations. \n");
     printf("                                                     Not realistic behaviour, but helpful for timing without using profiler tools.\n");
     printf("  --upper_triangle_convention (-U) [number] Default: 1. (range: [0,1]). 1 uses the standard pairwise correlation convention. 0 does not (i.e. complex conjugate of expected results).\n");
     printf("  --check_results (-c)                      Default: off. Calculates and checks GPU results with CPU calculations.\n");
     printf("  --verbose (-v)                            Default: off. Verbose calculation check. (Dumps all correlation products).\n");
-    printf("  --gen_type (-g) [number]                  Default: 4. (1 = Constant, 2 = Ramp up, 3 = Ramp down, 4 = Random (seeded)).\n");
+    printf("  --gen_type (-g) [number]                  Default: 4. (1 = Constant, 2 = Ramp up, 3 = Ramp down, 4 = Random (seeded), 5 = Counter-based random (seeded, generated in parallel)).\n");
     printf("  --random_seed (-r) [number]               Default: 42. The seed for the pseudorandom generator.\n");
     printf("  --no_repeat_random (-p)                   Default: off. Whether the random sequence repeats at each time step (and frequency channel).\n");
     printf("  --generate_frequency -q [number]          Default: -1 (All frequencies). Other numbers generate non-default values for that frequency channel.\n");
@@ -71,10 +99,431 @@ void print_help() {
     printf("  --default_imaginary (-y) [number]         Default: 0. (range: [-8, 7]). Only used for higher frequency channels when generate_freq != ALL_FREQUENCIES.\n");
     printf("  --initial_real (-X) [number]              Default: 0. (range: [-8, 7]). Only matters for ramped modes.\n");
     printf("  --initial_imaginary (-Y) [number]         Default: 0. (range: [-8, 7]). Only matters for ramped modes.\n");
-    printf("  --kernel_batch (-k) [number]              Default: 0. (0= Kernels from IEEE conference, 1= New more-packed version).\n");
+    printf("  --kernel_batch (-k) [number]              Default: 0. (0= Kernels from IEEE conference, 1= New more-packed version). With -u, batch 1 needs -f 1.\n");
+    printf("  --naive_cpu_check (-n)                    Default: off. Check results with the original straightforward CPU loops rather than the blocked CPU correlator.\n");
+    printf("  --cpu_engine (-C) [number]                Default: -1 (Auto). (0= Scalar, 1= AVX2, 2= AVX-512 VNNI, 3= Lookup table). Engine used by the blocked CPU correlator; auto times them all and picks the fastest.\n");
+    printf("  --cpu_threads (-j) [number]               Default: 0 (All online CPUs). Number of threads used by the blocked CPU correlator and the data generator.\n");
+    printf("  --dump_per_baseline_compare (-a)          Default: off. With -c, also writes the per-baseline GPU/CPU amplitude squared ratios and phase differences (raw doubles) to " AMP2_RATIO_DUMP_FILE " and " PHASE_DIFF_DUMP_FILE ".\n");
+    printf("  --cpu_scaling_report (-s)                 Default: off. With -c, times the blocked CPU correlator at 1, 2, 4, ... cpu_threads threads and reports the parallel efficiency (and, with -C -1, the speed of each engine).\n");
+    printf("  --emulate_kernels (-K)                    Default: off. With -c, the CPU result is a bit-exact emulation of the selected kernel batch (packed lanes, offset and preseed corrections, overflows included) rather than an exact correlation.\n");
+    printf("  --cpu_output_64 (-L)                      Default: off. With -c, the blocked CPU correlator keeps 64 bit results and reports how many no longer fit the GPU's 32 bit output (the GPU is compared against their low 32 bits).\n");
+    printf("  --transfer_mode (-I) [number]             Default: 0. How input frames get to the device: 0 = clEnqueueWriteBuffer from the host pointer, 1 = copy-engine staging through the pinned buffers, 2 = zero-copy (the pinned buffers are mapped/unmapped and the kernels read host memory directly; saves a full copy of every frame on integrated and CPU devices). Not with -w or -M.\n");
+    printf("  --fused_kernel (-u)                       Default: off. Runs a correlator that sums the element offsets while it streams the input and applies the preseed correction as it writes out, instead of offsetAccumulateElements, preseed and corr (the output is zeroed on the device instead). Same results. Not supported with kernel batch 1 (-k 1) and more than one frequency channel: the fused batch 1 kernel, like the batch 1 corr it replaces, correlates a single channel, so -u -k 1 needs -f 1 (or use -k 0 for several channels).\n");
+    printf("  --diagonal_launch (-J)                    Default: off. Correlates the diagonal blocks in a launch of their own, next to the one for the rest of the blocks. Only their upper triangle patches are computed, so that build has the registers and local memory to load twice as many timesteps per pass (when time_accum is a multiple of 2 x tile/4), halving its barriers. Same results. Not with -M.\n");
+    printf("  --integrate_frames (-N) [number]          Default: 1 (off). Sums this many frames of correlator output into 64 bit accumulators on the device and reads back only the sums, cutting read back traffic and host work by that factor. With -c, every frame has to be the same data (no -B).\n");
+    printf("  --accum_partials (-Q) [number]            Default: 1. Number of partial sums the offset accumulator splits each frame's timesteps into (at most time_steps/BASE_ACCUM); with more than one, a second kernel adds them up. 0 picks enough partials to give every compute unit work-groups from the device profile; that has not been timed against 1 on any device yet, so it is not the default. With -P, the offset_accumulate and combine_offsets stages time the choice.\n");
+    printf("  --triangle_output (-O) [number]           Default: 0. (0 = corr's blocks, 1 = packed int32, 2 = packed float32). With 1 or 2, a kernel packs each frame's upper triangle on the device (frequency-major, N(N+1)/2 complex values per channel, the layout the host reorganize makes) and only that is read back: no lower halves of diagonal blocks or edge tile padding, and no reorganize on the host. With -c, float32 output is compared with the CPU results rounded to float32. Not with -M or -N.\n");
+    printf("  --pipeline_depth (-D) [number]            Default: 2. (range: [2,8]). Number of sets of buffers for the upload -> kernels -> read back pipeline; uploads can run up to depth-1 frames ahead of the kernels.\n");
+    printf("  --stream_buffers (-B) [number]            Default: 0 (off). Streams a new frame of input for every iteration through a ring of this many pinned input buffers, filled by a producer thread, and reports the sustained throughput against the real-time rate.\n");
+    printf("  --stream_file (-F) [file name]            Default: none (use the generator). With -B, frames are read from this raw file (time_steps x num_freq x num_elements bytes each; it is replayed once it runs out).\n");
+    printf("  --stream_realtime (-R)                    Default: off. With -B, frames arrive at the real-time rate and are dropped when the ring is full, rather than the producer waiting.\n");
+    printf("  --kernel_cache (-Z) [directory]           Default: %s. Where built kernel binaries are kept, keyed by kernel source, build options and device/driver, so later runs with the same configuration skip compiling. \"none\" always compiles from source.\n", CL_PROGRAM_CACHE_DEFAULT_DIR);
+    printf("  --multi_device (-M) [number]              Default: off. Shards the frequency channels over this many OpenCL devices of the -G type, on every platform (0 = all of them), each with its own context, queues, buffers and host thread, and merges their outputs. Takes -D and -B; not -w or -P.\n");
+    printf("  --cpu_sub_devices (-S) [number]           Default: 0 (off). With -M, splits CPU OpenCL devices into sub-devices of this many compute units each, so sharding can be tried on a machine without GPUs.\n");
+    printf("  --autotune (-A)                           Default: off. Sweeps the kernel batch, time_accum, tile edge, BASE_ACCUM and offsetAccumulate work-group for the device, N, F and convention (with -T, only time_accum values dividing it), checks each candidate against the CPU correlator on short samples, times the correct ones over %d frames, and saves the fastest to the tuning database.\n", AUTOTUNE_TIMED_FRAMES);
+    printf("  --tuning_db (-W) [file name]              Default: %s. Tuning database written by -A. Runs on a single device use the entry for their device, N, F and convention; -k, -t, -T and -b given on the command line take precedence. \"none\" ignores it.\n", AUTOTUNE_DEFAULT_DB);
+    printf("  --profile_events (-P) [file name]         Default: off. Samples the OpenCL profiling times of every write, kernel and read back in the loop, prints a per-stage summary and writes it to this file: JSON if the name ends in .json, otherwise CSV (plus name_events.csv with every event).\n");
 }
 
 
+//called once per integration, from an OpenCL callback thread, as soon as the integration has been read back. output (len
+//values in the GPU's block layout) is only valid during the call: the stage's next integration waits until it returns
+typedef void (*integration_consumer)(void *context, int64_t integration, int64_t frame, double latency, int *output, int len);
+
+typedef struct {
+    integration_consumer consumer;
+    void *consumer_context;
+    int *output;
+    int len;
+    int64_t integration;
+    int64_t frame; //input stream frame (the integration number when not streaming)
+    double upload_time; //when the frame's upload was enqueued
+    cl_event consumed; //user event, set once the consumer has returned
+} readback_stage;
+//each read back is handed a copy of its stage's readback_stage, which the callback frees, so the host can queue the
+//stage's next integration (which waits on consumed on the device) before the consumer has had this one
+
+//what the default consumer keeps: one integration for the check (the first, or with streamed input the latest) and the
+//pipeline latency, from enqueuing the upload to the consumer getting the result
+typedef struct {
+    pthread_mutex_t lock; //read backs of different stages can complete at the same time
+    int compare_to_first; //every frame is the same data, so every integration should match the first
+    int *kept_output;
+    int64_t kept_integration;
+    int64_t kept_frame;
+    int64_t num_integrations;
+    int64_t num_dumps; //-N
+    int64_t num_differing;
+    double total_latency;
+    double max_latency;
+} integration_results;
+
+static void keep_integration(void *context, int64_t integration, int64_t frame, double latency, int *output, int len){
+    integration_results *results = (integration_results *)context;
+    pthread_mutex_lock(&results->lock);
+    if (results->num_integrations == 0 || (!results->compare_to_first && integration > results->kept_integration)){
+        memcpy(results->kept_output, output, len*sizeof(int));
+        results->kept_integration = integration;
+        results->kept_frame = frame;
+    }
+    else if (results->compare_to_first && memcmp(results->kept_output, output, len*sizeof(int)) != 0)
+        results->num_differing++;
+    results->num_integrations++;
+    results->total_latency += latency;
+    if (latency > results->max_latency)
+        results->max_latency = latency;
+    pthread_mutex_unlock(&results->lock);
+    return;
+}
+
+static void CL_CALLBACK integration_read_back(cl_event event, cl_int status, void *user_data){
+    readback_stage *stage = (readback_stage *)user_data;
+    if (status == CL_COMPLETE)
+        stage->consumer(stage->consumer_context, stage->integration, stage->frame, e_time() - stage->upload_time, stage->output, stage->len);
+    clSetUserEventStatus(stage->consumed, CL_COMPLETE);
+    clReleaseEvent(stage->consumed);
+    free(stage);
+    return;
+}
+
+//-N: called once per dump of num_frames integrations summed on the device, starting with frame first_frame. output is
+//len 64 bit sums, in the same layout and with the same lifetime as an integration_consumer's output
+typedef void (*dump_consumer)(void *context, int64_t dump, int64_t first_frame, int num_frames, double latency, int64_t *output, int len);
+
+typedef struct {
+    dump_consumer consumer;
+    void *consumer_context;
+    int64_t *output;
+    int len;
+    int64_t dump;
+    int64_t first_frame;
+    int num_frames;
+    double upload_time; //when the dump's last frame's upload was enqueued
+    cl_event consumed;
+} dump_stage; //copied per read back, like readback_stage
+
+//when every frame is the same data, a dump is num_frames times the frame's integration: keep that for the check, and
+//count dumps that aren't (or that differ from the first)
+static void keep_dump(void *context, int64_t dump, int64_t first_frame, int num_frames, double latency, int64_t *output, int len){
+    integration_results *results = (integration_results *)context;
+    pthread_mutex_lock(&results->lock);
+    if (results->compare_to_first){
+        int differs = 0;
+        for (int i = 0; i < len; i++){
+            int per_frame = (int)(output[i] / num_frames); //corr's output wraps at 32 bits, and so does the check's
+            if (output[i] != (int64_t)(output[i] / num_frames) * num_frames || (results->num_dumps > 0 && per_frame != results->kept_output[i]))
+                differs = 1;
+            if (results->num_dumps == 0)
+                results->kept_output[i] = per_frame;
+        }
+        results->num_differing += differs;
+        if (results->num_dumps == 0){
+            results->kept_integration = dump;
+            results->kept_frame = first_frame;
+        }
+    }
+    results->num_dumps++;
+    results->num_integrations += num_frames;
+    results->total_latency += latency;
+    if (latency > results->max_latency)
+        results->max_latency = latency;
+    pthread_mutex_unlock(&results->lock);
+    return;
+}
+
+static void CL_CALLBACK dump_read_back(cl_event event, cl_int status, void *user_data){
+    dump_stage *stage = (dump_stage *)user_data;
+    if (status == CL_COMPLETE)
+        stage->consumer(stage->consumer_context, stage->dump, stage->first_frame, stage->num_frames, e_time() - stage->upload_time, stage->output, stage->len);
+    clSetUserEventStatus(stage->consumed, CL_COMPLETE);
+    clReleaseEvent(stage->consumed);
+    free(stage);
+    return;
+}
+
+//OpenCL calls this once a streamed frame has been uploaded, so its buffer can go back to the producer
+static void CL_CALLBACK release_stream_buffer(cl_event event, cl_int status, void *user_data){
+    input_stream_buffer_ref *buffer = (input_stream_buffer_ref *)user_data;
+    input_stream_release(buffer->stream, buffer->index);
+    return;
+}
+
+//what the check needs to know about the run
+typedef struct {
+    int time_steps;
+    int num_freq;
+    int num_elem;
+    int time_accum;
+    int base_accum;
+    int kernel_batch;
+    int upper_triangle_convention;
+    int gen_type;
+    int random_seed;
+    int default_real;
+    int default_imaginary;
+    int initial_real;
+    int initial_imaginary;
+    int generate_frequency;
+    int no_repeat_random;
+    int naive_cpu_check;
+    int emulate_kernels;
+    int triangle_output; //the GPU output is already the packed upper triangle (-O)
+    int cpu_output_64;
+    int cpu_scaling_report;
+    int dump_per_baseline_compare;
+    int cpu_engine;
+    int cpu_threads;
+    int block_dim;
+    int verbose;
+} check_options;
+
+//with float32 output (-O 2) both sides are compared as float32 values, converted back to int (clamped, as 2^31 rounds up)
+static int float_for_check(float value){
+    if (value >= 2147483647.f)
+        return INT32_MAX;
+    if (value <= -2147483648.f)
+        return INT32_MIN;
+    return (int)value;
+}
+
+//the work of check_gpu_output, into buffers it owns: returns -1 as soon as the CPU reference or a step of the comparison fails
+static int compare_gpu_output(const check_options *o, unsigned char *input, int *gpu_output, int *correlated_CPU, int *correlated_GPU,
+                              double *amp2_ratio_GPU_div_CPU, double *phaseAngleDiff_GPU_m_CPU){
+    int err = 0;
+    int size1_block = o->block_dim;
+    int num_blocks = gpu_num_blocks(size1_block, o->num_elem);
+    int len = o->num_freq*num_blocks*(size1_block*size1_block)*2;
+    double cputime = e_time();
+
+    //the blocked correlator works straight from the input the GPU was given, rather than generating a second copy of it
+    if (o->cpu_scaling_report){
+        err = cpu_xengine_scaling_report(input, o->time_steps, o->num_freq, o->num_elem, o->cpu_engine, o->cpu_threads, correlated_CPU);
+        if (err){
+            printf("CPU scaling report failed\n");
+            return(-1);
+        }
+        cputime = e_time(); //don't count the report in the check timing
+    }
+
+    if (o->emulate_kernels){
+        //the CPU goes through the same packed arithmetic as the kernels, so a mismatch here is the device, not the algorithm
+        int *emulated_GPU = (int *)malloc(len*sizeof(int));
+        if (emulated_GPU == NULL){
+            printf("failed to allocate memory\n");
+            return(-1);
+        }
+        err = cpu_xengine_emulate_kernels(input, o->time_steps, o->num_freq, o->num_elem, o->block_dim, o->time_accum, o->base_accum, o->kernel_batch, o->upper_triangle_convention, o->cpu_threads, emulated_GPU);
+        if (!err){
+            if (TRIANGLE)
+                err = reorganize_GPU_to_upper_triangle_threaded(size1_block, num_blocks, o->num_freq, o->num_elem, NULL, emulated_GPU, correlated_CPU, o->cpu_threads);
+            else
+                reorganize_GPU_to_full_Matrix_for_comparison(size1_block, num_blocks, o->num_freq, o->num_elem, emulated_GPU, correlated_CPU);
+        }
+        free(emulated_GPU);
+    }
+    else if (!o->naive_cpu_check){
+        if (o->verbose){
+            print_element_data(1, o->num_freq, o->num_elem, ALL_FREQUENCIES, input);
+        }
+        if (o->cpu_output_64){
+            //long integrations wrap the GPU's 32 bit sums. The 64 bit totals say where that happened; their low 32 bits are
+            //what the GPU should have
+            size_t correlated_CPU_size = TRIANGLE ? (size_t)o->num_freq*((o->num_elem*(o->num_elem+1))/2)*2 : (size_t)o->num_elem*o->num_elem*o->num_freq*2;
+            int64_t *correlated_CPU_64 = (int64_t *)malloc(correlated_CPU_size*sizeof(int64_t));
+            if (correlated_CPU_64 == NULL){
+                printf("failed to allocate memory\n");
+                return(-1);
+            }
+            err = cpu_xengine_correlate_threaded_int64(input, o->time_steps, o->num_freq, o->num_elem, o->upper_triangle_convention, TRIANGLE, 0, o->cpu_engine, o->cpu_threads, o->verbose, correlated_CPU_64);
+            if (!err){
+                int64_t num_wide_values = 0;
+                int64_t largest_value = 0;
+                for (size_t i = 0; i < correlated_CPU_size; i++){
+                    int64_t value = correlated_CPU_64[i];
+                    if (value > INT32_MAX || value < INT32_MIN)
+                        num_wide_values++;
+                    if (llabs(value) > largest_value)
+                        largest_value = llabs(value);
+                    correlated_CPU[i] = (int)(uint32_t)value;
+                }
+                printf("CPU 64 bit results: largest magnitude %lld; %lld of %lld values exceed 32 bits\n", (long long int)largest_value, (long long int)num_wide_values, (long long int)correlated_CPU_size);
+            }
+            free(correlated_CPU_64);
+        }
+        else
+            err = cpu_xengine_correlate_threaded(input, o->time_steps, o->num_freq, o->num_elem, o->upper_triangle_convention, TRIANGLE, 0, o->cpu_engine, o->cpu_threads, o->verbose, correlated_CPU);
+    }
+    else if (o->upper_triangle_convention == 0){
+        if (TRIANGLE){
+            err = cpu_data_generate_and_correlate_upper_triangle_only_nonstandard_convention(o->time_steps, o->num_freq, o->num_elem, correlated_CPU,o->gen_type, o->random_seed, o->default_real, o->default_imaginary, o->initial_real, o->initial_imaginary,o->generate_frequency, o->no_repeat_random,o->verbose);
+        }
+        else{
+            err = cpu_data_generate_and_correlate_nonstandard_convention(o->time_steps, o->num_freq, o->num_elem, correlated_CPU,o->gen_type, o->random_seed, o->default_real, o->default_imaginary, o->initial_real, o->initial_imaginary,o->generate_frequency, o->no_repeat_random,o->verbose);
+        }
+    }
+    else{
+        if (TRIANGLE){
+            err = cpu_data_generate_and_correlate_upper_triangle_only(o->time_steps, o->num_freq, o->num_elem, correlated_CPU,o->gen_type, o->random_seed, o->default_real, o->default_imaginary, o->initial_real, o->initial_imaginary,o->generate_frequency, o->no_repeat_random,o->verbose);
+        }
+        else{
+            err = cpu_data_generate_and_correlate(o->time_steps, o->num_freq, o->num_elem, correlated_CPU,o->gen_type, o->random_seed, o->default_real, o->default_imaginary, o->initial_real, o->initial_imaginary,o->generate_frequency, o->no_repeat_random,o->verbose);
+        }
+    }
+    if (err){
+        printf("CPU reference correlation failed, so there is nothing to compare the GPU with\n");
+        return(-1);
+    }
+
+    if (o->triangle_output != TRIANGLE_OUTPUT_BLOCKS){
+        //the device has done the reorganize already; the CPU's values get the float32 output's rounding too
+        size_t triangle_size = (size_t)o->num_freq*((o->num_elem*(o->num_elem+1))/2)*2;
+        for (size_t i = 0; i < triangle_size; i++){
+            if (o->triangle_output == TRIANGLE_OUTPUT_FLOAT){
+                correlated_GPU[i] = float_for_check(((float *)gpu_output)[i]);
+                correlated_CPU[i] = float_for_check((float)correlated_CPU[i]);
+            }
+            else
+                correlated_GPU[i] = gpu_output[i];
+        }
+    }
+    else if (TRIANGLE){
+        err = reorganize_GPU_to_upper_triangle_threaded(size1_block, num_blocks, o->num_freq, o->num_elem, NULL, gpu_output, correlated_GPU, o->cpu_threads);
+        if (err){
+            printf("failed to reorganize the GPU output\n");
+            return(-1);
+        }
+    }
+    else{
+        reorganize_GPU_to_full_Matrix_for_comparison(size1_block, num_blocks, o->num_freq, o->num_elem, gpu_output, correlated_GPU);
+    }
+
+    //statistics are gathered in one streaming pass
+    compare_statistics compare_stats;
+    err = compare_correlator_results_streaming(&compare_stats, o->num_freq, o->num_elem, TRIANGLE, correlated_GPU, correlated_CPU, amp2_ratio_GPU_div_CPU, phaseAngleDiff_GPU_m_CPU, o->cpu_threads, o->verbose);
+    if (err){
+        printf("Comparison failed\n");
+        return (-1);
+    }
+    int64_t number_errors = compare_stats.num_err;
+
+    if (o->dump_per_baseline_compare){
+        size_t num_baselines = TRIANGLE ? (size_t)o->num_freq*((o->num_elem*(o->num_elem+1))/2) : (size_t)o->num_elem*o->num_elem*o->num_freq;
+        FILE *dump_file = fopen(AMP2_RATIO_DUMP_FILE, "wb");
+        if (dump_file != NULL){
+            fwrite(amp2_ratio_GPU_div_CPU, sizeof(double), num_baselines, dump_file);
+            fclose(dump_file);
+        }
+        else
+            printf("Could not open %s for writing\n", AMP2_RATIO_DUMP_FILE);
+        dump_file = fopen(PHASE_DIFF_DUMP_FILE, "wb");
+        if (dump_file != NULL){
+            fwrite(phaseAngleDiff_GPU_m_CPU, sizeof(double), num_baselines, dump_file);
+            fclose(dump_file);
+        }
+        else
+            printf("Could not open %s for writing\n", PHASE_DIFF_DUMP_FILE);
+        printf("Per-baseline amplitude squared ratios and phase differences (%zu doubles each) written to %s and %s\n", num_baselines, AMP2_RATIO_DUMP_FILE, PHASE_DIFF_DUMP_FILE);
+    }
+
+    if (number_errors > 0)
+        printf("Error with correlation/accumulation! Num Err: %lld and length of correlated data: %d\n",(long long int)number_errors, o->num_elem*o->num_elem*o->num_freq);
+    else
+        printf("Correlation/accumulation successful! CPU matches GPU.\n");
+    cputime=e_time()-cputime;
+    printf("Full Corr: %4.2fs on CPU (%.2f kHz)\n",cputime,o->time_steps/cputime/1e3);
+    return 0;
+}
+
+//checks one integration of GPU output (in the kernels' block layout, or with -O the packed upper triangle) against the CPU,
+//working from the input the GPU was given
+static int check_gpu_output(const check_options *o, unsigned char *input, int *gpu_output){
+    int *correlated_CPU = calloc((o->num_elem*(o->num_elem))*o->num_freq*2,sizeof(int)); //made for the largest possible size (one size fits all)
+    //the triangle is converted straight into a buffer of its own size
+    size_t correlated_GPU_size = TRIANGLE ? (size_t)o->num_freq*((o->num_elem*(o->num_elem+1))/2)*2 : (size_t)o->num_elem*o->num_elem*o->num_freq*2;
+    int *correlated_GPU = (int *)malloc(correlated_GPU_size*sizeof(int));
+    //the per-baseline arrays (8 B per baseline each) are only made on request
+    double *amp2_ratio_GPU_div_CPU = NULL;
+    double *phaseAngleDiff_GPU_m_CPU = NULL;
+    if (o->dump_per_baseline_compare){
+        amp2_ratio_GPU_div_CPU = (double *)malloc((size_t)o->num_elem*o->num_elem*o->num_freq*sizeof(double));
+        phaseAngleDiff_GPU_m_CPU = (double *)malloc((size_t)o->num_elem*o->num_elem*o->num_freq*sizeof(double));
+    }
+
+    int err = -1;
+    if (correlated_CPU == NULL || correlated_GPU == NULL || (o->dump_per_baseline_compare && (amp2_ratio_GPU_div_CPU == NULL || phaseAngleDiff_GPU_m_CPU == NULL)))
+        printf("failed to allocate memory\n");
+    else
+        err = compare_gpu_output(o, input, gpu_output, correlated_CPU, correlated_GPU, amp2_ratio_GPU_div_CPU, phaseAngleDiff_GPU_m_CPU);
+
+    free(correlated_CPU);
+    free(correlated_GPU);
+    free(amp2_ratio_GPU_div_CPU);
+    free(phaseAngleDiff_GPU_m_CPU);
+    return err;
+}
+
+// 4a load the source files //this load routine is based off of example code in OpenCL in Action by Matthew Scarpino
+static int load_source_file(const char *file_name, char **buffer, size_t *size){
+    FILE *fp = fopen(file_name, "r");
+    if (fp == NULL){
+        printf("error loading file: %s\n", file_name);
+        return (-1);
+    }
+    fseek(fp, 0, SEEK_END);
+    *size = ftell(fp);
+    rewind(fp);
+    *buffer = (char*)malloc(*size+1);
+    (*buffer)[*size] = '\0';
+    int sizeRead = fread(*buffer, sizeof(char), *size, fp);
+    if (sizeRead < *size)
+        printf("Error reading the file!!!");
+    fclose(fp);
+    return 0;
+}
+
+static int load_kernel_sources(int kernel_batch, int upper_triangle_convention, int fused_kernel, char **cl_programBuffer, size_t *cl_programSize){
+    char cl_fileNames[3][256];
+    if (upper_triangle_convention == 0){ //original code did the pairwise correlations with a non-standard convention...  The code is retained here, but in general it should be done as in the UT kernels
+        if (kernel_batch == 0){
+            sprintf(cl_fileNames[0],OPENCL_FILENAME_PACKED1_1);
+            sprintf(cl_fileNames[1],OPENCL_FILENAME_PACKED1_2);
+            sprintf(cl_fileNames[2],OPENCL_FILENAME_PACKED1_3);
+        }
+        else if (kernel_batch == 1){
+            sprintf(cl_fileNames[0],OPENCL_FILENAME_PACKED2_1);
+            sprintf(cl_fileNames[1],OPENCL_FILENAME_PACKED2_2);
+            sprintf(cl_fileNames[2],OPENCL_FILENAME_PACKED2_3);
+        }
+    }
+    else{ //UT kernels
+        if (kernel_batch == 0){
+            sprintf(cl_fileNames[0],OPENCL_FILENAME_PACKED1_UT_1);
+            sprintf(cl_fileNames[1],OPENCL_FILENAME_PACKED1_UT_2);
+            sprintf(cl_fileNames[2],OPENCL_FILENAME_PACKED1_UT_3);
+        }
+        else if (kernel_batch == 1){
+            sprintf(cl_fileNames[0],OPENCL_FILENAME_PACKED2_UT_1);
+            sprintf(cl_fileNames[1],OPENCL_FILENAME_PACKED2_UT_2);
+            sprintf(cl_fileNames[2],OPENCL_FILENAME_PACKED2_UT_3);
+        }
+    }
+
+    if (fused_kernel){
+        if (kernel_batch == 0)
+            sprintf(cl_fileNames[0], (upper_triangle_convention == 0) ? OPENCL_FILENAME_FUSED1 : OPENCL_FILENAME_FUSED1_UT);
+        else
+            sprintf(cl_fileNames[0], (upper_triangle_convention == 0) ? OPENCL_FILENAME_FUSED2 : OPENCL_FILENAME_FUSED2_UT);
+    }
+
+    printf("Using the following kernels: \n  \"%s\"\n  \"%s\"\n  \"%s\"\n", cl_fileNames[0],cl_fileNames[1],cl_fileNames[2]);
+
+    for (int i = 0; i < NUM_CL_FILES; i++){
+        if (load_source_file(cl_fileNames[i], &cl_programBuffer[i], &cl_programSize[i]))
+            return (-1);
+    }
+    return 0;
+}
+
 int main(int argc, char ** argv) {
 
     int opt_val = 0;
@@ -101,6 +550,36 @@ int main(int argc, char ** argv) {
     int kernel_batch = 0;
     int T_changed = 0;
     int upper_triangle_convention = 1;
+    int naive_cpu_check = 0;
+    int cpu_engine = CPU_XENGINE_AUTO;
+    int cpu_threads = 0;
+    int cpu_scaling_report = 0;
+    int dump_per_baseline_compare = 0;
+    int emulate_kernels = 0;
+    int cpu_output_64 = 0;
+    int stream_buffers = 0;
+    char *stream_file = NULL;
+    int stream_realtime = 0;
+    int num_stages = DEFAULT_STAGES;
+    char *kernel_cache_dir = CL_PROGRAM_CACHE_DEFAULT_DIR;
+    char *profile_file = NULL;
+    int multi_device = -1;
+    int cpu_sub_device_units = 0;
+    char *device_type_name = NULL;
+    cl_device_type device_type = CL_DEVICE_TYPE_GPU;
+    int autotune = 0;
+    int transfer_mode = TRANSFER_COPY;
+    int integrate_frames = 1;
+    int fused_kernel = 0;
+    int diagonal_launch = 0;
+    int block_dim = 32;
+    int b_changed = 0;
+    int triangle_output = TRIANGLE_OUTPUT_BLOCKS;
+    int accum_partials_requested = 1; //one partial until more have been measured to pay off; -Q 0 picks them from the device profile
+    char *tuning_db = AUTOTUNE_DEFAULT_DB;
+    int base_accum = BASE_TIMESAMPLES_ACCUM;
+    int t_changed = 0;
+    int k_changed = 0;
 
     for (;;) {
         static struct option long_options[] = {
@@ -123,13 +602,38 @@ int main(int argc, char ** argv) {
             {"initial_real",        required_argument, 0, 'X'},
             {"initial_imaginary",   required_argument, 0, 'Y'},
             {"kernel_batch",        required_argument, 0, 'k'},
+            {"naive_cpu_check",     no_argument,       0, 'n'},
+            {"cpu_engine",          required_argument, 0, 'C'},
+            {"cpu_threads",         required_argument, 0, 'j'},
+            {"cpu_scaling_report",  no_argument,       0, 's'},
+            {"dump_per_baseline_compare", no_argument, 0, 'a'},
+            {"emulate_kernels",     no_argument,       0, 'K'},
+            {"cpu_output_64",       no_argument,       0, 'L'},
+            {"pipeline_depth",      required_argument, 0, 'D'},
+            {"stream_buffers",      required_argument, 0, 'B'},
+            {"stream_file",         required_argument, 0, 'F'},
+            {"stream_realtime",     no_argument,       0, 'R'},
+            {"kernel_cache",        required_argument, 0, 'Z'},
+            {"profile_events",      required_argument, 0, 'P'},
+            {"multi_device",        required_argument, 0, 'M'},
+            {"cpu_sub_devices",     required_argument, 0, 'S'},
+            {"device_type",         required_argument, 0, 'G'},
+            {"autotune",            no_argument,       0, 'A'},
+            {"transfer_mode",       required_argument, 0, 'I'},
+            {"integrate_frames",    required_argument, 0, 'N'},
+            {"fused_kernel",        no_argument,       0, 'u'},
+            {"diagonal_launch",     no_argument,       0, 'J'},
+            {"block_dim",           required_argument, 0, 'b'},
+            {"triangle_output",     required_argument, 0, 'O'},
+            {"accum_partials",      required_argument, 0, 'Q'},
+            {"tuning_db",           required_argument, 0, 'W'},
             {"help",                no_argument,       0, 'h'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
 
-        opt_val = getopt_long (argc, argv, "d:i:f:e:t:T:wcvg:r:pq:x:y:X:Y:hk:U:",
+        opt_val = getopt_long (argc, argv, "d:i:f:e:t:T:wcvg:r:pq:x:y:X:Y:hk:U:nC:j:saKLB:F:RD:Z:P:M:S:G:AW:I:N:uJb:O:Q:",
                                long_options, &option_index);
 
         // End of args
@@ -156,6 +660,7 @@ int main(int argc, char ** argv) {
                 break;
             case 't':
                 time_accum = atoi(optarg);
+                t_changed = 1;
                 if (T_changed == 0){
                     time_steps = 128*time_accum;
                 }
@@ -176,7 +681,7 @@ int main(int argc, char ** argv) {
                 break;
             case 'g':
                 gen_type = atoi(optarg);
-                if (gen_type < 1 || gen_type >>4){
+                if (gen_type < 1 || gen_type > GENERATE_DATASET_COUNTER_BASED){
                     printf("Invalid parameter for gen_type.  See help for options\n");
                     print_help();
                     return -1;
@@ -205,6 +710,7 @@ int main(int argc, char ** argv) {
                 break;
             case 'k':
                 kernel_batch = atoi(optarg);
+                k_changed = 1;
                 if (kernel_batch < 0 || kernel_batch > 1){
                     printf("Invalid parameter for kernel_batch.  See help for options\n");
                     print_help();
@@ -219,6 +725,141 @@ int main(int argc, char ** argv) {
                     return -1;
                 }
                 break;
+            case 'n':
+                naive_cpu_check = 1;
+                break;
+            case 'C':
+                cpu_engine = atoi(optarg);
+                if (cpu_engine < CPU_XENGINE_AUTO || cpu_engine >= CPU_XENGINE_NUM_ENGINES){
+                    printf("Invalid parameter for cpu_engine.  See help for options\n");
+                    print_help();
+                    return -1;
+                }
+                if (cpu_engine != CPU_XENGINE_AUTO && !cpu_xengine_engine_supported(cpu_engine)){
+                    printf("cpu_engine %d (%s) is not supported on this host\n", cpu_engine, cpu_xengine_name(cpu_engine));
+                    return -1;
+                }
+                break;
+            case 'j':
+                cpu_threads = atoi(optarg);
+                if (cpu_threads < 0){
+                    printf("Invalid parameter for cpu_threads.  See help for options\n");
+                    print_help();
+                    return -1;
+                }
+                break;
+            case 's':
+                cpu_scaling_report = 1;
+                break;
+            case 'a':
+                dump_per_baseline_compare = 1;
+                break;
+            case 'K':
+                emulate_kernels = 1;
+                break;
+            case 'L':
+                cpu_output_64 = 1;
+                break;
+            case 'D':
+                num_stages = atoi(optarg);
+                if (num_stages < 2 || num_stages > MAX_STAGES){
+                    printf("Invalid parameter for pipeline_depth.  See help for options\n");
+                    print_help();
+                    return -1;
+                }
+                break;
+            case 'B':
+                stream_buffers = atoi(optarg);
+                if (stream_buffers < 0){
+                    printf("Invalid parameter for stream_buffers.  See help for options\n");
+                    print_help();
+                    return -1;
+                }
+                break;
+            case 'F':
+                stream_file = optarg;
+                break;
+            case 'R':
+                stream_realtime = 1;
+                break;
+            case 'Z':
+                kernel_cache_dir = (strcmp(optarg, "none") == 0) ? NULL : optarg;
+                break;
+            case 'P':
+                profile_file = optarg;
+                break;
+            case 'M':
+                multi_device = atoi(optarg);
+                if (multi_device < 0){
+                    printf("Invalid parameter for multi_device.  See help for options\n");
+                    print_help();
+                    return -1;
+                }
+                break;
+            case 'S':
+                cpu_sub_device_units = atoi(optarg);
+                break;
+            case 'A':
+                autotune = 1;
+                break;
+            case 'u':
+                fused_kernel = 1;
+                break;
+            case 'J':
+                diagonal_launch = 1;
+                break;
+            case 'Q':
+                accum_partials_requested = atoi(optarg);
+                if (accum_partials_requested < 0){
+                    printf("Invalid parameter for accum_partials.  See help for options\n");
+                    print_help();
+                    return -1;
+                }
+                break;
+            case 'O':
+                triangle_output = atoi(optarg);
+                if (triangle_output < TRIANGLE_OUTPUT_BLOCKS || triangle_output > TRIANGLE_OUTPUT_FLOAT){
+                    printf("Invalid parameter for triangle_output.  See help for options\n");
+                    print_help();
+                    return -1;
+                }
+                break;
+            case 'b':
+                block_dim = atoi(optarg);
+                b_changed = 1;
+                if (block_dim != 16 && block_dim != 32 && block_dim != 64){
+                    printf("Invalid parameter for block_dim.  See help for options\n");
+                    print_help();
+                    return -1;
+                }
+                break;
+            case 'N':
+                integrate_frames = atoi(optarg);
+                if (integrate_frames < 1){
+                    printf("Invalid parameter for integrate_frames.  See help for options\n");
+                    print_help();
+                    return -1;
+                }
+                break;
+            case 'I':
+                transfer_mode = atoi(optarg);
+                if (transfer_mode < TRANSFER_COPY || transfer_mode > TRANSFER_ZERO_COPY){
+                    printf("Invalid parameter for transfer_mode.  See help for options\n");
+                    print_help();
+                    return -1;
+                }
+                break;
+            case 'W':
+                tuning_db = (strcmp(optarg, "none") == 0) ? NULL : optarg;
+                break;
+            case 'G':
+                device_type_name = optarg;
+                if (device_profile_parse_type(device_type_name, &device_type) != 0){
+                    printf("Invalid parameter for device_type.  See help for options\n");
+                    print_help();
+                    return -1;
+                }
+                break;
             default:
                 //printf("Invalid option\n"); //does this automatically
                 print_help();
@@ -228,26 +869,234 @@ int main(int argc, char ** argv) {
     }
 
     //end of parsing
+    if (multi_device >= 0 && (timer_without_loop_copying || profile_file != NULL || autotune)){
+        printf("Sharding over devices (-M) can't be combined with -w, -P or -A\n");
+        return -1;
+    }
+    if (transfer_mode != TRANSFER_COPY && (timer_without_loop_copying || multi_device >= 0)){
+        printf("The pinned transfer modes (-I) upload every frame from the pinned buffers, so they can't be combined with -w or -M\n");
+        return -1;
+    }
+    if (integrate_frames > 1 && multi_device >= 0){
+        printf("Long-term integration (-N) runs on a single device, so it can't be combined with -M\n");
+        return -1;
+    }
+    if (diagonal_launch && multi_device >= 0){
+        printf("The separate diagonal block launch (-J) runs on a single device, so it can't be combined with -M\n");
+        return -1;
+    }
+    if (triangle_output != TRIANGLE_OUTPUT_BLOCKS && (multi_device >= 0 || integrate_frames > 1)){
+        printf("Packing the upper triangle on the device (-O) works on single frames of a single device, so it can't be combined with -M or -N\n");
+        return -1;
+    }
+    if (stream_buffers > 0){
+        //a dump of different frames can't be split back into the one frame the check remakes
+        if (check_results && integrate_frames > 1){
+            printf("The check (-c) needs every frame of a long-term integration (-N) to be the same data, so it can't check a stream (-B)\n");
+            return -1;
+        }
+        if (timer_without_loop_copying){
+            printf("Streaming (-B) uploads every frame, so it can't be timed without copies (-w)\n");
+            return -1;
+        }
+        //the check remakes the last frame the GPU correlated, so the source has to be able to produce it again
+        if (check_results && naive_cpu_check){
+            printf("The naive CPU check (-n) only knows the generator's first frame, so it can't check a stream (-B)\n");
+            return -1;
+        }
+        if (check_results && stream_file == NULL && gen_type == GENERATE_DATASET_RANDOM_SEEDED && no_repeat_random){
+            printf("The rand() generator with -p can't remake earlier frames to check a stream (-B): use -g 5 instead\n");
+            return -1;
+        }
+    }
 
     double cputime=0;
-
-
-    //basic setup of CL devices
     cl_int err;
 
-    // 1. Get a platform.
-    cl_platform_id platform;
-    clGetPlatformIDs( 1, &platform, NULL );
+    // 1. Find the devices of the requested type, on every platform (-M finds its own).
+    cl_device_id deviceID[DEVICE_PROFILE_MAX_DEVICES];
+    device_profile profile;
+    size_t accum_local_size = 0;
+    if (multi_device < 0){
+        int num_devices = device_profile_find_devices(device_type, deviceID, DEVICE_PROFILE_MAX_DEVICES);
+        if (num_devices < 0)
+            return (-1);
+        if (device_number >= num_devices){
+            printf("Error: device %d requested, but only %d found\n", device_number, num_devices);
+            return (-1);
+        }
+
+        // 2. Look up its profile: the work-group sizes and peak throughput used below.
+        if (device_profile_query(deviceID[device_number], &profile) != 0)
+            return (-1);
+        device_profile_print(&profile);
+        accum_local_size = profile.accum_local_size;
+
+        char device_key[1024];
+        autotune_device_key(deviceID[device_number], device_key, sizeof(device_key));
+        if (autotune){
+            char *tune_buffers[2][NUM_CL_FILES];
+            size_t tune_sizes[2][NUM_CL_FILES];
+            for (int b = 0; b < 2; b++){
+                if (load_kernel_sources(b, upper_triangle_convention, 0, tune_buffers[b], tune_sizes[b]))
+                    return (-1);
+            }
+            autotune_config tune = {.device_type = device_type, .device_index = device_number, .num_elements = num_elem, .num_frequencies = num_freq,
+                                    .upper_triangle_convention = upper_triangle_convention, .num_timesteps = T_changed ? time_steps : 0,
+                                    .num_stages = num_stages, .num_sources = NUM_CL_FILES, .sources = {(const char **)tune_buffers[0], (const char **)tune_buffers[1]},
+                                    .source_sizes = {tune_sizes[0], tune_sizes[1]}, .kernel_cache_dir = kernel_cache_dir, .cpu_threads = cpu_threads};
+            autotune_params best;
+            err = autotune_run(&tune, &best);
+            if (!err && tuning_db != NULL){
+                err = autotune_db_save(tuning_db, device_key, num_elem, num_freq, upper_triangle_convention, &best);
+                if (!err)
+                    printf("Saved to the tuning database %s\n", tuning_db);
+            }
+            for (int b = 0; b < 2; b++){
+                for (int i = 0; i < NUM_CL_FILES; i++)
+                    free(tune_buffers[b][i]);
+            }
+            return err ? -1 : 0;
+        }
 
-    // 2. Find a gpu device.
-    cl_device_id deviceID[5];
+        //a tuned configuration for this device and size replaces the defaults, but not what was set on the command line
+        autotune_params tuned;
+        int found = autotune_db_load(tuning_db, device_key, num_elem, num_freq, upper_triangle_convention, &tuned);
+        if (found < 0)
+            return (-1);
+        if (found == 0){
+            int keep_batch_and_accum = k_changed || t_changed || (T_changed && time_steps % tuned.time_accum != 0);
+            if (!keep_batch_and_accum){
+                kernel_batch = tuned.kernel_batch;
+                time_accum = tuned.time_accum;
+                if (T_changed == 0)
+                    time_steps = 128*time_accum;
+            }
+            if (time_steps % tuned.base_accum == 0)
+                base_accum = tuned.base_accum;
+            accum_local_size = tuned.accum_local_size;
+            if (!b_changed)
+                block_dim = tuned.block_dim;
+            printf("Tuned configuration from %s (%.1f kHz of band when tuned): kernel batch %d, time_accum %d, tile %d, BASE_ACCUM %d, offsetAccumulate work-group %zu%s%s\n",
+                   tuning_db, tuned.rate/1e3, tuned.kernel_batch, tuned.time_accum, tuned.block_dim, tuned.base_accum, tuned.accum_local_size,
+                   keep_batch_and_accum ? " (the kernel batch and time_accum set on the command line are kept)" : "",
+                   b_changed ? " (the tile edge set on the command line is kept)" : "");
+        }
+    }
 
-    err = clGetDeviceIDs( platform, CL_DEVICE_TYPE_GPU, 4, deviceID, NULL);
+    check_options check = {.time_steps = time_steps, .num_freq = num_freq, .num_elem = num_elem, .time_accum = time_accum, .base_accum = base_accum, .kernel_batch = kernel_batch,
+                           .upper_triangle_convention = upper_triangle_convention, .gen_type = gen_type, .random_seed = random_seed,
+                           .default_real = default_real, .default_imaginary = default_imaginary, .initial_real = initial_real,
+                           .initial_imaginary = initial_imaginary, .generate_frequency = generate_frequency, .no_repeat_random = no_repeat_random,
+                           .naive_cpu_check = naive_cpu_check, .emulate_kernels = emulate_kernels, .triangle_output = triangle_output, .cpu_output_64 = cpu_output_64,
+                           .cpu_scaling_report = cpu_scaling_report, .dump_per_baseline_compare = dump_per_baseline_compare,
+                           .cpu_engine = cpu_engine, .cpu_threads = cpu_threads, .block_dim = block_dim, .verbose = verbose};
+
+    //batch 1's correlator only handles a single channel, and its fused version sums the offsets of the data it correlates
+    if (fused_kernel && kernel_batch == 1 && num_freq > 1){
+        printf("Unsupported combination: --fused_kernel (-u) with --kernel_batch (-k) 1 and --num_freq (-f) %d. The fused batch 1 kernel only correlates a single frequency channel; use -f 1, or -k 0 for %d channels\n", num_freq, num_freq);
+        return -1;
+    }
 
-    if (err != CL_SUCCESS){
-        printf("Error getting device IDs\n");
+    size_t cl_programSize[NUM_CL_FILES];
+    char *cl_programBuffer[NUM_CL_FILES];
+    if (load_kernel_sources(kernel_batch, upper_triangle_convention, fused_kernel, cl_programBuffer, cl_programSize))
         return (-1);
+
+    if (multi_device >= 0){
+        //every device gets a share of the channels, a context, queues and buffers of its own, and a host thread
+        unsigned char *host_input;
+        err = posix_memalign ((void **)&host_input, PAGESIZE_MEM, time_steps*num_elem*num_freq);
+        if (err){
+            printf("error in creating memory buffers: Input, err: %i. Exiting program.\n", err);
+            return (err);
+        }
+        generate_char_data_set_threaded(gen_type, random_seed, default_real, default_imaginary, initial_real, initial_imaginary,
+                                        generate_frequency, time_steps, num_freq, num_elem, no_repeat_random, cpu_threads, host_input);
+
+        input_stream stream;
+        if (stream_buffers > 0){
+            err = input_stream_init(&stream, stream_buffers, time_steps, num_freq, num_elem, iterations, stream_realtime);
+            if (err){
+                printf("error in creating the input stream. Exiting program.\n");
+                return (-1);
+            }
+            if (stream_file != NULL){
+                err = input_stream_use_file(&stream, stream_file);
+                if (err)
+                    return (-1);
+            }
+            else
+                input_stream_use_generator(&stream, gen_type, random_seed, default_real, default_imaginary, initial_real, initial_imaginary, generate_frequency, no_repeat_random, cpu_threads);
+        }
+
+        int num_blocks = gpu_num_blocks(block_dim, num_elem);
+        int len = num_freq*num_blocks*block_dim*block_dim*2;
+        integration_results results;
+        memset(&results, 0, sizeof(results));
+        pthread_mutex_init(&results.lock, NULL);
+        results.compare_to_first = (stream_buffers == 0);
+        results.kept_output = (int *)malloc(len*sizeof(int));
+        if (results.kept_output == NULL){
+            printf("failed to allocate memory\n");
+            return (-1);
+        }
+
+        multi_device_config config = {.device_type = (device_type_name != NULL) ? device_type : CL_DEVICE_TYPE_ALL, .max_devices = multi_device, .cpu_sub_device_units = cpu_sub_device_units, .num_elements = num_elem,
+                                      .num_frequencies = num_freq, .num_timesteps = time_steps, .time_accum = time_accum,
+                                      .base_accum = base_accum, .num_stages = num_stages, .iterations = iterations,
+                                      .num_sources = NUM_CL_FILES, .sources = (const char **)cl_programBuffer, .source_sizes = cl_programSize,
+                                      .kernel_cache_dir = kernel_cache_dir, .stream = (stream_buffers > 0) ? &stream : NULL,
+                                      .fixed_input = host_input, .consumer = keep_integration, .consumer_context = &results,
+                                      .fused_kernel = fused_kernel, .block_dim = block_dim, .accum_partials = accum_partials_requested};
+        int64_t num_integrations;
+        err = multi_device_run(&config, &num_integrations, &cputime);
+        if (err)
+            return (-1);
+        if (stream_buffers > 0)
+            input_stream_report(&stream, cputime);
+        if (results.num_integrations > 0){
+            printf("Merged %lld integrations: latency from upload to consumer %.3f ms mean, %.3f ms max\n",
+                   (long long int)results.num_integrations, 1e3*results.total_latency/results.num_integrations, 1e3*results.max_latency);
+            if (results.compare_to_first && results.num_differing > 0)
+                printf("Warning: %lld integrations of the same data differ from the first one\n", (long long int)results.num_differing);
+        }
+        printf("Correlation matrices computation time: %6.4fs on all devices (%.1f kHz of 400 MHz band)\n", cputime,
+               time_steps*num_freq/cputime/1000*num_integrations);
+
+        if (check_results){
+            printf("Checking results. Please wait...\n");
+            if (results.num_integrations == 0){
+                printf("No frame was correlated, so there is nothing to check\n");
+                return (-1);
+            }
+            if (stream_buffers > 0){
+                printf("Checking stream frame %lld\n", (long long int)results.kept_frame);
+                err = input_stream_fill_frame(&stream, results.kept_frame, host_input);
+                if (err){
+                    printf("failed to remake the checked frame\n");
+                    return (-1);
+                }
+            }
+            if (check_gpu_output(&check, host_input, results.kept_output))
+                return (-1);
+        }
+        else{
+            printf("\nGPU calculations have not been verified. If kernels have been changed, be careful regarding these results.\n\n");
+        }
+
+        if (stream_buffers > 0)
+            input_stream_free(&stream);
+        free(results.kept_output);
+        pthread_mutex_destroy(&results.lock);
+        free(host_input);
+        for (int i = 0; i < NUM_CL_FILES; i++)
+            free(cl_programBuffer[i]);
+        return 0;
     }
+
+    //basic setup of CL devices (the device was found, and its tuning looked up, before the sources were loaded)
+
     cl_ulong lm;
     err = clGetDeviceInfo(deviceID[device_number], CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &lm, NULL);
     if (err != CL_SUCCESS){
@@ -255,10 +1104,7 @@ int main(int argc, char ** argv) {
         return (-1);
     }
 
-    cl_uint mcl,mcm;
-    clGetDeviceInfo(deviceID[device_number], CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(cl_uint), &mcl, NULL);
-    clGetDeviceInfo(deviceID[device_number], CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &mcm, NULL);
-    float card_tflops = mcl*1e6 * mcm*16*4*2 / 1e12;
+    float card_tflops = profile.peak_ops / 1e12;
 
     // 3. Create a context and command queues on that device.
     cl_context context = clCreateContext( NULL, 1, &deviceID[device_number], NULL, NULL, NULL);
@@ -274,98 +1120,105 @@ int main(int argc, char ** argv) {
     }
 
     // 4. Perform runtime source compilation, and obtain kernel entry point.
-    int size1_block = 32;
-    int num_blocks = (num_elem / size1_block) * (num_elem / size1_block + 1) / 2.; // 256/32 = 8, so 8 * 9/2 (= 36) //needed for the define statement
+    int size1_block = block_dim;
+    int num_blocks = gpu_num_blocks(size1_block, num_elem); // 256/32 = 8, so 8 * 9/2 (= 36); a partly filled last block column/row counts //needed for the define statement
 
-    // 4a load the source files //this load routine is based off of example code in OpenCL in Action by Matthew Scarpino
-    char cl_fileNames[3][256];
-    if (upper_triangle_convention == 0){ //original code did the pairwise correlations with a non-standard convention...  The code is retained here, but in general it should be done as in the UT kernels
-        if (kernel_batch == 0){
-            sprintf(cl_fileNames[0],OPENCL_FILENAME_PACKED1_1);
-            sprintf(cl_fileNames[1],OPENCL_FILENAME_PACKED1_2);
-            sprintf(cl_fileNames[2],OPENCL_FILENAME_PACKED1_3);
-        }
-        else if (kernel_batch == 1){
-            sprintf(cl_fileNames[0],OPENCL_FILENAME_PACKED2_1);
-            sprintf(cl_fileNames[1],OPENCL_FILENAME_PACKED2_2);
-            sprintf(cl_fileNames[2],OPENCL_FILENAME_PACKED2_3);
-        }
+    char cl_options[1024];
+    sprintf(cl_options,"-D NUM_ELEMENTS=%du -D NUM_FREQUENCIES=%du -D NUM_BLOCKS=%du -D NUM_TIMESAMPLES=%du -D NUM_TIME_ACCUM=%du -D BASE_ACCUM=%du -D SIZE_PER_SET=%du -D BLOCK_DIM=%du", num_elem, num_freq, num_blocks, time_steps, time_accum, base_accum,num_blocks*size1_block*size1_block*2*num_freq, size1_block);
+    printf("Dynamic define statements for GPU OpenCL kernels\n");
+    printf("-D NUM_ELEMENTS=%du \n-D NUM_FREQUENCIES=%du \n-D NUM_BLOCKS=%du \n-D NUM_TIMESAMPLES=%du\n-D NUM_TIME_ACCUM=%du\n-D BASE_ACCUM=%du\n-D SIZE_PER_SET=%du\n-D BLOCK_DIM=%du\n", num_elem, num_freq,num_blocks, time_steps, time_accum, base_accum, num_blocks*size1_block*size1_block*2*num_freq, size1_block);
+    //-J: the main build leaves the diagonal blocks to a second build of corr's source alone
+    char diagonal_options[sizeof(cl_options) + 32];
+    snprintf(diagonal_options, sizeof(diagonal_options), "%s -D DIAGONAL_BLOCKS", cl_options);
+    if (diagonal_launch)
+        strcat(cl_options, " -D OFF_DIAGONAL_BLOCKS");
+    int from_cache;
+    double build_time = e_time();
+    cl_program program = cl_program_cache_build(context, deviceID[device_number], NUM_CL_FILES, (const char**)cl_programBuffer, cl_programSize,
+                                                cl_options, kernel_cache_dir, &from_cache);
+    if (program == NULL)
+        return(-1);
+    cl_program diagonal_program = NULL;
+    if (diagonal_launch){
+        diagonal_program = cl_program_cache_build(context, deviceID[device_number], 1, (const char**)cl_programBuffer, cl_programSize,
+                                                  diagonal_options, kernel_cache_dir, NULL);
+        if (diagonal_program == NULL)
+            return(-1);
     }
-    else{ //UT kernels
-        if (kernel_batch == 0){
-            sprintf(cl_fileNames[0],OPENCL_FILENAME_PACKED1_UT_1);
-            sprintf(cl_fileNames[1],OPENCL_FILENAME_PACKED1_UT_2);
-            sprintf(cl_fileNames[2],OPENCL_FILENAME_PACKED1_UT_3);
-        }
-        else if (kernel_batch == 1){
-            sprintf(cl_fileNames[0],OPENCL_FILENAME_PACKED2_UT_1);
-            sprintf(cl_fileNames[1],OPENCL_FILENAME_PACKED2_UT_2);
-            sprintf(cl_fileNames[2],OPENCL_FILENAME_PACKED2_UT_3);
+    build_time = e_time() - build_time;
+    printf("Kernels %s in %.3fs\n", from_cache ? "loaded from the binary cache" : "built from source", build_time);
+
+    //the long-term integrator doesn't depend on the kernel batch or the build defines, so it is a program of its own
+    cl_program integrator_program = NULL;
+    cl_kernel integrate_kernel = NULL;
+    if (integrate_frames > 1){
+        char *integrator_source;
+        size_t integrator_size;
+        if (load_source_file(OPENCL_FILENAME_INTEGRATOR, &integrator_source, &integrator_size))
+            return (-1);
+        integrator_program = cl_program_cache_build(context, deviceID[device_number], 1, (const char**)&integrator_source, &integrator_size,
+                                                    "", kernel_cache_dir, NULL);
+        free(integrator_source);
+        if (integrator_program == NULL)
+            return (-1);
+        integrate_kernel = clCreateKernel(integrator_program, "integrate_frames", &err);
+        if (err){
+            printf("Error in clCreateKernel: %i\n",err);
+            return -1;
         }
     }
 
-    printf("Using the following kernels: \n  \"%s\"\n  \"%s\"\n  \"%s\"\n", cl_fileNames[0],cl_fileNames[1],cl_fileNames[2]);
-
-    char cl_options[1024];
-    sprintf(cl_options,"-D NUM_ELEMENTS=%du -D NUM_FREQUENCIES=%du -D NUM_BLOCKS=%du -D NUM_TIMESAMPLES=%du -D NUM_TIME_ACCUM=%du -D BASE_ACCUM=%du -D SIZE_PER_SET=%du", num_elem, num_freq, num_blocks, time_steps, time_accum, BASE_TIMESAMPLES_ACCUM,num_blocks*32*32*2*num_freq);
-    printf("Dynamic define statements for GPU OpenCL kernels\n");
-    printf("-D NUM_ELEMENTS=%du \n-D NUM_FREQUENCIES=%du \n-D NUM_BLOCKS=%du \n-D NUM_TIMESAMPLES=%du\n-D NUM_TIME_ACCUM=%du\n-D BASE_ACCUM=%du\n-D SIZE_PER_SET=%du\n", num_elem, num_freq,num_blocks, time_steps, time_accum, BASE_TIMESAMPLES_ACCUM, num_blocks*32*32*2*num_freq);
-
-    size_t cl_programSize[NUM_CL_FILES];
-    FILE *fp;
-    char *cl_programBuffer[NUM_CL_FILES];
-
-
-    for (int i = 0; i < NUM_CL_FILES; i++){
-        fp = fopen(cl_fileNames[i], "r");
-        if (fp == NULL){
-            printf("error loading file: %s\n", cl_fileNames[i]);
+    //so is the upper triangle packer, which only needs the layout of corr's output
+    cl_program packer_program = NULL;
+    cl_kernel pack_kernel = NULL;
+    if (triangle_output != TRIANGLE_OUTPUT_BLOCKS){
+        char *packer_source;
+        size_t packer_size;
+        char packer_options[128];
+        if (load_source_file(OPENCL_FILENAME_PACKER, &packer_source, &packer_size))
             return (-1);
+        snprintf(packer_options, sizeof(packer_options), "-D NUM_ELEMENTS=%du -D NUM_BLOCKS=%du -D BLOCK_DIM=%du%s",
+                 num_elem, num_blocks, block_dim, (triangle_output == TRIANGLE_OUTPUT_FLOAT) ? " -D PACKED_FLOAT" : "");
+        packer_program = cl_program_cache_build(context, deviceID[device_number], 1, (const char**)&packer_source, &packer_size,
+                                                packer_options, kernel_cache_dir, NULL);
+        free(packer_source);
+        if (packer_program == NULL)
+            return (-1);
+        pack_kernel = clCreateKernel(packer_program, "pack_upper_triangle", &err);
+        if (err){
+            printf("Error in clCreateKernel: %i\n",err);
+            return -1;
         }
-        fseek(fp, 0, SEEK_END);
-        cl_programSize[i] = ftell(fp);
-        rewind(fp);
-        cl_programBuffer[i] = (char*)malloc(cl_programSize[i]+1);
-        cl_programBuffer[i][cl_programSize[i]] = '\0';
-        int sizeRead = fread(cl_programBuffer[i], sizeof(char), cl_programSize[i], fp);
-        if (sizeRead < cl_programSize[i])
-            printf("Error reading the file!!!");
-        fclose(fp);
     }
 
-    cl_program program = clCreateProgramWithSource( context, NUM_CL_FILES, (const char**)cl_programBuffer, cl_programSize, &err );
+    cl_kernel corr_kernel = clCreateKernel( program, "corr", &err );
     if (err){
-        printf("Error in clCreateProgramWithSource: %i\n",err);
-        return(-1);
+        printf("Error in clCreateKernel: %i\n",err);
+        return (-1);
     }
 
-    err = clBuildProgram( program, 1, &deviceID[device_number], cl_options, NULL, NULL );
-    if (err){
-        printf("Error in clBuildProgram: %i\n",err);
-        size_t log_size;
-        clGetProgramBuildInfo(program,deviceID[device_number], CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
-        char *program_log;
-        program_log = (char*)malloc(log_size+1);
-        program_log[log_size] = '\0';
-        clGetProgramBuildInfo(program,deviceID[device_number], CL_PROGRAM_BUILD_LOG, log_size+1,program_log,NULL);
-        printf("%s\n",program_log);
-        free(program_log);
-        return(-1);
+    cl_kernel diagonal_corr_kernel = NULL;
+    if (diagonal_launch){
+        diagonal_corr_kernel = clCreateKernel( diagonal_program, "corr", &err );
+        if (err){
+            printf("Error in clCreateKernel: %i\n",err);
+            return (-1);
+        }
     }
 
-    cl_kernel corr_kernel = clCreateKernel( program, "corr", &err );
+    cl_kernel offsetAccumulate_kernel = clCreateKernel( program, "offsetAccumulateElements", &err );
     if (err){
         printf("Error in clCreateKernel: %i\n",err);
-        return (-1);
+        return -1;
     }
 
-    cl_kernel offsetAccumulate_kernel = clCreateKernel( program, "offsetAccumulateElements", &err );
+    cl_kernel preseed_kernel = clCreateKernel( program, "preseed", &err );
     if (err){
         printf("Error in clCreateKernel: %i\n",err);
         return -1;
     }
 
-    cl_kernel preseed_kernel = clCreateKernel( program, "preseed", &err );
+    cl_kernel combineOffsets_kernel = clCreateKernel( program, "combineOffsetPartials", &err );
     if (err){
         printf("Error in clCreateKernel: %i\n",err);
         return -1;
@@ -376,19 +1229,25 @@ int main(int argc, char ** argv) {
     }
 
     // 5. set up arrays and initilize if required
-    unsigned char *host_PrimaryInput    [N_STAGES]; //where things are brought from, ultimately. Code runs fastest when we create the aligned memory and then pin it to the device
-    int *host_PrimaryOutput             [N_STAGES];
-    cl_mem device_CLinput_pinnedBuffer  [N_STAGES];
-    cl_mem device_CLoutput_pinnedBuffer [N_STAGES];
-    cl_mem device_CLinput_kernelData    [N_STAGES];
-    cl_mem device_CLoutput_kernelData   [N_STAGES];
+    unsigned char *host_PrimaryInput    [MAX_STAGES]; //where things are brought from, ultimately. Code runs fastest when we create the aligned memory and then pin it to the device
+    int *host_PrimaryOutput             [MAX_STAGES]; //each integration is read back into its stage's buffer
+    cl_mem device_CLinput_pinnedBuffer  [MAX_STAGES];
+    cl_mem device_CLoutput_pinnedBuffer [MAX_STAGES];
+    cl_mem device_CLinput_kernelData    [MAX_STAGES];
+    cl_mem device_CLoutput_kernelData   [MAX_STAGES];
     cl_mem device_block_lock;
-    cl_mem device_CLoutputAccum         [N_STAGES];
+    cl_mem device_CLoutputAccum         [MAX_STAGES];
+    cl_mem device_CLtriangle            [MAX_STAGES]; //-O: the packed upper triangle, which is what gets read back
 
 
     int len=num_freq*num_blocks*(size1_block*size1_block)*2.;//NUM_TIMESAMPLES/TIME_ACCUM;// *2 because of real and imag
+    //what is read back per integration: corr's blocks, or with -O the packed upper triangle (int32 or float32, 4 B either way)
+    int out_len = (triangle_output != TRIANGLE_OUTPUT_BLOCKS) ? num_freq*num_elem*(num_elem+1) : len;
     printf("Num_blocks %d ", num_blocks);
     printf("Output Length %d and size %ld B\n", len, len*sizeof(cl_int));
+    if (triangle_output != TRIANGLE_OUTPUT_BLOCKS)
+        printf("Packing the upper triangle on the device as %s: %.2f MB read back per integration instead of %.2f MB\n",
+               (triangle_output == TRIANGLE_OUTPUT_FLOAT) ? "float32" : "int32", out_len*sizeof(cl_int)/1e6, len*sizeof(cl_int)/1e6);
     cl_int *zeros=calloc(num_blocks*num_freq,sizeof(cl_int)); //for the output buffers
     //printf("zeros %d\n",zeros[num_blocks*num_freq-1]);
     device_block_lock = clCreateBuffer (context,
@@ -406,7 +1265,7 @@ int main(int argc, char ** argv) {
     }
 
     // Set up arrays so that they can be used later on
-    for (int i = 0; i < N_STAGES; i++){
+    for (int i = 0; i < num_stages; i++){
         //preallocate memory for pinned buffers
         err = posix_memalign ((void **)&host_PrimaryInput[i], PAGESIZE_MEM, time_steps*num_elem*num_freq);
         //check if an extra command is needed to pre pin this--this might just make sure it is
@@ -433,8 +1292,8 @@ int main(int argc, char ** argv) {
             return (err);
         }
 
-        err = posix_memalign ((void **)&host_PrimaryOutput[i], PAGESIZE_MEM, len*sizeof(cl_int));
-        err |= mlock(host_PrimaryOutput[i],len*sizeof(cl_int));
+        err = posix_memalign ((void **)&host_PrimaryOutput[i], PAGESIZE_MEM, out_len*sizeof(cl_int));
+        err |= mlock(host_PrimaryOutput[i],out_len*sizeof(cl_int));
         if (err){
             printf("error in creating memory buffers: Output, stage: %i. Exiting program.\n",i);
             return (err);
@@ -442,7 +1301,7 @@ int main(int argc, char ** argv) {
 
         device_CLoutput_pinnedBuffer[i] = clCreateBuffer (context,
                                     CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR,
-                                    len*sizeof(cl_int),
+                                    out_len*sizeof(cl_int),
                                     host_PrimaryOutput[i],
                                     &err); //create the output buffer and allow cl to allocate host memory
 
@@ -452,15 +1311,19 @@ int main(int argc, char ** argv) {
         }
 
 
-        device_CLinput_kernelData[i] = clCreateBuffer (context,
-                                    CL_MEM_READ_ONLY,
-                                    time_steps*num_elem*num_freq,
-                                    0,
-                                    &err); //cl memory that can only be read by kernel
+        //zero-copy kernels read the pinned buffers themselves, so there is no device copy of the input
+        device_CLinput_kernelData[i] = NULL;
+        if (transfer_mode != TRANSFER_ZERO_COPY){
+            device_CLinput_kernelData[i] = clCreateBuffer (context,
+                                        CL_MEM_READ_ONLY,
+                                        time_steps*num_elem*num_freq,
+                                        0,
+                                        &err); //cl memory that can only be read by kernel
 
-        if (err){
-            printf("error in allocating memory. Exiting program.\n");
-            return (err);
+            if (err){
+                printf("error in allocating memory. Exiting program.\n");
+                return (err);
+            }
         }
 
 
@@ -475,29 +1338,60 @@ int main(int argc, char ** argv) {
             return (err);
         }
 
+        device_CLtriangle[i] = NULL;
+        if (triangle_output != TRIANGLE_OUTPUT_BLOCKS){
+            device_CLtriangle[i] = clCreateBuffer (context,
+                                        CL_MEM_WRITE_ONLY,
+                                        out_len*sizeof(cl_int),
+                                        0,
+                                        &err); //written in full by the packer every frame, so no need to zero it
+            if (err){
+                printf("error in allocating memory. Exiting program.\n");
+                return (err);
+            }
+        }
+
     } //end for
     free(zeros);
 
-    //initialize an array for the accumulator of offsets (borrowed this buffer from an old version of code--check this)
-    zeros=calloc(num_freq*num_elem*2,sizeof(cl_uint));
-    device_CLoutputAccum[0] = clCreateBuffer(context,
-                                          CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
-                                          num_freq*num_elem*2*sizeof(cl_uint),
-                                          zeros,
-                                          &err);
-    if (err){
-            printf("error in allocating memory. Exiting program.\n");
-            return (err);
+    //the accumulator of offsets: a set of partial sums per slice of the timesteps, added into the first when there is
+    //more than one. offsetAccumulateElements writes every sum, so nothing needs zeroing
+    int accum_partials = device_profile_accum_partials(&profile, accum_local_size, accum_partials_requested, num_elem, num_freq, time_steps, base_accum);
+    for (int i = 0; i < num_stages; i++){
+        device_CLoutputAccum[i] = clCreateBuffer(context,
+                                              CL_MEM_READ_WRITE,
+                                              (size_t)accum_partials*num_freq*num_elem*2*sizeof(cl_uint),
+                                              NULL,
+                                              &err);
+        if (err){
+                printf("error in allocating memory. Exiting program.\n");
+                return (err);
+        }
     }
-
-    device_CLoutputAccum[1] = clCreateBuffer(context,
-                                          CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
-                                          num_freq*num_elem*2*sizeof(cl_uint),
-                                          zeros,
-                                          &err);
-    if (err){
-            printf("error in allocating memory. Exiting program.\n");
-            return (err);
+    printf("Offset sums in %d partial%s of %d timesteps or so\n", accum_partials, (accum_partials > 1) ? "s" : "", (time_steps/base_accum)/accum_partials*base_accum);
+
+    //-N: two sets of 64 bit sums, so one dump can be read back while the next one is summed
+    cl_mem device_CLdump[2] = {NULL, NULL};
+    int64_t *host_dump[2] = {NULL, NULL};
+    if (integrate_frames > 1){
+        for (int i = 0; i < 2; i++){
+            device_CLdump[i] = clCreateBuffer(context,
+                                              CL_MEM_READ_WRITE,
+                                              len*sizeof(cl_long),
+                                              NULL,
+                                              &err); //written in full by each dump's first frame, so no need to zero it
+            if (err){
+                printf("error in allocating memory. Exiting program.\n");
+                return (err);
+            }
+            err = posix_memalign ((void **)&host_dump[i], PAGESIZE_MEM, len*sizeof(cl_long));
+            err |= mlock(host_dump[i], len*sizeof(cl_long));
+            if (err){
+                printf("error in creating memory buffers: dump %d. Exiting program.\n", i);
+                return (err);
+            }
+        }
+        printf("Integrating %d frames on the device per read back\n", integrate_frames);
     }
 
     //arrays have been allocated
@@ -505,7 +1399,7 @@ int main(int argc, char ** argv) {
     //--------------------------------------------------------------
     //Generate Data Set!
 
-    generate_char_data_set(gen_type,
+    generate_char_data_set_threaded(gen_type,
                            random_seed, //random seed
                            default_real,//default_real,
                            default_imaginary,//default_imaginary,
@@ -516,9 +1410,46 @@ int main(int argc, char ** argv) {
                            num_freq,//int num_frequencies,
                            num_elem,//int num_elements,
                            no_repeat_random,
+                           cpu_threads,//int num_threads (straight into the pinned buffer)
                            host_PrimaryInput[0]);
 
-    memcpy(host_PrimaryInput[1], host_PrimaryInput[0], time_steps*num_elem*num_freq);
+    for (int i = 1; i < num_stages; i++)
+        memcpy(host_PrimaryInput[i], host_PrimaryInput[0], time_steps*num_elem*num_freq);
+
+    //streaming: a producer thread fills a ring of pinned buffers of its own, and the loop uploads from those instead
+    input_stream stream;
+    cl_mem *device_CLinput_streamBuffer = NULL;
+    if (stream_buffers > 0){
+        err = input_stream_init(&stream, stream_buffers, time_steps, num_freq, num_elem, iterations, stream_realtime);
+        if (err){
+            printf("error in creating the input stream. Exiting program.\n");
+            return (-1);
+        }
+        if (stream_file != NULL){
+            err = input_stream_use_file(&stream, stream_file);
+            if (err)
+                return (-1);
+        }
+        else
+            input_stream_use_generator(&stream, gen_type, random_seed, default_real, default_imaginary, initial_real, initial_imaginary, generate_frequency, no_repeat_random, cpu_threads);
+
+        device_CLinput_streamBuffer = (cl_mem *)malloc(stream_buffers*sizeof(cl_mem));
+        if (device_CLinput_streamBuffer == NULL){
+            printf("failed to allocate memory\n");
+            return (-1);
+        }
+        for (int b = 0; b < stream_buffers; b++){
+            device_CLinput_streamBuffer[b] = clCreateBuffer (context,
+                                        CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
+                                        time_steps*num_elem*num_freq,
+                                        stream.buffers[b],
+                                        &err); //pin the ring buffer, like host_PrimaryInput
+            if (err){
+                printf("error in mapping pin pointers. Exiting program.\n");
+                return (err);
+            }
+        }
+    }
 
     //--------------------------------------------------------------
 
@@ -529,7 +1460,7 @@ int main(int argc, char ** argv) {
     unsigned int global_id_x_map[num_blocks];
     unsigned int global_id_y_map[num_blocks];
 
-    int largest_num_blocks_1D = num_elem/size1_block;
+    int largest_num_blocks_1D = (num_elem + size1_block - 1)/size1_block; //the last may be an edge tile
     int index_1D = 0;
     for (int j = 0; j < largest_num_blocks_1D; j++){
         for (int i = j; i < largest_num_blocks_1D; i++){
@@ -556,20 +1487,40 @@ int main(int argc, char ** argv) {
     clSetKernelArg(corr_kernel, 3, sizeof(void *), (void*) &id_y_map);
     clSetKernelArg(corr_kernel, 4, sizeof(void *), (void*) &device_block_lock);
 
+    if (diagonal_corr_kernel != NULL){
+        clSetKernelArg(diagonal_corr_kernel, 2, sizeof(void *), (void*) &id_x_map);
+        clSetKernelArg(diagonal_corr_kernel, 3, sizeof(void *), (void*) &id_y_map);
+        clSetKernelArg(diagonal_corr_kernel, 4, sizeof(void *), (void*) &device_block_lock);
+    }
+
     clSetKernelArg(preseed_kernel, 2, sizeof(void *), (void*) &id_x_map);
     clSetKernelArg(preseed_kernel, 3, sizeof(void *), (void*) &id_y_map);
-    clSetKernelArg(preseed_kernel, 4, 64* sizeof(cl_uint), NULL);
-    clSetKernelArg(preseed_kernel, 5, 64* sizeof(cl_uint), NULL);
+    clSetKernelArg(preseed_kernel, 4, 2*size1_block* sizeof(cl_uint), NULL);
+    clSetKernelArg(preseed_kernel, 5, 2*size1_block* sizeof(cl_uint), NULL);
+
+    if (pack_kernel != NULL){
+        clSetKernelArg(pack_kernel, 1, sizeof(void *), (void*) &id_x_map);
+        clSetKernelArg(pack_kernel, 2, sizeof(void *), (void*) &id_y_map);
+    }
 
     unsigned int n_cAccum=time_steps/time_accum; //n_cAccum == number_of_compressedAccum
-    size_t gws_corr[3]={8,8*num_freq,num_blocks*n_cAccum}; //global work size array
-    size_t lws_corr[3]={8,8,1}; //local work size array
+    size_t gws_corr[3]={size1_block/4,size1_block/4*num_freq,num_blocks*n_cAccum}; //global work size array: a work item does 4 x 4 of a block
+    size_t lws_corr[3]={size1_block/4,size1_block/4,1}; //local work size array
+    size_t gws_diagonal_corr[3]={size1_block/4,size1_block/4*num_freq,largest_num_blocks_1D*n_cAccum}; //-J: one block of each row
+
+    size_t gws_accum[3]={64, (int)ceil(num_elem*num_freq/256.0),accum_partials};
+    size_t lws_accum[3]={accum_local_size, 1, 1};
 
-    size_t gws_accum[3]={64, (int)ceil(num_elem*num_freq/256.0),time_steps/BASE_TIMESAMPLES_ACCUM};
-    size_t lws_accum[3]={64, 1, 1};
+    size_t gws_combine[1]={(num_freq*num_elem*2 + 63)/64*64};
+    size_t lws_combine[1]={accum_local_size};
+    cl_uint num_accum_partials = accum_partials;
+    clSetKernelArg(combineOffsets_kernel, 1, sizeof(cl_uint), (void*) &num_accum_partials);
 
-    size_t gws_preseed[3]={8, 8*num_freq, num_blocks};
-    size_t lws_preseed[3]={8, 8, 1};
+    size_t gws_preseed[3]={size1_block/4, size1_block/4*num_freq, num_blocks};
+    size_t lws_preseed[3]={size1_block/4, size1_block/4, 1};
+
+    size_t gws_pack[3]={size1_block*size1_block, num_blocks, num_freq}; //a work item moves one complex value of a block
+    size_t lws_pack[3]={64, 1, 1}; //16 x 16 is the smallest block
 
     //setup and start loop to process data in parallel
     int spinCount = 0; //we rotate through values to launch processes in order for the command queues. This helps keep track of what position, and can run indefinitely without overflow
@@ -580,14 +1531,83 @@ int main(int argc, char ** argv) {
     cl_int numWaitEventWrite = 0;
     cl_event* eventWaitPtr = NULL;
 
-    cl_event lastWriteEvent[N_STAGES]  = { 0 }; // All entries initialized to 0, since unspecified entries are set to 0
-    cl_event lastKernelEvent[N_STAGES] = { 0 };
+    cl_event lastWriteEvent[MAX_STAGES]  = { 0 }; // All entries initialized to 0, since unspecified entries are set to 0
+    cl_event lastKernelEvent[MAX_STAGES] = { 0 };
     cl_event copyInputDataEvent;
     cl_event offsetAccumulateEvent;
+    cl_event combineOffsetsEvent;
     cl_event preseedEvent;
+    cl_event readBackEvent;
+    cl_event packEvent;
+
+    int stream_index = -1;
+    int stage_stream_index[MAX_STAGES]; //stream buffer a zero-copy stage's kernels read, given back once they are done
+    cl_mem kernel_input[MAX_STAGES]; //what the kernels read: the device copy, or with zero-copy the pinned buffer itself
+    cl_event mapEvent;
+    const cl_int zero_pattern = 0;
+
+    cl_event integrateEvent;
+    cl_event lastIntegrateEvent = 0;
+    int frames_in_dump = 0;
+    int64_t num_dumps = 0;
+    size_t gws_integrate[1] = {len};
+    size_t lws_integrate[1] = {64}; //len is a multiple of 16 x 16 x 2, the smallest block
+    int64_t write_frame[MAX_STAGES]; //frame last uploaded to each stage
+    double upload_time[MAX_STAGES];
+
+    integration_results results;
+    memset(&results, 0, sizeof(results));
+    pthread_mutex_init(&results.lock, NULL);
+    results.compare_to_first = (stream_buffers == 0);
+    results.kept_output = (int *)malloc(out_len*sizeof(int));
+    if (results.kept_output == NULL){
+        printf("failed to allocate memory\n");
+        return (-1);
+    }
+    readback_stage readback[MAX_STAGES];
+    for (int i = 0; i < num_stages; i++){
+        readback[i].consumer = keep_integration;
+        readback[i].consumer_context = &results;
+        readback[i].output = host_PrimaryOutput[i];
+        readback[i].len = out_len;
+        readback[i].consumed = 0;
+        write_frame[i] = -1;
+        kernel_input[i] = device_CLinput_kernelData[i];
+        stage_stream_index[i] = -1;
+    }
+    dump_stage dump[2];
+    for (int i = 0; i < 2; i++){
+        dump[i].consumer = keep_dump;
+        dump[i].consumer_context = &results;
+        dump[i].output = host_dump[i];
+        dump[i].len = len;
+        dump[i].consumed = 0;
+    }
+
+    event_profiler profiler;
+    if (profile_file != NULL){
+        if (event_profiler_init(&profiler, ((int64_t)iterations+1) * EVENT_PROFILE_NUM_STAGES))
+            return (-1);
+        //bytes moved to or from global memory, ignoring reuse through caches and local memory; ops count each
+        //multiply and add (a complex multiply-accumulate is 4), the same way as the efficiency estimates below
+        double input_bytes = (double)time_steps * num_freq * num_elem;
+        double accum_bytes = (double)num_freq * num_elem * 2 * sizeof(cl_int);
+        double output_bytes = (double)len * sizeof(cl_int);
+        event_profiler_set_stage(&profiler, EVENT_PROFILE_WRITE_INPUT, input_bytes, 0);
+        event_profiler_set_stage(&profiler, EVENT_PROFILE_WRITE_ACCUM, output_bytes, 0); //only -u zeroes its output
+        event_profiler_set_stage(&profiler, EVENT_PROFILE_OFFSET_ACCUMULATE, input_bytes + accum_partials * accum_bytes, 2. * input_bytes);
+        event_profiler_set_stage(&profiler, EVENT_PROFILE_COMBINE_OFFSETS, (accum_partials + 1) * accum_bytes, (accum_partials - 1) * accum_bytes / sizeof(cl_uint));
+        event_profiler_set_stage(&profiler, EVENT_PROFILE_PRESEED, accum_bytes + output_bytes, len);
+        //-J splits each frame's corr into two launches, each tracked as half of the frame
+        event_profiler_set_stage(&profiler, EVENT_PROFILE_CORR, (input_bytes + output_bytes) / (diagonal_launch + 1.),
+                                 (double)num_blocks * size1_block * size1_block * 2. * 2. * num_freq * time_steps / (diagonal_launch + 1.));
+        event_profiler_set_stage(&profiler, EVENT_PROFILE_INTEGRATE, output_bytes + 2. * len * sizeof(cl_long), len);
+        event_profiler_set_stage(&profiler, EVENT_PROFILE_PACK, output_bytes / 2. + out_len * sizeof(cl_int), 0); //reads about half the blocks
+        event_profiler_set_stage(&profiler, EVENT_PROFILE_READ_BACK, (integrate_frames > 1) ? len * sizeof(cl_long) : out_len * sizeof(cl_int), 0);
+    }
 
     if (timer_without_loop_copying){
-        for (int i = 0; i < N_STAGES; i++){
+        for (int i = 0; i < num_stages; i++){
              err = clEnqueueWriteBuffer(queue[0],
                                     device_CLinput_kernelData[i], //to here
                                     CL_TRUE,
@@ -607,18 +1627,36 @@ int main(int argc, char ** argv) {
     }
 
     printf("Running %i iterations of full corr (%i time samples (%i Ki time samples), %i elements, %i frequencies)\n", iterations, time_steps, time_steps/1024, num_elem, num_freq);
+    const char *transfer_mode_names[3] = {"write from the host pointer", "copy-engine staging through pinned buffers", "zero-copy from pinned buffers"};
+    printf("Input transfer: %s\n", transfer_mode_names[transfer_mode]);
 
     //note that releasing events (while preventing memory leaks) can cause havoc on the CodeXL profiler--it needs the events for its analysis--if things act weird in CodeXL, this is a place to look
     ///////////////////////////////////////////////////////////////////////////////
+    if (stream_buffers > 0){
+        err = input_stream_start(&stream);
+        if (err)
+            return (-1);
+    }
     cputime = e_time();
-    for (int i=0; i<=iterations; i++){//if we were truly streaming data, for each correlation, we would need to change what arrays are used for input/output
-        writeToDevStageIndex =  (spinCount ); // + 0) % N_STAGES;
-        kernelStageIndex =      (spinCount + 1 ) % N_STAGES; //had been + 2 when it was 3 stages
+    for (int i=0; i<=iterations; i++){//frame i is uploaded while frame i-1 goes through the kernels and is then read back
+        writeToDevStageIndex =  (spinCount ); // + 0) % num_stages;
+        kernelStageIndex =      (spinCount + num_stages - 1) % num_stages; //the stage written last time around
+
+        if (stream_buffers > 0 && i < iterations){
+            stream_index = input_stream_acquire(&stream, &write_frame[writeToDevStageIndex]);
+            if (stream_index < 0){ //the source failed: finish off what has been uploaded
+                printf("Input stream ended after %d frames\n", i);
+                iterations = i;
+            }
+        }
 
         //transfer section
         if (i < iterations){ //Start at 0, Stop before the last loop
+            if (stream_buffers == 0)
+                write_frame[writeToDevStageIndex] = i;
+            upload_time[writeToDevStageIndex] = e_time();
             //check if it needs to wait on anything
-            if(lastKernelEvent[writeToDevStageIndex] != 0){ //only equals 0 when it hasn't yet been defined i.e. the first run through the loop with N_STAGES == 2
+            if(lastKernelEvent[writeToDevStageIndex] != 0){ //only equals 0 when it hasn't yet been defined i.e. the first num_stages runs through the loop
                 numWaitEventWrite = 1;
                 eventWaitPtr = &lastKernelEvent[writeToDevStageIndex]; //writes must wait on the last kernel operation since
             }
@@ -629,126 +1667,222 @@ int main(int argc, char ** argv) {
 
             //copy necessary buffers to device memory
             if (timer_without_loop_copying){
-                err = clEnqueueWriteBuffer(queue[0],
-                                        device_CLoutputAccum[writeToDevStageIndex],
-                                        CL_FALSE,
-                                        0,
-                                        num_freq*num_elem*2*sizeof(cl_int),
-                                        zeros,
-                                        numWaitEventWrite,
-                                        eventWaitPtr,
-                                        &lastWriteEvent[writeToDevStageIndex]);
+                //the input is already there and nothing needs zeroing: only the ordering is left to keep
+                err = clEnqueueMarkerWithWaitList(queue[0], numWaitEventWrite, eventWaitPtr, &lastWriteEvent[writeToDevStageIndex]);
                 if (err){
                     printf("Error in transfer to device memory. Error in loop %d\n",i);
                     exit(err);
                 }
                 if (eventWaitPtr != NULL)
                     clReleaseEvent(*eventWaitPtr);
-                //err = clFlush(queue[0]);
-                if (err){
-                    printf("Error in flushing transfer to device memory. Error in loop %d\n",i);
-                    exit(err);
-                }
-
             }
             else{
-                err = clEnqueueWriteBuffer(queue[0],
-                                        device_CLinput_kernelData[writeToDevStageIndex], //to here
-                                        CL_FALSE,
-                                        0, //offset
-                                        time_steps * num_elem*num_freq, //8 for multifreq interleaving
-                                        host_PrimaryInput[writeToDevStageIndex], //from here
-                                        numWaitEventWrite,
-                                        eventWaitPtr,
-                                        &copyInputDataEvent);
+                //the pinned buffer holding this frame: the stage's own, or the stream's ring buffer
+                cl_mem pinned_input = (stream_buffers > 0) ? device_CLinput_streamBuffer[stream_index] : device_CLinput_pinnedBuffer[writeToDevStageIndex];
+                if (transfer_mode == TRANSFER_PINNED_STAGING || transfer_mode == TRANSFER_ZERO_COPY){
+                    //the host (or the stream's producer) wrote the frame into the memory behind the pinned buffer while it
+                    //wasn't mapped, so the runtime may still hold an older copy of it. Mapping for CL_MAP_WRITE_INVALIDATE_REGION
+                    //and unmapping hands the new frame over: the old copy is dropped rather than copied back over the frame,
+                    //and the unmap makes the host memory current again (nothing moves on devices that share host memory)
+                    void *mapped_input = clEnqueueMapBuffer(queue[0],
+                                                            pinned_input,
+                                                            CL_FALSE,
+                                                            CL_MAP_WRITE_INVALIDATE_REGION,
+                                                            0,
+                                                            time_steps * num_elem*num_freq,
+                                                            numWaitEventWrite,
+                                                            eventWaitPtr,
+                                                            &mapEvent,
+                                                            &err);
+                    if (!err){
+                        err = clEnqueueUnmapMemObject(queue[0], pinned_input, mapped_input, 1, &mapEvent, &copyInputDataEvent);
+                        clReleaseEvent(mapEvent);
+                    }
+                    if (transfer_mode == TRANSFER_PINNED_STAGING){
+                        if (err){
+                            printf("Error handing the frame over to the device. Error in loop %d, error: %s\n",i,oclGetOpenCLErrorCodeStr(err));
+                            exit(err);
+                        }
+                        //then the copy engine reads the page-locked memory directly, rather than the driver staging it first
+                        cl_event handoverEvent = copyInputDataEvent;
+                        err = clEnqueueCopyBuffer(queue[0],
+                                                  pinned_input, //from here
+                                                  device_CLinput_kernelData[writeToDevStageIndex], //to here
+                                                  0,
+                                                  0,
+                                                  time_steps * num_elem*num_freq,
+                                                  1,
+                                                  &handoverEvent,
+                                                  &copyInputDataEvent);
+                        clReleaseEvent(handoverEvent);
+                    }
+                    else{
+                        //zero-copy: the kernels then read the pinned buffer itself
+                        kernel_input[writeToDevStageIndex] = pinned_input;
+                        stage_stream_index[writeToDevStageIndex] = stream_index;
+                    }
+                }
+                else{
+                    err = clEnqueueWriteBuffer(queue[0],
+                                            device_CLinput_kernelData[writeToDevStageIndex], //to here
+                                            CL_FALSE,
+                                            0, //offset
+                                            time_steps * num_elem*num_freq, //8 for multifreq interleaving
+                                            (stream_buffers > 0) ? stream.buffers[stream_index] : host_PrimaryInput[writeToDevStageIndex], //from here
+                                            numWaitEventWrite,
+                                            eventWaitPtr,
+                                            &copyInputDataEvent);
+                }
                 if (err){
                     printf("Error in transfer to device memory. Error in loop %d, error: %s\n",i,oclGetOpenCLErrorCodeStr(err));
                     exit(err);
                 }
+                if (profile_file != NULL)
+                    event_profiler_track(&profiler, copyInputDataEvent, EVENT_PROFILE_WRITE_INPUT, i);
+                //a zero-copy stream buffer is in use until the kernels are done with it, so it goes back after corr instead
+                if (stream_buffers > 0 && transfer_mode != TRANSFER_ZERO_COPY){
+                    err = clSetEventCallback(copyInputDataEvent, CL_COMPLETE, release_stream_buffer, &stream.buffer_refs[stream_index]);
+                    if (err){
+                        printf("Error setting the stream buffer callback in loop %d, error: %s\n",i,oclGetOpenCLErrorCodeStr(err));
+                        exit(err);
+                    }
+                }
                 if (eventWaitPtr != NULL)
                     clReleaseEvent(*eventWaitPtr);
 
-                err = clEnqueueWriteBuffer(queue[0],
-                                        device_CLoutputAccum[writeToDevStageIndex],
-                                        CL_FALSE,
-                                        0,
-                                        num_freq*num_elem*2*sizeof(cl_int),
-                                        zeros,
-                                        1,
-                                        &copyInputDataEvent,
-                                        &lastWriteEvent[writeToDevStageIndex]);
-
-                clReleaseEvent(copyInputDataEvent);
-                //err = clFlush(queue[0]);
-                if (err){
-                    printf("Error in flushing transfer to device memory. Error in loop %d\n",i);
-                    exit(err);
-                }
+                lastWriteEvent[writeToDevStageIndex] = copyInputDataEvent; //the kernels only need the input
             }
         }
 
         //processing section
         if (lastWriteEvent[kernelStageIndex] !=0 && i <= iterations){//insert additional steps for processing here
-            //accumulateFeeds_kernel--set 2 arguments--input array and zeroed output array
-            err = clSetKernelArg(offsetAccumulate_kernel,
-                                 0,
-                                 sizeof(void*),
-                                 (void*) &device_CLinput_kernelData[kernelStageIndex]);
-
-            err |= clSetKernelArg(offsetAccumulate_kernel,
-                                  1,
-                                  sizeof(void *),
-                                  (void *) &device_CLoutputAccum[kernelStageIndex]); //make sure this array is zeroed initially!
-            if (err){
-                printf("Error setting the kernel 0 arguments in loop %d\n", i);
-                exit(err);
+            if (fused_kernel){
+                //the fused corr adds its share of the preseed correction to the output, which only needs zeroing, once the
+                //consumer is done with the stage's previous integration
+                cl_event fillWait[2] = {lastWriteEvent[kernelStageIndex], readback[kernelStageIndex].consumed};
+                err = clEnqueueFillBuffer(queue[1],
+                                          device_CLoutput_kernelData[kernelStageIndex],
+                                          &zero_pattern,
+                                          sizeof(cl_int),
+                                          0,
+                                          len*sizeof(cl_int),
+                                          (readback[kernelStageIndex].consumed != 0) ? 2 : 1,
+                                          fillWait,
+                                          &preseedEvent);
+                if (err){
+                    printf("Error zeroing the output in loop %d: error %d\n", i,err);
+                    exit(err);
+                }
+                if (readback[kernelStageIndex].consumed != 0){
+                    clReleaseEvent(readback[kernelStageIndex].consumed);
+                    readback[kernelStageIndex].consumed = 0;
+                }
+                if (profile_file != NULL)
+                    event_profiler_track(&profiler, preseedEvent, EVENT_PROFILE_WRITE_ACCUM, i - 1);
+                clReleaseEvent(lastWriteEvent[kernelStageIndex]);
             }
+            else {
+                //accumulateFeeds_kernel--set 2 arguments--input array and zeroed output array
+                err = clSetKernelArg(offsetAccumulate_kernel,
+                                     0,
+                                     sizeof(void*),
+                                     (void*) &kernel_input[kernelStageIndex]);
+
+                err |= clSetKernelArg(offsetAccumulate_kernel,
+                                      1,
+                                      sizeof(void *),
+                                      (void *) &device_CLoutputAccum[kernelStageIndex]); //written in full, so no need to zero it
+                if (err){
+                    printf("Error setting the kernel 0 arguments in loop %d\n", i);
+                    exit(err);
+                }
 
 
-            err = clEnqueueNDRangeKernel(queue[1],
-                                         offsetAccumulate_kernel,
-                                         3,
-                                         NULL,
-                                         gws_accum,
-                                         lws_accum,
-                                         1,
-                                         &lastWriteEvent[kernelStageIndex], /* make sure data is present, first*/
-                                         &offsetAccumulateEvent);
-            if (err){
-                printf("Error accumulating in loop %d\n", i);
-                exit(err);
-            }
-            clReleaseEvent(lastWriteEvent[kernelStageIndex]);
-            //preseed_kernel--set only 2 of the 6 arguments (the other 4 stay the same)
-            err = clSetKernelArg(preseed_kernel,
-                                 0,
-                                 sizeof(void *),
-                                 (void *) &device_CLoutputAccum[kernelStageIndex]);//assign the accumulated data as input
-
-            err = clSetKernelArg(preseed_kernel,
-                                 1,
-                                 sizeof(void *),
-                                 (void *) &device_CLoutput_kernelData[kernelStageIndex]); //set the output for preseeding the correlator array
+                err = clEnqueueNDRangeKernel(queue[1],
+                                             offsetAccumulate_kernel,
+                                             3,
+                                             NULL,
+                                             gws_accum,
+                                             lws_accum,
+                                             1,
+                                             &lastWriteEvent[kernelStageIndex], /* make sure data is present, first*/
+                                             &offsetAccumulateEvent);
+                if (err){
+                    printf("Error accumulating in loop %d\n", i);
+                    exit(err);
+                }
+                if (profile_file != NULL)
+                    event_profiler_track(&profiler, offsetAccumulateEvent, EVENT_PROFILE_OFFSET_ACCUMULATE, i - 1);
+                clReleaseEvent(lastWriteEvent[kernelStageIndex]);
+
+                if (accum_partials > 1){
+                    //add the partial sums into the first, which is what preseed reads
+                    err = clSetKernelArg(combineOffsets_kernel,
+                                         0,
+                                         sizeof(void *),
+                                         (void *) &device_CLoutputAccum[kernelStageIndex]);
+                    if (err){
+                        printf("Error setting the combine arguments in loop %d\n", i);
+                        exit(err);
+                    }
+                    err = clEnqueueNDRangeKernel(queue[1],
+                                                 combineOffsets_kernel,
+                                                 1,
+                                                 NULL,
+                                                 gws_combine,
+                                                 lws_combine,
+                                                 1,
+                                                 &offsetAccumulateEvent,
+                                                 &combineOffsetsEvent);
+                    if (err){
+                        printf("Error combining the offset sums in loop %d\n", i);
+                        exit(err);
+                    }
+                    if (profile_file != NULL)
+                        event_profiler_track(&profiler, combineOffsetsEvent, EVENT_PROFILE_COMBINE_OFFSETS, i - 1);
+                    clReleaseEvent(offsetAccumulateEvent);
+                    offsetAccumulateEvent = combineOffsetsEvent;
+                }
 
-            err = clEnqueueNDRangeKernel(queue[1],
-                                         preseed_kernel,
-                                         3, //3d global dimension, also worksize
-                                         NULL, //no offsets
-                                         gws_preseed,
-                                         lws_preseed,
-                                         1,
-                                         &offsetAccumulateEvent,/*dependent on previous step so don't use &lastWriteEvent[kernelStageIndex],*/
-                                         &preseedEvent);
-            if (err){
-                printf("Error performing preseed kernel operation in loop %d: error %d\n", i,err);
-                exit(err);
+                //preseed overwrites the stage's output, so the consumer has to be done with the stage's previous integration
+                cl_event preseedWait[2] = {offsetAccumulateEvent, readback[kernelStageIndex].consumed};
+                //preseed_kernel--set only 2 of the 6 arguments (the other 4 stay the same)
+                err = clSetKernelArg(preseed_kernel,
+                                     0,
+                                     sizeof(void *),
+                                     (void *) &device_CLoutputAccum[kernelStageIndex]);//assign the accumulated data as input
+
+                err = clSetKernelArg(preseed_kernel,
+                                     1,
+                                     sizeof(void *),
+                                     (void *) &device_CLoutput_kernelData[kernelStageIndex]); //set the output for preseeding the correlator array
+
+                err = clEnqueueNDRangeKernel(queue[1],
+                                             preseed_kernel,
+                                             3, //3d global dimension, also worksize
+                                             NULL, //no offsets
+                                             gws_preseed,
+                                             lws_preseed,
+                                             (readback[kernelStageIndex].consumed != 0) ? 2 : 1,
+                                             preseedWait,/*dependent on previous step so don't use &lastWriteEvent[kernelStageIndex],*/
+                                             &preseedEvent);
+                if (err){
+                    printf("Error performing preseed kernel operation in loop %d: error %d\n", i,err);
+                    exit(err);
+                }
+                if (readback[kernelStageIndex].consumed != 0){
+                    clReleaseEvent(readback[kernelStageIndex].consumed);
+                    readback[kernelStageIndex].consumed = 0;
+                }
+                if (profile_file != NULL)
+                    event_profiler_track(&profiler, preseedEvent, EVENT_PROFILE_PRESEED, i - 1);
+                clReleaseEvent(offsetAccumulateEvent);
             }
-            clReleaseEvent(offsetAccumulateEvent);
             //corr_kernel--set the input and output buffers (the other parameters stay the same).
             err =  clSetKernelArg(corr_kernel,
                                     0,
                                     sizeof(void *),
-                                    (void*) &device_CLinput_kernelData[kernelStageIndex]);
+                                    (void*) &kernel_input[kernelStageIndex]);
             if (err){
                 printf("Error setting the kernel 0 arguments in loop %d\n", i);
                 exit(err);
@@ -775,51 +1909,268 @@ int main(int argc, char ** argv) {
                 printf("Error performing corr kernel operation in loop %d, err: %d\n", i,err);
                 exit(err);
             }
+            if (profile_file != NULL)
+                event_profiler_track(&profiler, lastKernelEvent[kernelStageIndex], EVENT_PROFILE_CORR, i - 1);
+            if (diagonal_corr_kernel != NULL){
+                //the diagonal blocks, alongside the rest; the frame's corr is done when both launches are
+                cl_event corrEvents[2] = {lastKernelEvent[kernelStageIndex], NULL};
+                clSetKernelArg(diagonal_corr_kernel, 0, sizeof(void *), (void*) &kernel_input[kernelStageIndex]);
+                clSetKernelArg(diagonal_corr_kernel, 1, sizeof(void *), (void*) &device_CLoutput_kernelData[kernelStageIndex]);
+                err = clEnqueueNDRangeKernel(queue[1],
+                                             diagonal_corr_kernel,
+                                             3,
+                                             NULL,
+                                             gws_diagonal_corr,
+                                             lws_corr,
+                                             1,
+                                             &preseedEvent,
+                                             &corrEvents[1]);
+                if (err){
+                    printf("Error performing the diagonal corr kernel operation in loop %d, err: %d\n", i,err);
+                    exit(err);
+                }
+                if (profile_file != NULL)
+                    event_profiler_track(&profiler, corrEvents[1], EVENT_PROFILE_CORR, i - 1);
+                err = clEnqueueMarkerWithWaitList(queue[1], 2, corrEvents, &lastKernelEvent[kernelStageIndex]);
+                if (err){
+                    printf("Error joining the corr launches in loop %d, err: %d\n", i,err);
+                    exit(err);
+                }
+                clReleaseEvent(corrEvents[0]);
+                clReleaseEvent(corrEvents[1]);
+            }
             clReleaseEvent(preseedEvent);
+            if (stream_buffers > 0 && transfer_mode == TRANSFER_ZERO_COPY){
+                err = clSetEventCallback(lastKernelEvent[kernelStageIndex], CL_COMPLETE, release_stream_buffer, &stream.buffer_refs[stage_stream_index[kernelStageIndex]]);
+                if (err){
+                    printf("Error setting the stream buffer callback in loop %d, error: %s\n",i,oclGetOpenCLErrorCodeStr(err));
+                    exit(err);
+                }
+            }
+
+            if (integrate_frames > 1){
+                //fold the frame into the current dump on the device rather than reading it back. The first frame of a dump
+                //overwrites the sums, after the dump that last used the buffer has been read back and consumed
+                int dump_buffer = num_dumps % 2;
+                cl_int first = (frames_in_dump == 0);
+                if (first)
+                    dump[dump_buffer].first_frame = write_frame[kernelStageIndex];
+                err  = clSetKernelArg(integrate_kernel, 0, sizeof(void *), (void *) &device_CLoutput_kernelData[kernelStageIndex]);
+                err |= clSetKernelArg(integrate_kernel, 1, sizeof(void *), (void *) &device_CLdump[dump_buffer]);
+                err |= clSetKernelArg(integrate_kernel, 2, sizeof(cl_int), (void *) &first);
+                if (err){
+                    printf("Error setting the integrate arguments in loop %d\n", i);
+                    exit(err);
+                }
+                //frames of different stages are summed one after another into the same buffer
+                cl_event integrateWait[3] = {lastKernelEvent[kernelStageIndex]};
+                cl_uint num_integrate_wait = 1;
+                if (lastIntegrateEvent != 0)
+                    integrateWait[num_integrate_wait++] = lastIntegrateEvent;
+                if (first && dump[dump_buffer].consumed != 0)
+                    integrateWait[num_integrate_wait++] = dump[dump_buffer].consumed;
+                err = clEnqueueNDRangeKernel(queue[1],
+                                             integrate_kernel,
+                                             1,
+                                             NULL,
+                                             gws_integrate,
+                                             lws_integrate,
+                                             num_integrate_wait,
+                                             integrateWait,
+                                             &integrateEvent);
+                if (err){
+                    printf("Error performing integrate kernel operation in loop %d, err: %d\n", i,err);
+                    exit(err);
+                }
+                if (first && dump[dump_buffer].consumed != 0){
+                    clReleaseEvent(dump[dump_buffer].consumed);
+                    dump[dump_buffer].consumed = 0;
+                }
+                if (profile_file != NULL)
+                    event_profiler_track(&profiler, integrateEvent, EVENT_PROFILE_INTEGRATE, i - 1);
+                if (lastIntegrateEvent != 0)
+                    clReleaseEvent(lastIntegrateEvent);
+                lastIntegrateEvent = integrateEvent;
+                //the stage's next upload (and so its next preseed) has to wait until the sum has read the stage's output
+                clReleaseEvent(lastKernelEvent[kernelStageIndex]);
+                lastKernelEvent[kernelStageIndex] = integrateEvent;
+                clRetainEvent(integrateEvent);
+
+                frames_in_dump++;
+                if (frames_in_dump == integrate_frames || i == iterations){
+                    dump_stage *dump_read = (dump_stage *)malloc(sizeof(dump_stage));
+                    if (dump_read == NULL){
+                        printf("Error allocating memory for the read back in loop %d\n", i);
+                        exit(-1);
+                    }
+                    *dump_read = dump[dump_buffer];
+                    dump_read->dump = num_dumps;
+                    dump_read->num_frames = frames_in_dump;
+                    dump_read->upload_time = upload_time[kernelStageIndex];
+                    dump_read->consumed = clCreateUserEvent(context, &err);
+                    if (err){
+                        printf("Error creating the read back event in loop %d, err: %d\n", i,err);
+                        exit(err);
+                    }
+                    //the next dump into this buffer waits on it too
+                    dump[dump_buffer].consumed = dump_read->consumed;
+                    clRetainEvent(dump[dump_buffer].consumed);
+                    err = clEnqueueReadBuffer(queue[2],
+                                              device_CLdump[dump_buffer],
+                                              CL_FALSE,
+                                              0,
+                                              len*sizeof(cl_long),
+                                              host_dump[dump_buffer],
+                                              1,
+                                              &lastIntegrateEvent,
+                                              &readBackEvent);
+                    if (err){
+                        printf("Error reading data back to host in loop %d, err: %s\n", i,oclGetOpenCLErrorCodeStr(err));
+                        exit(err);
+                    }
+                    if (profile_file != NULL)
+                        event_profiler_track(&profiler, readBackEvent, EVENT_PROFILE_READ_BACK, i - 1);
+                    err = clSetEventCallback(readBackEvent, CL_COMPLETE, dump_read_back, dump_read);
+                    if (err){
+                        printf("Error setting the read back callback in loop %d, err: %s\n", i,oclGetOpenCLErrorCodeStr(err));
+                        exit(err);
+                    }
+                    clReleaseEvent(readBackEvent);
+                    num_dumps++;
+                    frames_in_dump = 0;
+                }
+            }
+            else{
+                cl_mem read_back_buffer = device_CLoutput_kernelData[kernelStageIndex];
+                if (pack_kernel != NULL){
+                    //rewrite the frame as the packed upper triangle, so only that has to cross the bus
+                    err  = clSetKernelArg(pack_kernel, 0, sizeof(void *), (void *) &device_CLoutput_kernelData[kernelStageIndex]);
+                    err |= clSetKernelArg(pack_kernel, 3, sizeof(void *), (void *) &device_CLtriangle[kernelStageIndex]);
+                    if (err){
+                        printf("Error setting the pack arguments in loop %d\n", i);
+                        exit(err);
+                    }
+                    err = clEnqueueNDRangeKernel(queue[1],
+                                                 pack_kernel,
+                                                 3,
+                                                 NULL,
+                                                 gws_pack,
+                                                 lws_pack,
+                                                 1,
+                                                 &lastKernelEvent[kernelStageIndex],
+                                                 &packEvent);
+                    if (err){
+                        printf("Error performing pack kernel operation in loop %d, err: %d\n", i,err);
+                        exit(err);
+                    }
+                    if (profile_file != NULL)
+                        event_profiler_track(&profiler, packEvent, EVENT_PROFILE_PACK, i - 1);
+                    //the stage's next preseed overwrites what the packer reads, so it has to wait for the packer too
+                    clReleaseEvent(lastKernelEvent[kernelStageIndex]);
+                    lastKernelEvent[kernelStageIndex] = packEvent;
+                    read_back_buffer = device_CLtriangle[kernelStageIndex];
+                }
+                //read the integration back on its own queue, overlapping with the next frame's upload and kernels, and hand it
+                //to the consumer as soon as it arrives
+                readback_stage *integration_read = (readback_stage *)malloc(sizeof(readback_stage));
+                if (integration_read == NULL){
+                    printf("Error allocating memory for the read back in loop %d\n", i);
+                    exit(-1);
+                }
+                *integration_read = readback[kernelStageIndex];
+                integration_read->integration = i - 1;
+                integration_read->frame = write_frame[kernelStageIndex];
+                integration_read->upload_time = upload_time[kernelStageIndex];
+                integration_read->consumed = clCreateUserEvent(context, &err);
+                if (err){
+                    printf("Error creating the read back event in loop %d, err: %d\n", i,err);
+                    exit(err);
+                }
+                //the stage's next preseed (or zeroing) waits on it on the device
+                readback[kernelStageIndex].consumed = integration_read->consumed;
+                clRetainEvent(readback[kernelStageIndex].consumed);
+                err = clEnqueueReadBuffer(queue[2],
+                                          read_back_buffer,
+                                          CL_FALSE,
+                                          0,
+                                          out_len*sizeof(cl_int),
+                                          host_PrimaryOutput[kernelStageIndex],
+                                          1,
+                                          &lastKernelEvent[kernelStageIndex],
+                                          &readBackEvent);
+                if (err){
+                    printf("Error reading data back to host in loop %d, err: %s\n", i,oclGetOpenCLErrorCodeStr(err));
+                    exit(err);
+                }
+                if (profile_file != NULL)
+                    event_profiler_track(&profiler, readBackEvent, EVENT_PROFILE_READ_BACK, i - 1);
+                err = clSetEventCallback(readBackEvent, CL_COMPLETE, integration_read_back, integration_read);
+                if (err){
+                    printf("Error setting the read back callback in loop %d, err: %s\n", i,oclGetOpenCLErrorCodeStr(err));
+                    exit(err);
+                }
+                clReleaseEvent(readBackEvent);
+            }
 
 
         }
 
         spinCount++;
-        spinCount = (spinCount < N_STAGES) ? spinCount : 0; //keeps the value of spinCount small, always, and then saves 1 remainder calculation earlier in the loop.
+        spinCount = (spinCount < num_stages) ? spinCount : 0; //keeps the value of spinCount small, always, and then saves 1 remainder calculation earlier in the loop.
     }
 
-    //since there are only 2, simplify things (i.e. no need for a loop).
-    err =  clFinish(queue[0]);
-    err |= clFinish(queue[1]);
+    err = CL_SUCCESS;
+    for (int i = 0; i < N_QUEUES; i++)
+        err |= clFinish(queue[i]);
 
     if (err){
         printf("Error while finishing up the queue after the loops.\n");
         return (err);
     }
+    //and the consumer callbacks
+    for (int i = 0; i < num_stages; i++){
+        if (readback[i].consumed != 0){
+            clWaitForEvents(1, &readback[i].consumed);
+            clReleaseEvent(readback[i].consumed);
+            readback[i].consumed = 0;
+        }
+    }
+    for (int i = 0; i < 2; i++){
+        if (dump[i].consumed != 0){
+            clWaitForEvents(1, &dump[i].consumed);
+            clReleaseEvent(dump[i].consumed);
+            dump[i].consumed = 0;
+        }
+    }
+    if (lastIntegrateEvent != 0)
+        clReleaseEvent(lastIntegrateEvent);
     cputime = e_time()-cputime;
-
-    // 7. Look at the results
-    err = clEnqueueReadBuffer(queue[0], device_CLoutput_kernelData[0], CL_TRUE, 0, len*sizeof(cl_int), host_PrimaryOutput[0], 0, NULL, NULL);
-    err |= clEnqueueReadBuffer(queue[0], device_CLoutput_kernelData[1], CL_TRUE, 0, len*sizeof(cl_int), host_PrimaryOutput[1], 0, NULL, NULL);
-
-    if (err){
-        printf("Error reading data back to host.\n");
-        //return (err);
+    if (profile_file != NULL){
+        event_profiler_wait(&profiler);
+        event_profiler_report(&profiler);
+        if (event_profiler_write(&profiler, profile_file) == 0)
+            printf("Event profile written to %s\n", profile_file);
+        event_profiler_free(&profiler);
     }
-
-    err = clFinish(queue[0]);
-
-    if (err){
-        printf("Error while finishing up the queue after the loops.\n");
-        //return (err);
+    if (stream_buffers > 0){
+        input_stream_stop(&stream);
+        input_stream_report(&stream, cputime);
     }
 
-
-
-
-    if (iterations > 1){
-        for (int i = 0; i < len; i++){
-            host_PrimaryOutput[0][i] += host_PrimaryOutput[1][i];
-            host_PrimaryOutput[0][i] /=2; //the results in output 0 and 1 should be identical--this is just to check (in a rough way) that they are.
-            //if the average of the two arrays is the correct answer, and one expects both of them to have an answer, then the answers of both should be correct
-            //-could skip this and just compare against the first array's results
-        }
+    // 7. Look at the results (each integration has already been read back and handed to keep_integration)
+    if (results.num_dumps > 0){
+        printf("Read back %lld dumps of up to %d integrations (%lld integrations in all, %.1f MB read back instead of %.1f MB): latency from the last frame's upload to consumer %.3f ms mean, %.3f ms max\n",
+               (long long int)results.num_dumps, integrate_frames, (long long int)results.num_integrations,
+               results.num_dumps*len*sizeof(cl_long)/1e6, results.num_integrations*len*sizeof(cl_int)/1e6,
+               1e3*results.total_latency/results.num_dumps, 1e3*results.max_latency);
+        if (results.compare_to_first && results.num_differing > 0)
+            printf("Warning: %lld dumps of the same data aren't a whole number of copies of the first one's integration\n", (long long int)results.num_differing);
+    }
+    else if (results.num_integrations > 0){
+        printf("Read back %lld integrations through a pipeline of depth %d: latency from upload to consumer %.3f ms mean, %.3f ms max\n",
+               (long long int)results.num_integrations, num_stages, 1e3*results.total_latency/results.num_integrations, 1e3*results.max_latency);
+        if (results.compare_to_first && results.num_differing > 0)
+            printf("Warning: %lld integrations of the same data differ from the first one\n", (long long int)results.num_differing);
     }
 
     //--------------------------------------------------------------
@@ -831,81 +2182,26 @@ int main(int argc, char ** argv) {
     printf("    [Algorithm max:   @%.1f TFLOPS, %.1f kHz; %2.0f%% efficiency]\n", card_tflops,
                                     card_tflops*1e12 / (num_blocks * size1_block * size1_block * 2. * 2.) / 1e3,
                                     100.*iterations*time_steps/cputime / (card_tflops*1e12) * num_blocks * size1_block * size1_block * 2. * 2.*num_freq);
+    printf("    [Input transfer: %s, %.2f GB/s of input]\n", transfer_mode_names[transfer_mode], (double)iterations*time_steps*num_elem*num_freq/cputime/1e9);
 
 
     if (check_results){
         printf("Checking results. Please wait...\n");
-        // start using calls to do the comparisons
-        cputime = e_time();
-        int *correlated_CPU = calloc((num_elem*(num_elem))*num_freq*2,sizeof(int)); //made for the largest possible size (one size fits all)
-        if (correlated_CPU == NULL){
-            printf("failed to allocate memory\n");
-            return(-1);
-        }
-
-        if (upper_triangle_convention == 0){
-            if (TRIANGLE){
-                err = cpu_data_generate_and_correlate_upper_triangle_only_nonstandard_convention(time_steps, num_freq, num_elem, correlated_CPU,gen_type, random_seed, default_real, default_imaginary, initial_real, initial_imaginary,generate_frequency, no_repeat_random,verbose);
-            }
-            else{
-                err = cpu_data_generate_and_correlate_nonstandard_convention(time_steps, num_freq, num_elem, correlated_CPU,gen_type, random_seed, default_real, default_imaginary, initial_real, initial_imaginary,generate_frequency, no_repeat_random,verbose);
-            }
+        if (results.num_integrations == 0){
+            printf("No frame was correlated, so there is nothing to check\n");
+            return (-1);
         }
-        else{
-            if (TRIANGLE){
-                err = cpu_data_generate_and_correlate_upper_triangle_only(time_steps, num_freq, num_elem, correlated_CPU,gen_type, random_seed, default_real, default_imaginary, initial_real, initial_imaginary,generate_frequency, no_repeat_random,verbose);
-            }
-            else{
-                err = cpu_data_generate_and_correlate(time_steps, num_freq, num_elem, correlated_CPU,gen_type, random_seed, default_real, default_imaginary, initial_real, initial_imaginary,generate_frequency, no_repeat_random,verbose);
+        if (stream_buffers > 0){
+            //the kept integration is the latest one: remake its frame for the CPU
+            printf("Checking stream frame %lld\n", (long long int)results.kept_frame);
+            err = input_stream_fill_frame(&stream, results.kept_frame, host_PrimaryInput[0]);
+            if (err){
+                printf("failed to remake the checked frame\n");
+                return (-1);
             }
         }
-
-        int *correlated_GPU = (int *)malloc((num_elem*(num_elem))*num_freq*2*sizeof(int));
-
-        if (correlated_GPU == NULL){
-            printf("failed to allocate memory\n");
-            return(-1);
-        }
-
-
-        if (TRIANGLE){
-            reorganize_GPU_to_upper_triangle(size1_block, num_blocks, num_freq, num_elem, host_PrimaryOutput[0], correlated_GPU);
-        }
-        else{
-            reorganize_GPU_to_full_Matrix_for_comparison(size1_block, num_blocks, num_freq, num_elem, host_PrimaryOutput[0], correlated_GPU);
-        }
-
-        int number_errors = 0;
-        int64_t errors_squared;
-        double *amp2_ratio_GPU_div_CPU = (double *)malloc(num_elem*num_elem*num_freq*sizeof(double));
-        if (amp2_ratio_GPU_div_CPU == NULL){
-            printf("ran out of memory\n");
-            return (-1);
-        }
-        double *phaseAngleDiff_GPU_m_CPU = (double *)malloc(num_elem*num_elem*num_freq*sizeof(double));
-        if (phaseAngleDiff_GPU_m_CPU == NULL){
-            printf("2ran out of memory\n");
+        if (check_gpu_output(&check, host_PrimaryInput[0], results.kept_output))
             return (-1);
-        }
-
-        if (TRIANGLE){
-            compare_NSquared_correlator_results_data_has_upper_triangle_only ( &number_errors, &errors_squared, num_freq, num_elem, correlated_GPU, correlated_CPU, amp2_ratio_GPU_div_CPU, phaseAngleDiff_GPU_m_CPU, verbose);
-        }
-        else{
-            compare_NSquared_correlator_results ( &number_errors, &errors_squared, num_freq, num_elem, correlated_GPU, correlated_CPU, amp2_ratio_GPU_div_CPU, phaseAngleDiff_GPU_m_CPU, verbose);
-        }
-
-        if (number_errors > 0)
-            printf("Error with correlation/accumulation! Num Err: %d and length of correlated data: %d\n",number_errors, num_elem*num_elem*num_freq);
-        else
-            printf("Correlation/accumulation successful! CPU matches GPU.\n");
-        cputime=e_time()-cputime;
-        printf("Full Corr: %4.2fs on CPU (%.2f kHz)\n",cputime,time_steps/cputime/1e3);
-
-        free(correlated_CPU);
-        free(correlated_GPU);
-        free(amp2_ratio_GPU_div_CPU);
-        free(phaseAngleDiff_GPU_m_CPU);
     }
     else{
         printf("\nGPU calculations have not been verified. If kernels have been changed, be careful regarding these results.\n\n");
@@ -919,7 +2215,7 @@ int main(int argc, char ** argv) {
         exit(err);
     }
 
-    for (int ns=0; ns < N_STAGES; ns++){
+    for (int ns=0; ns < num_stages; ns++){
         err = clReleaseMemObject(device_CLinput_pinnedBuffer[ns]);
         if (err != SDK_SUCCESS) {
             printf("clReleaseMemObject() failed with %d (%s)\n",err,oclGetOpenCLErrorCodeStr(err));
@@ -932,11 +2228,13 @@ int main(int argc, char ** argv) {
             printf("Error at line %u in file %s !!!\n\n", __LINE__, __FILE__);
             exit(err);
         }
-        err = clReleaseMemObject(device_CLinput_kernelData[ns]);
-        if (err != SDK_SUCCESS) {
-            printf("clReleaseMemObject() failed with %d (%s)\n",err,oclGetOpenCLErrorCodeStr(err));
-            printf("Error at line %u in file %s !!!\n\n", __LINE__, __FILE__);
-            exit(err);
+        if (device_CLinput_kernelData[ns] != NULL){
+            err = clReleaseMemObject(device_CLinput_kernelData[ns]);
+            if (err != SDK_SUCCESS) {
+                printf("clReleaseMemObject() failed with %d (%s)\n",err,oclGetOpenCLErrorCodeStr(err));
+                printf("Error at line %u in file %s !!!\n\n", __LINE__, __FILE__);
+                exit(err);
+            }
         }
         err = clReleaseMemObject(device_CLoutput_kernelData[ns]);
         if (err != SDK_SUCCESS) {
@@ -948,6 +2246,9 @@ int main(int argc, char ** argv) {
         free(host_PrimaryInput[ns]);
         free(host_PrimaryOutput[ns]);
 
+        if (device_CLtriangle[ns] != NULL)
+            clReleaseMemObject(device_CLtriangle[ns]);
+
         err = clReleaseMemObject(device_CLoutputAccum[ns]);
         if (err != SDK_SUCCESS) {
             printf("clReleaseMemObject() failed with %d (%s)\n",err,oclGetOpenCLErrorCodeStr(err));
@@ -956,17 +2257,51 @@ int main(int argc, char ** argv) {
         }
     }
 
-    free(zeros);
+    free(results.kept_output);
+    for (int i = 0; i < 2; i++){
+        if (device_CLdump[i] != NULL)
+            clReleaseMemObject(device_CLdump[i]);
+        free(host_dump[i]);
+    }
+    if (integrate_kernel != NULL){
+        clReleaseKernel(integrate_kernel);
+        clReleaseProgram(integrator_program);
+    }
+    if (pack_kernel != NULL){
+        clReleaseKernel(pack_kernel);
+        clReleaseProgram(packer_program);
+    }
+    pthread_mutex_destroy(&results.lock);
+
+    if (stream_buffers > 0){
+        for (int b = 0; b < stream_buffers; b++){
+            err = clReleaseMemObject(device_CLinput_streamBuffer[b]);
+            if (err != SDK_SUCCESS) {
+                printf("clReleaseMemObject() failed with %d (%s)\n",err,oclGetOpenCLErrorCodeStr(err));
+                printf("Error at line %u in file %s !!!\n\n", __LINE__, __FILE__);
+                exit(err);
+            }
+        }
+        free(device_CLinput_streamBuffer);
+        input_stream_free(&stream);
+    }
 
     //--------------------------------------------------------------
 
     clReleaseKernel(corr_kernel);
+    if (diagonal_corr_kernel != NULL){
+        clReleaseKernel(diagonal_corr_kernel);
+        clReleaseProgram(diagonal_program);
+    }
+    clReleaseKernel(offsetAccumulate_kernel);
+    clReleaseKernel(combineOffsets_kernel);
+    clReleaseKernel(preseed_kernel);
     clReleaseProgram(program);
     clReleaseMemObject(device_block_lock);
     clReleaseMemObject(id_x_map);
     clReleaseMemObject(id_y_map);
-    clReleaseCommandQueue(queue[0]);
-    clReleaseCommandQueue(queue[1]);
+    for (int i = 0; i < N_QUEUES; i++)
+        clReleaseCommandQueue(queue[i]);
     clReleaseContext(context);
     return 0;
 }
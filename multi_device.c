@@ -0,0 +1,687 @@
+// multi_device.c
+// the calling thread posts frames on a small board (a slot per frame in flight) and each device thread takes every frame
+// from it, uploading only its own channels with a rectangular copy: the input is [time][frequency][element], so a device's
+// channels are one run of bytes per time step. With a stream, a ring buffer goes back to the producer once all the devices'
+// uploads from it have finished. The outputs are [frequency][block], so each device's result is one run of the merged
+// output; a merged integration goes to the consumer once every device has added its part.
+#include "multi_device.h"
+#include <stdio.h> // printf
+#include <stdlib.h> // malloc, etc.
+#include <string.h>
+#include <math.h> // ceil
+#include <pthread.h>
+#include "cl_program_cache.h"
+#include "device_profile.h"
+#include "gpu_cpu_helpers.h"
+#include "gpu_data_reorg.h"
+#include "amd_firepro_error_code_list_for_opencl.h"
+
+#define MAX_PLATFORMS                   8
+#define MAX_DEVICES_PER_PLATFORM        16
+#define N_DEVICE_QUEUES                 3 //uploads, kernels and read backs
+
+typedef struct multi_device_shared multi_device_shared;
+
+typedef struct {
+    multi_device_shared *shared;
+    int index;
+} upload_ref;
+
+typedef struct {
+    multi_device_shared *shared;
+    cl_device_id device;
+    int is_sub_device;
+    char name[256];
+    int first_frequency;
+    int num_frequencies;
+    int num_blocks;
+    int len; //output values for this device's channels
+
+    cl_context context;
+    cl_command_queue queue[N_DEVICE_QUEUES];
+    cl_program program;
+    cl_kernel corr_kernel;
+    cl_kernel offsetAccumulate_kernel;
+    cl_kernel combineOffsets_kernel;
+    cl_kernel preseed_kernel;
+    cl_mem input[MULTI_DEVICE_MAX_STAGES];
+    cl_mem accum[MULTI_DEVICE_MAX_STAGES];
+    cl_mem output[MULTI_DEVICE_MAX_STAGES];
+    cl_mem block_lock;
+    cl_mem id_x_map;
+    cl_mem id_y_map;
+    int *host_output[MULTI_DEVICE_MAX_STAGES];
+    unsigned int *zeros;
+    size_t gws_corr[3];
+    size_t lws_corr[3];
+    size_t gws_accum[3];
+    size_t lws_accum[3];
+    int accum_partials; //offsetAccumulateElements' partial sums, added into the first when there is more than one
+    size_t gws_combine[1];
+    size_t gws_preseed[3];
+    size_t lws_preseed[3];
+
+    cl_event read_event[MULTI_DEVICE_MAX_STAGES]; //0 when the stage is idle
+    int64_t stage_integration[MULTI_DEVICE_MAX_STAGES];
+    int64_t stage_frame[MULTI_DEVICE_MAX_STAGES];
+    double stage_post_time[MULTI_DEVICE_MAX_STAGES];
+
+    pthread_t thread;
+    int64_t num_integrations;
+} device_context;
+
+struct multi_device_shared {
+    const multi_device_config *config;
+    int num_devices;
+    device_context devices[MULTI_DEVICE_MAX_DEVICES];
+    int merged_len;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+
+    //frames posted by the calling thread: frame i is in slot i % num_slots until every device has taken it
+    int num_slots;
+    int64_t *posted_frame;
+    int *posted_buffer; //stream buffer, or -1 for the fixed input
+    double *posted_time;
+    int *posted_taken;
+    int64_t num_posted;
+    int64_t end; //number of frames, once known (-1 before)
+
+    //stream buffers being uploaded: each goes back to the stream when all the devices are done with it
+    int *uploads_left;
+    upload_ref *upload_refs;
+
+    //integration i is merged in slot i % num_stages
+    int *merged_output[MULTI_DEVICE_MAX_STAGES];
+    int64_t merged_integration[MULTI_DEVICE_MAX_STAGES];
+    int merged_claimed[MULTI_DEVICE_MAX_STAGES]; //devices adding to the slot's integration (0 when the slot is free)
+    int merged_copied[MULTI_DEVICE_MAX_STAGES]; //devices that have added their part
+    int64_t num_merged;
+};
+
+//takes a device found, unless it is one of the first config->first_device, which are skipped
+static void add_device(const multi_device_config *config, device_context *devices, int *num_devices, int *num_skipped, cl_device_id device, int is_sub_device){
+    if (*num_skipped < config->first_device){
+        (*num_skipped)++;
+        if (is_sub_device)
+            clReleaseDevice(device);
+        return;
+    }
+    devices[*num_devices].device = device;
+    devices[*num_devices].is_sub_device = is_sub_device;
+    (*num_devices)++;
+    return;
+}
+
+//devices of the configured type on every platform, with CPU devices optionally split into sub-devices
+static int find_devices(const multi_device_config *config, device_context *devices){
+    cl_platform_id platforms[MAX_PLATFORMS];
+    cl_uint num_platforms = 0;
+    int num_devices = 0;
+    int num_skipped = 0;
+    int max_devices = (config->max_devices > 0 && config->max_devices < MULTI_DEVICE_MAX_DEVICES) ? config->max_devices : MULTI_DEVICE_MAX_DEVICES;
+
+    if (clGetPlatformIDs(MAX_PLATFORMS, platforms, &num_platforms) != CL_SUCCESS || num_platforms == 0){
+        printf("Error: no OpenCL platforms found\n");
+        return (-1);
+    }
+    if (num_platforms > MAX_PLATFORMS)
+        num_platforms = MAX_PLATFORMS;
+
+    for (cl_uint p = 0; p < num_platforms && num_devices < max_devices; p++){
+        cl_device_id platform_devices[MAX_DEVICES_PER_PLATFORM];
+        cl_uint num_platform_devices = 0;
+        if (clGetDeviceIDs(platforms[p], config->device_type, MAX_DEVICES_PER_PLATFORM, platform_devices, &num_platform_devices) != CL_SUCCESS)
+            continue;
+        if (num_platform_devices > MAX_DEVICES_PER_PLATFORM)
+            num_platform_devices = MAX_DEVICES_PER_PLATFORM;
+
+        for (cl_uint d = 0; d < num_platform_devices && num_devices < max_devices; d++){
+            cl_device_type type = 0;
+            clGetDeviceInfo(platform_devices[d], CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+            if ((type & CL_DEVICE_TYPE_CPU) && config->cpu_sub_device_units > 0){
+                cl_device_partition_property properties[3] = {CL_DEVICE_PARTITION_EQUALLY, config->cpu_sub_device_units, 0};
+                cl_device_id sub_devices[MULTI_DEVICE_MAX_DEVICES];
+                cl_uint num_sub_devices = 0;
+                cl_int err = clCreateSubDevices(platform_devices[d], properties, MULTI_DEVICE_MAX_DEVICES, sub_devices, &num_sub_devices);
+                if (err == CL_SUCCESS && num_sub_devices > 0){
+                    if (num_sub_devices > MULTI_DEVICE_MAX_DEVICES)
+                        num_sub_devices = MULTI_DEVICE_MAX_DEVICES;
+                    for (cl_uint s = 0; s < num_sub_devices; s++){
+                        if (num_devices < max_devices)
+                            add_device(config, devices, &num_devices, &num_skipped, sub_devices[s], 1);
+                        else
+                            clReleaseDevice(sub_devices[s]);
+                    }
+                    continue;
+                }
+                printf("Warning: could not split a CPU device into sub-devices of %d compute units (error %d), so it is used whole\n", config->cpu_sub_device_units, err);
+            }
+            add_device(config, devices, &num_devices, &num_skipped, platform_devices[d], 0);
+        }
+    }
+    return num_devices;
+}
+
+static int setup_device(device_context *dev, const multi_device_config *config){
+    cl_int err;
+    int num_elem = config->num_elements;
+    int num_freq = dev->num_frequencies;
+    int time_steps = config->num_timesteps;
+    int block_dim = config->block_dim;
+
+    device_profile profile;
+    if (device_profile_query(dev->device, &profile) != 0)
+        return (-1);
+    strcpy(dev->name, profile.name);
+    dev->num_blocks = gpu_num_blocks(block_dim, num_elem);
+    dev->len = dev->num_blocks * block_dim * block_dim * 2 * num_freq;
+
+    dev->context = clCreateContext(NULL, 1, &dev->device, NULL, NULL, &err);
+    if (err){
+        printf("Error creating a context on %s: %s\n", dev->name, oclGetOpenCLErrorCodeStr(err));
+        return (-1);
+    }
+    for (int q = 0; q < N_DEVICE_QUEUES; q++){
+        dev->queue[q] = clCreateCommandQueue(dev->context, dev->device, 0, &err);
+        if (err){
+            printf("Error creating a queue on %s: %s\n", dev->name, oclGetOpenCLErrorCodeStr(err));
+            return (-1);
+        }
+    }
+
+    //the same defines as the single device build, for this device's channels
+    char cl_options[1024];
+    sprintf(cl_options,"-D NUM_ELEMENTS=%du -D NUM_FREQUENCIES=%du -D NUM_BLOCKS=%du -D NUM_TIMESAMPLES=%du -D NUM_TIME_ACCUM=%du -D BASE_ACCUM=%du -D SIZE_PER_SET=%du -D BLOCK_DIM=%du",
+            num_elem, num_freq, dev->num_blocks, time_steps, config->time_accum, config->base_accum, dev->num_blocks*block_dim*block_dim*2*num_freq, block_dim);
+    int from_cache;
+    dev->program = cl_program_cache_build(dev->context, dev->device, config->num_sources, config->sources, config->source_sizes, cl_options, config->kernel_cache_dir, &from_cache);
+    if (dev->program == NULL)
+        return (-1);
+
+    dev->corr_kernel = clCreateKernel(dev->program, "corr", &err);
+    if (!err)
+        dev->offsetAccumulate_kernel = clCreateKernel(dev->program, "offsetAccumulateElements", &err);
+    if (!err)
+        dev->combineOffsets_kernel = clCreateKernel(dev->program, "combineOffsetPartials", &err);
+    if (!err)
+        dev->preseed_kernel = clCreateKernel(dev->program, "preseed", &err);
+    if (err){
+        printf("Error in clCreateKernel on %s: %i\n", dev->name, err);
+        return (-1);
+    }
+
+    size_t accum_local_size = (config->accum_local_size > 0) ? config->accum_local_size : profile.accum_local_size;
+    dev->accum_partials = device_profile_accum_partials(&profile, accum_local_size, config->accum_partials, num_elem, num_freq, time_steps, config->base_accum);
+
+    //zeros for the block locks and the outputs (offsetAccumulateElements writes every sum, so the accumulators needn't be zeroed)
+    size_t zeros_size = dev->len;
+    if (zeros_size < (size_t)dev->num_blocks*num_freq)
+        zeros_size = (size_t)dev->num_blocks*num_freq;
+    dev->zeros = (unsigned int *)calloc(zeros_size, sizeof(cl_uint));
+    if (dev->zeros == NULL){
+        printf("failed to allocate memory\n");
+        return (-1);
+    }
+
+    for (int s = 0; s < config->num_stages; s++){
+        dev->input[s] = clCreateBuffer(dev->context, CL_MEM_READ_ONLY, (size_t)time_steps*num_elem*num_freq, NULL, &err);
+        if (!err)
+            dev->accum[s] = clCreateBuffer(dev->context, CL_MEM_READ_WRITE, (size_t)dev->accum_partials*num_freq*num_elem*2*sizeof(cl_uint), NULL, &err);
+        if (!err)
+            dev->output[s] = clCreateBuffer(dev->context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, dev->len*sizeof(cl_int), dev->zeros, &err);
+        if (err){
+            printf("error in allocating memory on %s: %s\n", dev->name, oclGetOpenCLErrorCodeStr(err));
+            return (-1);
+        }
+        dev->host_output[s] = (int *)malloc(dev->len*sizeof(int));
+        if (dev->host_output[s] == NULL){
+            printf("failed to allocate memory\n");
+            return (-1);
+        }
+        dev->read_event[s] = 0;
+    }
+    dev->block_lock = clCreateBuffer(dev->context, CL_MEM_COPY_HOST_PTR, dev->num_blocks*num_freq*sizeof(cl_int), dev->zeros, &err);
+    if (err){
+        printf("error in allocating memory on %s: %s\n", dev->name, oclGetOpenCLErrorCodeStr(err));
+        return (-1);
+    }
+
+    //upper triangular address mapping, as for the single device
+    cl_uint *global_id_x_map = (cl_uint *)malloc(dev->num_blocks*sizeof(cl_uint));
+    cl_uint *global_id_y_map = (cl_uint *)malloc(dev->num_blocks*sizeof(cl_uint));
+    if (global_id_x_map == NULL || global_id_y_map == NULL){
+        printf("failed to allocate memory\n");
+        return (-1);
+    }
+    int largest_num_blocks_1D = (num_elem + block_dim - 1)/block_dim; //the last may be an edge tile
+    int index_1D = 0;
+    for (int j = 0; j < largest_num_blocks_1D; j++){
+        for (int i = j; i < largest_num_blocks_1D; i++){
+            global_id_x_map[index_1D] = i;
+            global_id_y_map[index_1D] = j;
+            index_1D++;
+        }
+    }
+    dev->id_x_map = clCreateBuffer(dev->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dev->num_blocks * sizeof(cl_uint), global_id_x_map, &err);
+    if (!err)
+        dev->id_y_map = clCreateBuffer(dev->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, dev->num_blocks * sizeof(cl_uint), global_id_y_map, &err);
+    free(global_id_x_map);
+    free(global_id_y_map);
+    if (err){
+        printf("Error in clCreateBuffer on %s: %i\n", dev->name, err);
+        return (-1);
+    }
+
+    err  = clSetKernelArg(dev->corr_kernel, 2, sizeof(void *), (void*) &dev->id_x_map);
+    err |= clSetKernelArg(dev->corr_kernel, 3, sizeof(void *), (void*) &dev->id_y_map);
+    err |= clSetKernelArg(dev->corr_kernel, 4, sizeof(void *), (void*) &dev->block_lock);
+    err |= clSetKernelArg(dev->preseed_kernel, 2, sizeof(void *), (void*) &dev->id_x_map);
+    err |= clSetKernelArg(dev->preseed_kernel, 3, sizeof(void *), (void*) &dev->id_y_map);
+    err |= clSetKernelArg(dev->preseed_kernel, 4, 2*block_dim* sizeof(cl_uint), NULL);
+    err |= clSetKernelArg(dev->preseed_kernel, 5, 2*block_dim* sizeof(cl_uint), NULL);
+    cl_uint num_accum_partials = dev->accum_partials;
+    err |= clSetKernelArg(dev->combineOffsets_kernel, 1, sizeof(cl_uint), (void*) &num_accum_partials);
+    if (err){
+        printf("Error setting the kernel arguments on %s\n", dev->name);
+        return (-1);
+    }
+
+    unsigned int n_cAccum = time_steps/config->time_accum;
+    size_t gws_corr[3] = {block_dim/4, block_dim/4*num_freq, dev->num_blocks*n_cAccum};
+    size_t lws_corr[3] = {block_dim/4, block_dim/4, 1};
+    size_t gws_accum[3] = {64, (int)ceil(num_elem*num_freq/256.0), dev->accum_partials};
+    size_t lws_accum[3] = {accum_local_size, 1, 1};
+    size_t gws_preseed[3] = {block_dim/4, block_dim/4*num_freq, dev->num_blocks};
+    size_t lws_preseed[3] = {block_dim/4, block_dim/4, 1};
+    memcpy(dev->gws_corr, gws_corr, sizeof(gws_corr));
+    memcpy(dev->lws_corr, lws_corr, sizeof(lws_corr));
+    memcpy(dev->gws_accum, gws_accum, sizeof(gws_accum));
+    memcpy(dev->lws_accum, lws_accum, sizeof(lws_accum));
+    dev->gws_combine[0] = (num_freq*num_elem*2 + 63)/64*64;
+    memcpy(dev->gws_preseed, gws_preseed, sizeof(gws_preseed));
+    memcpy(dev->lws_preseed, lws_preseed, sizeof(lws_preseed));
+
+    if (!config->quiet)
+        printf("  %-40s channels %d to %d, %s profile, offsetAccumulate work-group %zu and %d partial sums%s\n", dev->name, dev->first_frequency, dev->first_frequency + num_freq - 1,
+               profile.kind, lws_accum[0], dev->accum_partials, from_cache ? " (kernels from the binary cache)" : "");
+    return 0;
+}
+
+static void release_device(device_context *dev, int num_stages){
+    for (int s = 0; s < num_stages; s++){
+        if (dev->input[s] != NULL)
+            clReleaseMemObject(dev->input[s]);
+        if (dev->accum[s] != NULL)
+            clReleaseMemObject(dev->accum[s]);
+        if (dev->output[s] != NULL)
+            clReleaseMemObject(dev->output[s]);
+        free(dev->host_output[s]);
+    }
+    if (dev->block_lock != NULL)
+        clReleaseMemObject(dev->block_lock);
+    if (dev->id_x_map != NULL)
+        clReleaseMemObject(dev->id_x_map);
+    if (dev->id_y_map != NULL)
+        clReleaseMemObject(dev->id_y_map);
+    if (dev->corr_kernel != NULL)
+        clReleaseKernel(dev->corr_kernel);
+    if (dev->offsetAccumulate_kernel != NULL)
+        clReleaseKernel(dev->offsetAccumulate_kernel);
+    if (dev->combineOffsets_kernel != NULL)
+        clReleaseKernel(dev->combineOffsets_kernel);
+    if (dev->preseed_kernel != NULL)
+        clReleaseKernel(dev->preseed_kernel);
+    if (dev->program != NULL)
+        clReleaseProgram(dev->program);
+    for (int q = 0; q < N_DEVICE_QUEUES; q++){
+        if (dev->queue[q] != NULL)
+            clReleaseCommandQueue(dev->queue[q]);
+    }
+    if (dev->context != NULL)
+        clReleaseContext(dev->context);
+    if (dev->is_sub_device)
+        clReleaseDevice(dev->device);
+    free(dev->zeros);
+    return;
+}
+
+//OpenCL calls this when a device's upload from a stream buffer has finished
+static void CL_CALLBACK upload_done(cl_event event, cl_int status, void *user_data){
+    upload_ref *ref = (upload_ref *)user_data;
+    multi_device_shared *shared = ref->shared;
+    pthread_mutex_lock(&shared->lock);
+    int last = (--shared->uploads_left[ref->index] == 0);
+    pthread_mutex_unlock(&shared->lock);
+    if (last)
+        input_stream_release(shared->config->stream, ref->index);
+    return;
+}
+
+//adds a device's finished integration to the merged one, and hands the merged one on when it is complete
+static void merge_integration(device_context *dev, int s){
+    multi_device_shared *shared = dev->shared;
+    int64_t integration = dev->stage_integration[s];
+    int m = integration % shared->config->num_stages;
+
+    pthread_mutex_lock(&shared->lock);
+    while (shared->merged_claimed[m] > 0 && shared->merged_integration[m] != integration) //a device can't get more than a pipeline ahead
+        pthread_cond_wait(&shared->changed, &shared->lock);
+    shared->merged_integration[m] = integration;
+    shared->merged_claimed[m]++;
+    pthread_mutex_unlock(&shared->lock);
+
+    memcpy(shared->merged_output[m] + (size_t)dev->first_frequency*dev->num_blocks*shared->config->block_dim*shared->config->block_dim*2, dev->host_output[s], dev->len*sizeof(int));
+
+    pthread_mutex_lock(&shared->lock);
+    int complete = (++shared->merged_copied[m] == shared->num_devices);
+    pthread_mutex_unlock(&shared->lock);
+
+    if (complete){
+        //the slot stays claimed until the consumer is done with it
+        shared->config->consumer(shared->config->consumer_context, integration, dev->stage_frame[s], e_time() - dev->stage_post_time[s],
+                                 shared->merged_output[m], shared->merged_len);
+        pthread_mutex_lock(&shared->lock);
+        shared->merged_claimed[m] = 0;
+        shared->merged_copied[m] = 0;
+        shared->num_merged++;
+        pthread_cond_broadcast(&shared->changed);
+        pthread_mutex_unlock(&shared->lock);
+    }
+    return;
+}
+
+static void finish_stage(device_context *dev, int s){
+    clWaitForEvents(1, &dev->read_event[s]);
+    clReleaseEvent(dev->read_event[s]);
+    dev->read_event[s] = 0;
+    merge_integration(dev, s);
+    dev->num_integrations++;
+    return;
+}
+
+static void *device_thread(void *arg){
+    device_context *dev = (device_context *)arg;
+    multi_device_shared *shared = dev->shared;
+    const multi_device_config *config = shared->config;
+    cl_int err;
+    cl_event copyInputDataEvent;
+    cl_event offsetAccumulateEvent;
+    cl_event combineOffsetsEvent;
+    cl_event preseedEvent;
+    cl_event corrEvent;
+
+    //this device's channels of a [time][frequency][element] frame: num_timesteps rows, num_frequencies*num_elements bytes each
+    size_t host_origin[3] = {(size_t)dev->first_frequency*config->num_elements, 0, 0};
+    size_t device_origin[3] = {0, 0, 0};
+    size_t region[3] = {(size_t)dev->num_frequencies*config->num_elements, config->num_timesteps, 1};
+    size_t host_row_pitch = (size_t)config->num_frequencies*config->num_elements;
+
+    for (int64_t i = 0; ; i++){
+        int slot = i % shared->num_slots;
+        pthread_mutex_lock(&shared->lock);
+        while (shared->num_posted <= i && (shared->end < 0 || i < shared->end))
+            pthread_cond_wait(&shared->changed, &shared->lock);
+        if (shared->num_posted <= i){ //the end
+            pthread_mutex_unlock(&shared->lock);
+            break;
+        }
+        int64_t frame = shared->posted_frame[slot];
+        int buffer = shared->posted_buffer[slot];
+        double post_time = shared->posted_time[slot];
+        shared->posted_taken[slot]++;
+        pthread_cond_broadcast(&shared->changed);
+        pthread_mutex_unlock(&shared->lock);
+
+        int s = i % config->num_stages;
+        if (dev->read_event[s] != 0) //the stage's buffers are free once its last integration is back
+            finish_stage(dev, s);
+        dev->stage_integration[s] = i;
+        dev->stage_frame[s] = frame;
+        dev->stage_post_time[s] = post_time;
+
+        err = clEnqueueWriteBufferRect(dev->queue[0], dev->input[s], CL_FALSE, device_origin, host_origin, region,
+                                       region[0], 0, host_row_pitch, 0,
+                                       (buffer >= 0) ? config->stream->buffers[buffer] : config->fixed_input,
+                                       0, NULL, &copyInputDataEvent);
+        if (err){
+            printf("Error in transfer to %s in loop %lld, error: %s\n", dev->name, (long long int)i, oclGetOpenCLErrorCodeStr(err));
+            exit(err);
+        }
+        if (buffer >= 0){
+            err = clSetEventCallback(copyInputDataEvent, CL_COMPLETE, upload_done, &shared->upload_refs[buffer]);
+            if (err){
+                printf("Error setting the upload callback on %s in loop %lld, error: %s\n", dev->name, (long long int)i, oclGetOpenCLErrorCodeStr(err));
+                exit(err);
+            }
+        }
+        const cl_int zero_pattern = 0;
+        if (config->fused_kernel){
+            //the fused correlator adds its share of the preseed correction to the output, so it only needs zeroing
+            err = clEnqueueFillBuffer(dev->queue[1], dev->output[s], &zero_pattern, sizeof(cl_int), 0, dev->len*sizeof(cl_int), 1, &copyInputDataEvent, &preseedEvent);
+            if (err){
+                printf("Error zeroing the output on %s in loop %lld, error: %s\n", dev->name, (long long int)i, oclGetOpenCLErrorCodeStr(err));
+                exit(err);
+            }
+            clReleaseEvent(copyInputDataEvent);
+        }
+        else {
+            err  = clSetKernelArg(dev->offsetAccumulate_kernel, 0, sizeof(void*), (void*) &dev->input[s]);
+            err |= clSetKernelArg(dev->offsetAccumulate_kernel, 1, sizeof(void*), (void*) &dev->accum[s]);
+            err |= clSetKernelArg(dev->preseed_kernel, 0, sizeof(void*), (void*) &dev->accum[s]);
+            err |= clSetKernelArg(dev->preseed_kernel, 1, sizeof(void*), (void*) &dev->output[s]);
+            err |= clSetKernelArg(dev->combineOffsets_kernel, 0, sizeof(void*), (void*) &dev->accum[s]);
+            if (err){
+                printf("Error setting the kernel arguments on %s in loop %lld\n", dev->name, (long long int)i);
+                exit(err);
+            }
+            err = clEnqueueNDRangeKernel(dev->queue[1], dev->offsetAccumulate_kernel, 3, NULL, dev->gws_accum, dev->lws_accum, 1, &copyInputDataEvent, &offsetAccumulateEvent);
+            if (err){
+                printf("Error accumulating on %s in loop %lld, err: %s\n", dev->name, (long long int)i, oclGetOpenCLErrorCodeStr(err));
+                exit(err);
+            }
+            clReleaseEvent(copyInputDataEvent);
+            if (dev->accum_partials > 1){
+                err = clEnqueueNDRangeKernel(dev->queue[1], dev->combineOffsets_kernel, 1, NULL, dev->gws_combine, dev->lws_accum, 1, &offsetAccumulateEvent, &combineOffsetsEvent);
+                if (err){
+                    printf("Error combining the offset sums on %s in loop %lld, err: %s\n", dev->name, (long long int)i, oclGetOpenCLErrorCodeStr(err));
+                    exit(err);
+                }
+                clReleaseEvent(offsetAccumulateEvent);
+                offsetAccumulateEvent = combineOffsetsEvent;
+            }
+            err = clEnqueueNDRangeKernel(dev->queue[1], dev->preseed_kernel, 3, NULL, dev->gws_preseed, dev->lws_preseed, 1, &offsetAccumulateEvent, &preseedEvent);
+            if (err){
+                printf("Error performing preseed kernel operation on %s in loop %lld, err: %s\n", dev->name, (long long int)i, oclGetOpenCLErrorCodeStr(err));
+                exit(err);
+            }
+            clReleaseEvent(offsetAccumulateEvent);
+        }
+        err  = clSetKernelArg(dev->corr_kernel, 0, sizeof(void*), (void*) &dev->input[s]);
+        err |= clSetKernelArg(dev->corr_kernel, 1, sizeof(void*), (void*) &dev->output[s]);
+        if (err){
+            printf("Error setting the kernel arguments on %s in loop %lld\n", dev->name, (long long int)i);
+            exit(err);
+        }
+        err = clEnqueueNDRangeKernel(dev->queue[1], dev->corr_kernel, 3, NULL, dev->gws_corr, dev->lws_corr, 1, &preseedEvent, &corrEvent);
+        if (err){
+            printf("Error performing corr kernel operation on %s in loop %lld, err: %s\n", dev->name, (long long int)i, oclGetOpenCLErrorCodeStr(err));
+            exit(err);
+        }
+        clReleaseEvent(preseedEvent);
+        err = clEnqueueReadBuffer(dev->queue[2], dev->output[s], CL_FALSE, 0, dev->len*sizeof(cl_int), dev->host_output[s], 1, &corrEvent, &dev->read_event[s]);
+        if (err){
+            printf("Error reading data back from %s in loop %lld, err: %s\n", dev->name, (long long int)i, oclGetOpenCLErrorCodeStr(err));
+            exit(err);
+        }
+        clReleaseEvent(corrEvent);
+        for (int q = 0; q < N_DEVICE_QUEUES; q++)
+            clFlush(dev->queue[q]);
+    }
+
+    //the integrations still in the pipeline, in order
+    for (;;){
+        int oldest = -1;
+        for (int s = 0; s < config->num_stages; s++){
+            if (dev->read_event[s] != 0 && (oldest < 0 || dev->stage_integration[s] < dev->stage_integration[oldest]))
+                oldest = s;
+        }
+        if (oldest < 0)
+            break;
+        finish_stage(dev, oldest);
+    }
+    return NULL;
+}
+
+static void free_shared(multi_device_shared *shared){
+    for (int d = 0; d < shared->num_devices; d++)
+        release_device(&shared->devices[d], shared->config->num_stages);
+    for (int m = 0; m < shared->config->num_stages; m++)
+        free(shared->merged_output[m]);
+    free(shared->posted_frame);
+    free(shared->posted_buffer);
+    free(shared->posted_time);
+    free(shared->posted_taken);
+    free(shared->uploads_left);
+    free(shared->upload_refs);
+    pthread_mutex_destroy(&shared->lock);
+    pthread_cond_destroy(&shared->changed);
+    free(shared);
+    return;
+}
+
+int multi_device_run(const multi_device_config *config, int64_t *num_integrations, double *run_time){
+    multi_device_shared *shared = (multi_device_shared *)calloc(1, sizeof(multi_device_shared));
+    if (shared == NULL){
+        printf("failed to allocate memory\n");
+        return (-1);
+    }
+    shared->config = config;
+    shared->end = -1;
+    pthread_mutex_init(&shared->lock, NULL);
+    pthread_cond_init(&shared->changed, NULL);
+
+    int num_found = find_devices(config, shared->devices);
+    if (num_found <= 0){
+        printf("Error: no OpenCL devices found\n");
+        free_shared(shared);
+        return (-1);
+    }
+    //every device needs at least one channel
+    shared->num_devices = (num_found < config->num_frequencies) ? num_found : config->num_frequencies;
+    for (int d = shared->num_devices; d < num_found; d++){
+        if (shared->devices[d].is_sub_device)
+            clReleaseDevice(shared->devices[d].device);
+    }
+    if (!config->quiet)
+        printf("Sharding %d frequency channels over %d OpenCL devices:\n", config->num_frequencies, shared->num_devices);
+
+    int first_frequency = 0;
+    for (int d = 0; d < shared->num_devices; d++){
+        device_context *dev = &shared->devices[d];
+        dev->shared = shared;
+        dev->first_frequency = first_frequency;
+        dev->num_frequencies = config->num_frequencies / shared->num_devices + (d < config->num_frequencies % shared->num_devices);
+        first_frequency += dev->num_frequencies;
+        if (setup_device(dev, config)){
+            free_shared(shared);
+            return (-1);
+        }
+    }
+
+    int num_blocks = gpu_num_blocks(config->block_dim, config->num_elements);
+    shared->merged_len = num_blocks * config->block_dim * config->block_dim * 2 * config->num_frequencies;
+    for (int m = 0; m < config->num_stages; m++){
+        shared->merged_output[m] = (int *)malloc(shared->merged_len*sizeof(int));
+        if (shared->merged_output[m] == NULL){
+            printf("failed to allocate memory\n");
+            free_shared(shared);
+            return (-1);
+        }
+    }
+
+    //with a stream, every buffer can be in flight at once; a fixed frame is posted a pipeline ahead
+    shared->num_slots = (config->stream != NULL) ? config->stream->num_buffers : config->num_stages;
+    shared->posted_frame = (int64_t *)calloc(shared->num_slots, sizeof(int64_t));
+    shared->posted_buffer = (int *)calloc(shared->num_slots, sizeof(int));
+    shared->posted_time = (double *)calloc(shared->num_slots, sizeof(double));
+    shared->posted_taken = (int *)calloc(shared->num_slots, sizeof(int));
+    if (shared->posted_frame == NULL || shared->posted_buffer == NULL || shared->posted_time == NULL || shared->posted_taken == NULL){
+        printf("failed to allocate memory\n");
+        free_shared(shared);
+        return (-1);
+    }
+    if (config->stream != NULL){
+        shared->uploads_left = (int *)calloc(config->stream->num_buffers, sizeof(int));
+        shared->upload_refs = (upload_ref *)malloc(config->stream->num_buffers*sizeof(upload_ref));
+        if (shared->uploads_left == NULL || shared->upload_refs == NULL){
+            printf("failed to allocate memory\n");
+            free_shared(shared);
+            return (-1);
+        }
+        for (int b = 0; b < config->stream->num_buffers; b++){
+            shared->upload_refs[b].shared = shared;
+            shared->upload_refs[b].index = b;
+        }
+        if (input_stream_start(config->stream)){
+            free_shared(shared);
+            return (-1);
+        }
+    }
+
+    double start_time = e_time();
+    for (int d = 0; d < shared->num_devices; d++){
+        if (pthread_create(&shared->devices[d].thread, NULL, device_thread, &shared->devices[d]) != 0){
+            printf("Error creating the thread for device %d\n", d);
+            exit(-1); //the others are already waiting on the board
+        }
+    }
+
+    for (int64_t i = 0; i < config->iterations; i++){
+        int slot = i % shared->num_slots;
+        pthread_mutex_lock(&shared->lock);
+        while (i >= shared->num_slots && shared->posted_taken[slot] < shared->num_devices)
+            pthread_cond_wait(&shared->changed, &shared->lock);
+        pthread_mutex_unlock(&shared->lock);
+
+        int64_t frame = i;
+        int buffer = -1;
+        if (config->stream != NULL){
+            buffer = input_stream_acquire(config->stream, &frame);
+            if (buffer < 0){
+                printf("Input stream ended after %lld frames\n", (long long int)i);
+                break;
+            }
+        }
+        pthread_mutex_lock(&shared->lock);
+        shared->posted_frame[slot] = frame;
+        shared->posted_buffer[slot] = buffer;
+        shared->posted_time[slot] = e_time();
+        shared->posted_taken[slot] = 0;
+        if (buffer >= 0)
+            shared->uploads_left[buffer] = shared->num_devices;
+        shared->num_posted = i + 1;
+        pthread_cond_broadcast(&shared->changed);
+        pthread_mutex_unlock(&shared->lock);
+    }
+    pthread_mutex_lock(&shared->lock);
+    shared->end = shared->num_posted;
+    pthread_cond_broadcast(&shared->changed);
+    pthread_mutex_unlock(&shared->lock);
+
+    for (int d = 0; d < shared->num_devices; d++)
+        pthread_join(shared->devices[d].thread, NULL);
+    *run_time = e_time() - start_time;
+    *num_integrations = shared->num_merged;
+    if (config->stream != NULL)
+        input_stream_stop(config->stream);
+
+    for (int d = 0; d < shared->num_devices && !config->quiet; d++){
+        device_context *dev = &shared->devices[d];
+        printf("  %-40s %lld integrations, %.1f kHz of band\n", dev->name, (long long int)dev->num_integrations,
+               (double)config->num_timesteps*dev->num_frequencies*dev->num_integrations / *run_time / 1e3);
+    }
+
+    free_shared(shared);
+    return 0;
+}
@@ -0,0 +1,49 @@
+// multi_device.h
+// runs the correlator on several OpenCL devices at once, each taking a contiguous share of the frequency channels. Every
+// device has its own context, queues, buffers and host thread; they all upload their channels straight out of the same
+// input frames (one shared input stream ring, or a fixed frame), and their outputs are merged back into the single device
+// layout, in frequency order, before being handed to the consumer.
+#ifndef MULTI_DEVICE_H
+#define MULTI_DEVICE_H
+
+#include <CL/cl.h>
+#include <stdint.h>
+#include "input_stream.h"
+
+#define MULTI_DEVICE_MAX_DEVICES        32
+#define MULTI_DEVICE_MAX_STAGES         8
+
+//called once per merged integration (the same signature as the single device consumers). output is only valid during the call
+typedef void (*multi_device_consumer)(void *context, int64_t integration, int64_t frame, double latency, int *output, int len);
+
+typedef struct {
+    cl_device_type device_type; //CL_DEVICE_TYPE_ALL for every device
+    int max_devices; //0 uses every device found
+    int first_device; //devices found before this one are skipped (so max_devices 1 picks a single device, as -d does)
+    int cpu_sub_device_units; //> 0 splits CPU devices into sub-devices of this many compute units each
+    int num_elements;
+    int num_frequencies;
+    int num_timesteps;
+    int time_accum;
+    int base_accum;
+    size_t accum_local_size; //offsetAccumulateElements work-group; 0 takes it from each device's profile
+    int accum_partials; //offsetAccumulateElements partial sums; 0 picks them from each device's profile
+    int num_stages; //pipeline depth on each device
+    int64_t iterations;
+    cl_uint num_sources; //kernel sources, as for the single device build
+    const char **sources;
+    const size_t *source_sizes;
+    const char *kernel_cache_dir;
+    input_stream *stream; //NULL: every iteration uploads fixed_input
+    unsigned char *fixed_input;
+    multi_device_consumer consumer;
+    void *consumer_context;
+    int block_dim; //output tile edge the kernels are built for (16, 32 or 64)
+    int fused_kernel; //the sources hold the fused correlator (-u): no offsetAccumulateElements or preseed, the output is zeroed instead
+    int quiet; //no per-device reports (for callers making many short runs)
+} multi_device_config;
+
+//returns 0, with the number of integrations completed and the run time (from the first upload to the last merge), or -1
+int multi_device_run(const multi_device_config *config, int64_t *num_integrations, double *run_time);
+
+#endif
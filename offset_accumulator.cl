@@ -2,48 +2,107 @@
 //#define ACTUAL_NUM_ELEMENTS         16u
 //#define ACTUAL_NUM_FREQUENCIES      256u
 #define NUM_TIMESTEPS_LOCAL         BASE_ACCUM
-#define OFFSET_FOR_1_TIMESTEP       (NUM_ELEMENTS*NUM_FREQUENCIES/4u) //divide by 4 to account for the 4 B per uint
+#define OFFSET_FOR_1_TIMESTEP       (NUM_ELEMENTS*NUM_FREQUENCIES) //in bytes, since a timestep needn't start on a 4 B boundary
+#define NUM_CHUNKS                  (NUM_TIMESAMPLES/BASE_ACCUM) //any timesteps after the last full chunk are left out
+#define PARTIAL_SIZE                (NUM_ELEMENTS*NUM_FREQUENCIES*2u) //uints in one set of partial sums
+
+//The sums are made in two phases, without atomics. offsetAccumulateElements splits the chunks of BASE_ACCUM timesteps
+//between the work items along dimension 2 (its global size is the number of partials). A chunk is summed in the 16 bit
+//halves of a word (15 x BASE_ACCUM has to fit). Each chunk's sums are then added to 32 bit sums kept in registers. A work
+//item stores its sums in partial get_global_id(2) of outputData. With more than one partial, combineOffsetPartials adds
+//the rest into the first, which is what preseed reads. The integer sums wrap the same way in any order, so the result is
+//the same as before
+
+//NUM_ELEMENTS x NUM_FREQUENCIES needn't be a multiple of 4: the last work item then sums a partial word, and only writes
+//out the elements that exist. Otherwise none of this is compiled in
+#if ((NUM_ELEMENTS*NUM_FREQUENCIES)%4u) == 0u
+#define LOAD_4_ACCUM_ELEMENTS(addr, element)        inputData[(addr)>>2u]
+#define ACCUM_ELEMENT_IN_RANGE(element)             1
+#else
+#define LOAD_4_ACCUM_ELEMENTS(addr, element)        load_4_accum_elements(inputData, (addr), (element))
+#define ACCUM_ELEMENT_IN_RANGE(element)             ((element) < NUM_ELEMENTS*NUM_FREQUENCIES)
+
+uint load_4_accum_elements(__global const uint *inputData, uint addr, uint element){
+    if (element + 4u <= NUM_ELEMENTS*NUM_FREQUENCIES)
+        return as_uint(vload4(0u, (__global const uchar *)inputData + addr));
+    uint word = 0u;
+    for (uint k = 0u; element + k < NUM_ELEMENTS*NUM_FREQUENCIES; k++)
+        word |= (uint)((__global const uchar *)inputData)[addr + k] << (8u*k);
+    return word;
+}
+#endif
 
 __kernel void offsetAccumulateElements (__global const uint *inputData,
                                         __global uint *outputData){
     uint    data;
-    uint4   dataExpanded = (uint4)(0u,0u,0u,0u);
+    uint4   dataExpanded;
     uint4   temp;
+    uint4   sumReal = (uint4)(0u,0u,0u,0u);
+    uint4   sumImag = (uint4)(0u,0u,0u,0u);
     //we load 4 Byte words, addresses are based on that size
-    uint    address = get_local_id(0) + //0-63
-                      get_group_id(1)*64u;//   the 64 comes from the fact we're using 4 B words... that is we're mutiplying by 256 B / 4 B
+    uint    element = (get_global_id(0) + //0-63 (global rather than local, so the work-group can be any divisor of 64)
+                       get_group_id(1)*64u)*4u;//   the 64 comes from the fact we're using 4 B words... that is we're mutiplying by 256 B / 4 B
+                                               //   and each word holds 4 elements
+    const uint partial = get_global_id(2);
+    const uint num_partials = get_global_size(2);
 
     //only compute values if the output address is going to be valid
-    //address * 8 accounts for the 8 values (4 pairs of complex numbers) accessed by loading 4 B of packed data
-    if (address * 8u + 7u < NUM_ELEMENTS*NUM_FREQUENCIES*2u){ //check to see if the output address falls in a useful range (i.e. < Num_Elements x Num_Freq)
-        address += get_group_id(2)*NUM_TIMESTEPS_LOCAL*OFFSET_FOR_1_TIMESTEP;
+    if (element < NUM_ELEMENTS*NUM_FREQUENCIES){ //check to see if the output address falls in a useful range (i.e. < Num_Elements x Num_Freq)
+        const uint chunk_end = ((partial+1u)*NUM_CHUNKS)/num_partials;
+        for (uint chunk = (partial*NUM_CHUNKS)/num_partials; chunk < chunk_end; chunk++){
+            uint address = element + chunk*NUM_TIMESTEPS_LOCAL*OFFSET_FOR_1_TIMESTEP;
+            dataExpanded = (uint4)(0u,0u,0u,0u);
+
+            for (int i = 0; i < NUM_TIMESTEPS_LOCAL; i++){
+                data = LOAD_4_ACCUM_ELEMENTS(address, element); //should be a coalesced load with local work group
 
-        for (int i = 0; i < NUM_TIMESTEPS_LOCAL; i++){
-            data = inputData[address]; //should be a coalesced load with local work group
+                //unpack
+                temp.s0 = ((data & 0x000000f0) << 12u) | ((data & 0x0000000f) >>   0u);
+                temp.s1 = ((data & 0x0000f000) <<  4u) | ((data & 0x00000f00) >>   8u);
+                temp.s2 = ((data & 0x00f00000) >>  4u) | ((data & 0x000f0000) >>  16u);
+                temp.s3 = ((data & 0xf0000000) >> 12u) | ((data & 0x0f000000) >>  24u);
 
-            //unpack
-            temp.s0 = ((data & 0x000000f0) << 12u) | ((data & 0x0000000f) >>   0u);
-            temp.s1 = ((data & 0x0000f000) <<  4u) | ((data & 0x00000f00) >>   8u);
-            temp.s2 = ((data & 0x00f00000) >>  4u) | ((data & 0x000f0000) >>  16u);
-            temp.s3 = ((data & 0xf0000000) >> 12u) | ((data & 0x0f000000) >>  24u);
+                //accumulate
+                dataExpanded += temp;
 
-            //accumulate
-            dataExpanded += temp;
+                //update address for next iteration
+                address += OFFSET_FOR_1_TIMESTEP;
+            }
 
-            //update address for next iteration
-            address += OFFSET_FOR_1_TIMESTEP;
+            //widen the chunk's sums before the 16 bit halves can overflow
+            sumReal += dataExpanded >> 16u;
+            sumImag += dataExpanded & 0x0000ffffu;
         }
 
         //output reduced data set, expanding one more time (store as uint to avoid a cast to int)--recasting will be done when expanding the smaller N*M*2 matrix to N(N+1)/2*M*2
-        //8 output values
-        address = (get_local_id(0) + get_group_id(1)*64u)*8u; //([0,504] + [0,M*N/256)*512)
-        atomic_add(&outputData[address+0u], (dataExpanded.s0>>16) );         //real value
-        atomic_add(&outputData[address+1u], (dataExpanded.s0&0x0000ffff) );  //imaginary
-        atomic_add(&outputData[address+2u], (dataExpanded.s1>>16) );         //real value
-        atomic_add(&outputData[address+3u], (dataExpanded.s1&0x0000ffff) );  //imaginary
-        atomic_add(&outputData[address+4u], (dataExpanded.s2>>16) );         //real value
-        atomic_add(&outputData[address+5u], (dataExpanded.s2&0x0000ffff) );  //imaginary
-        atomic_add(&outputData[address+6u], (dataExpanded.s3>>16) );         //real value
-        atomic_add(&outputData[address+7u], (dataExpanded.s3&0x0000ffff) );  //imaginary
+        //8 output values, real then imaginary for each element: plain stores, as nothing else writes this partial
+        __global uint *output = outputData + partial*PARTIAL_SIZE + element*2u;
+        if (ACCUM_ELEMENT_IN_RANGE(element+3u)){
+            vstore8((uint8)(sumReal.s0, sumImag.s0, sumReal.s1, sumImag.s1, sumReal.s2, sumImag.s2, sumReal.s3, sumImag.s3), 0u, output);
+        }
+        else{
+            output[0u] = sumReal.s0;
+            output[1u] = sumImag.s0;
+            if (ACCUM_ELEMENT_IN_RANGE(element+1u)){
+                output[2u] = sumReal.s1;
+                output[3u] = sumImag.s1;
+            }
+            if (ACCUM_ELEMENT_IN_RANGE(element+2u)){
+                output[4u] = sumReal.s2;
+                output[5u] = sumImag.s2;
+            }
+        }
+    }
+}
+
+//adds partials 1 to num_partials-1 of offsetAccumulateElements into partial 0; one work item per sum, so the reads coalesce
+__kernel void combineOffsetPartials (__global uint *outputData,
+                                     const uint num_partials){
+    const uint value_id = get_global_id(0);
+    if (value_id < PARTIAL_SIZE){
+        uint sum = outputData[value_id];
+        for (uint p = 1u; p < num_partials; p++)
+            sum += outputData[p*PARTIAL_SIZE + value_id];
+        outputData[value_id] = sum;
     }
 }
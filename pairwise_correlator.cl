@@ -3,21 +3,68 @@
 //#define NUM_FREQUENCIES                             128u
 //#define NUM_BLOCKS                                  1u  // N(N+1)/2 where N=(NUM_ELEMENTS/32)
 #define N_TIME_CHUNKS_LOCAL                         NUM_TIME_ACCUM //256u
-#define NUM_ELEMENTS_div_4                          (NUM_ELEMENTS/4u)  // N/4
-#define _INTLENGTH_x_NUM_ELEMENTS_div_4_x_NUM_FREQUENCIES (N_TIME_CHUNKS_LOCAL*NUM_ELEMENTS_div_4*NUM_FREQUENCIES)
-#define NUM_ELEMENTS_div_4_x_NUM_FREQUENCIES        (NUM_ELEMENTS_div_4*NUM_FREQUENCIES)
-#define NUM_BLOCKS_x_2048                           (NUM_BLOCKS*2048u) //each block size is 32 x 32 x 2 = 2048
+#define _INTLENGTH_x_NUM_ELEMENTS_x_NUM_FREQUENCIES (N_TIME_CHUNKS_LOCAL*NUM_ELEMENTS*NUM_FREQUENCIES)
+#define NUM_ELEMENTS_x_NUM_FREQUENCIES              (NUM_ELEMENTS*NUM_FREQUENCIES)
+#define BLOCK_SIZE                                  (BLOCK_DIM*BLOCK_DIM*2u) //ints in an output block (BLOCK_DIM x BLOCK_DIM complex values)
+#define NUM_BLOCKS_x_BLOCK_SIZE                     (NUM_BLOCKS*BLOCK_SIZE)
+#define OUTPUT_ROW                                  (BLOCK_DIM*2u) //ints in a row of an output block
 
-#define LOCAL_SIZE                                  8u
-#define BLOCK_DIM_div_4                             8u
+#define LOCAL_SIZE                                  (BLOCK_DIM/4u) //BLOCK_DIM (the tile edge: 16, 32 or 64) defined at compile time; a work item does 4 x 4 of the tile
+#define BLOCK_DIM_div_4                             (BLOCK_DIM/4u)
 
 
 #define FREQUENCY_BAND                              (get_group_id(1))
+//-D DIAGONAL_BLOCKS builds corr for the diagonal blocks alone, in a launch of their own over NUM_BLOCKS_1D blocks per
+//time chunk; the build for the rest of the blocks (-D OFF_DIAGONAL_BLOCKS) skips them
+#define NUM_BLOCKS_1D                               ((NUM_ELEMENTS + BLOCK_DIM - 1u)/BLOCK_DIM)
+#ifdef DIAGONAL_BLOCKS
+#define TIME_STEP_DIV_INTLENGTH                     (get_global_id(2)/NUM_BLOCKS_1D)
+#define DIAGONAL_INDEX                              (get_global_id(2)%NUM_BLOCKS_1D)
+#define BLOCK_ID_CORR                               (DIAGONAL_INDEX*(2u*NUM_BLOCKS_1D + 1u - DIAGONAL_INDEX)/2u) //blocks are numbered along the rows of the upper triangle
+#else
 #define TIME_STEP_DIV_INTLENGTH                     (get_global_id(2)/NUM_BLOCKS)
 #define BLOCK_ID_CORR                               (get_global_id(2)%NUM_BLOCKS)
+#endif
 #define LOCAL_X                                     (get_local_id(0))
 #define LOCAL_Y                                     (get_local_id(1))
 
+//on a diagonal block (block_x == block_y) the 4 x 4 patches below the diagonal are never read, as the output is the upper
+//triangle. There the LOCAL_SIZE*(LOCAL_SIZE+1)/2 patches on or above the diagonal are handed to the lowest linear ids, and the
+//rest of the work items only help load the block, so whole wavefronts of them sit out the multiply-adds. Patch rows p and
+//LOCAL_SIZE-1-p together hold LOCAL_SIZE+1 patches, so the hand-out folds those pairs of rows into rows of LOCAL_SIZE+1
+#define NUM_UPPER_PATCHES                           (LOCAL_SIZE*(LOCAL_SIZE+1u)/2u)
+//with only those patches to correlate, the DIAGONAL_BLOCKS build (which has its own registers) loads TIME_UNROLL x
+//LOCAL_SIZE timesteps per pass instead of LOCAL_SIZE, so it runs twice as many multiply-adds between barriers
+#if defined(DIAGONAL_BLOCKS) && (N_TIME_CHUNKS_LOCAL%(2u*LOCAL_SIZE)) == 0u
+#define TIME_UNROLL                                 2u
+#else
+#define TIME_UNROLL                                 1u
+#endif
+
+
+//NUM_ELEMENTS needn't be a multiple of BLOCK_DIM: addresses into packed are in bytes (i.e. elements), and the blocks of the last
+//block column and row are edge tiles. There, elements past NUM_ELEMENTS load as 0x88 (0 + 0i, without touching memory)
+//and groups of 4 entirely past it aren't written out. With a multiple of BLOCK_DIM none of this is compiled in
+#if (NUM_ELEMENTS%BLOCK_DIM) == 0u
+#define LOAD_4_ELEMENTS(addr, element)              packed[(addr)>>2u]
+#define GROUP_IN_RANGE(element_x, element_y)        1
+#else
+#define LOAD_4_ELEMENTS(addr, element)              load_4_elements(packed, (addr), (element))
+#define GROUP_IN_RANGE(element_x, element_y)        ((element_x) < NUM_ELEMENTS && (element_y) < NUM_ELEMENTS)
+
+uint load_4_elements(__global const uint *packed, uint addr, uint element){
+    if (element + 4u <= NUM_ELEMENTS)
+#if (NUM_ELEMENTS%4u) == 0u
+        return packed[addr>>2u];
+#else
+        return as_uint(vload4(0u, (__global const uchar *)packed + addr)); //rows don't start on 4 B boundaries
+#endif
+    uint word = 0x88888888u;
+    for (uint k = 0u; element + k < NUM_ELEMENTS; k++)
+        word = (word & ~(0xffu << (8u*k))) | ((uint)((__global const uchar *)packed)[addr + k] << (8u*k));
+    return word;
+}
+#endif
 
 __kernel __attribute__((reqd_work_group_size(LOCAL_SIZE, LOCAL_SIZE, 1)))
 void corr ( __global const uint *packed,
@@ -26,20 +73,41 @@ void corr ( __global const uint *packed,
             __constant uint *id_y_map,
             __global int *block_lock)
 {
-    __local uint stillPackedY[256];
-    __local uint stillPackedX[256];
+    __local uint stillPackedY[TIME_UNROLL*LOCAL_SIZE*BLOCK_DIM];
+    __local uint stillPackedX[TIME_UNROLL*LOCAL_SIZE*BLOCK_DIM];
     const uint block_x = id_x_map[BLOCK_ID_CORR]; //column of output block
     const uint block_y = id_y_map[BLOCK_ID_CORR]; //row of output block  //if NUM_BLOCKS = 1, then BLOCK_ID = 0 then block_x = block_y = 0
+#ifdef OFF_DIAGONAL_BLOCKS
+    if (block_x == block_y) //done by the DIAGONAL_BLOCKS build
+        return;
+#endif
+    //the 4 x 4 patch of the block this work item correlates: its own, except on diagonal blocks (see NUM_UPPER_PATCHES)
+    uint patch_x = LOCAL_X;
+    uint patch_y = LOCAL_Y;
+    uint patch_active = 1u;
+    if (block_x == block_y){
+        const uint linear_id = LOCAL_Y*LOCAL_SIZE + LOCAL_X;
+        const uint fold_row = linear_id/(LOCAL_SIZE+1u);
+        const uint fold_col = linear_id%(LOCAL_SIZE+1u);
+        patch_y = (fold_col < LOCAL_SIZE - fold_row) ? fold_row : LOCAL_SIZE-1u - fold_row;
+        patch_x = (fold_col < LOCAL_SIZE - fold_row) ? fold_row + fold_col : fold_col - 1u;
+        patch_active = (linear_id < NUM_UPPER_PATCHES);
+    }
+    //nor is anything of a patch that starts past the last element (in an edge tile), so it isn't computed either
+    if (!GROUP_IN_RANGE(4u*(BLOCK_DIM_div_4*block_x + patch_x), 4u*(BLOCK_DIM_div_4*block_y + patch_y)))
+        patch_active = 0u;
 
     /// The address for the x elements for the data
-    uint addr_x = (   LOCAL_Y*NUM_ELEMENTS_div_4_x_NUM_FREQUENCIES
-                    + TIME_STEP_DIV_INTLENGTH * _INTLENGTH_x_NUM_ELEMENTS_div_4_x_NUM_FREQUENCIES
-                    + FREQUENCY_BAND*NUM_ELEMENTS_div_4); //temporarily precompute an offset
+    uint addr_x = (   LOCAL_Y*NUM_ELEMENTS_x_NUM_FREQUENCIES
+                    + TIME_STEP_DIV_INTLENGTH * _INTLENGTH_x_NUM_ELEMENTS_x_NUM_FREQUENCIES
+                    + FREQUENCY_BAND*NUM_ELEMENTS); //temporarily precompute an offset
 
     /// The address for the y elements for the data
-    uint addr_y = ( (BLOCK_DIM_div_4*block_y + LOCAL_X) + addr_x);
+    const uint element_y = 4u*(BLOCK_DIM_div_4*block_y + LOCAL_X); //first of the 4 y (and x) elements this work item loads
+    const uint element_x = 4u*(BLOCK_DIM_div_4*block_x + LOCAL_X);
+    uint addr_y = element_y + addr_x;
 
-    addr_x += (BLOCK_DIM_div_4*block_x + LOCAL_X); //the x address
+    addr_x += element_x; //the x address
 
     uint corr_a0=0u;
     uint corr_b0=0u;
@@ -78,29 +146,35 @@ void corr ( __global const uint *packed,
     uint4 temp_stillPackedY;
     uint4 temp_stillPackedX;
     uint temp_pa;
+    uint pa;
 
-    for (uint i = 0; i < N_TIME_CHUNKS_LOCAL; i += LOCAL_SIZE){
-        uint pa=packed[i * NUM_ELEMENTS_div_4_x_NUM_FREQUENCIES + addr_y ];
-        uint la=(LOCAL_Y<<5| LOCAL_X<<2); //a short form for LOCAL_Y * 32 + LOCAL_X * 4 which may or may not be faster...
+    for (uint i = 0; i < N_TIME_CHUNKS_LOCAL; i += TIME_UNROLL*LOCAL_SIZE){
+        for (uint u = 0; u < TIME_UNROLL; u++){ //rows u*LOCAL_SIZE + LOCAL_Y of the pass
+            pa=LOAD_4_ELEMENTS((i + u*LOCAL_SIZE) * NUM_ELEMENTS_x_NUM_FREQUENCIES + addr_y, element_y);
+            uint la=((u*LOCAL_SIZE + LOCAL_Y)*BLOCK_DIM + (LOCAL_X<<2)); //BLOCK_DIM is a power of 2, so this is still a shift and an or
 
+            if (u == 0u) //the previous pass has been read in full before any of it is overwritten
+                barrier(CLK_LOCAL_MEM_FENCE);
+            stillPackedY[la]    = ((pa & 0x000000f0) << 12u) | ((pa & 0x0000000f) >>  0u);
+            stillPackedY[la+1u] = ((pa & 0x0000f000) <<  4u) | ((pa & 0x00000f00) >>  8u);
+            stillPackedY[la+2u] = ((pa & 0x00f00000) >>  4u) | ((pa & 0x000f0000) >> 16u);
+            stillPackedY[la+3u] = ((pa & 0xf0000000) >> 12u) | ((pa & 0x0f000000) >> 24u);
+            //barrier(CLK_LOCAL_MEM_FENCE);//is removing this a bad idea???  things should be in lock-step...
+
+            temp_pa=LOAD_4_ELEMENTS((i + u*LOCAL_SIZE) * NUM_ELEMENTS_x_NUM_FREQUENCIES + addr_x, element_x);
+
+            stillPackedX[la]    = ((temp_pa & 0x000000f0) << 12u) | ((temp_pa & 0x0000000f) >>  0u);
+            stillPackedX[la+1u] = ((temp_pa & 0x0000f000) <<  4u) | ((temp_pa & 0x00000f00) >>  8u);
+            stillPackedX[la+2u] = ((temp_pa & 0x00f00000) >>  4u) | ((temp_pa & 0x000f0000) >> 16u);
+            stillPackedX[la+3u] = ((temp_pa & 0xf0000000) >> 12u) | ((temp_pa & 0x0f000000) >> 24u);
+        }
         barrier(CLK_LOCAL_MEM_FENCE);
-        stillPackedY[la]    = ((pa & 0x000000f0) << 12u) | ((pa & 0x0000000f) >>  0u);
-        stillPackedY[la+1u] = ((pa & 0x0000f000) <<  4u) | ((pa & 0x00000f00) >>  8u);
-        stillPackedY[la+2u] = ((pa & 0x00f00000) >>  4u) | ((pa & 0x000f0000) >> 16u);
-        stillPackedY[la+3u] = ((pa & 0xf0000000) >> 12u) | ((pa & 0x0f000000) >> 24u);
-        //barrier(CLK_LOCAL_MEM_FENCE);//is removing this a bad idea???  things should be in lock-step...
-
-        temp_pa=packed[i * NUM_ELEMENTS_div_4_x_NUM_FREQUENCIES + addr_x ];
-
-        stillPackedX[la]    = ((temp_pa & 0x000000f0) << 12u) | ((temp_pa & 0x0000000f) >>  0u);
-        stillPackedX[la+1u] = ((temp_pa & 0x0000f000) <<  4u) | ((temp_pa & 0x00000f00) >>  8u);
-        stillPackedX[la+2u] = ((temp_pa & 0x00f00000) >>  4u) | ((temp_pa & 0x000f0000) >> 16u);
-        stillPackedX[la+3u] = ((temp_pa & 0xf0000000) >> 12u) | ((temp_pa & 0x0f000000) >> 24u);
-        barrier(CLK_LOCAL_MEM_FENCE);
+        if (!patch_active) //nothing of this patch is kept: the work item only helps load the block
+            continue;
 
-        for (uint j=0; j< LOCAL_SIZE; j++){
-            temp_stillPackedY = vload4(mad24(j, 8u, LOCAL_Y), stillPackedY);
-            temp_stillPackedX = vload4(mad24(j, 8u, LOCAL_X), stillPackedX);
+        for (uint j=0; j< TIME_UNROLL*LOCAL_SIZE; j++){
+            temp_stillPackedY = vload4(mad24(j, LOCAL_SIZE, patch_y), stillPackedY);
+            temp_stillPackedX = vload4(mad24(j, LOCAL_SIZE, patch_x), stillPackedX);
 
             pa = temp_stillPackedX.s0;
 
@@ -158,47 +232,49 @@ void corr ( __global const uint *packed,
     }
     //output: 32 numbers--> 16 pairs of real/imag numbers
     //16 pairs * 8 (local_size(0)) * 8 (local_size(1)) = 1024
-    uint addr_o = ((BLOCK_ID_CORR * 2048u) + (LOCAL_Y * 256u) + (LOCAL_X * 8u)) + (FREQUENCY_BAND * NUM_BLOCKS_x_2048);
+    uint addr_o = ((BLOCK_ID_CORR * BLOCK_SIZE) + (patch_y * 4u*OUTPUT_ROW) + (patch_x * 8u)) + (FREQUENCY_BAND * NUM_BLOCKS_x_BLOCK_SIZE);
 
     if (LOCAL_X == 0 && LOCAL_Y == 0){
         while(atomic_cmpxchg(&block_lock[FREQUENCY_BAND*NUM_BLOCKS + BLOCK_ID_CORR],0,1)); //wait until unlocked
     }
         barrier(CLK_GLOBAL_MEM_FENCE); //sync point for the group
-        corr_buf[addr_o+0u]+=   (corr_a0 >> 16u) + (corr_a1 & 0xffff) ; //real value
-        corr_buf[addr_o+1u]+=   (corr_a1 >> 16u) - (corr_a0 & 0xffff) ;
-        corr_buf[addr_o+2u]+=   (corr_a2 >> 16u) + (corr_a3 & 0xffff) ;
-        corr_buf[addr_o+3u]+=   (corr_a3 >> 16u) - (corr_a2 & 0xffff) ;
-        corr_buf[addr_o+4u]+=   (corr_e0 >> 16u) + (corr_e1 & 0xffff) ;
-        corr_buf[addr_o+5u]+=   (corr_e1 >> 16u) - (corr_e0 & 0xffff) ;
-        corr_buf[addr_o+6u]+=   (corr_e2 >> 16u) + (corr_e3 & 0xffff) ;
-        corr_buf[addr_o+7u]+=   (corr_e3 >> 16u) - (corr_e2 & 0xffff) ;
-
-        corr_buf[addr_o+64u]+=  (corr_b0 >> 16u) + (corr_b1 & 0xffff) ;
-        corr_buf[addr_o+65u]+=  (corr_b1 >> 16u) - (corr_b0 & 0xffff) ;
-        corr_buf[addr_o+66u]+=  (corr_b2 >> 16u) + (corr_b3 & 0xffff) ;
-        corr_buf[addr_o+67u]+=  (corr_b3 >> 16u) - (corr_b2 & 0xffff) ;
-        corr_buf[addr_o+68u]+=  (corr_f0 >> 16u) + (corr_f1 & 0xffff) ;
-        corr_buf[addr_o+69u]+=  (corr_f1 >> 16u) - (corr_f0 & 0xffff) ;
-        corr_buf[addr_o+70u]+=  (corr_f2 >> 16u) + (corr_f3 & 0xffff) ;
-        corr_buf[addr_o+71u]+=  (corr_f3 >> 16u) - (corr_f2 & 0xffff) ;
-
-        corr_buf[addr_o+128u]+= (corr_c0 >> 16u) + (corr_c1 & 0xffff) ;
-        corr_buf[addr_o+129u]+= (corr_c1 >> 16u) - (corr_c0 & 0xffff) ;
-        corr_buf[addr_o+130u]+= (corr_c2 >> 16u) + (corr_c3 & 0xffff) ;
-        corr_buf[addr_o+131u]+= (corr_c3 >> 16u) - (corr_c2 & 0xffff) ;
-        corr_buf[addr_o+132u]+= (corr_g0 >> 16u) + (corr_g1 & 0xffff) ;
-        corr_buf[addr_o+133u]+= (corr_g1 >> 16u) - (corr_g0 & 0xffff) ;
-        corr_buf[addr_o+134u]+= (corr_g2 >> 16u) + (corr_g3 & 0xffff) ;
-        corr_buf[addr_o+135u]+= (corr_g3 >> 16u) - (corr_g2 & 0xffff) ;
-
-        corr_buf[addr_o+192u]+= (corr_d0 >> 16u) + (corr_d1 & 0xffff) ;
-        corr_buf[addr_o+193u]+= (corr_d1 >> 16u) - (corr_d0 & 0xffff) ;
-        corr_buf[addr_o+194u]+= (corr_d2 >> 16u) + (corr_d3 & 0xffff) ;
-        corr_buf[addr_o+195u]+= (corr_d3 >> 16u) - (corr_d2 & 0xffff) ;
-        corr_buf[addr_o+196u]+= (corr_h0 >> 16u) + (corr_h1 & 0xffff) ;
-        corr_buf[addr_o+197u]+= (corr_h1 >> 16u) - (corr_h0 & 0xffff) ;
-        corr_buf[addr_o+198u]+= (corr_h2 >> 16u) + (corr_h3 & 0xffff) ;
-        corr_buf[addr_o+199u]+= (corr_h3 >> 16u) - (corr_h2 & 0xffff) ;
+        if (patch_active){
+            corr_buf[addr_o+0u]+=   (corr_a0 >> 16u) + (corr_a1 & 0xffff) ; //real value
+            corr_buf[addr_o+1u]+=   (corr_a1 >> 16u) - (corr_a0 & 0xffff) ;
+            corr_buf[addr_o+2u]+=   (corr_a2 >> 16u) + (corr_a3 & 0xffff) ;
+            corr_buf[addr_o+3u]+=   (corr_a3 >> 16u) - (corr_a2 & 0xffff) ;
+            corr_buf[addr_o+4u]+=   (corr_e0 >> 16u) + (corr_e1 & 0xffff) ;
+            corr_buf[addr_o+5u]+=   (corr_e1 >> 16u) - (corr_e0 & 0xffff) ;
+            corr_buf[addr_o+6u]+=   (corr_e2 >> 16u) + (corr_e3 & 0xffff) ;
+            corr_buf[addr_o+7u]+=   (corr_e3 >> 16u) - (corr_e2 & 0xffff) ;
+
+            corr_buf[addr_o+OUTPUT_ROW+0u]+=  (corr_b0 >> 16u) + (corr_b1 & 0xffff) ;
+            corr_buf[addr_o+OUTPUT_ROW+1u]+=  (corr_b1 >> 16u) - (corr_b0 & 0xffff) ;
+            corr_buf[addr_o+OUTPUT_ROW+2u]+=  (corr_b2 >> 16u) + (corr_b3 & 0xffff) ;
+            corr_buf[addr_o+OUTPUT_ROW+3u]+=  (corr_b3 >> 16u) - (corr_b2 & 0xffff) ;
+            corr_buf[addr_o+OUTPUT_ROW+4u]+=  (corr_f0 >> 16u) + (corr_f1 & 0xffff) ;
+            corr_buf[addr_o+OUTPUT_ROW+5u]+=  (corr_f1 >> 16u) - (corr_f0 & 0xffff) ;
+            corr_buf[addr_o+OUTPUT_ROW+6u]+=  (corr_f2 >> 16u) + (corr_f3 & 0xffff) ;
+            corr_buf[addr_o+OUTPUT_ROW+7u]+=  (corr_f3 >> 16u) - (corr_f2 & 0xffff) ;
+
+            corr_buf[addr_o+2u*OUTPUT_ROW+0u]+= (corr_c0 >> 16u) + (corr_c1 & 0xffff) ;
+            corr_buf[addr_o+2u*OUTPUT_ROW+1u]+= (corr_c1 >> 16u) - (corr_c0 & 0xffff) ;
+            corr_buf[addr_o+2u*OUTPUT_ROW+2u]+= (corr_c2 >> 16u) + (corr_c3 & 0xffff) ;
+            corr_buf[addr_o+2u*OUTPUT_ROW+3u]+= (corr_c3 >> 16u) - (corr_c2 & 0xffff) ;
+            corr_buf[addr_o+2u*OUTPUT_ROW+4u]+= (corr_g0 >> 16u) + (corr_g1 & 0xffff) ;
+            corr_buf[addr_o+2u*OUTPUT_ROW+5u]+= (corr_g1 >> 16u) - (corr_g0 & 0xffff) ;
+            corr_buf[addr_o+2u*OUTPUT_ROW+6u]+= (corr_g2 >> 16u) + (corr_g3 & 0xffff) ;
+            corr_buf[addr_o+2u*OUTPUT_ROW+7u]+= (corr_g3 >> 16u) - (corr_g2 & 0xffff) ;
+
+            corr_buf[addr_o+3u*OUTPUT_ROW+0u]+= (corr_d0 >> 16u) + (corr_d1 & 0xffff) ;
+            corr_buf[addr_o+3u*OUTPUT_ROW+1u]+= (corr_d1 >> 16u) - (corr_d0 & 0xffff) ;
+            corr_buf[addr_o+3u*OUTPUT_ROW+2u]+= (corr_d2 >> 16u) + (corr_d3 & 0xffff) ;
+            corr_buf[addr_o+3u*OUTPUT_ROW+3u]+= (corr_d3 >> 16u) - (corr_d2 & 0xffff) ;
+            corr_buf[addr_o+3u*OUTPUT_ROW+4u]+= (corr_h0 >> 16u) + (corr_h1 & 0xffff) ;
+            corr_buf[addr_o+3u*OUTPUT_ROW+5u]+= (corr_h1 >> 16u) - (corr_h0 & 0xffff) ;
+            corr_buf[addr_o+3u*OUTPUT_ROW+6u]+= (corr_h2 >> 16u) + (corr_h3 & 0xffff) ;
+            corr_buf[addr_o+3u*OUTPUT_ROW+7u]+= (corr_h3 >> 16u) - (corr_h2 & 0xffff) ;
+        }
         barrier(CLK_GLOBAL_MEM_FENCE); //make sure everyone is done
 
     if (LOCAL_X == 0 && LOCAL_Y == 0)
@@ -5,16 +5,27 @@
 
 
 #define NUM_TIMESAMPLES_x_128           (NUM_TIMESAMPLES*128u)// need the total number of iterations for the offset outputs: this 128 is from the offset calcs--not part of the smallest accum period
-#define NUM_BLOCKS_x_2048               (NUM_BLOCKS*2048u) //each block size is 32 x 32 x 2 = 2048
+#define BLOCK_SIZE                      (BLOCK_DIM*BLOCK_DIM*2u) //ints in an output block (BLOCK_DIM x BLOCK_DIM complex values)
+#define NUM_BLOCKS_x_BLOCK_SIZE         (NUM_BLOCKS*BLOCK_SIZE)
+#define OUTPUT_ROW                      (BLOCK_DIM*2u) //ints in a row of an output block
 
-#define LOCAL_SIZE                      8u
-#define BLOCK_DIM                       32u
+#define LOCAL_SIZE                      (BLOCK_DIM/4u) //BLOCK_DIM (the tile edge: 16, 32 or 64) defined at compile time; a work item does 4 x 4 of the tile
 
 #define FREQUENCY_BAND                  (get_group_id(1))
 #define BLOCK_ID                        (get_group_id(2))
 #define LOCAL_X                         (get_local_id(0))
 #define LOCAL_Y                         (get_local_id(1))
 
+//NUM_ELEMENTS needn't be a multiple of BLOCK_DIM: the blocks of the last block column and row are then edge tiles, which only load
+//the sums of elements that exist, and don't write out groups of 4 entirely past NUM_ELEMENTS
+#if (NUM_ELEMENTS%BLOCK_DIM) == 0u
+#define PRESEED_SUM_IN_RANGE(block, index)          1
+#define PRESEED_GROUP_IN_RANGE                      1
+#else
+#define PRESEED_SUM_IN_RANGE(block, index)          (BLOCK_DIM*2u*(block) + (index) < NUM_ELEMENTS*2u)
+#define PRESEED_GROUP_IN_RANGE                      (BLOCK_DIM*block_x + 4u*LOCAL_X < NUM_ELEMENTS && BLOCK_DIM*block_y + 4u*LOCAL_Y < NUM_ELEMENTS)
+#endif
+
 
 __kernel __attribute__((reqd_work_group_size(LOCAL_SIZE, LOCAL_SIZE, 1)))
 void preseed( __global const uint *dataIn,
@@ -27,7 +38,7 @@ void preseed( __global const uint *dataIn,
     uint block_x = id_x_map[BLOCK_ID]; //column of output block
     uint block_y = id_y_map[BLOCK_ID]; //row of output block  //if NUM_BLOCKS = 1, then BLOCK_ID = 0 then block_x = block_y = 0
 
-    uint local_index = LOCAL_X + LOCAL_Y*LOCAL_SIZE; //0-63
+    uint local_index = LOCAL_X + LOCAL_Y*LOCAL_SIZE; //0 to LOCAL_SIZE^2 - 1
 
     uint base_addr_x = ( (BLOCK_DIM*block_x)
                     + FREQUENCY_BAND*NUM_ELEMENTS)*2u; //times 2 because there are pairs of numbers for the complex values
@@ -41,10 +52,15 @@ void preseed( __global const uint *dataIn,
 
     //synchronize then load
     barrier(CLK_LOCAL_MEM_FENCE);
-    //want to load 32 complex values (i.e. 64 values)
-    localDataX[local_index] = dataIn[base_addr_x+local_index]; //local_index has 64 contiguous entries
-    localDataY[local_index] = dataIn[base_addr_y+local_index];
+    //want to load BLOCK_DIM complex values (i.e. 2 x BLOCK_DIM values): one pass for 32 x 32 tiles, two for 16 x 16, and
+    //half of the work items for 64 x 64
+    for (uint index = local_index; index < 2u*BLOCK_DIM; index += LOCAL_SIZE*LOCAL_SIZE){ //contiguous entries
+        localDataX[index] = PRESEED_SUM_IN_RANGE(block_x, index) ? dataIn[base_addr_x+index] : 0u;
+        localDataY[index] = PRESEED_SUM_IN_RANGE(block_y, index) ? dataIn[base_addr_y+index] : 0u;
+    }
     barrier(CLK_LOCAL_MEM_FENCE);
+    if (!PRESEED_GROUP_IN_RANGE)
+        return;
 
     //load relevant values for this work item
     xVals = vload8(LOCAL_X,localDataX); //offsets are in sizes of the vector, so 8 uints big
@@ -72,11 +88,11 @@ void preseed( __global const uint *dataIn,
     //output results
     //Each work item outputs 4 x 4 complex values (so 32 values rather than 16)
     //
-    //offset to the next row is 8 (local_x vals) x 8 vals = 64
-    //each y takes care of 4 values, so y * 4*64
+    //offset to the next row is OUTPUT_ROW: LOCAL_SIZE (local_x vals) x 8 vals (64 for 32 x 32 tiles)
+    //each y takes care of 4 values, so y * 4*OUTPUT_ROW
     //
     //16 pairs * 8 (local_size(0)) * 8 (local_size(1)) = 1024
-    uint addr_o = ((BLOCK_ID * 2048u) + (LOCAL_Y * 256u) + (LOCAL_X * 8u)) + (FREQUENCY_BAND * NUM_BLOCKS_x_2048);
+    uint addr_o = ((BLOCK_ID * BLOCK_SIZE) + (LOCAL_Y * 4u*OUTPUT_ROW) + (LOCAL_X * 8u)) + (FREQUENCY_BAND * NUM_BLOCKS_x_BLOCK_SIZE);
     //row 0
     corr_buf[addr_o+0u]   =   NUM_TIMESAMPLES_x_128 + xValOffsets[0] + yValOffsets[0]; //real value correction
     corr_buf[addr_o+1u]   =                           xValOffsets[1] + yValOffsets[1]; //imaginary value correction (the extra subtraction in the notes has been performed by swapping order above
@@ -87,34 +103,34 @@ void preseed( __global const uint *dataIn,
     corr_buf[addr_o+6u]   =   NUM_TIMESAMPLES_x_128 + xValOffsets[6] + yValOffsets[0];
     corr_buf[addr_o+7u]   =                           xValOffsets[7] + yValOffsets[1];
     //row 1
-    corr_buf[addr_o+64u]  =   NUM_TIMESAMPLES_x_128 + xValOffsets[0] + yValOffsets[2]; //real value correction
-    corr_buf[addr_o+65u]  =                           xValOffsets[1] + yValOffsets[3]; //imaginary value correction (the extra subtraction in the notes has been performed by swapping order above
-    corr_buf[addr_o+66u]  =   NUM_TIMESAMPLES_x_128 + xValOffsets[2] + yValOffsets[2]; //note that x changes, but y stays the same
-    corr_buf[addr_o+67u]  =                           xValOffsets[3] + yValOffsets[3];
-    corr_buf[addr_o+68u]  =   NUM_TIMESAMPLES_x_128 + xValOffsets[4] + yValOffsets[2];
-    corr_buf[addr_o+69u]  =                           xValOffsets[5] + yValOffsets[3];
-    corr_buf[addr_o+70u]  =   NUM_TIMESAMPLES_x_128 + xValOffsets[6] + yValOffsets[2];
-    corr_buf[addr_o+71u]  =                           xValOffsets[7] + yValOffsets[3];
+    corr_buf[addr_o+OUTPUT_ROW+0u]  =   NUM_TIMESAMPLES_x_128 + xValOffsets[0] + yValOffsets[2]; //real value correction
+    corr_buf[addr_o+OUTPUT_ROW+1u]  =                           xValOffsets[1] + yValOffsets[3]; //imaginary value correction (the extra subtraction in the notes has been performed by swapping order above
+    corr_buf[addr_o+OUTPUT_ROW+2u]  =   NUM_TIMESAMPLES_x_128 + xValOffsets[2] + yValOffsets[2]; //note that x changes, but y stays the same
+    corr_buf[addr_o+OUTPUT_ROW+3u]  =                           xValOffsets[3] + yValOffsets[3];
+    corr_buf[addr_o+OUTPUT_ROW+4u]  =   NUM_TIMESAMPLES_x_128 + xValOffsets[4] + yValOffsets[2];
+    corr_buf[addr_o+OUTPUT_ROW+5u]  =                           xValOffsets[5] + yValOffsets[3];
+    corr_buf[addr_o+OUTPUT_ROW+6u]  =   NUM_TIMESAMPLES_x_128 + xValOffsets[6] + yValOffsets[2];
+    corr_buf[addr_o+OUTPUT_ROW+7u]  =                           xValOffsets[7] + yValOffsets[3];
 
     //row 2
-    corr_buf[addr_o+128u] =   NUM_TIMESAMPLES_x_128 + xValOffsets[0] + yValOffsets[4]; //real value correction
-    corr_buf[addr_o+129u] =                           xValOffsets[1] + yValOffsets[5]; //imaginary value correction (the extra subtraction in the notes has been performed by swapping order above
-    corr_buf[addr_o+130u] =   NUM_TIMESAMPLES_x_128 + xValOffsets[2] + yValOffsets[4]; //note that x changes, but y stays the same
-    corr_buf[addr_o+131u] =                           xValOffsets[3] + yValOffsets[5];
-    corr_buf[addr_o+132u] =   NUM_TIMESAMPLES_x_128 + xValOffsets[4] + yValOffsets[4];
-    corr_buf[addr_o+133u] =                           xValOffsets[5] + yValOffsets[5];
-    corr_buf[addr_o+134u] =   NUM_TIMESAMPLES_x_128 + xValOffsets[6] + yValOffsets[4];
-    corr_buf[addr_o+135u] =                           xValOffsets[7] + yValOffsets[5];
+    corr_buf[addr_o+2u*OUTPUT_ROW+0u] =   NUM_TIMESAMPLES_x_128 + xValOffsets[0] + yValOffsets[4]; //real value correction
+    corr_buf[addr_o+2u*OUTPUT_ROW+1u] =                           xValOffsets[1] + yValOffsets[5]; //imaginary value correction (the extra subtraction in the notes has been performed by swapping order above
+    corr_buf[addr_o+2u*OUTPUT_ROW+2u] =   NUM_TIMESAMPLES_x_128 + xValOffsets[2] + yValOffsets[4]; //note that x changes, but y stays the same
+    corr_buf[addr_o+2u*OUTPUT_ROW+3u] =                           xValOffsets[3] + yValOffsets[5];
+    corr_buf[addr_o+2u*OUTPUT_ROW+4u] =   NUM_TIMESAMPLES_x_128 + xValOffsets[4] + yValOffsets[4];
+    corr_buf[addr_o+2u*OUTPUT_ROW+5u] =                           xValOffsets[5] + yValOffsets[5];
+    corr_buf[addr_o+2u*OUTPUT_ROW+6u] =   NUM_TIMESAMPLES_x_128 + xValOffsets[6] + yValOffsets[4];
+    corr_buf[addr_o+2u*OUTPUT_ROW+7u] =                           xValOffsets[7] + yValOffsets[5];
 
     //row 3
-    corr_buf[addr_o+192u] =   NUM_TIMESAMPLES_x_128 + xValOffsets[0] + yValOffsets[6]; //real value correction
-    corr_buf[addr_o+193u] =                           xValOffsets[1] + yValOffsets[7]; //imaginary value correction (the extra subtraction in the notes has been performed by swapping order above
-    corr_buf[addr_o+194u] =   NUM_TIMESAMPLES_x_128 + xValOffsets[2] + yValOffsets[6]; //note that x changes, but y stays the same
-    corr_buf[addr_o+195u] =                           xValOffsets[3] + yValOffsets[7];
-    corr_buf[addr_o+196u] =   NUM_TIMESAMPLES_x_128 + xValOffsets[4] + yValOffsets[6];
-    corr_buf[addr_o+197u] =                           xValOffsets[5] + yValOffsets[7];
-    corr_buf[addr_o+198u] =   NUM_TIMESAMPLES_x_128 + xValOffsets[6] + yValOffsets[6];
-    corr_buf[addr_o+199u] =                           xValOffsets[7] + yValOffsets[7];
+    corr_buf[addr_o+3u*OUTPUT_ROW+0u] =   NUM_TIMESAMPLES_x_128 + xValOffsets[0] + yValOffsets[6]; //real value correction
+    corr_buf[addr_o+3u*OUTPUT_ROW+1u] =                           xValOffsets[1] + yValOffsets[7]; //imaginary value correction (the extra subtraction in the notes has been performed by swapping order above
+    corr_buf[addr_o+3u*OUTPUT_ROW+2u] =   NUM_TIMESAMPLES_x_128 + xValOffsets[2] + yValOffsets[6]; //note that x changes, but y stays the same
+    corr_buf[addr_o+3u*OUTPUT_ROW+3u] =                           xValOffsets[3] + yValOffsets[7];
+    corr_buf[addr_o+3u*OUTPUT_ROW+4u] =   NUM_TIMESAMPLES_x_128 + xValOffsets[4] + yValOffsets[6];
+    corr_buf[addr_o+3u*OUTPUT_ROW+5u] =                           xValOffsets[5] + yValOffsets[7];
+    corr_buf[addr_o+3u*OUTPUT_ROW+6u] =   NUM_TIMESAMPLES_x_128 + xValOffsets[6] + yValOffsets[6];
+    corr_buf[addr_o+3u*OUTPUT_ROW+7u] =                           xValOffsets[7] + yValOffsets[7];
 
 //     //row 0
 //     corr_buf[addr_o+0u]=   NUM_TIMESAMPLES_x_128 - 8u*(xVals.s0 + yVals.s0 + yVals.s1)+7u*xVals.s1; //real value correction
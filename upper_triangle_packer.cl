@@ -0,0 +1,35 @@
+//upper_triangle_packer.cl
+//rewrites one frame's corr output (BLOCK_DIM x BLOCK_DIM blocks of complex values, with the lower half of the diagonal
+//blocks and the padding of edge tiles) as the packed upper triangle reorganize_GPU_to_upper_triangle makes on the host: for
+//each frequency, row y's values from x = y to NUM_ELEMENTS-1, one row after another, N(N+1)/2 complex values in all.
+//A work item moves one complex value, taken in block order, so the reads are coalesced and each block row is written
+//contiguously. Built on its own (and only with -O): NUM_ELEMENTS, NUM_BLOCKS and BLOCK_DIM defined at compile time, and
+//PACKED_FLOAT for float32 output
+#define NUM_BASELINES                               (NUM_ELEMENTS*(NUM_ELEMENTS+1u)/2u)
+#define BLOCK_SIZE                                  (BLOCK_DIM*BLOCK_DIM*2u) //ints in an output block
+
+#ifdef PACKED_FLOAT
+#define PACKED_TYPE                                 float2
+#define CONVERT_PACKED(value)                       convert_float2(value) //rounds to nearest, as a cast on the host does
+#else
+#define PACKED_TYPE                                 int2
+#define CONVERT_PACKED(value)                       (value)
+#endif
+
+__kernel void pack_upper_triangle (__global const int *blocks,
+                                   __constant uint *id_x_map,
+                                   __constant uint *id_y_map,
+                                   __global PACKED_TYPE *triangle){
+    const uint value_id = get_global_id(0); //value within the block, row by row
+    const uint block_id = get_global_id(1);
+    const uint frequency = get_global_id(2);
+    const uint x = id_x_map[block_id]*BLOCK_DIM + (value_id % BLOCK_DIM);
+    const uint y = id_y_map[block_id]*BLOCK_DIM + (value_id / BLOCK_DIM);
+
+    //below the diagonal, or past the last element in an edge tile (y <= x, so then y is in range too)
+    if (x < y || x >= NUM_ELEMENTS)
+        return;
+
+    const int2 value = vload2(0u, blocks + (frequency*NUM_BLOCKS + block_id)*BLOCK_SIZE + 2u*value_id);
+    triangle[frequency*NUM_BASELINES + y*NUM_ELEMENTS - (y*(y-1u))/2u + (x - y)] = CONVERT_PACKED(value);
+}